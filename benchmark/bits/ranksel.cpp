@@ -1,4 +1,5 @@
 #include "../../test/xoroshiro128pp.hpp"
+#include "../harness.hpp"
 #include <cassert>
 #include <chrono>
 #include <climits>
@@ -6,20 +7,37 @@
 #include <cstdio>
 #include <cstdlib>
 #include <sux/bits/EliasFano.hpp>
+#include <sux/bits/PartitionedEliasFano.hpp>
+#include <sux/bits/RRR.hpp>
+#include <sux/bits/Rank9Interleaved.hpp>
 #include <sux/bits/Rank9Sel.hpp>
 #include <sux/bits/SimpleSelect.hpp>
 #include <sux/bits/SimpleSelectHalf.hpp>
+#include <thread>
+#include <vector>
 
 using namespace std;
 
-#define REPEATS 10
-
 using namespace sux;
 using namespace sux::bits;
 
+// Runs f(t) in threads t = 0, 1, ..., threads - 1 and returns the xor of the results.
+template <typename F> static uint64_t run_threads(const int threads, F &&f) {
+	vector<thread> pool;
+	vector<uint64_t> result(threads);
+	for (int t = 0; t < threads; t++) pool.emplace_back([&, t] { result[t] = f(t); });
+	uint64_t u = 0;
+	for (int t = 0; t < threads; t++) {
+		pool[t].join();
+		u ^= result[t];
+	}
+	return u;
+}
+
 int main(int argc, char *argv[]) {
+	harness::Harness h("ranksel", argc, argv);
 	if (argc < 4) {
-		fprintf(stderr, "Usage: %s NUMBITS NUMPOS DENSITY0 [DENSITY1]\n", argv[0]);
+		fprintf(stderr, "Usage: %s NUMBITS NUMPOS DENSITY0 [DENSITY1 [THREADS]]\n", argv[0]);
 		return 0;
 	}
 
@@ -33,13 +51,20 @@ int main(int argc, char *argv[]) {
 	}
 #endif
 	const uint64_t num_pos = strtoll(argv[2], NULL, 0);
-	printf("Number of bits: %lld\n", num_bits);
-	printf("Number of positions: %lld\n", num_pos);
-	printf("Number of words: %lld\n", num_bits / 64);
-	printf("Number of blocks: %lld\n", (num_bits / 64) / 16);
+	h.param("class", STRINGIFY(CLASS));
+#ifdef MAX_LOG2_LONGWORDS_PER_SUBINVENTORY
+	h.param("max_log2_longwords_per_subinventory", MAX_LOG2_LONGWORDS_PER_SUBINVENTORY);
+#endif
+	h.param("bits", num_bits);
+	h.param("positions", num_pos);
 	uint64_t *const bits = (uint64_t *)calloc(num_bits / 64 + 1, sizeof *bits);
 
 	double density0 = atof(argv[3]), density1 = argc > 4 ? atof(argv[4]) : density0;
+	// Dependent queries are run concurrently by this number of threads
+	const int threads = argc > 5 ? max(1, atoi(argv[5])) : 1;
+	h.param("density0", density0);
+	h.param("density1", density1);
+	h.param("threads", threads);
 	assert(density0 >= 0);
 	assert(density0 <= 1);
 	assert(density1 >= 0);
@@ -61,49 +86,75 @@ int main(int argc, char *argv[]) {
 			bits[i / 64] |= 1LL << i % 64;
 		}
 
+	auto begin_construction = chrono::high_resolution_clock::now();
 #ifdef MAX_LOG2_LONGWORDS_PER_SUBINVENTORY
 	CLASS rs(bits, num_bits, MAX_LOG2_LONGWORDS_PER_SUBINVENTORY);
 #else
 	CLASS rs(bits, num_bits);
 #endif
-
-	printf("Bit cost: %lld (%.2f%%)\n", rs.bitCount(), (rs.bitCount() * 100.0) / num_bits);
+	auto end_construction = chrono::high_resolution_clock::now();
+	h.record("construction", {{"s", chrono::duration_cast<chrono::nanoseconds>(end_construction - begin_construction).count() / 1E9}});
+	h.record("space", {{"bits", double(rs.bitCount())}, {"%", (rs.bitCount() * 100.0) / num_bits}});
 
 	uint64_t u = 0;
 
 #ifndef NORANKTEST
 
-	auto begin = chrono::high_resolution_clock::now();
-
-	for (int k = REPEATS; k-- != 0;) {
-		s[0] = 0x333e2c3815b27604;
-		s[1] = 0x47ed6e7691d8f09f;
-		for (int i = 0; i < num_pos; i++) u ^= rs.rank(remap128(next() ^ u, num_bits));
+	// Dependent queries; with more threads, the time per operation is that of each thread
+	h.run("rank", num_pos, [&] {
+		u ^= run_threads(threads, [&](const int t) {
+			uint64_t x = u;
+			s[0] = 0x333e2c3815b27604 ^ t;
+			s[1] = 0x47ed6e7691d8f09f;
+			for (int i = 0; i < num_pos; i++) x ^= rs.rank(remap128(next() ^ x, num_bits));
+			return x;
+		});
+	});
+
+#ifndef NOBATCHTEST
+	{
+		// Independent queries known in advance: a scalar loop versus a batch
+		vector<size_t> pos(num_pos);
+		vector<uint64_t> out(num_pos);
+		for (auto &p : pos) p = remap128(next(), num_bits);
+
+		h.run("rank (loop)", num_pos, [&] {
+			for (uint64_t i = 0; i < num_pos; i++) out[i] = rs.rank(pos[i]);
+		});
+		for (const auto o : out) u ^= o;
+		h.run("rank (batch)", num_pos, [&] { rs.rank(pos.data(), out.data(), num_pos); });
+		for (const auto o : out) u ^= o;
 	}
-
-	auto end = chrono::high_resolution_clock::now();
-	const uint64_t elapsed = chrono::duration_cast<chrono::nanoseconds>(end - begin).count();
-	const double secs = elapsed / 1E9;
-	printf("%f s, %f ranks/s, %f ns/rank\n", secs, (REPEATS * num_pos) / secs, 1E9 * secs / (REPEATS * num_pos));
+#endif
 #endif
 
 #ifndef NOSELECTTEST
 
 	if (num_ones_first_half && num_ones_second_half) {
-		auto begin = chrono::high_resolution_clock::now();
-
-		for (int k = REPEATS; k-- != 0;) {
-			s[0] = 0x333e2c3815b27604;
-			s[1] = 0x47ed6e7691d8f09f;
-			for (int i = 0; i < num_pos; i++) u ^= rs.select((u & 1) ? remap128(next(), num_ones_first_half) : num_ones_first_half + remap128(next(), num_ones_second_half));
-		}
-
-		auto end = chrono::high_resolution_clock::now();
-		const uint64_t elapsed = chrono::duration_cast<chrono::nanoseconds>(end - begin).count();
-		const double secs = elapsed / 1E9;
-		printf("%f s, %f selects/s, %f ns/select\n", secs, (REPEATS * num_pos) / secs, 1E9 * secs / (REPEATS * num_pos));
+		h.run("select", num_pos, [&] {
+			u ^= run_threads(threads, [&](const int t) {
+				uint64_t x = u;
+				s[0] = 0x333e2c3815b27604 ^ t;
+				s[1] = 0x47ed6e7691d8f09f;
+				for (int i = 0; i < num_pos; i++) x ^= rs.select((x & 1) ? remap128(next(), num_ones_first_half) : num_ones_first_half + remap128(next(), num_ones_second_half));
+				return x;
+			});
+		});
+
+#ifndef NOBATCHTEST
+		vector<uint64_t> rank(num_pos);
+		vector<decltype(rs.select(0))> out(num_pos);
+		for (auto &r : rank) r = (next() & 1) ? remap128(next(), num_ones_first_half) : num_ones_first_half + remap128(next(), num_ones_second_half);
+
+		h.run("select (loop)", num_pos, [&] {
+			for (uint64_t i = 0; i < num_pos; i++) out[i] = rs.select(rank[i]);
+		});
+		for (const auto o : out) u ^= o;
+		h.run("select (batch)", num_pos, [&] { rs.select(rank.data(), out.data(), num_pos); });
+		for (const auto o : out) u ^= o;
+#endif
 	} else
-		printf("Too few ones to measure select speed\n");
+		fprintf(stderr, "Too few ones to measure select speed\n");
 #endif
 
 	const auto volatile unused = u;
@@ -0,0 +1,86 @@
+#include "../../test/xoroshiro128pp.hpp"
+#include "../harness.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sux/function/RecSplit.hpp>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace sux::function;
+
+// Leaf sizes that can be swept (each one is a separate instantiation of RecSplit)
+#define LEAVES 2, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 16
+
+// Parses a comma-separated list of integers
+static vector<uint64_t> parse(const char *s) {
+	vector<uint64_t> v;
+	for (char *e;; s = e + 1) {
+		v.push_back(strtoll(s, &e, 0));
+		if (*e != ',') break;
+	}
+	return v;
+}
+
+template <size_t LEAF> static RecSplitProfile build(const uint64_t n, const size_t bucket_size, const size_t threads, const bool strings) {
+	s[0] = 0x5603141978c51071;
+	s[1] = 0x3bbddc01ebdf4b72;
+	if (strings) {
+		vector<string> keys;
+		for (uint64_t i = 0; i < n; i++) keys.push_back(to_string(next()) + to_string(i));
+		return RecSplit<LEAF, ALLOC_TYPE>(keys, bucket_size, threads).buildProfile();
+	}
+	vector<hash128_t> keys;
+	for (uint64_t i = 0; i < n; i++) keys.push_back(hash128_t(next(), next()));
+	return RecSplit<LEAF, ALLOC_TYPE>(keys, bucket_size, threads).buildProfile();
+}
+
+// Builds a function with the given leaf size, choosing among LEAVES
+template <size_t... L> static bool build(const size_t leaf, const uint64_t n, const size_t bucket_size, const size_t threads, const bool strings, RecSplitProfile &profile) {
+	return ((leaf == L && (profile = build<L>(n, bucket_size, threads, strings), true)) || ...);
+}
+
+int main(int argc, char **argv) {
+	harness::Harness h("recsplit_build", argc, argv);
+	if (argc < 4) {
+		fprintf(stderr, "Usage: %s <n>[,<n>...] <leaf>[,<leaf>...] <bucket size>[,<bucket size>...] [threads=<t>] [strings]\n", argv[0]);
+		return 1;
+	}
+
+	const auto ns = parse(argv[1]), leaves = parse(argv[2]), bucket_sizes = parse(argv[3]);
+	size_t threads = 1;
+	bool strings = false;
+	for (int i = 4; i < argc; i++) {
+		if (strncmp(argv[i], "threads=", 8) == 0) threads = max(1, atoi(argv[i] + 8));
+		else if (strcmp(argv[i], "strings") == 0) strings = true;
+	}
+
+	h.param("alloc", STRINGIFY(ALLOC_TYPE));
+	h.param("threads", threads);
+	h.param("keys", strings ? "strings" : "hash128");
+	for (const auto n : ns)
+		for (const auto leaf : leaves)
+			for (const auto bucket_size : bucket_sizes) {
+				RecSplitProfile p;
+				if (!build<LEAVES>(leaf, n, bucket_size, threads, strings, p)) {
+					fprintf(stderr, "Unsupported leaf size %lu\n", leaf);
+					return 1;
+				}
+				// Phase times in ms
+				h.record("n=" + to_string(n) + " leaf=" + to_string(leaf) + " bucket=" + to_string(bucket_size),
+						 {{"ns/key", p.time() / (double)n},
+						  {"hash_ms", p.time_hash * 1E-6},
+						  {"sort_ms", p.time_sort * 1E-6},
+						  {"buckets_ms", p.time_buckets * 1E-6},
+						  {"concat_ms", p.time_concat * 1E-6},
+						  {"descriptors_ms", p.time_descriptors * 1E-6},
+						  {"ef_ms", p.time_ef * 1E-6},
+						  {"bits/key", (p.descriptor_bits + p.ef_bits) / (double)n},
+						  {"sort_MiB", p.sort_bytes / (1024. * 1024)},
+						  {"scratch_allocations", double(p.scratch_allocations)}});
+			}
+
+	return 0;
+}
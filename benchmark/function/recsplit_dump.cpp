@@ -1,3 +1,4 @@
+#include "../harness.hpp"
 #include <chrono>
 #include <cstdio>
 #include <fstream>
@@ -8,8 +9,9 @@ using namespace std;
 using namespace sux::function;
 
 int main(int argc, char **argv) {
+	harness::Harness h("recsplit_dump", argc, argv);
 	if (argc < 4) {
-		fprintf(stderr, "Usage: %s <keys> <bucket size> <mpfh>\n", argv[0]);
+		fprintf(stderr, "Usage: %s <keys> <bucket size> <mpfh> [<threads> [<memory budget>]]\n", argv[0]);
 		return 1;
 	}
 
@@ -20,14 +22,21 @@ int main(int argc, char **argv) {
 		return 1;
 	}
 	const size_t bucket_size = strtoll(argv[2], NULL, 0);
+	const size_t num_threads = argc > 4 ? strtoll(argv[4], NULL, 0) : 1;
+	const size_t memory_budget = argc > 5 ? strtoll(argv[5], NULL, 0) : 0;
 
-	printf("Building...\n");
+	fprintf(stderr, "Building...\n");
 	auto begin = chrono::high_resolution_clock::now();
-	RecSplit<LEAF, ALLOC_TYPE> rs(ifs, bucket_size);
+	RecSplit<LEAF, ALLOC_TYPE> rs = memory_budget ? RecSplit<LEAF, ALLOC_TYPE>(ifs, bucket_size, num_threads, memory_budget) : RecSplit<LEAF, ALLOC_TYPE>(ifs, bucket_size, num_threads);
 	ifs.close();
 
 	auto elapsed = chrono::duration_cast<std::chrono::nanoseconds>(chrono::high_resolution_clock::now() - begin).count();
-	printf("Construction time: %.3f s, %.0f ns/key\n", elapsed * 1E-9, elapsed / (double)rs.size());
+	h.param("leaf", LEAF);
+	h.param("alloc", STRINGIFY(ALLOC_TYPE));
+	h.param("bucket_size", bucket_size);
+	h.param("threads", num_threads);
+	h.param("keys", rs.size());
+	h.record("construction", {{"s", elapsed * 1E-9}, {"ns/key", elapsed / (double)rs.size()}});
 
 	ofstream ofs;
 	ofs.exceptions(fstream::failbit | fstream::badbit);
@@ -1,4 +1,5 @@
 #include "../../test/xoroshiro128pp.hpp"
+#include "../harness.hpp"
 #include <algorithm>
 #include <chrono>
 #include <cstdio>
@@ -10,21 +11,28 @@ using namespace std;
 using namespace sux::function;
 
 int main(int argc, char **argv) {
+	harness::Harness h("recsplit_dump128", argc, argv);
 	if (argc < 4) {
-		fprintf(stderr, "Usage: %s <n> <bucket size> <mphf>\n", argv[0]);
+		fprintf(stderr, "Usage: %s <n> <bucket size> <mphf> [<threads>]\n", argv[0]);
 		return 1;
 	}
 
 	const uint64_t n = strtoll(argv[1], NULL, 0);
 	const size_t bucket_size = strtoll(argv[2], NULL, 0);
+	const size_t num_threads = argc > 4 ? strtoll(argv[4], NULL, 0) : 1;
 	std::vector<hash128_t> keys;
 	for (uint64_t i = 0; i < n; i++) keys.push_back(hash128_t(next(), next()));
 
-	printf("Building...\n");
+	fprintf(stderr, "Building...\n");
 	auto begin = chrono::high_resolution_clock::now();
-	RecSplit<LEAF, ALLOC_TYPE> rs(keys, bucket_size);
+	RecSplit<LEAF, ALLOC_TYPE> rs(keys, bucket_size, num_threads);
 	auto elapsed = chrono::duration_cast<std::chrono::nanoseconds>(chrono::high_resolution_clock::now() - begin).count();
-	printf("Construction time: %.3f s, %.0f ns/key\n", elapsed * 1E-9, elapsed / (double)n);
+	h.param("leaf", LEAF);
+	h.param("alloc", STRINGIFY(ALLOC_TYPE));
+	h.param("bucket_size", bucket_size);
+	h.param("threads", num_threads);
+	h.param("keys", n);
+	h.record("construction", {{"s", elapsed * 1E-9}, {"ns/key", elapsed / (double)n}});
 
 	fstream fs;
 	fs.exceptions(fstream::failbit | fstream::badbit);
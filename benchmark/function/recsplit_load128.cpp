@@ -1,56 +1,143 @@
 #include "../../test/xoroshiro128pp.hpp"
+#include "../harness.hpp"
 #include <algorithm>
 #include <chrono>
 #include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <optional>
 #include <random>
 #include <sux/function/RecSplit.hpp>
-
-#define SAMPLES (11)
+#include <sux/util/LoadedFile.hpp>
+#include <sux/util/Numa.hpp>
+#include <thread>
 
 using namespace std;
 using namespace sux::function;
 
-void benchmark(RecSplit<LEAF, ALLOC_TYPE> &rs, const uint64_t n) {
-	printf("Benchmarking...\n");
+#define BATCH (256)
 
-	uint64_t sample[SAMPLES];
+void benchmark_batch(harness::Harness &harness, RecSplit<LEAF, ALLOC_TYPE> &rs, const uint64_t n) {
 	uint64_t h = 0;
+	vector<hash128_t> in;
+	size_t out[BATCH];
 
-	for (int k = SAMPLES; k-- != 0;) {
+	harness.run("batched lookup", n, [&] {
 		s[0] = 0x5603141978c51071;
 		s[1] = 0x3bbddc01ebdf4b72;
-		auto begin = chrono::high_resolution_clock::now();
-		for (uint64_t i = 0; i < n; i++) h ^= rs(hash128_t(next(), next() ^ h));
-		auto end = chrono::high_resolution_clock::now();
-		const uint64_t elapsed = chrono::duration_cast<chrono::nanoseconds>(end - begin).count();
-		sample[k] = elapsed;
-		printf("Elapsed: %.3fs; %.3f ns/key\n", elapsed * 1E-9, elapsed / (double)n);
-	}
+		for (uint64_t i = 0; i < n; i += BATCH) {
+			const size_t b = min(uint64_t(BATCH), n - i);
+			in.clear();
+			for (size_t j = 0; j < b; j++) in.push_back(hash128_t(next(), next() ^ h));
+			rs.lookup(&in[0], out, b);
+			for (size_t j = 0; j < b; j++) h ^= out[j];
+		}
+	});
 
 	const volatile uint64_t unused = h;
-	sort(sample, sample + SAMPLES);
-	printf("\nMedian: %.3fs; %.3f ns/key\n", sample[SAMPLES / 2] * 1E-9, sample[SAMPLES / 2] / (double)n);
+}
+
+/* Each thread performs n dependent lookups on the function returned by get(); the elapsed time is that of the slowest thread,
+ * so the time per operation is that of each thread, and aggregate throughput is threads times larger. */
+template <typename G> void benchmark(harness::Harness &harness, G &&get, const uint64_t n, const int threads) {
+	vector<uint64_t> h(threads);
+
+	harness.run("lookup", n, [&] {
+		vector<thread> pool;
+		for (int t = 0; t < threads; t++)
+			pool.emplace_back([&, t] {
+				RecSplit<LEAF, ALLOC_TYPE> &rs = get();
+				s[0] = 0x5603141978c51071 ^ t;
+				s[1] = 0x3bbddc01ebdf4b72;
+				uint64_t x = h[t];
+				for (uint64_t i = 0; i < n; i++) x ^= rs(hash128_t(next(), next() ^ x));
+				h[t] = x;
+			});
+		for (auto &t : pool) t.join();
+	});
+
+	for (int t = 0; t < threads; t++) {
+		const volatile uint64_t unused = h[t];
+	}
 }
 
 int main(int argc, char **argv) {
+	harness::Harness harness("recsplit_load128", argc, argv);
 	if (argc < 3) {
-		fprintf(stderr, "Usage: %s <n> <mphf>\n", argv[0]);
+		fprintf(stderr, "Usage: %s <n> <mphf> [mmap | populate | load] [batch] [threads=<t>] [interleave | replicate]\n", argv[0]);
 		return 1;
 	}
 
 	const uint64_t n = strtoll(argv[1], NULL, 0);
+	bool mmap = false, populate = false, load = false, batch = false, interleave = false, replicate = false;
+	int threads = 1;
+	for (int i = 3; i < argc; i++) {
+		if (strcmp(argv[i], "mmap") == 0) mmap = true;
+		else if (strcmp(argv[i], "populate") == 0) mmap = populate = true;
+		else if (strcmp(argv[i], "load") == 0) load = true;
+		else if (strcmp(argv[i], "batch") == 0) batch = true;
+		else if (strncmp(argv[i], "threads=", 8) == 0) threads = max(1, atoi(argv[i] + 8));
+		else if (strcmp(argv[i], "interleave") == 0) interleave = true;
+		else if (strcmp(argv[i], "replicate") == 0) replicate = true;
+	}
+	harness.param("leaf", LEAF);
+	harness.param("alloc", STRINGIFY(ALLOC_TYPE));
+	harness.param("keys", n);
+	harness.param("load", mmap ? populate ? "populate" : "mmap" : load ? "load" : "stream");
+	harness.param("threads", threads);
+	harness.param("numa", replicate ? "replicate" : interleave ? "interleave" : "default");
+	harness.param("numa_nodes", sux::util::numa::nodes());
+
+	if (replicate) {
+		// A private copy of the function on each node; threads use the one on their node
+		sux::util::NumaReplicas<RecSplit<LEAF, ALLOC_TYPE>> replicas([&] {
+			auto rs = make_unique<RecSplit<LEAF, ALLOC_TYPE>>();
+			fstream fs;
+			fs.exceptions(fstream::failbit | fstream::badbit);
+			fs.open(argv[2], fstream::in | fstream::binary);
+			fs >> *rs;
+			return rs;
+		});
+		benchmark(harness, [&]() -> RecSplit<LEAF, ALLOC_TYPE> & { return replicas.local(); }, n, threads);
+		return 0;
+	}
 
 	fstream fs;
+	sux::util::MappedFile file;
+	// A private copy on transparent huge pages, read with O_DIRECT
+	sux::util::LoadedFile<sux::util::TRANSHUGEPAGE> loaded;
 	RecSplit<LEAF, ALLOC_TYPE> rs;
 
-	fs.exceptions(fstream::failbit | fstream::badbit);
-	fs.open(argv[2], fstream::in | fstream::binary);
-	fs >> rs;
-	fs.close();
+	auto begin = chrono::high_resolution_clock::now();
+	if (mmap || load) {
+		const char *data, *end;
+		if (mmap) {
+			file = sux::util::MappedFile(argv[2], populate);
+			data = file.data();
+			end = file.end();
+		} else {
+			loaded = sux::util::LoadedFile<sux::util::TRANSHUGEPAGE>(argv[2]);
+			data = loaded.data();
+			end = loaded.end();
+		}
+		if (rs.view(data, end) == nullptr) {
+			fprintf(stderr, "Invalid file %s\n", argv[2]);
+			return 1;
+		}
+	} else {
+		fs.exceptions(fstream::failbit | fstream::badbit);
+		fs.open(argv[2], fstream::in | fstream::binary);
+		optional<sux::util::NumaScope> scope;
+		if (interleave) scope.emplace();
+		fs >> rs;
+		fs.close();
+	}
+	auto elapsed = chrono::duration_cast<std::chrono::nanoseconds>(chrono::high_resolution_clock::now() - begin).count();
+	harness.record("loading", {{"s", elapsed * 1E-9}});
 
-	benchmark(rs, n);
+	if (batch) benchmark_batch(harness, rs, n);
+	else benchmark(harness, [&]() -> RecSplit<LEAF, ALLOC_TYPE> & { return rs; }, n, threads);
 
 	return 0;
 }
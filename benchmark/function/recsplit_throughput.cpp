@@ -0,0 +1,159 @@
+#include "../../test/xoroshiro128pp.hpp"
+#include "../harness.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <sux/function/RecSplit.hpp>
+#include <sux/util/MappedFile.hpp>
+#include <thread>
+
+using namespace std;
+using namespace sux::function;
+
+// Pins the calling thread to the given core (modulo the number of cores available to the process)
+static void pin(const int t) {
+	cpu_set_t available;
+	if (sched_getaffinity(0, sizeof available, &available) != 0) return;
+	const int cores = CPU_COUNT(&available);
+	for (int c = 0, k = t % cores; c < CPU_SETSIZE; c++)
+		if (CPU_ISSET(c, &available) && k-- == 0) {
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(c, &set);
+			pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+			return;
+		}
+}
+
+// Runs f(t) in threads t = 0, 1, ..., threads - 1, which start together, and returns the elapsed time in nanoseconds
+template <typename F> static uint64_t run_threads(const int threads, const bool pinned, F &&f) {
+	atomic<int> ready(0);
+	atomic<bool> go(false);
+	vector<thread> pool;
+	for (int t = 0; t < threads; t++)
+		pool.emplace_back([&, t] {
+			if (pinned) pin(t);
+			ready++;
+			while (!go.load(memory_order_acquire)) this_thread::yield();
+			f(t);
+		});
+	while (ready.load() != threads) this_thread::yield();
+	auto begin = chrono::high_resolution_clock::now();
+	go.store(true, memory_order_release);
+	for (auto &t : pool) t.join();
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - begin).count();
+}
+
+// Returns the given percentile of a sorted vector
+static uint64_t percentile(const vector<uint64_t> &sorted, const double p) { return sorted[min(sorted.size() - 1, size_t(p * sorted.size()))]; }
+
+/* In the dependent mode each key depends on the result of the previous lookup, so lookups
+ * cannot overlap and the time is the latency of a lookup; in the independent mode keys are
+ * known in advance, so the processor can overlap the cache misses of consecutive lookups. */
+static void benchmark(harness::Harness &harness, RecSplit<LEAF, ALLOC_TYPE> &rs, const uint64_t n, const int threads, const bool pinned, const bool dependent) {
+	const string mode = dependent ? "dependent" : "independent";
+
+	// Keys are generated in advance, and each thread uses its own keys
+	vector<vector<hash128_t>> keys(threads);
+	for (int t = 0; t < threads; t++) {
+		s[0] = 0x5603141978c51071 ^ t;
+		s[1] = 0x3bbddc01ebdf4b72;
+		keys[t].reserve(n);
+		for (uint64_t i = 0; i < n; i++) keys[t].push_back(hash128_t(next(), next()));
+	}
+
+	// Throughput: lookups are not timed individually, and operations are counted on all threads
+	vector<uint64_t> h(threads * 8); // One cache line per thread
+	harness.run(mode + " throughput", threads * n, [&] {
+		run_threads(threads, pinned, [&](const int t) {
+			const hash128_t *key = keys[t].data();
+			uint64_t x = 0;
+			if (dependent)
+				for (uint64_t i = 0; i < n; i++) x ^= rs(hash128_t(key[i].first, key[i].second ^ x));
+			else
+				for (uint64_t i = 0; i < n; i++) x ^= rs(key[i]);
+			h[t * 8] ^= x;
+		});
+	});
+
+	/* Latency: every lookup is timed individually. The clock adds some overhead, and in the
+	 * independent mode it also limits the overlap between lookups, so latencies are slightly
+	 * pessimistic with respect to the throughput measured above. */
+	vector<vector<uint64_t>> latency(threads);
+	run_threads(threads, pinned, [&](const int t) {
+		const hash128_t *key = keys[t].data();
+		auto &lat = latency[t];
+		lat.resize(n);
+		uint64_t x = 0;
+		for (uint64_t i = 0; i < n; i++) {
+			const auto begin = chrono::steady_clock::now();
+			x ^= rs(dependent ? hash128_t(key[i].first, key[i].second ^ x) : key[i]);
+			lat[i] = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - begin).count();
+		}
+		h[t * 8] ^= x;
+		sort(lat.begin(), lat.end());
+	});
+
+	vector<uint64_t> all;
+	for (int t = 0; t < threads; t++) {
+		harness.record(mode + " latency (thread " + to_string(t) + ")", {{"p50_ns", double(percentile(latency[t], .5))}, {"p99_ns", double(percentile(latency[t], .99))}, {"p999_ns", double(percentile(latency[t], .999))}});
+		all.insert(all.end(), latency[t].begin(), latency[t].end());
+	}
+	sort(all.begin(), all.end());
+	harness.record(mode + " latency", {{"p50_ns", double(percentile(all, .5))}, {"p99_ns", double(percentile(all, .99))}, {"p999_ns", double(percentile(all, .999))}});
+
+	for (int t = 0; t < threads; t++) {
+		const volatile uint64_t unused = h[t * 8];
+	}
+}
+
+int main(int argc, char **argv) {
+	harness::Harness harness("recsplit_throughput", argc, argv);
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s <n> <mphf> [threads=<t>] [pin] [dependent | independent] [mmap]\n", argv[0]);
+		return 1;
+	}
+
+	const uint64_t n = strtoll(argv[1], NULL, 0);
+	int threads = thread::hardware_concurrency();
+	bool pinned = false, dependent = true, independent = true, mmap = false;
+	for (int i = 3; i < argc; i++) {
+		if (strncmp(argv[i], "threads=", 8) == 0) threads = max(1, atoi(argv[i] + 8));
+		else if (strcmp(argv[i], "pin") == 0) pinned = true;
+		else if (strcmp(argv[i], "dependent") == 0) independent = false;
+		else if (strcmp(argv[i], "independent") == 0) dependent = false;
+		else if (strcmp(argv[i], "mmap") == 0) mmap = true;
+	}
+
+	// All threads share a single instance
+	sux::util::MappedFile file;
+	RecSplit<LEAF, ALLOC_TYPE> rs;
+	if (mmap) {
+		file = sux::util::MappedFile(argv[2], true);
+		if (rs.view(file.data(), file.end()) == nullptr) {
+			fprintf(stderr, "Invalid file %s\n", argv[2]);
+			return 1;
+		}
+	} else {
+		fstream fs;
+		fs.exceptions(fstream::failbit | fstream::badbit);
+		fs.open(argv[2], fstream::in | fstream::binary);
+		fs >> rs;
+	}
+
+	harness.param("leaf", LEAF);
+	harness.param("alloc", STRINGIFY(ALLOC_TYPE));
+	harness.param("keys", n);
+	harness.param("threads", threads);
+	harness.param("pinned", pinned ? "true" : "false");
+	if (dependent) benchmark(harness, rs, n, threads, pinned, true);
+	if (independent) benchmark(harness, rs, n, threads, pinned, false);
+
+	return 0;
+}
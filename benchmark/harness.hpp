@@ -0,0 +1,267 @@
+/*
+ * A small harness shared by all benchmarks.
+ *
+ * Benchmarks keep their positional arguments; harness options start with "--" and are
+ * removed from argv by the Harness constructor:
+ *
+ *     --warmup=<n>   untimed runs before measuring (default: 1)
+ *     --repeats=<n>  timed runs (default: 10)
+ *     --pin=<cpu>    pin the main thread to a CPU
+ *     --perf         read hardware counters with perf_event_open()
+ *     --csv, --json  machine-readable output (default: text)
+ *     --out=<file>   write results to a file instead of standard output
+ *
+ * Each timed run of Harness::run() performs a given number of operations; the harness reports
+ * the median time per operation over the runs and its median absolute deviation, so that a
+ * few disturbed runs do not affect the results. Hardware counters (cycles, instructions, cache
+ * misses and data TLB misses) are counted on the calling thread and on threads it creates,
+ * and they are reported as medians per operation. If they are not available (e.g., because of
+ * `/proc/sys/kernel/perf_event_paranoid`) they are silently omitted.
+ *
+ * CSV output has one row per metric (benchmark, parameters, name, metric, value), so rows of
+ * different benchmarks can be concatenated; JSON output is an array with an object per result.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace harness {
+
+enum Format { TEXT, CSV, JSON };
+
+// Hardware counters, in the order in which they are reported
+class Counters {
+	static constexpr int NUM = 4;
+	int fd[NUM];
+
+	static int open(const uint32_t type, const uint64_t config) {
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof attr);
+		attr.size = sizeof attr;
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = 1;
+		attr.inherit = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+
+  public:
+	static constexpr const char *names[NUM] = {"cycles", "instructions", "cache_misses", "dtlb_misses"};
+
+	Counters() {
+		fd[0] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+		fd[1] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+		fd[2] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+		fd[3] = open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	}
+
+	~Counters() {
+		for (int i = 0; i < NUM; i++)
+			if (fd[i] != -1) close(fd[i]);
+	}
+
+	Counters(const Counters &) = delete;
+	Counters &operator=(const Counters &) = delete;
+
+	static int size() { return NUM; }
+
+	bool available(const int i) const { return fd[i] != -1; }
+
+	void start() {
+		for (int i = 0; i < NUM; i++)
+			if (fd[i] != -1) {
+				ioctl(fd[i], PERF_EVENT_IOC_RESET, 0);
+				ioctl(fd[i], PERF_EVENT_IOC_ENABLE, 0);
+			}
+	}
+
+	void stop(uint64_t *value) {
+		for (int i = 0; i < NUM; i++)
+			if (fd[i] != -1) {
+				ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+				if (read(fd[i], value + i, sizeof *value) != sizeof *value) value[i] = 0;
+			}
+	}
+};
+
+// Returns the median of a vector, which is partially reordered
+static inline double median(std::vector<double> &v) {
+	std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+	return v[v.size() / 2];
+}
+
+class Harness {
+	const std::string benchmark;
+	std::vector<std::pair<std::string, std::string>> params;
+	int warmup = 1, repeats = 10;
+	bool perf = false;
+	Format format = TEXT;
+	FILE *out = stdout;
+	bool first = true, changed = true;
+
+	// JSON strings
+	static std::string quote(const std::string &s) {
+		std::string q = "\"";
+		for (const char c : s) {
+			if (c == '"' || c == '\\') q += '\\';
+			q += c;
+		}
+		return q + "\"";
+	}
+
+	// CSV fields
+	static std::string csv(const std::string &s) {
+		std::string q = "\"";
+		for (const char c : s) q += c == '"' ? std::string("\"\"") : std::string(1, c);
+		return q + "\"";
+	}
+
+	static std::string number(const double v) {
+		char buf[32];
+		// Integers (e.g., sizes) are printed exactly
+		snprintf(buf, sizeof buf, v == std::floor(v) && std::abs(v) < 1E15 ? "%.0f" : "%.6g", v);
+		return buf;
+	}
+
+  public:
+	/** Creates a harness for the given benchmark, removing harness options from argv. */
+	Harness(const std::string &benchmark, int &argc, char **argv) : benchmark(benchmark) {
+		int j = 1;
+		for (int i = 1; i < argc; i++) {
+			const char *a = argv[i];
+			if (strncmp(a, "--warmup=", 9) == 0) warmup = std::max(0, atoi(a + 9));
+			else if (strncmp(a, "--repeats=", 10) == 0) repeats = std::max(1, atoi(a + 10));
+			else if (strncmp(a, "--pin=", 6) == 0) {
+				cpu_set_t set;
+				CPU_ZERO(&set);
+				CPU_SET(atoi(a + 6), &set);
+				if (sched_setaffinity(0, sizeof set, &set) != 0) fprintf(stderr, "Cannot pin to CPU %s\n", a + 6);
+			} else if (strcmp(a, "--perf") == 0) perf = true;
+			else if (strcmp(a, "--csv") == 0) format = CSV;
+			else if (strcmp(a, "--json") == 0) format = JSON;
+			else if (strncmp(a, "--out=", 6) == 0) {
+				if ((out = fopen(a + 6, "w")) == nullptr) {
+					fprintf(stderr, "Cannot open file %s\n", a + 6);
+					abort();
+				}
+			} else
+				argv[j++] = argv[i];
+		}
+		argc = j;
+		argv[argc] = nullptr;
+	}
+
+	~Harness() {
+		if (format == JSON) fprintf(out, first ? "[]\n" : "\n]\n");
+		if (out != stdout) fclose(out);
+	}
+
+	Harness(const Harness &) = delete;
+	Harness &operator=(const Harness &) = delete;
+
+	/** Returns the number of timed runs. */
+	int repetitions() const { return repeats; }
+
+	/** Sets a parameter describing all subsequent results (e.g., the allocation type). */
+	template <typename T> void param(const std::string &name, const T &value) {
+		std::string v;
+		if constexpr (std::is_arithmetic_v<T>) v = number(value);
+		else v = value;
+		changed = true;
+		for (auto &p : params)
+			if (p.first == name) {
+				p.second = v;
+				return;
+			}
+		params.emplace_back(name, v);
+	}
+
+	/** Reports a result given by arbitrary metrics. */
+	void record(const std::string &name, const std::vector<std::pair<std::string, double>> &metrics) {
+		switch (format) {
+		case TEXT:
+			// Parameters are printed when they change
+			if (changed && !params.empty()) {
+				fprintf(out, first ? "" : "\n");
+				for (size_t i = 0; i < params.size(); i++) fprintf(out, "%s%s=%s", i ? ", " : "", params[i].first.c_str(), params[i].second.c_str());
+				fprintf(out, "\n");
+			}
+			fprintf(out, "%s:", name.c_str());
+			for (size_t i = 0; i < metrics.size(); i++) fprintf(out, "%s %s %s", i ? "," : "", number(metrics[i].second).c_str(), metrics[i].first.c_str());
+			fprintf(out, "\n");
+			break;
+		case CSV: {
+			std::string p;
+			for (const auto &kv : params) p += (p.empty() ? "" : ";") + kv.first + "=" + kv.second;
+			if (first) fprintf(out, "benchmark,params,name,metric,value\n");
+			for (const auto &m : metrics) fprintf(out, "%s,%s,%s,%s,%s\n", csv(benchmark).c_str(), csv(p).c_str(), csv(name).c_str(), m.first.c_str(), number(m.second).c_str());
+			break;
+		}
+		case JSON: {
+			std::string p, m;
+			for (const auto &kv : params) p += (p.empty() ? "" : ", ") + quote(kv.first) + ": " + quote(kv.second);
+			for (const auto &kv : metrics) m += (m.empty() ? "" : ", ") + quote(kv.first) + ": " + (std::isfinite(kv.second) ? number(kv.second) : "null");
+			fprintf(out, "%s  {\"benchmark\": %s, \"params\": {%s}, \"name\": %s, \"metrics\": {%s}}", first ? "[\n" : ",\n", quote(benchmark).c_str(), p.c_str(), quote(name).c_str(), m.c_str());
+			break;
+		}
+		}
+		first = changed = false;
+		fflush(out);
+	}
+
+	/** Runs f() the number of warmup times, and then the number of repeats times, reporting the
+	 * time per operation.
+	 *
+	 * @param name the name of the result.
+	 * @param ops the number of operations performed by a call to f().
+	 * @param f a function performing ops operations.
+	 */
+	template <typename F> void run(const std::string &name, const uint64_t ops, F &&f) {
+		for (int k = warmup; k-- != 0;) f();
+
+		std::vector<double> ns(repeats);
+		std::vector<std::vector<double>> counter(Counters::size(), std::vector<double>(repeats));
+		Counters counters;
+		uint64_t value[Counters::size()];
+		for (int k = 0; k < repeats; k++) {
+			if (perf) counters.start();
+			const auto begin = std::chrono::high_resolution_clock::now();
+			f();
+			const auto end = std::chrono::high_resolution_clock::now();
+			if (perf) {
+				counters.stop(value);
+				for (int i = 0; i < Counters::size(); i++) counter[i][k] = value[i] / double(ops);
+			}
+			ns[k] = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() / double(ops);
+		}
+
+		const double min = *std::min_element(ns.begin(), ns.end()), med = median(ns);
+		std::vector<double> dev(repeats);
+		for (int k = 0; k < repeats; k++) dev[k] = std::abs(ns[k] - med);
+		std::vector<std::pair<std::string, double>> metrics = {{"ns/op", med}, {"mad_ns/op", median(dev)}, {"min_ns/op", min}, {"Mops/s", 1E3 / med}};
+		if (perf)
+			for (int i = 0; i < Counters::size(); i++)
+				if (counters.available(i)) metrics.emplace_back(std::string(Counters::names[i]) + "/op", median(counter[i]));
+		record(name, metrics);
+	}
+};
+
+} // namespace harness
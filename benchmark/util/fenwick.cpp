@@ -3,6 +3,7 @@
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <vector>
 
 #include <sux/util/FenwickBitF.hpp>
 #include <sux/util/FenwickBitL.hpp>
@@ -10,47 +11,64 @@
 #include <sux/util/FenwickByteL.hpp>
 #include <sux/util/FenwickFixedF.hpp>
 #include <sux/util/FenwickFixedL.hpp>
+#include <sux/util/KaryPrefixSums.hpp>
 
 #include "../../test/xoroshiro128pp.hpp"
+#include "../harness.hpp"
 
 using namespace std;
 using namespace sux;
 using namespace sux::util;
 
-template <template <size_t, AllocType> class FENWICK, size_t BOUND, AllocType AT> void runall(const char *name, size_t size, size_t queries) {
+template <template <size_t, AllocType> class FENWICK, size_t BOUND, AllocType AT> void runall(harness::Harness &h, const char *name, size_t size, size_t queries) {
 	uint64_t u = 0;
-	const double c = 1. / queries;
+	h.param("class", name);
 
-	cout << name << endl;
 	FENWICK<BOUND, AT> fenwick;
 
 	// fenwick.reserve(size); // pushing becomes inexpensive
 
-	cout << "push: " << flush;
+	// Pushes are timed once, as they change the size of the tree
 	auto begin = chrono::high_resolution_clock::now();
 	for (size_t i = 0; i < size; i++) fenwick.push(next() % (BOUND + 1));
 	auto end = chrono::high_resolution_clock::now();
-	cout << chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / (double)size << " ns/item" << endl;
-
-	cout << "prefix: " << flush;
-	begin = chrono::high_resolution_clock::now();
-	for (uint64_t i = 0; i < queries; ++i) u ^= fenwick.prefix(1 + (next() ^ (u & 1)) % size);
-	end = chrono::high_resolution_clock::now();
-	cout << chrono::duration_cast<chrono::nanoseconds>(end - begin).count() * c << " ns/item" << endl;
+	h.record("push", {{"ns/op", chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / (double)size}});
+
+	h.run("prefix", queries, [&] {
+		for (uint64_t i = 0; i < queries; ++i) u ^= fenwick.prefix(1 + (next() ^ (u & 1)) % size);
+	});
+
+	h.run("find", queries, [&] {
+		for (size_t i = 0; i < queries; i++) u ^= fenwick.find((next() ^ (u & 1)) % ((BOUND + 1) * size));
+	});
+
+	h.run("add", queries, [&] {
+		for (size_t i = 0; i < queries; i++) fenwick.add(1 + (next() ^ (u & 1)) % size, next() % (BOUND + 1));
+	});
+
+	// Sorted batches, as produced by buffering updates; they are generated in advance
+	const size_t batch = min(queries, size_t(4096)), batches = (queries + batch - 1) / batch;
+	vector<size_t> idx(batch * batches);
+	vector<int64_t> inc(batch * batches);
+	vector<uint64_t> out(batch);
+	for (size_t i = 0; i < idx.size(); i++) {
+		idx[i] = 1 + next() % size;
+		inc[i] = next() % (BOUND + 1);
+	}
+	for (size_t b = 0; b < batches; b++) sort(idx.begin() + b * batch, idx.begin() + (b + 1) * batch);
 
-	cout << "find: " << flush;
-	begin = chrono::high_resolution_clock::now();
-	for (size_t i = 0; i < queries; i++) u ^= fenwick.find((next() ^ (u & 1)) % ((BOUND + 1) * size));
-	end = chrono::high_resolution_clock::now();
-	cout << chrono::duration_cast<chrono::nanoseconds>(end - begin).count() * c << " ns/item" << endl;
+	h.run("addBatch (sorted, " + to_string(batch) + ")", batch * batches, [&] {
+		for (size_t b = 0; b < batches; b++) fenwick.addBatch(idx.data() + b * batch, inc.data() + b * batch, batch);
+	});
 
-	cout << "add: " << flush;
-	begin = chrono::high_resolution_clock::now();
-	for (size_t i = 0; i < queries; i++) fenwick.add(1 + (next() ^ (u & 1)) % size, next() % (BOUND + 1));
-	end = chrono::high_resolution_clock::now();
-	cout << chrono::duration_cast<chrono::nanoseconds>(end - begin).count() * c << " ns/item" << endl;
+	h.run("bulk prefix (sorted, " + to_string(batch) + ")", batch * batches, [&] {
+		for (size_t b = 0; b < batches; b++) {
+			fenwick.prefix(idx.data() + b * batch, out.data(), batch);
+			u ^= out[batch - 1];
+		}
+	});
 
-	cout << "space: " << fenwick.bitCount() / (double)size << " b/item\n";
+	h.record("space", {{"b/item", fenwick.bitCount() / (double)size}});
 
 	// The add cannot be erased by the compiler
 	u ^= fenwick.prefix(1 + next() % size);
@@ -58,6 +76,7 @@ template <template <size_t, AllocType> class FENWICK, size_t BOUND, AllocType AT
 }
 
 int main(int argc, char **argv) {
+	harness::Harness h("fenwick", argc, argv);
 	if (argc != 3) {
 		cerr << "Not enough parameters: <size> <queries>\n";
 		return -1;
@@ -78,15 +97,18 @@ int main(int argc, char **argv) {
 	size_t size = stoul(argv[1]);
 	size_t queries = stoul(argv[2]);
 
-	cout << "Performing " << queries << " queries over " << size << " elements\n";
-	cout << "The bound is " << SET_BOUND << " and allocations use " << STRINGIFY(SET_ALLOC) << "\n";
-
-	runall<FenwickFixedF, B, AT>("\nFenwickFixedF", size, queries);
-	runall<FenwickFixedL, B, AT>("\nFenwickFixedL", size, queries);
-	runall<FenwickByteF, B, AT>("\nFenwickByteF", size, queries);
-	runall<FenwickByteL, B, AT>("\nFenwickByteL", size, queries);
-	runall<FenwickBitF, B, AT>("\nFenwickBitF", size, queries);
-	runall<FenwickBitL, B, AT>("\nFenwickBitL", size, queries);
+	h.param("size", size);
+	h.param("queries", queries);
+	h.param("bound", B);
+	h.param("alloc", STRINGIFY(SET_ALLOC));
+
+	runall<FenwickFixedF, B, AT>(h, "FenwickFixedF", size, queries);
+	runall<FenwickFixedL, B, AT>(h, "FenwickFixedL", size, queries);
+	runall<FenwickByteF, B, AT>(h, "FenwickByteF", size, queries);
+	runall<FenwickByteL, B, AT>(h, "FenwickByteL", size, queries);
+	runall<FenwickBitF, B, AT>(h, "FenwickBitF", size, queries);
+	runall<FenwickBitL, B, AT>(h, "FenwickBitL", size, queries);
+	runall<KaryPrefixSums, B, AT>(h, "KaryPrefixSums", size, queries);
 
 	return 0;
 }
@@ -28,10 +28,13 @@
 
 #pragma once
 
+#include "../support/Instrumentation.hpp"
 #include "Rank.hpp"
-#include "SimpleSelectHalf.hpp"
-#include "SimpleSelectZeroHalf.hpp"
+#include "Select.hpp"
+#include "SimpleSelectBoth.hpp"
 #include <cstdint>
+#include <iostream>
+#include <iterator>
 #include <vector>
 
 namespace sux::bits {
@@ -44,16 +47,20 @@ using namespace sux;
  *
  * Instances of this class can be built using a bit vector or an explicit list of
  * positions for the ones in a vector. In every case, the bit vector or the list
- * are not necessary after construction.
+ * are not necessary after construction. Instances can be serialized with operator<<()
+ * and loaded with operator>>() or view().
+ *
+ * For each query sampled by the instrumentation policy, select(const uint64_t) records the
+ * number of words of the upper bits scanned after the position given by the inventories.
  *
  * @tparam AT a type of memory allocation out of sux::util::AllocType.
+ * @tparam INSTR an instrumentation policy out of those in sux::instrumentation.
  */
 
-template <util::AllocType AT = util::AllocType::MALLOC> class EliasFano : public Rank, public Select {
+template <util::AllocType AT = util::AllocType::MALLOC, typename INSTR = instrumentation::None> class EliasFano : public Rank, public Select {
   private:
 	util::Vector<uint64_t, AT> lower_bits, upper_bits;
-	SimpleSelectHalf<AT> select_upper;
-	SimpleSelectZeroHalf<AT> selectz_upper;
+	SimpleSelectBoth<AT> select_upper;
 	uint64_t num_bits, num_ones;
 	int l;
 	int block_size;
@@ -63,10 +70,11 @@ template <util::AllocType AT = util::AllocType::MALLOC> class EliasFano : public
 	uint64_t ones_step_l;
 	uint64_t msbs_step_l;
 	uint64_t compressor;
+	INSTR instr;
 
 	__inline static void set(util::Vector<uint64_t, AT> &bits, const uint64_t pos) { bits[pos / 64] |= 1ULL << pos % 64; }
 
-	__inline static uint64_t get_bits(util::Vector<uint64_t, AT> &bits, const uint64_t start, const int width) {
+	__inline static uint64_t get_bits(const util::Vector<uint64_t, AT> &bits, const uint64_t start, const int width) {
 		const int start_word = start / 64;
 		const int start_bit = start % 64;
 		const int total_offset = start_bit + width;
@@ -91,51 +99,124 @@ template <util::AllocType AT = util::AllocType::MALLOC> class EliasFano : public
 		}
 	}
 
+	// Sets, using atomic operations, the bits of a value of given width at a given position; the bits must be zero
+	__inline static void or_bits_atomic(util::Vector<uint64_t, AT> &bits, const uint64_t start, const int width, const uint64_t value) {
+		const uint64_t start_word = start / 64;
+		const uint64_t end_word = (start + width - 1) / 64;
+		const uint64_t start_bit = start % 64;
+
+		__atomic_fetch_or(&bits[start_word], value << start_bit, __ATOMIC_RELAXED);
+		if (start_word != end_word) __atomic_fetch_or(&bits[end_word], value >> (64 - start_bit), __ATOMIC_RELAXED);
+	}
+
   public:
-	/** Creates a new instance using a given bit vector.
-	 *
-	 * Note that the bit vector is read only at construction time.
+	/** A builder accepting the positions of the ones one at a time, in increasing order.
 	 *
-	 * @param bits a bit vector of 64-bit words.
-	 * @param num_bits the length (in bits) of the bit vector.
+	 * The number of ones and the length of the bit vector must be known in advance: the lower
+	 * and upper bits are then written directly into their final storage, and no further memory is
+	 * needed, so that an instance can be built from a stream of positions.
 	 */
-	EliasFano(const uint64_t *const bits, const uint64_t num_bits) {
-		const uint64_t num_words = (num_bits + 63) / 64;
-		uint64_t m = 0;
-		for (uint64_t i = num_words; i-- != 0;) m += __builtin_popcountll(bits[i]);
-		num_ones = m;
-		this->num_bits = num_bits;
-		l = num_ones == 0 ? 0 : max(0, lambda_safe(num_bits / num_ones));
+	class Builder {
+		friend class EliasFano;
+		util::Vector<uint64_t, AT> lower_bits, upper_bits;
+		uint64_t num_ones, num_bits, count = 0, last = 0;
+		int l;
+
+		// Sets, using atomic operations, the lower and upper bits of the one of given rank and position
+		void set_atomic(const uint64_t rank, const uint64_t pos) {
+			if (l != 0) or_bits_atomic(lower_bits, rank * l, l, pos & ((1ULL << l) - 1));
+			or_bits_atomic(upper_bits, (pos >> l) + rank, 1, 1);
+		}
+
+	  public:
+		/** Creates a new builder.
+		 *
+		 * @param num_ones the number of ones that will be pushed.
+		 * @param num_bits the length (in bits) of the bit vector, that is, an upper bound on the positions.
+		 */
+		Builder(const uint64_t num_ones, const uint64_t num_bits) : num_ones(num_ones), num_bits(num_bits) {
+			l = num_ones == 0 ? 0 : max(0, lambda_safe(num_bits / num_ones));
 
 #ifdef DEBUG
-		printf("Number of ones: %lld l: %d\n", num_ones, l);
-		printf("Upper bits: %lld\n", num_ones + (num_bits >> l) + 1);
-		printf("Lower bits: %lld\n", num_ones * l);
+			printf("Number of ones: %lld l: %d\n", num_ones, l);
+			printf("Upper bits: %lld\n", num_ones + (num_bits >> l) + 1);
+			printf("Lower bits: %lld\n", num_ones * l);
 #endif
 
-		const uint64_t lower_bits_mask = (1ULL << l) - 1;
-
-		lower_bits.size((num_ones * l + 63) / 64 + 2 * (l == 0));
-		upper_bits.size(((num_ones + (num_bits >> l) + 1) + 63) / 64);
+			lower_bits.size((num_ones * l + 63) / 64 + 2 * (l == 0));
+			upper_bits.size(((num_ones + (num_bits >> l) + 1) + 63) / 64);
+		}
 
-		uint64_t pos = 0;
-		for (uint64_t i = 0; i < num_bits; i++) {
-			if (bits[i / 64] & (1ULL << i % 64)) {
-				if (l != 0) set_bits(lower_bits, pos * l, l, i & lower_bits_mask);
-				set(upper_bits, (i >> l) + pos);
-				pos++;
+		/** Adds the position of the next one.
+		 *
+		 * @param pos a position smaller than the length of the bit vector, and not smaller than the previous one.
+		 */
+		void push(const uint64_t pos) {
+			assert(count < num_ones);
+			assert(pos >= last && pos < num_bits);
+			if (l != 0) {
+				const uint64_t start = count * l, lower = pos & ((1ULL << l) - 1);
+				lower_bits[start / 64] |= lower << start % 64;
+				if (start % 64 + l > 64) lower_bits[start / 64 + 1] |= lower >> (64 - start % 64);
 			}
+			set(upper_bits, (pos >> l) + count);
+			last = pos;
+			count++;
+		}
+
+		/** Builds an instance containing the positions pushed so far, which must be as many as the
+		 * number of ones specified at construction time; the builder cannot be used afterwards.
+		 *
+		 * @param num_threads the number of threads used to build the select structures.
+		 */
+		EliasFano build(const size_t num_threads = 1) {
+			assert(count == num_ones);
+			return EliasFano(std::move(*this), num_threads);
+		}
+	};
+
+  private:
+	// Returns a builder containing the ones of a bit vector, scanning a word at a time
+	static Builder scan(const uint64_t *const bits, const uint64_t num_bits, const size_t num_threads) {
+		const uint64_t num_words = (num_bits + 63) / 64;
+		Builder builder(popcount_words(bits, num_words), num_bits);
+
+		if (num_threads > 1) {
+			// Threads may share the words at the borders of their ranges, so bits are set atomically
+			parallel_word_ranges(bits, num_words, num_threads, 1, [&](const uint64_t begin, const uint64_t end, uint64_t rank) {
+				for (uint64_t i = begin; i < end; i++)
+					for (uint64_t w = bits[i]; w != 0; w &= w - 1) builder.set_atomic(rank++, i * 64 + __builtin_ctzll(w));
+			});
+			builder.count = builder.num_ones;
+		} else {
+			for (uint64_t i = 0; i < num_words; i++)
+				for (uint64_t w = bits[i]; w != 0; w &= w - 1) builder.push(i * 64 + __builtin_ctzll(w));
 		}
 
+		return builder;
+	}
+
+	static Builder scan(const std::vector<uint64_t> &ones, const uint64_t num_bits) {
+		Builder builder(ones.size(), num_bits);
+		for (const uint64_t pos : ones) builder.push(pos);
+		return builder;
+	}
+
+	EliasFano(Builder &&builder, const size_t num_threads) : lower_bits(std::move(builder.lower_bits)), upper_bits(std::move(builder.upper_bits)) {
+		num_ones = builder.num_ones;
+		num_bits = builder.num_bits;
+		l = builder.l;
+		init(num_threads);
+	}
+
+	// Builds the select structure on the upper bits and the constants used by queries
+	void init(const size_t num_threads) {
 #ifdef DEBUG
-		// printf("First lower: %016llx %016llx %016llx %016llx\n", lower_bits[0], lower_bits[1],
-		//       lower_bits[2], lower_bits[3]);
-		// printf("First upper: %016llx %016llx %016llx %016llx\n", upper_bits[0], upper_bits[1],
-		//       upper_bits[2], upper_bits[3]);
+		printf("First lower: %016llx %016llx %016llx %016llx\n", lower_bits[0], lower_bits[1], lower_bits[2], lower_bits[3]);
+		printf("First upper: %016llx %016llx %016llx %016llx\n", upper_bits[0], upper_bits[1], upper_bits[2], upper_bits[3]);
 #endif
 
-		select_upper = SimpleSelectHalf(&upper_bits, num_ones + (num_bits >> l));
-		selectz_upper = SimpleSelectZeroHalf(&upper_bits, num_ones + (num_bits >> l));
+		select_upper = SimpleSelectBoth(&upper_bits, num_ones + (num_bits >> l) + 1, num_threads);
 
 		block_size = 0;
 		do
@@ -162,6 +243,39 @@ template <util::AllocType AT = util::AllocType::MALLOC> class EliasFano : public
 		lower_l_bits_mask = (1ULL << l) - 1;
 	}
 
+	// Whether the header fields are consistent with the sizes of the lower and upper bits
+	bool valid() const {
+		return l == (num_ones == 0 ? 0 : max(0, lambda_safe(num_bits / num_ones))) && lower_bits.size() == (num_ones * l + 63) / 64 + 2 * (l == 0) &&
+			   upper_bits.size() == (num_ones + (num_bits >> l) + 1 + 63) / 64;
+	}
+
+	// The select structure on the upper bits is not serialized, as it is rebuilt quickly
+	friend std::ostream &operator<<(std::ostream &os, const EliasFano &ef) {
+		serialization::writeHeader(os, serialization::tag("EliasFan"), {}, {ef.num_bits, ef.num_ones, uint64_t(ef.l)});
+		return os << ef.lower_bits << ef.upper_bits;
+	}
+
+	friend std::istream &operator>>(std::istream &is, EliasFano &ef) {
+		uint64_t l;
+		if (!serialization::readHeader(is, serialization::tag("EliasFan"), {}, {&ef.num_bits, &ef.num_ones, &l})) return is;
+		ef.l = l;
+		is >> ef.lower_bits >> ef.upper_bits;
+		if (is && !ef.valid()) is.setstate(std::ios::failbit);
+		if (is) ef.init(1);
+		return is;
+	}
+
+  public:
+	/** Creates a new instance using a given bit vector.
+	 *
+	 * Note that the bit vector is read only at construction time.
+	 *
+	 * @param bits a bit vector of 64-bit words whose bits past `num_bits` are zero.
+	 * @param num_bits the length (in bits) of the bit vector.
+	 * @param num_threads the number of threads used to build the structure.
+	 */
+	EliasFano(const uint64_t *const bits, const uint64_t num_bits, const size_t num_threads = 1) : EliasFano(scan(bits, num_bits, num_threads), num_threads) {}
+
 	/** Creates a new instance using an
 	 *  explicit list of positions for the ones in a bit vector.
 	 *
@@ -170,62 +284,35 @@ template <util::AllocType AT = util::AllocType::MALLOC> class EliasFano : public
 	 *  In practice this constructor builds an Elias-Fano
 	 *  representation of the given list. select(const uint64_t rank) will retrieve
 	 *  an element of the list, and rank(const size_t pos) will return how many
-	 *  element of the list are smaller than the argument.
+	 *  element of the list are smaller than the argument. To avoid storing the
+	 *  list in memory, use a Builder.
 	 *
 	 * @param ones a list of positions of the ones in a bit vector.
 	 * @param num_bits the length (in bits) of the bit vector.
 	 */
-	EliasFano(const std::vector<uint64_t> ones, const uint64_t num_bits) {
-		num_ones = ones.size();
-		this->num_bits = num_bits;
-		l = num_ones == 0 ? 0 : max(0, lambda_safe(num_bits / num_ones));
-
-#ifdef DEBUG
-		printf("Number of ones: %lld l: %d\n", num_ones, l);
-		printf("Upper bits: %lld\n", num_ones + (num_bits >> l) + 1);
-		printf("Lower bits: %lld\n", num_ones * l);
-#endif
-
-		const uint64_t lower_bits_mask = (1ULL << l) - 1;
+	EliasFano(const std::vector<uint64_t> &ones, const uint64_t num_bits) : EliasFano(scan(ones, num_bits), 1) {}
 
-		lower_bits = new uint64_t[(num_ones * l + 63) / 64 + 2 * (l == 0)];
-		upper_bits = new uint64_t[((num_ones + (num_bits >> l) + 1) + 63) / 64]();
-
-		for (uint64_t i = 0; i < num_ones; i++) {
-			if (l != 0) set_bits(lower_bits, i * l, l, ones[i] & lower_bits_mask);
-			set(upper_bits, (ones[i] >> l) + i);
-		}
-
-#ifdef DEBUG
-		printf("First lower: %016llx %016llx %016llx %016llx\n", lower_bits[0], lower_bits[1], lower_bits[2], lower_bits[3]);
-		printf("First upper: %016llx %016llx %016llx %016llx\n", upper_bits[0], upper_bits[1], upper_bits[2], upper_bits[3]);
-#endif
+	/** Creates an empty instance, which can be filled using operator>>() or view(). */
+	EliasFano() : num_bits(0), num_ones(0), l(0) {}
 
-		select_upper = SimpleSelectHalf(upper_bits, num_ones + (num_bits >> l));
-		selectz_upper = SimpleSelectZeroHalf(upper_bits, num_ones + (num_bits >> l));
-
-		block_size = 0;
-		do
-			++block_size;
-		while (block_size * l + block_size <= 64 && block_size <= l);
-		block_size--;
-
-#ifdef DEBUG
-		printf("Block size: %d\n", block_size);
-#endif
-		block_size_mask = (1ULL << block_size) - 1;
-		block_length = block_size * l;
-
-#ifdef PARSEARCH
-		ones_step_l = 0;
-		for (int i = 0; i < block_size; i++) ones_step_l |= 1ULL << i * l;
-		msbs_step_l = ones_step_l << (l - 1);
-
-		compressor = 0;
-		for (int i = 0; i < block_size; i++) compressor |= 1ULL << ((l - 1) * i + block_size);
-#endif
-
-		lower_l_bits_mask = (1ULL << l) - 1;
+	/** Makes this instance a read-only view of an instance serialized by operator<<().
+	 *
+	 * The select structure on the upper bits is rebuilt in memory.
+	 *
+	 * @param p a pointer to the serialized instance, aligned to 8 bytes, or `nullptr`.
+	 * @param end a pointer to the end of the available data.
+	 * @param check whether to verify the checksums of the data.
+	 * @return a pointer just after the serialized instance, or `nullptr` if `p` is `nullptr`
+	 * or the data is not valid.
+	 */
+	const char *view(const char *p, const char *end, const bool check = false) {
+		uint64_t l = 0;
+		p = serialization::viewHeader(p, end, serialization::tag("EliasFan"), {}, {&num_bits, &num_ones, &l});
+		this->l = l;
+		p = upper_bits.view(lower_bits.view(p, end, check), end, check);
+		if (p == nullptr || !valid()) return nullptr;
+		init(1);
+		return p;
 	}
 
 	uint64_t rank(const size_t k) {
@@ -237,7 +324,7 @@ template <util::AllocType AT = util::AllocType::MALLOC> class EliasFano : public
 		const uint64_t k_shiftr_l = k >> l;
 
 #ifndef PARSEARCH
-		int64_t pos = selectz_upper.selectZero(k_shiftr_l);
+		int64_t pos = select_upper.selectZero(k_shiftr_l);
 		uint64_t rank = pos - (k_shiftr_l);
 
 #ifdef DEBUG
@@ -263,7 +350,7 @@ template <util::AllocType AT = util::AllocType::MALLOC> class EliasFano : public
 
 		const uint64_t k_lower_bits_step_l = k_lower_bits * ones_step_l;
 
-		uint64_t pos = selectz_upper.selectZero(k_shiftr_l);
+		uint64_t pos = select_upper.selectZero(k_shiftr_l);
 		uint64_t rank = pos - (k_shiftr_l);
 		uint64_t rank_times_l = rank * l;
 
@@ -320,6 +407,13 @@ template <util::AllocType AT = util::AllocType::MALLOC> class EliasFano : public
 #endif
 	}
 
+	/** The counters recorded by the instrumentation policy, whose names are in COUNTER_NAMES. */
+	enum Counter { SCANNED_WORDS };
+	static constexpr const char *COUNTER_NAMES[] = {"scanned_words"};
+
+	/** Returns the instrumentation policy of this instance, from which counters can be read. */
+	const INSTR &instrumentation() const { return instr; }
+
 	size_t select(const uint64_t rank) {
 #ifdef DEBUG
 		printf("Selecting %lld...\n", rank);
@@ -328,7 +422,9 @@ template <util::AllocType AT = util::AllocType::MALLOC> class EliasFano : public
 		printf("Returning %lld = %llx << %d | %llx\n", (select_upper.select(rank) - rank) << l | get_bits(lower_bits, rank * l, l), select_upper.select(rank) - rank, l,
 			   get_bits(lower_bits, rank * l, l));
 #endif
-		return (select_upper.select(rank) - rank) << l | get_bits(lower_bits, rank * l, l);
+		const size_t pos = (select_upper.select(rank) - rank) << l | get_bits(lower_bits, rank * l, l);
+		if (instr.sample()) instr.record(SCANNED_WORDS, select_upper.scannedWords(rank));
+		return pos;
 	}
 
 	uint64_t select(const uint64_t rank, uint64_t *const next) {
@@ -341,13 +437,127 @@ template <util::AllocType AT = util::AllocType::MALLOC> class EliasFano : public
 		return s << l | get_bits(lower_bits, position, l);
 	}
 
+	void rank(const size_t *pos, uint64_t *out, const size_t n) {
+		batch_pipeline(
+			n,
+			[&](const size_t i) {
+				if (num_ones != 0 && pos[i] < num_bits) select_upper.prefetchInventoryZero(pos[i] >> l);
+			},
+			[&](const size_t i) {
+				if (num_ones != 0 && pos[i] < num_bits) select_upper.prefetchBitsZero(pos[i] >> l);
+			},
+			[&](const size_t i) { out[i] = rank(pos[i]); });
+	}
+
+	void select(const uint64_t *rank, size_t *out, const size_t n) {
+		batch_pipeline(
+			n,
+			[&](const size_t i) {
+				select_upper.prefetchInventory(rank[i]);
+				__builtin_prefetch(&lower_bits + rank[i] * l / 64);
+			},
+			[&](const size_t i) { select_upper.prefetchBits(rank[i]); }, [&](const size_t i) { out[i] = select(rank[i]); });
+	}
+
+	/** A forward iterator over the elements of an EliasFano instance, that is, the positions of its ones.
+	 *
+	 * The upper bits are decoded word by word, so advancing the iterator costs a few
+	 * cycles, rather than a full call to select(const uint64_t).
+	 */
+	class Iterator {
+		const EliasFano *ef;
+		uint64_t curr_index;
+		uint64_t word_index;
+		uint64_t window;
+		uint64_t value;
+
+		void decode() {
+			while (window == 0) window = ef->upper_bits[++word_index];
+			const uint64_t pos = word_index * 64 + rho(window);
+			window = clear_rho(window);
+			value = (pos - curr_index) << ef->l | get_bits(ef->lower_bits, curr_index * ef->l, ef->l);
+		}
+
+	  public:
+		using value_type = uint64_t;
+		using difference_type = ptrdiff_t;
+		using pointer = const uint64_t *;
+		using reference = const uint64_t &;
+		using iterator_category = forward_iterator_tag;
+
+		/** Creates an iterator positioned on the element of given rank.
+		 *
+		 * @param ef an EliasFano instance.
+		 * @param rank the rank of the first element returned; if it is at least the number of ones,
+		 * the iterator will be equal to the end iterator.
+		 */
+		Iterator(const EliasFano *ef, const uint64_t rank) : ef(ef), curr_index(std::min(rank, ef->num_ones)) {
+			if (curr_index == ef->num_ones) return;
+			const uint64_t pos = ef->select_upper.select(curr_index);
+			word_index = pos / 64;
+			window = ef->upper_bits[word_index] & -1ULL << pos % 64;
+			decode();
+		}
+
+		/** Returns the current element. */
+		uint64_t operator*() const { return value; }
+		const uint64_t *operator->() const { return &value; }
+
+		/** Returns the rank of the current element. */
+		uint64_t index() const { return curr_index; }
+
+		Iterator &operator++() {
+			if (++curr_index < ef->num_ones) decode();
+			return *this;
+		}
+
+		Iterator operator++(int) {
+			Iterator result = *this;
+			++*this;
+			return result;
+		}
+
+		bool operator==(const Iterator &other) const { return curr_index == other.curr_index; }
+		bool operator!=(const Iterator &other) const { return !(*this == other); }
+	};
+
+	/** Returns an iterator positioned on the first element. */
+	Iterator begin() const { return Iterator(this, 0); }
+
+	/** Returns an iterator positioned past the last element. */
+	Iterator end() const { return Iterator(this, num_ones); }
+
+	/** Returns an iterator positioned on the element of given rank.
+	 *
+	 * @param rank the rank of an element, or the number of ones for the end iterator.
+	 */
+	Iterator iterator(const uint64_t rank) const { return Iterator(this, rank); }
+
+	/** Returns an iterator positioned on the smallest element greater than or equal to a given bound.
+	 *
+	 * The upper bits of the bound are located using a selection on zeros, and the
+	 * few elements sharing them are then scanned linearly.
+	 *
+	 * @param x a bound.
+	 * @return an iterator positioned on the smallest element greater than or equal to `x`, or end()
+	 * if there is no such element.
+	 */
+	Iterator next_geq(const uint64_t x) const {
+		if (x >= num_bits) return end();
+		const uint64_t x_shiftr_l = x >> l;
+		// The elements with upper bits smaller than those of x precede the zero of rank x_shiftr_l - 1
+		const uint64_t rank = x_shiftr_l == 0 ? 0 : select_upper.selectZero(x_shiftr_l - 1) - (x_shiftr_l - 1);
+		Iterator it(this, rank);
+		while (it.index() < num_ones && *it < x) ++it;
+		return it;
+	}
+
 	/** Returns the size in bits of the underlying bit vector. */
 	size_t size() const { return num_bits; }
 
 	/** Returns an estimate of the size in bits of this structure. */
 	uint64_t bitCount() {
-		return upper_bits.bitCount() - sizeof(upper_bits) * 8 + lower_bits.bitCount() - sizeof(lower_bits) * 8 + select_upper.bitCount() - sizeof(select_upper) * 8 + selectz_upper.bitCount() -
-			   sizeof(selectz_upper) * 8 + sizeof(*this) * 8;
+		return upper_bits.bitCount() - sizeof(upper_bits) * 8 + lower_bits.bitCount() - sizeof(lower_bits) * 8 + select_upper.bitCount() - sizeof(select_upper) * 8 + sizeof(*this) * 8;
 	}
 };
 
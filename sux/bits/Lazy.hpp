@@ -0,0 +1,91 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2007-2020 Sebastiano Vigna
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <optional>
+
+namespace sux::bits {
+
+using namespace std;
+
+/** A wrapper deferring the construction of a rank/select structure to its first query.
+ *
+ * The constructor of this class just records its arguments, which will be passed to the
+ * constructor of the wrapped structure when a query is first issued (or when get() is first
+ * called), so that startup time is not spent building structures that might never be used.
+ * Construction happens exactly once even if the first queries are issued concurrently.
+ *
+ * All query methods of the wrapped structure are forwarded, so, for example,
+ * `Lazy<Rank9Sel<>>` provides `rank()` and `select()` like `Rank9Sel`.
+ *
+ * Note that the arguments are copied, so a bit vector is referenced by pointer: it must
+ * remain available (and unchanged) until the structure is built, even when the wrapped
+ * structure, like EliasFano, does not need it afterwards.
+ *
+ * @tparam T the type of the wrapped structure.
+ */
+
+template <typename T> class Lazy {
+  private:
+	function<void(optional<T> &)> build;
+	once_flag built;
+	optional<T> index;
+
+  public:
+	/** Creates a new instance recording the arguments for the constructor of the wrapped structure.
+	 *
+	 * @param args the arguments for the constructor of `T` (e.g., a bit vector, its length
+	 * in bits and a number of threads).
+	 */
+	template <typename... Args> explicit Lazy(Args... args) : build([=](optional<T> &index) { index.emplace(args...); }) {}
+
+	Lazy(const Lazy &) = delete;
+	Lazy &operator=(const Lazy &) = delete;
+
+	/** Returns the wrapped structure, building it if necessary. */
+	T &get() {
+		call_once(built, [&] { build(index); });
+		return *index;
+	}
+
+	template <typename... A> auto rank(A... a) { return get().rank(a...); }
+	template <typename... A> auto rankZero(A... a) { return get().rankZero(a...); }
+	template <typename... A> auto select(A... a) { return get().select(a...); }
+	template <typename... A> auto selectZero(A... a) { return get().selectZero(a...); }
+
+	/** Returns the size in bits of the underlying bit vector. */
+	size_t size() { return get().size(); }
+
+	/** Returns an estimate of the size in bits of the wrapped structure, building it if necessary. */
+	size_t bitCount() { return get().bitCount(); }
+};
+
+} // namespace sux::bits
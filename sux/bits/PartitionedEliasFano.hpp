@@ -0,0 +1,193 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2007-2020 Sebastiano Vigna
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../support/common.hpp"
+#include "../util/Vector.hpp"
+#include "EliasFano.hpp"
+#include "Rank.hpp"
+#include "Rank9Sel.hpp"
+#include "Select.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace sux::bits {
+
+using namespace std;
+using namespace sux;
+
+/** A partitioned Elias-Fano representation of monotone sequences, providing ranking and selection.
+ *
+ * The positions of the ones are split into chunks containing the same number of elements. Each chunk
+ * is represented relatively to its first element, either by an EliasFano instance, which picks the
+ * number of lower bits best suited to the chunk, or, when the chunk is dense, by a plain bit
+ * vector with a Rank9Sel structure. The first elements of the chunks are in turn represented
+ * by an EliasFano instance. On clustered sequences, this representation is significantly
+ * smaller than a single EliasFano instance, at the cost of an additional selection on the
+ * chunk endpoints per query.
+ *
+ * Instances of this class can be built using a bit vector or an explicit list of
+ * positions for the ones in a vector. In every case, the bit vector or the list
+ * are not necessary after construction.
+ *
+ * @tparam AT a type of memory allocation out of sux::util::AllocType.
+ */
+
+template <util::AllocType AT = util::AllocType::MALLOC> class PartitionedEliasFano : public Rank, public Select {
+  private:
+	struct Chunk {
+		unique_ptr<EliasFano<AT>> sparse;
+		util::Vector<uint64_t, AT> bits;
+		unique_ptr<Rank9Sel<AT>> dense;
+	};
+
+	uint64_t num_bits, num_ones;
+	int log2_chunk_size;
+	uint64_t chunk_mask;
+	vector<Chunk> chunks;
+	unique_ptr<EliasFano<AT>> firsts;
+
+	// Encodes the given elements, in the interval [elements[0]..end), as a new chunk
+	void addChunk(const vector<uint64_t> &elements, const uint64_t end) {
+		const uint64_t first = elements[0], universe = end - first;
+		vector<uint64_t> local(elements.size());
+		for (size_t i = 0; i < elements.size(); i++) local[i] = elements[i] - first;
+
+		Chunk chunk;
+		chunk.sparse = make_unique<EliasFano<AT>>(local, universe);
+		// The Rank9 counts alone take a quarter of the bit vector
+		if (universe + universe / 4 < chunk.sparse->bitCount()) {
+			chunk.bits.size(universe / 64 + 1);
+			for (const auto x : local) chunk.bits[x / 64] |= UINT64_C(1) << x % 64;
+			chunk.dense = make_unique<Rank9Sel<AT>>(&chunk.bits, universe);
+			if (chunk.dense->bitCount() + chunk.bits.bitCount() < chunk.sparse->bitCount())
+				chunk.sparse.reset();
+			else {
+				chunk.dense.reset();
+				chunk.bits = util::Vector<uint64_t, AT>();
+			}
+		}
+		chunks.push_back(std::move(chunk));
+	}
+
+	void build(const uint64_t *const bits, const vector<uint64_t> *const ones) {
+		const uint64_t chunk_size = UINT64_C(1) << log2_chunk_size;
+		vector<uint64_t> elements, first_elements;
+		elements.reserve(chunk_size);
+
+		auto add = [&](const uint64_t x) {
+			if (elements.size() == chunk_size) {
+				addChunk(elements, x);
+				elements.clear();
+			}
+			if (elements.empty()) first_elements.push_back(x);
+			elements.push_back(x);
+		};
+
+		if (ones != nullptr) {
+			for (const auto x : *ones) add(x);
+		} else {
+			for (uint64_t i = 0; i < (num_bits + 63) / 64; i++)
+				for (uint64_t word = bits[i]; word != 0; word = clear_rho(word)) add(i * 64 + rho(word));
+		}
+
+		num_ones = (first_elements.size() == 0 ? 0 : (first_elements.size() - 1) << log2_chunk_size) + elements.size();
+		if (!elements.empty()) addChunk(elements, num_bits);
+		firsts = make_unique<EliasFano<AT>>(first_elements, num_bits);
+	}
+
+  public:
+	/** Creates a new instance using a given bit vector.
+	 *
+	 * Note that the bit vector is read only at construction time.
+	 *
+	 * @param bits a bit vector of 64-bit words.
+	 * @param num_bits the length (in bits) of the bit vector.
+	 * @param log2_chunk_size the base-2 logarithm of the number of elements in a chunk: a smaller
+	 * value adapts better to local variations of density, but increases the fixed overhead of chunks.
+	 */
+	PartitionedEliasFano(const uint64_t *const bits, const uint64_t num_bits, const int log2_chunk_size = 12)
+		: num_bits(num_bits), log2_chunk_size(log2_chunk_size), chunk_mask((UINT64_C(1) << log2_chunk_size) - 1) {
+		build(bits, nullptr);
+	}
+
+	/** Creates a new instance using an explicit list of positions for the ones in a bit vector.
+	 *
+	 * Note that the list is read only at construction time.
+	 *
+	 * @param ones a list of increasing positions of the ones in a bit vector.
+	 * @param num_bits the length (in bits) of the bit vector.
+	 * @param log2_chunk_size the base-2 logarithm of the number of elements in a chunk: a smaller
+	 * value adapts better to local variations of density, but increases the fixed overhead of chunks.
+	 */
+	PartitionedEliasFano(const std::vector<uint64_t> &ones, const uint64_t num_bits, const int log2_chunk_size = 12)
+		: num_bits(num_bits), log2_chunk_size(log2_chunk_size), chunk_mask((UINT64_C(1) << log2_chunk_size) - 1) {
+		build(nullptr, &ones);
+	}
+
+	uint64_t rank(const size_t k) {
+		if (num_ones == 0) return 0;
+		if (k >= num_bits) return num_ones;
+		// Number of chunks whose first element is at most k
+		const uint64_t c = firsts->rank(k + 1);
+		if (c == 0) return 0;
+		const uint64_t first = firsts->select(c - 1);
+		Chunk &chunk = chunks[c - 1];
+		return ((c - 1) << log2_chunk_size) + (chunk.dense ? chunk.dense->rank(k - first) : chunk.sparse->rank(k - first));
+	}
+
+	size_t select(const uint64_t rank) {
+		const uint64_t c = rank >> log2_chunk_size;
+		Chunk &chunk = chunks[c];
+		return firsts->select(c) + (chunk.dense ? chunk.dense->select(rank & chunk_mask) : chunk.sparse->select(rank & chunk_mask));
+	}
+
+	/** Returns the number of chunks represented by a plain bit vector. */
+	size_t denseChunks() const {
+		size_t dense = 0;
+		for (const auto &chunk : chunks) dense += chunk.dense != nullptr;
+		return dense;
+	}
+
+	/** Returns the number of chunks. */
+	size_t numChunks() const { return chunks.size(); }
+
+	/** Returns the size in bits of the underlying bit vector. */
+	size_t size() const { return num_bits; }
+
+	/** Returns an estimate of the size in bits of this structure. */
+	uint64_t bitCount() {
+		uint64_t bits = firsts->bitCount() + chunks.capacity() * sizeof(Chunk) * 8 + sizeof(*this) * 8;
+		for (auto &chunk : chunks) bits += chunk.dense ? chunk.dense->bitCount() + chunk.bits.bitCount() - sizeof(chunk.bits) * 8 : chunk.sparse->bitCount();
+		return bits;
+	}
+};
+
+} // namespace sux::bits
@@ -0,0 +1,279 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2007-2020 Sebastiano Vigna
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../support/common.hpp"
+#include "../util/Vector.hpp"
+#include "Rank.hpp"
+#include "Select.hpp"
+#include "SelectZero.hpp"
+#include <cstdint>
+
+namespace sux::bits {
+
+using namespace sux;
+
+/** A compressed bit vector in the style of Raman, Raman and Rao, with ranking and selection.
+ *
+ * The bit vector is divided into blocks of 63 bits. Each block is stored as its _class_, that is,
+ * its number of ones, in 6 bits, followed by its _offset_, that is, its index among the blocks of
+ * the same class, in &lceil;log<sub>2</sub> <i>C</i>(63, <i>class</i>)&rceil; bits (blocks made
+ * only of zeros or ones need no offset). Every 32 blocks a superblock records the number of ones
+ * before it and the position of its first offset; ranking scans the classes of at most 31 blocks
+ * and decodes the offset of a single block.
+ *
+ * Selection of ones (zeros) uses an inventory recording the superblock of every 4096th one (zero),
+ * and a binary search on the superblocks between two consecutive inventory entries.
+ *
+ * The space used is close to the empirical entropy of the bit vector, which makes this structure
+ * suitable for bit vectors of intermediate density, or with a skewed distribution of ones, for which
+ * Rank9Sel wastes space and EliasFano is not effective. Queries are slower than those of Rank9Sel.
+ *
+ * Note that the bit vector is read only at construction time.
+ *
+ * @tparam AT a type of memory allocation out of sux::util::AllocType.
+ */
+
+template <util::AllocType AT = util::AllocType::MALLOC> class RRR : public Rank, public Select, public SelectZero {
+  private:
+	static constexpr int block_size = 63;
+	static constexpr int log2_blocks_per_superblock = 5;
+	static constexpr int blocks_per_superblock = 1 << log2_blocks_per_superblock;
+	static constexpr int classes_per_word = 10;
+	static constexpr int log2_ones_per_inventory = 12;
+
+	// Binomial coefficients C(n, k) for n, k < 64
+	struct Binomials {
+		uint64_t c[64][64];
+		uint8_t width[64];
+
+		constexpr Binomials() : c(), width() {
+			for (int n = 0; n < 64; n++) {
+				c[n][0] = 1;
+				for (int k = 1; k <= n; k++) c[n][k] = c[n - 1][k - 1] + c[n - 1][k];
+			}
+			for (int k = 0; k <= block_size; k++) {
+				// ceil(log2(C(63, k)))
+				uint64_t x = c[block_size][k] - 1;
+				while (x != 0) {
+					width[k]++;
+					x >>= 1;
+				}
+			}
+		}
+	};
+
+	static constexpr Binomials binomials{};
+
+	size_t num_bits, num_ones, num_blocks, num_superblocks;
+	// The classes of the blocks, ten per word
+	util::Vector<uint64_t, AT> classes;
+	util::Vector<uint64_t, AT> offsets;
+	// For each superblock, the number of ones before it and the position of its first offset
+	util::Vector<uint64_t, AT> superblocks;
+	util::Vector<uint64_t, AT> inventory, inventory_zero;
+
+	int get_class(const uint64_t block) const { return classes[block / classes_per_word] >> (block % classes_per_word) * 6 & 0x3F; }
+
+	// Reads width <= 64 bits starting at a given position
+	static uint64_t get_bits(const uint64_t *const bits, const uint64_t start, const int width) {
+		if (width == 0) return 0;
+		const uint64_t start_word = start / 64, start_bit = start % 64;
+		uint64_t result = bits[start_word] >> start_bit;
+		if (start_bit + width > 64) result |= bits[start_word + 1] << (64 - start_bit);
+		return width == 64 ? result : result & ((UINT64_C(1) << width) - 1);
+	}
+
+	// Writes width < 64 bits starting at a given position, which must be zero
+	static void set_bits(uint64_t *const bits, const uint64_t start, const int width, const uint64_t value) {
+		if (width == 0) return;
+		const uint64_t start_word = start / 64, start_bit = start % 64;
+		bits[start_word] |= value << start_bit;
+		if (start_bit + width > 64) bits[start_word + 1] |= value >> (64 - start_bit);
+	}
+
+	// Returns the offset of a block of given class
+	static uint64_t encode(uint64_t block, int k) {
+		uint64_t offset = 0;
+		while (block != 0) {
+			const int p = lambda(block);
+			offset += binomials.c[p][k--];
+			block ^= UINT64_C(1) << p;
+		}
+		return offset;
+	}
+
+	// Returns the block of given class and offset
+	static uint64_t decode(uint64_t offset, int k) {
+		if (k == block_size) return (UINT64_C(1) << block_size) - 1;
+		uint64_t block = 0;
+		for (int p = block_size; k != 0 && p-- != 0;)
+			if (offset >= binomials.c[p][k]) {
+				offset -= binomials.c[p][k--];
+				block |= UINT64_C(1) << p;
+			}
+		return block;
+	}
+
+	uint64_t ones_before(const uint64_t superblock) const { return superblocks[superblock * 2]; }
+
+	uint64_t zeros_before(const uint64_t superblock) const { return min(superblock * blocks_per_superblock * block_size, (uint64_t)num_bits) - ones_before(superblock); }
+
+	// Returns the last superblock in [lo..hi] with at most rank ones (zeros) before it
+	template <bool ZERO> uint64_t find_superblock(const uint64_t rank, uint64_t lo, uint64_t hi) const {
+		while (lo < hi) {
+			const uint64_t mid = (lo + hi + 1) / 2;
+			if ((ZERO ? zeros_before(mid) : ones_before(mid)) <= rank)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+		return lo;
+	}
+
+	template <bool ZERO> size_t select_in(const uint64_t rank, const util::Vector<uint64_t, AT> &inventory) const {
+		const uint64_t superblock = find_superblock<ZERO>(rank, inventory[rank >> log2_ones_per_inventory], inventory[(rank >> log2_ones_per_inventory) + 1]);
+		uint64_t block = superblock * blocks_per_superblock, pos = superblocks[superblock * 2 + 1];
+		uint64_t r = ZERO ? zeros_before(superblock) : ones_before(superblock);
+
+		for (;; block++) {
+			const int k = get_class(block);
+			const uint64_t count = ZERO ? block_size - k : k;
+			if (rank < r + count) {
+				const uint64_t value = decode(get_bits(&offsets, pos, binomials.width[k]), k);
+				return block * block_size + select64(ZERO ? ~value : value, rank - r);
+			}
+			r += count;
+			pos += binomials.width[k];
+		}
+	}
+
+	// Fills an inventory with the superblocks of every 2^log2_ones_per_inventory-th one (zero)
+	template <bool ZERO> void fill_inventory(util::Vector<uint64_t, AT> &inventory, const uint64_t count) {
+		const uint64_t inventory_size = (count + (1 << log2_ones_per_inventory) - 1) >> log2_ones_per_inventory;
+		inventory.size(inventory_size + 1);
+		for (uint64_t s = 0, d = 0; d < count; d += 1 << log2_ones_per_inventory) {
+			while (s + 1 < num_superblocks && (ZERO ? zeros_before(s + 1) : ones_before(s + 1)) <= d) s++;
+			inventory[d >> log2_ones_per_inventory] = s;
+		}
+		inventory[inventory_size] = num_superblocks - 1;
+	}
+
+  public:
+	/** Creates a new instance using a given bit vector.
+	 *
+	 * @param bits a bit vector of 64-bit words.
+	 * @param num_bits the length (in bits) of the bit vector.
+	 */
+	RRR(const uint64_t *const bits, const uint64_t num_bits) : num_bits(num_bits) {
+		num_blocks = (num_bits + block_size - 1) / block_size;
+		num_superblocks = num_blocks / blocks_per_superblock + 1;
+		classes.size((num_blocks + classes_per_word - 1) / classes_per_word);
+		superblocks.size(num_superblocks * 2);
+
+		// First pass: classes and offset sizes
+		uint64_t offset_bits = 0;
+		num_ones = 0;
+		for (uint64_t block = 0; block < num_blocks; block++) {
+			if (block % blocks_per_superblock == 0) {
+				superblocks[block / blocks_per_superblock * 2] = num_ones;
+				superblocks[block / blocks_per_superblock * 2 + 1] = offset_bits;
+			}
+			const int width = min(uint64_t(block_size), num_bits - block * block_size);
+			const int k = __builtin_popcountll(get_bits(bits, block * block_size, width));
+			classes[block / classes_per_word] |= uint64_t(k) << (block % classes_per_word) * 6;
+			num_ones += k;
+			offset_bits += binomials.width[k];
+		}
+		if (num_blocks % blocks_per_superblock == 0) {
+			superblocks[num_blocks / blocks_per_superblock * 2] = num_ones;
+			superblocks[num_blocks / blocks_per_superblock * 2 + 1] = offset_bits;
+		}
+
+		// Second pass: offsets (plus a word, as get_bits() might read past the last offset)
+		offsets.size(offset_bits / 64 + 2);
+		for (uint64_t block = 0, pos = 0; block < num_blocks; block++) {
+			const int width = min(uint64_t(block_size), num_bits - block * block_size);
+			const int k = get_class(block);
+			set_bits(&offsets, pos, binomials.width[k], encode(get_bits(bits, block * block_size, width), k));
+			pos += binomials.width[k];
+		}
+
+		fill_inventory<false>(inventory, num_ones);
+		fill_inventory<true>(inventory_zero, num_bits - num_ones);
+	}
+
+	RRR() : num_bits(0), num_ones(0), num_blocks(0), num_superblocks(0) {}
+
+	uint64_t rank(const size_t pos) {
+		const uint64_t block = pos / block_size, superblock = block / blocks_per_superblock;
+		uint64_t r = ones_before(superblock), offset = superblocks[superblock * 2 + 1];
+		for (uint64_t b = superblock * blocks_per_superblock; b < block; b++) {
+			const int k = get_class(b);
+			r += k;
+			offset += binomials.width[k];
+		}
+		if (pos % block_size == 0) return r;
+		const int k = get_class(block);
+		if (k == 0) return r;
+		return r + __builtin_popcountll(decode(get_bits(&offsets, offset, binomials.width[k]), k) & ((UINT64_C(1) << pos % block_size) - 1));
+	}
+
+	void rank(const size_t *pos, uint64_t *out, const size_t n) {
+		batch_pipeline(
+			n,
+			[&](const size_t i) {
+				const uint64_t block = pos[i] / block_size;
+				__builtin_prefetch(&superblocks + block / blocks_per_superblock * 2);
+				__builtin_prefetch(&classes + block / classes_per_word);
+			},
+			[&](const size_t i) { __builtin_prefetch(&offsets + superblocks[pos[i] / block_size / blocks_per_superblock * 2 + 1] / 64); }, [&](const size_t i) { out[i] = rank(pos[i]); });
+	}
+
+	size_t select(const uint64_t rank) { return select_in<false>(rank, inventory); }
+
+	void select(const uint64_t *rank, size_t *out, const size_t n) {
+		batch_pipeline(
+			n, [&](const size_t i) { __builtin_prefetch(&inventory + (rank[i] >> log2_ones_per_inventory)); },
+			[&](const size_t i) { __builtin_prefetch(&superblocks + inventory[rank[i] >> log2_ones_per_inventory] * 2); }, [&](const size_t i) { out[i] = select(rank[i]); });
+	}
+
+	size_t selectZero(const uint64_t rank) { return select_in<true>(rank, inventory_zero); }
+
+	/** Returns an estimate of the size in bits of this structure. */
+	size_t bitCount() const {
+		return classes.bitCount() - sizeof(classes) * 8 + offsets.bitCount() - sizeof(offsets) * 8 + superblocks.bitCount() - sizeof(superblocks) * 8 + inventory.bitCount() - sizeof(inventory) * 8 +
+			   inventory_zero.bitCount() - sizeof(inventory_zero) * 8 + sizeof(*this) * 8;
+	}
+
+	/** Returns the size in bits of the underlying bit vector. */
+	size_t size() const { return num_bits; }
+};
+
+} // namespace sux::bits
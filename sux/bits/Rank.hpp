@@ -54,6 +54,19 @@ class Rank {
 	 */
 	virtual uint64_t rank(std::size_t pos) = 0;
 
+	/** Ranks a batch of positions.
+	 *
+	 * Implementations may interleave the queries and prefetch the data they need, so this
+	 * method is faster than a loop over rank(std::size_t) when the positions are known in advance.
+	 *
+	 * @param pos an array of `n` positions from 0 to size() (included).
+	 * @param out an array of `n` elements that will be filled with the ranks of the given positions.
+	 * @param n the number of positions.
+	 */
+	virtual void rank(const std::size_t *pos, uint64_t *out, std::size_t n) {
+		for (std::size_t i = 0; i < n; i++) out[i] = rank(pos[i]);
+	}
+
 	/** Returns the number of ones between two given positions.
 	 *
 	 * @param from A starting position from 0 to size() (included).
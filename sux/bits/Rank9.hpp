@@ -33,6 +33,7 @@
 #include "Rank.hpp"
 
 #include <cstdint>
+#include <iostream>
 
 namespace sux::bits {
 
@@ -44,6 +45,10 @@ using namespace sux;
  * The constructors of this class only store a reference
  * to a provided bit vector. Should the content of the
  * bit vector change, the results will be unpredictable.
+ * Alternatively, the bit vector can be moved into the
+ * instance as a util::Vector, which is then owned by the
+ * instance and serialized with it: an instance loaded
+ * with operator>>() or view() needs no other data.
  *
  * **Warning**: if you plan an calling rank(size_t) with
  * argument size(), you must have at least one additional
@@ -54,11 +59,90 @@ using namespace sux;
 
 template <util::AllocType AT = util::AllocType::MALLOC> class Rank9 : public Rank {
   protected:
-	const size_t num_bits;
+	size_t num_bits;
 	size_t num_ones;
 	const uint64_t *bits;
+	util::Vector<uint64_t, AT> owned_bits;
 	util::Vector<uint64_t, AT> counts;
 
+	// Builds the counts
+	void build(const size_t num_threads) {
+		const uint64_t num_words = (num_bits + 63) / 64;
+		const uint64_t num_counts = ((num_bits + 64 * 8 - 1) / (64 * 8)) * 2;
+
+		// Init rank structure
+		counts.size(num_counts + 2);
+
+		num_ones = 0;
+		parallel_word_ranges(bits, num_words, num_threads, 8, [&](const uint64_t begin, const uint64_t end, const uint64_t before) {
+			const uint64_t ones = fill_counts(begin, end, before);
+			if (end == num_words) num_ones = ones;
+		});
+
+		counts[num_counts] = num_ones;
+
+		assert(num_ones <= num_bits);
+	}
+
+	// Takes ownership of a bit vector, making room for the additional free bit needed by rank(size())
+	void own(util::Vector<uint64_t, AT> &&bits) {
+		owned_bits = std::move(bits);
+		if (owned_bits.size() < num_bits / 64 + 1) owned_bits.resize(num_bits / 64 + 1);
+		this->bits = &owned_bits;
+	}
+
+	// The bit vector is always serialized, and it is owned by loaded instances; the section of
+	// the counts follows it, so a view can read the word after the last one, as rank(size()) does
+	friend std::ostream &operator<<(std::ostream &os, const Rank9<AT> &rank9) {
+		serialization::writeHeader(os, serialization::tag("Rank9\0\0\0"), {}, {rank9.num_bits, rank9.num_ones});
+		serialization::writeSection(os, rank9.bits, (rank9.num_bits + 63) / 64);
+		return os << rank9.counts;
+	}
+
+	friend std::istream &operator>>(std::istream &is, Rank9<AT> &rank9) {
+		uint64_t words, sum;
+		if (!serialization::readHeader(is, serialization::tag("Rank9\0\0\0"), {}, {&rank9.num_bits, &rank9.num_ones})) return is;
+		if (!serialization::readSectionHeader(is, sizeof(uint64_t), words, sum)) return is;
+		if (words != (rank9.num_bits + 63) / 64) {
+			is.setstate(std::ios::failbit);
+			return is;
+		}
+		util::Vector<uint64_t, AT> bits(rank9.num_bits / 64 + 1);
+		if (!serialization::readSectionData(is, &bits, words, sum)) return is;
+		rank9.own(std::move(bits));
+		return is >> rank9.counts;
+	}
+
+	// Fills the counts of the blocks of words [begin..end), where begin is a multiple of 8, given the number of ones before begin;
+	// returns the number of ones up to end
+	uint64_t fill_counts(const uint64_t begin, const uint64_t end, uint64_t ones) {
+		uint64_t pos = begin / 4;
+#ifdef SUX_VPOPCNT
+		// The subcounts of a block are the inclusive prefix sums of the counts of its first seven words
+		const __m512i shifts = _mm512_setr_epi64(0, 9, 18, 27, 36, 45, 54, 0), zero = _mm512_setzero_si512();
+		for (uint64_t i = begin; i < end; i += 8, pos += 2) {
+			const __mmask8 valid = end - i >= 8 ? 0xFF : (1 << (end - i)) - 1;
+			const __m512i word_counts = _mm512_popcnt_epi64(_mm512_maskz_loadu_epi64(valid, bits + i));
+			__m512i prefix = _mm512_add_epi64(word_counts, _mm512_alignr_epi64(word_counts, zero, 7));
+			prefix = _mm512_add_epi64(prefix, _mm512_alignr_epi64(prefix, zero, 6));
+			prefix = _mm512_add_epi64(prefix, _mm512_alignr_epi64(prefix, zero, 4));
+			counts[pos] = ones;
+			counts[pos + 1] = _mm512_mask_reduce_or_epi64(0x7F, _mm512_sllv_epi64(prefix, shifts));
+			ones += _mm512_reduce_add_epi64(word_counts);
+		}
+#else
+		for (uint64_t i = begin; i < end; i += 8, pos += 2) {
+			counts[pos] = ones;
+			ones += __builtin_popcountll(bits[i]);
+			for (int j = 1; j < 8; j++) {
+				counts[pos + 1] |= (ones - counts[pos]) << 9 * (j - 1);
+				if (i + j < end) ones += __builtin_popcountll(bits[i + j]);
+			}
+		}
+#endif
+		return ones;
+	}
+
   public:
 	/** Creates a new instance using a given bit vector.
 	 *
@@ -72,31 +156,47 @@ template <util::AllocType AT = util::AllocType::MALLOC> class Rank9 : public Ran
 	 *
 	 * @param bits a bit vector of 64-bit words.
 	 * @param num_bits the length (in bits) of the bit vector.
+	 * @param num_threads the number of threads used to compute the counts.
 	 */
 
-	Rank9(const uint64_t *const bits, const uint64_t num_bits) : num_bits(num_bits), bits(bits) {
-		const uint64_t num_words = (num_bits + 63) / 64;
-		const uint64_t num_counts = ((num_bits + 64 * 8 - 1) / (64 * 8)) * 2;
+	Rank9(const uint64_t *const bits, const uint64_t num_bits, const size_t num_threads = 1) : num_bits(num_bits), bits(bits) { build(num_threads); }
 
-		// Init rank structure
-		counts.size(num_counts + 2);
-
-		num_ones = 0;
-		uint64_t pos = 0;
-		for (uint64_t i = 0; i < num_words; i += 8, pos += 2) {
-			counts[pos] = num_ones;
-			num_ones += __builtin_popcountll(bits[i]);
-			for (int j = 1; j < 8; j++) {
-				counts[pos + 1] |= (num_ones - counts[pos]) << 9 * (j - 1);
-				if (i + j < num_words) num_ones += __builtin_popcountll(bits[i + j]);
-			}
-		}
+	/** Creates a new instance owning a given bit vector.
+	 *
+	 * The bit vector is enlarged, if necessary, so that rank(size_t) can be called with argument size().
+	 *
+	 * @param bits a bit vector of 64-bit words, which will be moved into this instance.
+	 * @param num_bits the length (in bits) of the bit vector.
+	 * @param num_threads the number of threads used to compute the counts.
+	 */
+	Rank9(util::Vector<uint64_t, AT> bits, const uint64_t num_bits, const size_t num_threads = 1) : num_bits(num_bits) {
+		own(std::move(bits));
+		build(num_threads);
+	}
 
-		counts[num_counts] = num_ones;
+	/** Creates an empty instance, which can be filled using operator>>() or view(). */
+	Rank9() : num_bits(0), num_ones(0), bits(nullptr) {}
 
-		assert(num_ones <= num_bits);
+	/** Makes this instance a read-only view of an instance serialized by operator<<().
+	 *
+	 * @param p a pointer to the serialized instance, aligned to 8 bytes, or `nullptr`.
+	 * @param end a pointer to the end of the available data.
+	 * @param check whether to verify the checksums of the data.
+	 * @return a pointer just after the serialized instance, or `nullptr` if `p` is `nullptr`
+	 * or the data is not valid.
+	 */
+	const char *view(const char *p, const char *end, const bool check = false) {
+		p = serialization::viewHeader(p, end, serialization::tag("Rank9\0\0\0"), {}, {&num_bits, &num_ones});
+		p = owned_bits.view(p, end, check);
+		p = counts.view(p, end, check);
+		if (p != nullptr && owned_bits.size() != (num_bits + 63) / 64) return nullptr;
+		bits = &owned_bits;
+		return p;
 	}
 
+	/** Returns whether this instance owns its bit vector (see the constructors, operator>>() and view()). */
+	bool ownsBits() const { return bits != nullptr && bits == &owned_bits; }
+
 	uint64_t rank(const size_t k) {
 		const uint64_t word = k / 64;
 		const uint64_t block = word / 4 & ~1;
@@ -104,6 +204,17 @@ template <util::AllocType AT = util::AllocType::MALLOC> class Rank9 : public Ran
 		return counts[block] + (counts[block + 1] >> (offset + (offset >> (sizeof offset * 8 - 4) & 0x8)) * 9 & 0x1FF) + __builtin_popcountll(bits[word] & ((1ULL << k % 64) - 1));
 	}
 
+	/** Prefetches the counts and the word of the bit vector that rank(size_t) will read for a given position. */
+	void prefetch(const size_t k) const {
+		const uint64_t word = k / 64;
+		__builtin_prefetch(&counts + (word / 4 & ~1));
+		__builtin_prefetch(bits + word);
+	}
+
+	void rank(const size_t *pos, uint64_t *out, const size_t n) {
+		batch_pipeline(n, [&](const size_t i) { prefetch(pos[i]); }, [](size_t) {}, [&](const size_t i) { out[i] = rank(pos[i]); });
+	}
+
 	/** Returns an estimate of the size in bits of this structure. */
 	size_t bitCount() const { return counts.bitCount() - sizeof(counts) * 8 + sizeof(*this) * 8; }
 
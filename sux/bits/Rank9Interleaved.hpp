@@ -0,0 +1,167 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2007-2020 Sebastiano Vigna
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../support/common.hpp"
+#include "../util/Vector.hpp"
+#include "Rank.hpp"
+#include "Select.hpp"
+#include <cstdint>
+
+namespace sux::bits {
+
+using namespace sux;
+
+/** A class implementing a variant of Rank9 with interleaved counts, and selection on top of it.
+ *
+ * Rank9 stores its counts in a separate array, so a random rank usually causes two cache
+ * misses: one for the counts and one for the word of the bit vector. This class copies
+ * the bit vector into cache-line-aligned lines of eight words: an absolute count (the
+ * number of ones before the line), five 9-bit cumulative counts of the first five data words,
+ * and six data words. A rank thus reads a single cache line. The price is a space
+ * overhead of 33% instead of 25%.
+ *
+ * Selection uses an inventory recording the line of every 512th one, and a binary search
+ * on the absolute counts of the lines between two consecutive inventory entries, followed
+ * by a broadword search on the cumulative counts of the line.
+ *
+ * Since the bit vector is copied at construction time, it can be discarded afterwards.
+ *
+ * @tparam AT a type of memory allocation out of sux::util::AllocType.
+ */
+
+template <util::AllocType AT = util::AllocType::MALLOC> class Rank9Interleaved : public Rank, public Select {
+  private:
+	static const int words_per_line = 8;
+	static const int data_words_per_line = 6;
+	static const int log2_ones_per_inventory = 9;
+
+	size_t num_bits, num_ones, num_lines;
+	util::Vector<uint64_t, AT> storage;
+	// Cache-line-aligned start of the lines within storage
+	uint64_t *lines;
+	util::Vector<uint64_t, AT> inventory;
+
+	// Returns the index of the line containing the one of given rank
+	uint64_t find_line(const uint64_t rank) const {
+		uint64_t lo = inventory[rank >> log2_ones_per_inventory], hi = inventory[(rank >> log2_ones_per_inventory) + 1];
+		while (lo < hi) {
+			const uint64_t mid = (lo + hi + 1) / 2;
+			if (lines[mid * words_per_line] <= rank)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+		return lo;
+	}
+
+  public:
+	/** Creates a new instance using a given bit vector.
+	 *
+	 * Note that the bit vector is read only at construction time.
+	 *
+	 * @param bits a bit vector of 64-bit words.
+	 * @param num_bits the length (in bits) of the bit vector.
+	 */
+	Rank9Interleaved(const uint64_t *const bits, const uint64_t num_bits) : num_bits(num_bits) {
+		const uint64_t num_words = (num_bits + 63) / 64;
+		// Room for the word read by rank(size())
+		num_lines = (num_bits / 64 + 1 + data_words_per_line - 1) / data_words_per_line;
+		storage.size(num_lines * words_per_line + words_per_line - 1);
+		lines = &storage + (-((uintptr_t)&storage / sizeof(uint64_t)) & (words_per_line - 1));
+
+		num_ones = 0;
+		for (uint64_t l = 0; l < num_lines; l++) {
+			uint64_t *const line = lines + l * words_per_line;
+			line[0] = num_ones;
+			// Unused cumulative counts are larger than any rank in a line, as select() expects
+			line[1] = UINT64_C(0x1FF) << 45 | UINT64_C(0x1FF) << 54;
+			for (int j = 0; j < data_words_per_line; j++) {
+				const uint64_t word = l * data_words_per_line + j;
+				if (j != 0) line[1] |= (num_ones - line[0]) << 9 * (j - 1);
+				if (word < num_words) {
+					line[2 + j] = bits[word];
+					num_ones += __builtin_popcountll(bits[word]);
+				}
+			}
+		}
+
+		assert(num_ones <= num_bits);
+
+		const uint64_t inventory_size = (num_ones + (1 << log2_ones_per_inventory) - 1) >> log2_ones_per_inventory;
+		inventory.size(inventory_size + 1);
+		for (uint64_t l = 0, d = 0; d < num_ones; d += 1 << log2_ones_per_inventory) {
+			while (l + 1 < num_lines && lines[(l + 1) * words_per_line] <= d) l++;
+			inventory[d >> log2_ones_per_inventory] = l;
+		}
+		inventory[inventory_size] = num_lines - 1;
+	}
+
+	Rank9Interleaved() : num_bits(0), num_ones(0), num_lines(0), lines(nullptr) {}
+
+	uint64_t rank(const size_t k) {
+		const uint64_t word = k / 64;
+		const uint64_t *const line = lines + word / data_words_per_line * words_per_line;
+		const int offset = word % data_words_per_line - 1;
+		return line[0] + (line[1] >> (offset + (offset >> (sizeof offset * 8 - 4) & 0x8)) * 9 & 0x1FF) + __builtin_popcountll(line[2 + offset + 1] & ((1ULL << k % 64) - 1));
+	}
+
+	void rank(const size_t *pos, uint64_t *out, const size_t n) {
+		batch_pipeline(
+			n, [&](const size_t i) { __builtin_prefetch(lines + pos[i] / 64 / data_words_per_line * words_per_line); }, [](size_t) {}, [&](const size_t i) { out[i] = rank(pos[i]); });
+	}
+
+	size_t select(const uint64_t rank) {
+		const uint64_t *const line = lines + find_line(rank) * words_per_line;
+		const uint64_t rank_in_line = rank - line[0];
+		const uint64_t rank_in_line_step_9 = rank_in_line * ONES_STEP_9;
+		const uint64_t subcounts = line[1];
+		const uint64_t offset_in_line = ULEQ_STEP_9(subcounts, rank_in_line_step_9) * ONES_STEP_9 >> 54 & 0x7;
+		const uint64_t rank_in_word = rank_in_line - (subcounts >> ((offset_in_line - 1) & 7) * 9 & 0x1FF);
+		assert(offset_in_line < data_words_per_line);
+		assert(rank_in_word < 64);
+		return ((line - lines) / words_per_line * data_words_per_line + offset_in_line) * 64 + select64(line[2 + offset_in_line], rank_in_word);
+	}
+
+	void select(const uint64_t *rank, size_t *out, const size_t n) {
+		batch_pipeline(
+			n, [&](const size_t i) { __builtin_prefetch(&inventory + (rank[i] >> log2_ones_per_inventory)); },
+			[&](const size_t i) { __builtin_prefetch(lines + inventory[rank[i] >> log2_ones_per_inventory] * words_per_line); }, [&](const size_t i) { out[i] = select(rank[i]); });
+	}
+
+	/** Returns an estimate of the size in bits of this structure, excluding the data words. */
+	size_t bitCount() const {
+		return storage.bitCount() - sizeof(storage) * 8 - num_lines * data_words_per_line * 64 + inventory.bitCount() - sizeof(inventory) * 8 + sizeof(*this) * 8;
+	}
+
+	/** Returns the size in bits of the underlying bit vector. */
+	size_t size() const { return num_bits; }
+};
+
+} // namespace sux::bits
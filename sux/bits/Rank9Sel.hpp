@@ -32,6 +32,7 @@
 #include "Rank9.hpp"
 #include "Select.hpp"
 #include <cstdint>
+#include <iostream>
 
 namespace sux::bits {
 
@@ -42,6 +43,8 @@ namespace sux::bits {
  * The constructors of this class only store a reference
  * to a provided bit vector. Should the content of the
  * bit vector change, the results will be unpredictable.
+ * Alternatively, the bit vector can be moved into the
+ * instance as a util::Vector, as in Rank9.
  *
  * **Warning**: if you plan an calling rank(size_t) with
  * argument size(), you must have at least one additional
@@ -56,23 +59,9 @@ template <util::AllocType AT = util::AllocType::MALLOC> class Rank9Sel : public
 	util::Vector<uint64_t, AT> inventory, subinventory;
 	uint64_t inventory_size;
 
-  public:
-	/** Creates a new instance using a given bit vector.
-	 *
-	 * Note that this constructor only stores a reference
-	 * to the provided bit vector. Should the content of the
-	 * bit vector change, the results will be unpredictable.
-	 *
-	 * **Warning**: if you plan an calling rank(size_t) with
-	 * argument size(), you must have at least one additional
-	 * free bit at the end of the provided bit vector.
-	 *
-	 * @param bits a bit vector of 64-bit words.
-	 * @param num_bits the length (in bits) of the bit vector.
-	 */
-
-	Rank9Sel(const uint64_t *const bits, const uint64_t num_bits) : Rank9<AT>(bits, num_bits) {
-		const uint64_t num_words = (num_bits + 63) / 64;
+	// Builds the inventory and the subinventories
+	void build_inventory(const size_t num_threads) {
+		const uint64_t num_words = (this->num_bits + 63) / 64;
 		inventory_size = (this->num_ones + ones_per_inventory - 1) / ones_per_inventory;
 
 #ifdef DEBUG
@@ -83,114 +72,188 @@ template <util::AllocType AT = util::AllocType::MALLOC> class Rank9Sel : public
 		inventory.size(inventory_size + 1);
 		subinventory.size((num_words + 3) / 4);
 
-		uint64_t d = 0;
-		for (uint64_t i = 0; i < num_words; i++)
-			for (int j = 0; j < 64; j++)
-				if (bits[i] & 1ULL << j) {
-					if ((d & inventory_mask) == 0) {
-						inventory[d >> log2_ones_per_inventory] = i * 64 + j;
-						assert(this->counts[(i / 8) * 2] <= d);
-						assert(this->counts[(i / 8) * 2 + 2] > d);
-					}
+		// The counts of Rank9 provide the number of ones before each block
+		const uint64_t num_blocks = (num_words + 7) / 8;
+		parallel(num_threads, [&](const size_t t) {
+			const uint64_t first_block = min(num_blocks, t * ((num_blocks + num_threads - 1) / num_threads));
+			const uint64_t last_block = min(num_blocks, first_block + (num_blocks + num_threads - 1) / num_threads);
+			fill_inventory(first_block * 8, min(num_words, last_block * 8), this->counts[first_block * 2]);
+		});
 
-					d++;
-				}
-
-		assert(this->num_ones == d);
 		inventory[inventory_size] = ((num_words + 3) & ~3ULL) * 64;
 
 #ifdef DEBUG
 		printf("Inventory size: %" PRId64 "\n", inventory_size);
-		printf("Inventory entries filled: %" PRId64 "\n", d / ones_per_inventory + 1);
+		printf("Inventory entries filled: %" PRId64 "\n", this->num_ones / ones_per_inventory + 1);
 		// printf("First inventories: %" PRId64 " %" PRId64 " %" PRId64 " %" PRId64 "\n", inventory[0],
 		// inventory[1], inventory[2],
 		//       inventory[3]);
 #endif
 
-		d = 0;
-		int state;
-		uint64_t *s, first_bit, index, span, block_span, block_left, counts_at_start;
+		// Each thread fills the subinventories of a range of inventory entries
+		parallel(num_threads, [&](const size_t t) {
+			const uint64_t first = min(inventory_size, t * ((inventory_size + num_threads - 1) / num_threads));
+			fill_subinventory(first, min(inventory_size, first + (inventory_size + num_threads - 1) / num_threads));
+		});
+	}
 
-		for (uint64_t i = 0; i < num_words; i++)
+	friend std::ostream &operator<<(std::ostream &os, const Rank9Sel<AT> &rank9sel) {
+		serialization::writeHeader(os, serialization::tag("Rank9Sel"), {}, {rank9sel.inventory_size});
+		return os << (const Rank9<AT> &)rank9sel << rank9sel.inventory << rank9sel.subinventory;
+	}
+
+	friend std::istream &operator>>(std::istream &is, Rank9Sel<AT> &rank9sel) {
+		if (!serialization::readHeader(is, serialization::tag("Rank9Sel"), {}, {&rank9sel.inventory_size})) return is;
+		return is >> (Rank9<AT> &)rank9sel >> rank9sel.inventory >> rank9sel.subinventory;
+	}
+
+	// Fills the inventory entries of the ones in words [begin..end), given the number of ones before begin
+	void fill_inventory(const uint64_t begin, const uint64_t end, uint64_t d) {
+		for (uint64_t i = begin; i < end; i++)
 			for (int j = 0; j < 64; j++)
-				if (bits[i] & 1ULL << j) {
+				if (this->bits[i] & 1ULL << j) {
 					if ((d & inventory_mask) == 0) {
-						first_bit = i * 64 + j;
-						index = d >> log2_ones_per_inventory;
-						assert(inventory[index] == first_bit);
-						s = &subinventory[(inventory[index] / 64) / 4];
-						span = (inventory[index + 1] / 64) / 4 - (inventory[index] / 64) / 4;
-						state = -1;
-						counts_at_start = this->counts[((inventory[index] / 64) / 8) * 2];
-						block_span = (inventory[index + 1] / 64) / 8 - (inventory[index] / 64) / 8;
-						block_left = (inventory[index] / 64) / 8;
-
-						if (span >= 512)
-							state = 0;
-						else if (span >= 256)
-							state = 1;
-						else if (span >= 128)
-							state = 2;
-						else if (span >= 16) {
-							assert(((block_span + 8) & -8LL) + 8 <= span * 4);
-
-							uint64_t k;
-							for (k = 0; k < block_span; k++) {
-								assert(((uint16_t *)s)[k + 8] == 0);
-								((uint16_t *)s)[k + 8] = this->counts[(block_left + k + 1) * 2] - counts_at_start;
-							}
-
-							for (; k < ((block_span + 8) & -8LL); k++) {
-								assert(((uint16_t *)s)[k + 8] == 0);
-								((uint16_t *)s)[k + 8] = 0xFFFFU;
-							}
-
-							assert(block_span / 8 <= 8);
-
-							for (k = 0; k < block_span / 8; k++) {
-								assert(((uint16_t *)s)[k] == 0);
-								((uint16_t *)s)[k] = this->counts[(block_left + (k + 1) * 8) * 2] - counts_at_start;
-							}
-
-							for (; k < 8; k++) {
-								assert(((uint16_t *)s)[k] == 0);
-								((uint16_t *)s)[k] = 0xFFFFU;
-							}
-						} else if (span >= 2) {
-							assert(((block_span + 8) & -8LL) <= span * 4);
-
-							uint64_t k;
-							for (k = 0; k < block_span; k++) {
-								assert(((uint16_t *)s)[k] == 0);
-								((uint16_t *)s)[k] = this->counts[(block_left + k + 1) * 2] - counts_at_start;
-							}
-
-							for (; k < ((block_span + 8) & -8LL); k++) {
-								assert(((uint16_t *)s)[k] == 0);
-								((uint16_t *)s)[k] = 0xFFFFU;
-							}
-						}
+						inventory[d >> log2_ones_per_inventory] = i * 64 + j;
+						assert(this->counts[(i / 8) * 2] <= d);
+						assert(this->counts[(i / 8) * 2 + 2] > d);
 					}
 
-					switch (state) {
-					case 0:
-						assert(s[d & inventory_mask] == 0);
-						s[d & inventory_mask] = i * 64 + j;
-						break;
-					case 1:
-						assert(((uint32_t *)s)[d & inventory_mask] == 0);
-						assert(i * 64 + j - first_bit < (1ULL << 32));
-						((uint32_t *)s)[d & inventory_mask] = i * 64 + j - first_bit;
-						break;
-					case 2:
-						assert(((uint16_t *)s)[d & inventory_mask] == 0);
-						assert(i * 64 + j - first_bit < (1 << 16));
-						((uint16_t *)s)[d & inventory_mask] = i * 64 + j - first_bit;
-						break;
+					d++;
+				}
+	}
+
+	// Fills the subinventories of the inventory entries [first..last)
+	void fill_subinventory(const uint64_t first, const uint64_t last) {
+		const uint64_t *const bits = this->bits;
+		const uint64_t end = min(last * ones_per_inventory, (uint64_t)this->num_ones);
+		int state;
+		uint64_t *s, first_bit, index, span, block_span, block_left, counts_at_start;
+
+		for (uint64_t d = first * ones_per_inventory, p = first < last ? inventory[first] : 0; d < end; p++)
+			if (bits[p / 64] & 1ULL << p % 64) {
+				if ((d & inventory_mask) == 0) {
+					first_bit = p;
+					index = d >> log2_ones_per_inventory;
+					assert(inventory[index] == first_bit);
+					s = &subinventory[(inventory[index] / 64) / 4];
+					span = (inventory[index + 1] / 64) / 4 - (inventory[index] / 64) / 4;
+					state = -1;
+					counts_at_start = this->counts[((inventory[index] / 64) / 8) * 2];
+					block_span = (inventory[index + 1] / 64) / 8 - (inventory[index] / 64) / 8;
+					block_left = (inventory[index] / 64) / 8;
+
+					if (span >= 512)
+						state = 0;
+					else if (span >= 256)
+						state = 1;
+					else if (span >= 128)
+						state = 2;
+					else if (span >= 16) {
+						assert(((block_span + 8) & -8LL) + 8 <= span * 4);
+
+						uint64_t k;
+						for (k = 0; k < block_span; k++) {
+							assert(((uint16_t *)s)[k + 8] == 0);
+							((uint16_t *)s)[k + 8] = this->counts[(block_left + k + 1) * 2] - counts_at_start;
+						}
+
+						for (; k < ((block_span + 8) & -8LL); k++) {
+							assert(((uint16_t *)s)[k + 8] == 0);
+							((uint16_t *)s)[k + 8] = 0xFFFFU;
+						}
+
+						assert(block_span / 8 <= 8);
+
+						for (k = 0; k < block_span / 8; k++) {
+							assert(((uint16_t *)s)[k] == 0);
+							((uint16_t *)s)[k] = this->counts[(block_left + (k + 1) * 8) * 2] - counts_at_start;
+						}
+
+						for (; k < 8; k++) {
+							assert(((uint16_t *)s)[k] == 0);
+							((uint16_t *)s)[k] = 0xFFFFU;
+						}
+					} else if (span >= 2) {
+						assert(((block_span + 8) & -8LL) <= span * 4);
+
+						uint64_t k;
+						for (k = 0; k < block_span; k++) {
+							assert(((uint16_t *)s)[k] == 0);
+							((uint16_t *)s)[k] = this->counts[(block_left + k + 1) * 2] - counts_at_start;
+						}
+
+						for (; k < ((block_span + 8) & -8LL); k++) {
+							assert(((uint16_t *)s)[k] == 0);
+							((uint16_t *)s)[k] = 0xFFFFU;
+						}
 					}
+				}
 
-					d++;
+				switch (state) {
+				case 0:
+					assert(s[d & inventory_mask] == 0);
+					s[d & inventory_mask] = p;
+					break;
+				case 1:
+					assert(((uint32_t *)s)[d & inventory_mask] == 0);
+					assert(p - first_bit < (1ULL << 32));
+					((uint32_t *)s)[d & inventory_mask] = p - first_bit;
+					break;
+				case 2:
+					assert(((uint16_t *)s)[d & inventory_mask] == 0);
+					assert(p - first_bit < (1 << 16));
+					((uint16_t *)s)[d & inventory_mask] = p - first_bit;
+					break;
 				}
+
+				d++;
+			}
+	}
+
+  public:
+	/** Creates a new instance using a given bit vector.
+	 *
+	 * Note that this constructor only stores a reference
+	 * to the provided bit vector. Should the content of the
+	 * bit vector change, the results will be unpredictable.
+	 *
+	 * **Warning**: if you plan an calling rank(size_t) with
+	 * argument size(), you must have at least one additional
+	 * free bit at the end of the provided bit vector.
+	 *
+	 * @param bits a bit vector of 64-bit words.
+	 * @param num_bits the length (in bits) of the bit vector.
+	 * @param num_threads the number of threads used to build the structure.
+	 */
+
+	Rank9Sel(const uint64_t *const bits, const uint64_t num_bits, const size_t num_threads = 1) : Rank9<AT>(bits, num_bits, num_threads) { build_inventory(num_threads); }
+
+	/** Creates a new instance owning a given bit vector.
+	 *
+	 * The bit vector is enlarged, if necessary, so that rank(size_t) can be called with argument size().
+	 *
+	 * @param bits a bit vector of 64-bit words, which will be moved into this instance.
+	 * @param num_bits the length (in bits) of the bit vector.
+	 * @param num_threads the number of threads used to build the structure.
+	 */
+	Rank9Sel(util::Vector<uint64_t, AT> bits, const uint64_t num_bits, const size_t num_threads = 1) : Rank9<AT>(std::move(bits), num_bits, num_threads) { build_inventory(num_threads); }
+
+	/** Creates an empty instance, which can be filled using operator>>() or view(). */
+	Rank9Sel() : inventory_size(0) {}
+
+	/** Makes this instance a read-only view of an instance serialized by operator<<().
+	 *
+	 * @param p a pointer to the serialized instance, aligned to 8 bytes, or `nullptr`.
+	 * @param end a pointer to the end of the available data.
+	 * @param check whether to verify the checksums of the data.
+	 * @return a pointer just after the serialized instance, or `nullptr` if `p` is `nullptr`
+	 * or the data is not valid.
+	 */
+	const char *view(const char *p, const char *end, const bool check = false) {
+		p = serialization::viewHeader(p, end, serialization::tag("Rank9Sel"), {}, {&inventory_size});
+		p = Rank9<AT>::view(p, end, check);
+		p = inventory.view(p, end, check);
+		return subinventory.view(p, end, check);
 	}
 
 	size_t select(const uint64_t rank) {
@@ -266,6 +329,10 @@ template <util::AllocType AT = util::AllocType::MALLOC> class Rank9Sel : public
 			return s[rank % ones_per_inventory];
 		}
 
+#ifdef SUX_VPOPCNT
+		// Vectorised in-block select: the words of the block are popcounted together
+		return select_from(this->bits, (this->num_bits + 63) / 64, block_left * 64, rank_in_block);
+#endif
 		const uint64_t rank_in_block_step_9 = rank_in_block * ONES_STEP_9;
 		const uint64_t subcounts = this->counts[count_left + 1];
 		const uint64_t offset_in_block = (ULEQ_STEP_9(subcounts, rank_in_block_step_9) * ONES_STEP_9 >> 54 & 0x7);
@@ -290,6 +357,18 @@ template <util::AllocType AT = util::AllocType::MALLOC> class Rank9Sel : public
 		return word * UINT64_C(64) + select64(this->bits[word], rank_in_word);
 	}
 
+	void select(const uint64_t *rank, size_t *out, const size_t n) {
+		batch_pipeline(
+			n, [&](const size_t i) { __builtin_prefetch(&inventory + (rank[i] >> log2_ones_per_inventory)); },
+			[&](const size_t i) {
+				const uint64_t block_left = inventory[rank[i] >> log2_ones_per_inventory] / 64;
+				__builtin_prefetch(&subinventory + block_left / 4);
+				__builtin_prefetch(&this->counts + block_left / 8 * 2);
+				__builtin_prefetch(this->bits + block_left);
+			},
+			[&](const size_t i) { out[i] = select(rank[i]); });
+	}
+
 	size_t bitCount() const {
 		return this->counts.bitCount() - sizeof(this->counts) * 8 + inventory.bitCount() - sizeof(inventory) * 8 + subinventory.bitCount() - sizeof(subinventory) * 8 + sizeof(*this) * 8;
 	}
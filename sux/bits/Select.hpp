@@ -47,6 +47,19 @@ class Select {
 	 * the result is undefined if no zero of the given rank exists.
 	 */
 	virtual std::size_t select(uint64_t rank) = 0;
+
+	/** Selects a batch of ranks.
+	 *
+	 * Implementations may interleave the queries and prefetch the data they need, so this
+	 * method is faster than a loop over select(uint64_t) when the ranks are known in advance.
+	 *
+	 * @param rank an array of `n` ranks of ones in the bit vector.
+	 * @param out an array of `n` elements that will be filled with the positions of the ones of given rank.
+	 * @param n the number of ranks.
+	 */
+	virtual void select(const uint64_t *rank, std::size_t *out, std::size_t n) {
+		for (std::size_t i = 0; i < n; i++) out[i] = select(rank[i]);
+	}
 };
 
 } // namespace sux
@@ -28,10 +28,12 @@
 
 #pragma once
 
+#include "../support/Instrumentation.hpp"
 #include "../support/common.hpp"
 #include "../util/Vector.hpp"
 #include "Select.hpp"
 #include <cstdint>
+#include <iostream>
 
 namespace sux::bits {
 
@@ -46,38 +48,54 @@ using namespace std;
  * The constructors of this class only store a reference
  * to a provided bit vector. Should the content of the
  * bit vector change, the results will be unpredictable.
+ * Alternatively, the bit vector can be moved into the
+ * instance as a util::Vector, which is then owned by the
+ * instance and serialized with it: an instance loaded
+ * with operator>>() or view() needs no other data.
+ *
+ * For each query sampled by the instrumentation policy, select(uint64_t) records the
+ * number of words scanned after the position given by the inventories, and whether
+ * the position of the one was spilled.
  *
  * @tparam AT a type of memory allocation out of sux::util::AllocType.
+ * @tparam INSTR an instrumentation policy out of those in sux::instrumentation.
  */
 
-template <util::AllocType AT = util::AllocType::MALLOC> class SimpleSelect : public Select {
+template <util::AllocType AT = util::AllocType::MALLOC, typename INSTR = instrumentation::None> class SimpleSelect : public Select {
   private:
 	static const int max_ones_per_inventory = 8192;
 
 	const uint64_t *bits;
+	util::Vector<uint64_t, AT> owned_bits;
 	util::Vector<int64_t, AT> inventory;
 	util::Vector<uint64_t, AT> exact_spill;
 	int log2_ones_per_inventory, log2_ones_per_sub16, log2_ones_per_sub64, log2_longwords_per_subinventory, ones_per_inventory, ones_per_sub16, ones_per_sub64, longwords_per_subinventory,
 		longwords_per_inventory, ones_per_inventory_mask, ones_per_sub16_mask, ones_per_sub64_mask;
 
 	uint64_t num_words, inventory_size, exact_spill_size, num_ones;
+	INSTR instr;
 
-  public:
-	SimpleSelect() {}
+	// Computes the parameters derived from log2_ones_per_inventory and log2_longwords_per_subinventory
+	void set_parameters() {
+		ones_per_inventory = 1ULL << log2_ones_per_inventory;
+		ones_per_inventory_mask = ones_per_inventory - 1;
+		longwords_per_subinventory = 1 << log2_longwords_per_subinventory;
+		longwords_per_inventory = longwords_per_subinventory + 1;
+		log2_ones_per_sub64 = max(0, log2_ones_per_inventory - log2_longwords_per_subinventory);
+		log2_ones_per_sub16 = max(0, log2_ones_per_sub64 - 2);
+		ones_per_sub64 = 1ULL << log2_ones_per_sub64;
+		ones_per_sub16 = 1ULL << log2_ones_per_sub16;
+		ones_per_sub64_mask = ones_per_sub64 - 1;
+		ones_per_sub16_mask = ones_per_sub16 - 1;
+	}
 
-	/** Creates a new instance using a given bit vector.
-	 *
-	 * @param bits a bit vector of 64-bit words.
-	 * @param num_bits the length (in bits) of the bit vector.
-	 * @param max_log2_longwords_per_subinventory the number of words per subinventory:
-	 * a larger value yields a faster map that uses more space; typical values are between 0 and 3.
-	 */
-	SimpleSelect(const uint64_t *const bits, const uint64_t num_bits, const int max_log2_longwords_per_subinventory) : bits(bits) {
+	// Builds the inventory, the subinventories and the exact spill
+	void build(const uint64_t num_bits, const int max_log2_longwords_per_subinventory, const size_t num_threads) {
 		num_words = (num_bits + 63) / 64;
+		exact_spill_size = 0;
 
 		// Init rank/select structure
-		uint64_t c = 0;
-		for (uint64_t i = 0; i < num_words; i++) c += __builtin_popcountll(bits[i]);
+		uint64_t c = popcount_words(bits, num_words);
 		num_ones = c;
 
 		assert(c <= num_bits);
@@ -86,7 +104,6 @@ template <util::AllocType AT = util::AllocType::MALLOC> class SimpleSelect : pub
 		// Make ones_per_inventory into a power of 2
 		log2_ones_per_inventory = max(0, lambda_safe(ones_per_inventory));
 		ones_per_inventory = 1ULL << log2_ones_per_inventory;
-		ones_per_inventory_mask = ones_per_inventory - 1;
 		inventory_size = (c + ones_per_inventory - 1) / ones_per_inventory;
 
 #ifdef DEBUG
@@ -94,35 +111,26 @@ template <util::AllocType AT = util::AllocType::MALLOC> class SimpleSelect : pub
 #endif
 
 		log2_longwords_per_subinventory = min(max_log2_longwords_per_subinventory, max(0, log2_ones_per_inventory - 2));
-		longwords_per_subinventory = 1 << log2_longwords_per_subinventory;
-		longwords_per_inventory = longwords_per_subinventory + 1;
-		log2_ones_per_sub64 = max(0, log2_ones_per_inventory - log2_longwords_per_subinventory);
-		log2_ones_per_sub16 = max(0, log2_ones_per_sub64 - 2);
-		ones_per_sub64 = 1ULL << log2_ones_per_sub64;
-		ones_per_sub16 = 1ULL << log2_ones_per_sub16;
-		ones_per_sub64_mask = ones_per_sub64 - 1;
-		ones_per_sub16_mask = ones_per_sub16 - 1;
+		set_parameters();
 
 #ifdef DEBUG
 		printf("Longwords per subinventory: %d Ones per sub 64: %d sub 16: %d\n", longwords_per_subinventory, ones_per_sub64, ones_per_sub16);
 #endif
 
 		inventory.size(inventory_size * longwords_per_inventory + 1);
-		const int64_t *end_of_inventory = &inventory + inventory_size * longwords_per_inventory + 1;
-
-		uint64_t d = 0;
 
 		// First phase: we build an inventory for each one out of ones_per_inventory.
-		for (uint64_t i = 0; i < num_words; i++)
-			for (int j = 0; j < 64; j++) {
-				if (i * 64 + j >= num_bits) break;
-				if (bits[i] & 1ULL << j) {
-					if ((d & ones_per_inventory_mask) == 0) inventory[(d >> log2_ones_per_inventory) * longwords_per_inventory] = i * 64 + j;
-					d++;
+		parallel_word_ranges(bits, num_words, num_threads, 1, [&](const uint64_t begin, const uint64_t end, uint64_t d) {
+			for (uint64_t i = begin; i < end; i++)
+				for (int j = 0; j < 64; j++) {
+					if (i * 64 + j >= num_bits) break;
+					if (bits[i] & 1ULL << j) {
+						if ((d & ones_per_inventory_mask) == 0) inventory[(d >> log2_ones_per_inventory) * longwords_per_inventory] = i * 64 + j;
+						d++;
+					}
 				}
-			}
+		});
 
-		assert(c == d);
 		inventory[inventory_size * longwords_per_inventory] = num_bits;
 
 #ifdef DEBUG
@@ -130,32 +138,26 @@ template <util::AllocType AT = util::AllocType::MALLOC> class SimpleSelect : pub
 #endif
 
 		if (ones_per_inventory > 1) {
-			d = 0;
-			int ones;
-			uint64_t spilled = 0, exact = 0, start, span, inventory_index;
+			// Each thread fills the subinventories of a range of inventory entries
+			const uint64_t chunk = (inventory_size + num_threads - 1) / num_threads;
+			vector<uint64_t> spilled_before(num_threads + 1);
+			uint64_t spilled = 0, exact = 0;
 
-			for (uint64_t i = 0; i < num_words; i++)
+			for (uint64_t inventory_index = 0; inventory_index < inventory_size; inventory_index++) {
 				// We estimate the subinventory and exact spill size
-				for (int j = 0; j < 64; j++) {
-					if (i * 64 + j >= num_bits) break;
-					if (bits[i] & 1ULL << j) {
-						if ((d & ones_per_inventory_mask) == 0) {
-							inventory_index = d >> log2_ones_per_inventory;
-							start = inventory[inventory_index * longwords_per_inventory];
-							span = inventory[(inventory_index + 1) * longwords_per_inventory] - start;
-							ones = min(c - d, (uint64_t)ones_per_inventory);
-
-							assert(start + span == num_bits || ones == ones_per_inventory);
-
-							// We accumulate space for exact pointers ONLY if necessary.
-							if (span >= (1 << 16)) {
-								exact += ones;
-								if (ones_per_sub64 > 1) spilled += ones;
-							}
-						}
-						d++;
-					}
+				if (inventory_index % chunk == 0) spilled_before[inventory_index / chunk] = spilled;
+				const uint64_t start = inventory[inventory_index * longwords_per_inventory];
+				const uint64_t span = inventory[(inventory_index + 1) * longwords_per_inventory] - start;
+				const uint64_t ones = min(c - inventory_index * ones_per_inventory, (uint64_t)ones_per_inventory);
+
+				assert(start + span == num_bits || ones == (uint64_t)ones_per_inventory);
+
+				// We accumulate space for exact pointers ONLY if necessary.
+				if (span >= (1 << 16)) {
+					exact += ones;
+					if (ones_per_sub64 > 1) spilled += ones;
 				}
+			}
 
 #ifdef DEBUG
 			printf("Spilled entries: %" PRId64 " exact: %" PRId64 "\n", spilled, exact);
@@ -164,50 +166,16 @@ template <util::AllocType AT = util::AllocType::MALLOC> class SimpleSelect : pub
 			exact_spill_size = spilled;
 			exact_spill.size(exact_spill_size);
 
-			uint16_t *p16;
-			int64_t *p64;
-			int offset;
-			spilled = 0;
-			d = 0;
-
-			for (uint64_t i = 0; i < num_words; i++)
-				for (int j = 0; j < 64; j++) {
-					if (i * 64 + j >= num_bits) break;
-					if (bits[i] & 1ULL << j) {
-						if ((d & ones_per_inventory_mask) == 0) {
-							inventory_index = d >> log2_ones_per_inventory;
-							start = inventory[inventory_index * longwords_per_inventory];
-							span = inventory[(inventory_index + 1) * longwords_per_inventory] - start;
-							p64 = &inventory[inventory_index * longwords_per_inventory + 1];
-							p16 = (uint16_t *)p64;
-							offset = 0;
-						}
-
-						if (span < (1 << 16)) {
-							assert(i * 64 + j - start <= (1 << 16));
-							if ((d & ones_per_sub16_mask) == 0) {
-								assert(offset < longwords_per_subinventory * 4);
-								assert(p16 + offset < (uint16_t *)end_of_inventory);
-								p16[offset++] = i * 64 + j - start;
-							}
-						} else {
-							if (ones_per_sub64 == 1) {
-								assert(p64 + offset < end_of_inventory);
-								p64[offset++] = i * 64 + j;
-							} else {
-								assert(p64 < end_of_inventory);
-								if ((d & ones_per_inventory_mask) == 0) {
-									inventory[inventory_index * longwords_per_inventory] |= 1ULL << 63;
-									p64[0] = spilled;
-								}
-								assert(spilled < exact_spill_size);
-								exact_spill[spilled++] = i * 64 + j;
-							}
-						}
+			parallel(num_threads, [&](const size_t t) {
+				const uint64_t first = min(inventory_size, t * chunk), last = min(inventory_size, first + chunk);
+				if (first < last) fill_subinventory(first, last, spilled_before[t]);
+			});
 
-						d++;
-					}
-				}
+			// Spilled inventories are marked only now, as their start is needed by the previous ones
+			if (ones_per_sub64 > 1)
+				for (uint64_t inventory_index = 0; inventory_index < inventory_size; inventory_index++)
+					if (inventory[(inventory_index + 1) * longwords_per_inventory] - inventory[inventory_index * longwords_per_inventory] >= (1 << 16))
+						inventory[inventory_index * longwords_per_inventory] |= 1ULL << 63;
 		}
 #ifdef DEBUG
 		// printf("First inventories: %" PRId64 " %" PRId64 " %" PRId64 " %" PRId64 "\n", inventory[0],
@@ -223,7 +191,172 @@ template <util::AllocType AT = util::AllocType::MALLOC> class SimpleSelect : pub
 #endif
 	}
 
+	// The bit vector is always serialized, and it is owned by loaded instances
+	friend std::ostream &operator<<(std::ostream &os, const SimpleSelect &ss) {
+		serialization::writeHeader(os, serialization::tag("SimplSel"), {},
+								   {ss.num_words, ss.num_ones, ss.inventory_size, ss.exact_spill_size, uint64_t(ss.log2_ones_per_inventory), uint64_t(ss.log2_longwords_per_subinventory)});
+		serialization::writeSection(os, ss.bits, ss.num_words);
+		return os << ss.inventory << ss.exact_spill;
+	}
+
+	friend std::istream &operator>>(std::istream &is, SimpleSelect &ss) {
+		uint64_t log2_ones, log2_longwords;
+		if (!serialization::readHeader(is, serialization::tag("SimplSel"), {}, {&ss.num_words, &ss.num_ones, &ss.inventory_size, &ss.exact_spill_size, &log2_ones, &log2_longwords})) return is;
+		ss.log2_ones_per_inventory = log2_ones;
+		ss.log2_longwords_per_subinventory = log2_longwords;
+		ss.set_parameters();
+		is >> ss.owned_bits >> ss.inventory >> ss.exact_spill;
+		if (is && ss.owned_bits.size() != ss.num_words) is.setstate(std::ios::failbit);
+		ss.bits = &ss.owned_bits;
+		return is;
+	}
+
+	// Fills the subinventories of the inventory entries [first..last), given the number of spilled entries before first
+	void fill_subinventory(const uint64_t first, const uint64_t last, uint64_t spilled) {
+		[[maybe_unused]] const int64_t *end_of_inventory = &inventory + inventory_size * longwords_per_inventory + 1;
+		const uint64_t end = min(last * ones_per_inventory, num_ones);
+		uint16_t *p16;
+		int64_t *p64;
+		int offset;
+		uint64_t start, span, inventory_index;
+
+		for (uint64_t d = first * ones_per_inventory, p = inventory[first * longwords_per_inventory]; d < end; p++)
+			if (bits[p / 64] & 1ULL << p % 64) {
+				if ((d & ones_per_inventory_mask) == 0) {
+					inventory_index = d >> log2_ones_per_inventory;
+					start = inventory[inventory_index * longwords_per_inventory];
+					span = inventory[(inventory_index + 1) * longwords_per_inventory] - start;
+					p64 = &inventory[inventory_index * longwords_per_inventory + 1];
+					p16 = (uint16_t *)p64;
+					offset = 0;
+				}
+
+				if (span < (1 << 16)) {
+					assert(p - start <= (1 << 16));
+					if ((d & ones_per_sub16_mask) == 0) {
+						assert(offset < longwords_per_subinventory * 4);
+						assert(p16 + offset < (uint16_t *)end_of_inventory);
+						p16[offset++] = p - start;
+					}
+				} else {
+					if (ones_per_sub64 == 1) {
+						assert(p64 + offset < end_of_inventory);
+						p64[offset++] = p;
+					} else {
+						assert(p64 < end_of_inventory);
+						if ((d & ones_per_inventory_mask) == 0) p64[0] = spilled;
+						assert(spilled < exact_spill_size);
+						exact_spill[spilled++] = p;
+					}
+				}
+
+				d++;
+			}
+	}
+
+  public:
+	SimpleSelect() {}
+
+	/** Creates a new instance using a given bit vector.
+	 *
+	 * @param bits a bit vector of 64-bit words.
+	 * @param num_bits the length (in bits) of the bit vector.
+	 * @param max_log2_longwords_per_subinventory the number of words per subinventory:
+	 * a larger value yields a faster map that uses more space; typical values are between 0 and 3.
+	 * @param num_threads the number of threads used to build the structure.
+	 */
+	SimpleSelect(const uint64_t *const bits, const uint64_t num_bits, const int max_log2_longwords_per_subinventory, const size_t num_threads = 1) : bits(bits) {
+		build(num_bits, max_log2_longwords_per_subinventory, num_threads);
+	}
+
+	/** Creates a new instance owning a given bit vector.
+	 *
+	 * @param bits a bit vector of 64-bit words, which will be moved into this instance.
+	 * @param num_bits the length (in bits) of the bit vector.
+	 * @param max_log2_longwords_per_subinventory the number of words per subinventory:
+	 * a larger value yields a faster map that uses more space; typical values are between 0 and 3.
+	 * @param num_threads the number of threads used to build the structure.
+	 */
+	SimpleSelect(util::Vector<uint64_t, AT> bits, const uint64_t num_bits, const int max_log2_longwords_per_subinventory, const size_t num_threads = 1)
+		: owned_bits(std::move(bits)) {
+		this->bits = &owned_bits;
+		build(num_bits, max_log2_longwords_per_subinventory, num_threads);
+	}
+
+	/** Makes this instance a read-only view of an instance serialized by operator<<().
+	 *
+	 * @param p a pointer to the serialized instance, aligned to 8 bytes, or `nullptr`.
+	 * @param end a pointer to the end of the available data.
+	 * @param check whether to verify the checksums of the data.
+	 * @return a pointer just after the serialized instance, or `nullptr` if `p` is `nullptr`
+	 * or the data is not valid.
+	 */
+	const char *view(const char *p, const char *end, const bool check = false) {
+		uint64_t log2_ones, log2_longwords;
+		p = serialization::viewHeader(p, end, serialization::tag("SimplSel"), {}, {&num_words, &num_ones, &inventory_size, &exact_spill_size, &log2_ones, &log2_longwords});
+		if (p == nullptr) return nullptr;
+		log2_ones_per_inventory = log2_ones;
+		log2_longwords_per_subinventory = log2_longwords;
+		set_parameters();
+		p = owned_bits.view(p, end, check);
+		p = inventory.view(p, end, check);
+		p = exact_spill.view(p, end, check);
+		if (p != nullptr && owned_bits.size() != num_words) return nullptr;
+		bits = &owned_bits;
+		return p;
+	}
+
+	/** Prefetches the inventory entries that select(uint64_t) will read for a given rank.
+	 *
+	 * @param rank the rank of a one in the bit vector.
+	 */
+	void prefetchInventory(const uint64_t rank) const {
+		const uint64_t inventory_index = rank >> log2_ones_per_inventory;
+		const int64_t *const inventory_start = &inventory + (inventory_index << log2_longwords_per_subinventory) + inventory_index;
+		__builtin_prefetch(inventory_start);
+		__builtin_prefetch(inventory_start + longwords_per_subinventory);
+	}
+
+	/** Reads the inventory entries for a given rank and prefetches the data that select(uint64_t) will read next.
+	 *
+	 * The inventory entries should have been prefetched in advance using prefetchInventory().
+	 *
+	 * @param rank the rank of a one in the bit vector.
+	 */
+	void prefetchBits(const uint64_t rank) const {
+		const uint64_t inventory_index = rank >> log2_ones_per_inventory;
+		const int64_t *const inventory_start = &inventory + (inventory_index << log2_longwords_per_subinventory) + inventory_index;
+		const int64_t inventory_rank = *inventory_start;
+		const int subrank = rank & ones_per_inventory_mask;
+
+		if (inventory_rank >= 0)
+			__builtin_prefetch(bits + (inventory_rank + ((uint16_t *)(inventory_start + 1))[subrank >> log2_ones_per_sub16]) / 64);
+		else if (ones_per_sub64 != 1)
+			__builtin_prefetch(&exact_spill + *(inventory_start + 1) + subrank);
+	}
+
+	/** The counters recorded by the instrumentation policy, whose names are in COUNTER_NAMES. */
+	enum Counter { SCANNED_WORDS, SPILLED };
+	static constexpr const char *COUNTER_NAMES[] = {"scanned_words", "spilled"};
+
+	/** Returns the instrumentation policy of this instance, from which counters can be read. */
+	const INSTR &instrumentation() const { return instr; }
+
 	size_t select(const uint64_t rank) {
+		const size_t pos = locate(rank);
+		if (instr.sample()) record(rank, pos);
+		return pos;
+	}
+
+	void select(const uint64_t *rank, size_t *out, const size_t n) {
+		batch_pipeline(n, [&](const size_t i) { prefetchInventory(rank[i]); }, [&](const size_t i) { prefetchBits(rank[i]); }, [&](const size_t i) { out[i] = select(rank[i]); });
+	}
+
+	/** Returns an estimate of the size (in bits) of this structure. */
+	size_t bitCount() const { return inventory.bitCount() - sizeof(inventory) * 8 + exact_spill.bitCount() - sizeof(exact_spill) * 8 + sizeof(*this) * 8; }
+
+  private:
+	size_t locate(const uint64_t rank) const {
 #ifdef DEBUG
 		printf("Selecting %" PRId64 "\n...", rank);
 #endif
@@ -262,21 +395,20 @@ template <util::AllocType AT = util::AllocType::MALLOC> class SimpleSelect : pub
 
 		if (residual == 0) return start;
 
-		uint64_t word_index = start / 64;
-		uint64_t word = bits[word_index] & -1ULL << start % 64;
-
-		for (;;) {
-			const int bit_count = __builtin_popcountll(word);
-			if (residual < bit_count) break;
-			word = bits[++word_index];
-			residual -= bit_count;
-		}
-
-		return word_index * 64 + select64(word, residual);
+		return select_from(bits, num_words, start, residual);
 	}
 
-	/** Returns an estimate of the size (in bits) of this structure. */
-	size_t bitCount() const { return inventory.bitCount() - sizeof(inventory) * 8 + exact_spill.bitCount() - sizeof(exact_spill) * 8 + sizeof(*this) * 8; }
+	// Records the counters of a sampled query, reading again its inventory entries
+	void record(const uint64_t rank, const size_t pos) const {
+		const uint64_t inventory_index = rank >> log2_ones_per_inventory;
+		const int64_t *inventory_start = &inventory + (inventory_index << log2_longwords_per_subinventory) + inventory_index;
+		const int64_t inventory_rank = *inventory_start;
+		const int subrank = rank & ones_per_inventory_mask;
+		const bool spilled = subrank != 0 && inventory_rank < 0;
+		const uint64_t start = subrank == 0 || spilled ? pos : inventory_rank + ((uint16_t *)(inventory_start + 1))[subrank >> log2_ones_per_sub16];
+		instr.record(SCANNED_WORDS, pos / 64 - start / 64);
+		instr.record(SPILLED, spilled);
+	}
 };
 
 } // namespace sux::bits
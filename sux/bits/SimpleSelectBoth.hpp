@@ -0,0 +1,288 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2007-2020 Sebastiano Vigna
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../support/common.hpp"
+#include "../util/Vector.hpp"
+#include <cstdint>
+
+namespace sux::bits {
+
+using namespace std;
+using namespace sux;
+
+/** A combination of SimpleSelectHalf and SimpleSelectZeroHalf sharing the same storage and built in a single pass.
+ *
+ * The inventories for ones and zeros have exactly the same layout as those of SimpleSelectHalf and
+ * SimpleSelectZeroHalf, and they are stored one after the other in a single vector. Both inventories
+ * are built at the same time by two scans of the bit vector (one for the first level, one for the subinventories)
+ * that process a word at a time, rather than a bit at a time, and can be split among threads.
+ * EliasFano uses this class to support both select and selectZero on its upper bits.
+ *
+ * The constructors of this class only store a reference
+ * to a provided bit vector. Should the content of the
+ * bit vector change, the results will be unpredictable.
+ *
+ * @tparam AT a type of memory allocation out of sux::util::AllocType.
+ */
+
+template <util::AllocType AT = util::AllocType::MALLOC> class SimpleSelectBoth {
+  private:
+	static const int log2_ones_per_inventory = 10;
+	static const int ones_per_inventory = 1 << log2_ones_per_inventory;
+	static const uint64_t ones_per_inventory_mask = ones_per_inventory - 1;
+	static const int log2_longwords_per_subinventory = 2;
+	static const int longwords_per_subinventory = 1 << log2_longwords_per_subinventory;
+	static const int log2_ones_per_sub64 = log2_ones_per_inventory - log2_longwords_per_subinventory;
+	static const int ones_per_sub64 = 1 << log2_ones_per_sub64;
+	static const uint64_t ones_per_sub64_mask = ones_per_sub64 - 1;
+	static const int log2_ones_per_sub16 = log2_ones_per_sub64 - 2;
+	static const int ones_per_sub16 = 1 << log2_ones_per_sub16;
+	static const uint64_t ones_per_sub16_mask = ones_per_sub16 - 1;
+
+	const uint64_t *bits;
+	// The inventory of ones, followed by the inventory of zeros starting at zeros_offset
+	util::Vector<int64_t, AT> inventory;
+
+	uint64_t num_words, num_ones, num_zeros, zeros_offset;
+
+	// Calls f(rank, pos) for each one of w whose rank is a multiple of 2^log2_step, given the number of ones before w
+	template <typename F> static void sample(const uint64_t w, const uint64_t before, const int log2_step, const uint64_t base, F &&f) {
+		const uint64_t end = before + nu(w);
+		for (uint64_t r = (before + (1ULL << log2_step) - 1) & -1ULL << log2_step; r < end; r += 1ULL << log2_step) f(r, base + select64(w, r - before));
+	}
+
+	// Fills the subinventory entry of the given rank, given the start of the corresponding inventory
+	static void fill(int64_t *const inventory_start, const uint64_t rank, const uint64_t pos) {
+		const uint64_t start = inventory_start[0], span = inventory_start[longwords_per_subinventory + 1] - start;
+		const uint64_t subrank = rank & ones_per_inventory_mask;
+		if (span < (1 << 16)) {
+			assert(pos - start <= (1 << 16));
+			if ((subrank & ones_per_sub16_mask) == 0) ((uint16_t *)(inventory_start + 1))[subrank >> log2_ones_per_sub16] = pos - start;
+		} else if ((subrank & ones_per_sub64_mask) == 0)
+			inventory_start[1 + (subrank >> log2_ones_per_sub64)] = pos - start;
+	}
+
+	// Marks the inventories with a large span; their start is needed when filling the subinventories
+	static void mark(int64_t *const inventory, const uint64_t inventory_size) {
+		for (uint64_t inventory_index = 0; inventory_index < inventory_size * (longwords_per_subinventory + 1); inventory_index += longwords_per_subinventory + 1)
+			if (inventory[inventory_index + longwords_per_subinventory + 1] - inventory[inventory_index] >= (1 << 16)) inventory[inventory_index] = -inventory[inventory_index] - 1;
+	}
+
+	template <bool ZERO> const int64_t *inventory_start(const uint64_t rank) const {
+		const uint64_t inventory_index = rank >> log2_ones_per_inventory;
+		return &inventory + (ZERO ? zeros_offset : 0) + (inventory_index << log2_longwords_per_subinventory) + inventory_index;
+	}
+
+	template <bool ZERO> void prefetch_bits(const uint64_t rank) const {
+		const int64_t *const inventory_start = this->inventory_start<ZERO>(rank);
+		const int64_t inventory_rank = *inventory_start;
+		const int subrank = rank & ones_per_inventory_mask;
+
+		if (inventory_rank >= 0)
+			__builtin_prefetch(bits + (inventory_rank + ((uint16_t *)(inventory_start + 1))[subrank >> log2_ones_per_sub16]) / 64);
+		else
+			__builtin_prefetch(bits + (-inventory_rank - 1 + *(inventory_start + 1 + (subrank >> log2_ones_per_sub64))) / 64);
+	}
+
+	// Returns the position, given by the inventories, from which the bit of given rank is searched,
+	// storing in residual the rank of the bit counting from that position
+	template <bool ZERO> uint64_t start(const uint64_t rank, int &residual) const {
+		const int64_t *const inventory_start = this->inventory_start<ZERO>(rank);
+		const int64_t inventory_rank = *inventory_start;
+		const int subrank = rank & ones_per_inventory_mask;
+
+		if (inventory_rank >= 0) {
+			residual = subrank & ones_per_sub16_mask;
+			return inventory_rank + ((uint16_t *)(inventory_start + 1))[subrank >> log2_ones_per_sub16];
+		} else {
+			assert((subrank >> log2_ones_per_sub64) < longwords_per_subinventory);
+			residual = subrank & ones_per_sub64_mask;
+			return -inventory_rank - 1 + *(inventory_start + 1 + (subrank >> log2_ones_per_sub64));
+		}
+	}
+
+	template <bool ZERO> uint64_t select(const uint64_t rank) const {
+		assert(rank < (ZERO ? num_zeros : num_ones));
+
+		int residual;
+		const uint64_t start = this->start<ZERO>(rank, residual);
+		if (residual == 0) return start;
+
+		return select_from<ZERO>(bits, num_words, start, residual);
+	}
+
+	template <bool ZERO> uint64_t select(const uint64_t rank, uint64_t *const next) const {
+		const uint64_t s = select<ZERO>(rank);
+		int curr = s / 64;
+
+		uint64_t window = (ZERO ? ~bits[curr] : bits[curr]) & -1ULL << s;
+		window &= window - 1;
+
+		while (window == 0) window = ZERO ? ~bits[++curr] : bits[++curr];
+		*next = curr * 64 + __builtin_ctzll(window);
+
+		return s;
+	}
+
+  public:
+	SimpleSelectBoth() {}
+
+	/** Creates a new instance using a given bit vector.
+	 *
+	 * @param bits a bit vector of 64-bit words.
+	 * @param num_bits the length (in bits) of the bit vector.
+	 * @param num_threads the number of threads used to build the structure.
+	 */
+
+	SimpleSelectBoth(const uint64_t *const bits, const uint64_t num_bits, const size_t num_threads = 1) : bits(bits) {
+		num_words = (num_bits + 63) / 64;
+		num_ones = popcount_words(bits, num_words);
+		assert(num_ones <= num_bits);
+		num_zeros = num_bits - num_ones;
+
+		const uint64_t ones_inventory_size = (num_ones + ones_per_inventory - 1) / ones_per_inventory;
+		const uint64_t zeros_inventory_size = (num_zeros + ones_per_inventory - 1) / ones_per_inventory;
+		zeros_offset = ones_inventory_size * (longwords_per_subinventory + 1) + 1;
+		inventory.size(zeros_offset + zeros_inventory_size * (longwords_per_subinventory + 1) + 1);
+		int64_t *const ones_inventory = &inventory, *const zeros_inventory = &inventory + zeros_offset;
+
+		// Calls f(i, w, z, ones, zeros) for each word, where w and z are the word and its complement
+		// restricted to the bit vector, and ones and zeros are the number of ones and zeros before the word
+		const auto scan = [&](auto &&f) {
+			parallel_word_ranges<false>(bits, num_words, num_threads, 1, [&](const uint64_t begin, const uint64_t end, uint64_t ones) {
+				for (uint64_t i = begin; i < end; i++) {
+					const uint64_t w = bits[i];
+					const uint64_t z = ~w & (i == num_words - 1 && num_bits % 64 != 0 ? (1ULL << num_bits % 64) - 1 : -1ULL);
+					f(i, w, z, ones, i * 64 - ones);
+					ones += nu(w);
+				}
+			});
+		};
+
+		// First phase: we build both inventories, using an entry for each one (zero) out of ones_per_inventory
+		scan([&](const uint64_t i, const uint64_t w, const uint64_t z, const uint64_t ones, const uint64_t zeros) {
+			sample(w, ones, log2_ones_per_inventory, i * 64, [&](const uint64_t r, const uint64_t p) { ones_inventory[(r >> log2_ones_per_inventory) * (longwords_per_subinventory + 1)] = p; });
+			sample(z, zeros, log2_ones_per_inventory, i * 64, [&](const uint64_t r, const uint64_t p) { zeros_inventory[(r >> log2_ones_per_inventory) * (longwords_per_subinventory + 1)] = p; });
+		});
+
+		ones_inventory[ones_inventory_size * (longwords_per_subinventory + 1)] = num_bits;
+		zeros_inventory[zeros_inventory_size * (longwords_per_subinventory + 1)] = num_bits;
+
+		// Second phase: we fill the subinventories, whose entries are addressed directly by rank
+		scan([&](const uint64_t i, const uint64_t w, const uint64_t z, const uint64_t ones, const uint64_t zeros) {
+			sample(w, ones, log2_ones_per_sub16, i * 64,
+				   [&](const uint64_t r, const uint64_t p) { fill(ones_inventory + (r >> log2_ones_per_inventory) * (longwords_per_subinventory + 1), r, p); });
+			sample(z, zeros, log2_ones_per_sub16, i * 64,
+				   [&](const uint64_t r, const uint64_t p) { fill(zeros_inventory + (r >> log2_ones_per_inventory) * (longwords_per_subinventory + 1), r, p); });
+		});
+
+		mark(ones_inventory, ones_inventory_size);
+		mark(zeros_inventory, zeros_inventory_size);
+	}
+
+	/** Prefetches the inventory entries that select(uint64_t) will read for a given rank.
+	 *
+	 * @param rank the rank of a one in the bit vector.
+	 */
+	void prefetchInventory(const uint64_t rank) const {
+		const int64_t *const inventory_start = this->inventory_start<false>(rank);
+		__builtin_prefetch(inventory_start);
+		__builtin_prefetch(inventory_start + longwords_per_subinventory);
+	}
+
+	/** Prefetches the inventory entries that selectZero(uint64_t) will read for a given rank.
+	 *
+	 * @param rank the rank of a zero in the bit vector.
+	 */
+	void prefetchInventoryZero(const uint64_t rank) const {
+		const int64_t *const inventory_start = this->inventory_start<true>(rank);
+		__builtin_prefetch(inventory_start);
+		__builtin_prefetch(inventory_start + longwords_per_subinventory);
+	}
+
+	/** Reads the inventory entries for a given rank and prefetches the data that select(uint64_t) will read next.
+	 *
+	 * The inventory entries should have been prefetched in advance using prefetchInventory().
+	 *
+	 * @param rank the rank of a one in the bit vector.
+	 */
+	void prefetchBits(const uint64_t rank) const { prefetch_bits<false>(rank); }
+
+	/** Reads the inventory entries for a given rank and prefetches the data that selectZero(uint64_t) will read next.
+	 *
+	 * The inventory entries should have been prefetched in advance using prefetchInventoryZero().
+	 *
+	 * @param rank the rank of a zero in the bit vector.
+	 */
+	void prefetchBitsZero(const uint64_t rank) const { prefetch_bits<true>(rank); }
+
+	uint64_t select(const uint64_t rank) const { return select<false>(rank); }
+
+	uint64_t selectZero(const uint64_t rank) const { return select<true>(rank); }
+
+	/** Selects a batch of ranks, prefetching the data needed by each query in advance.
+	 *
+	 * @param rank an array of `n` ranks of ones in the bit vector.
+	 * @param out an array of `n` elements that will be filled with the positions of the ones of given rank.
+	 * @param n the number of ranks.
+	 */
+	void select(const uint64_t *rank, uint64_t *out, const size_t n) const {
+		batch_pipeline(n, [&](const size_t i) { prefetchInventory(rank[i]); }, [&](const size_t i) { prefetchBits(rank[i]); }, [&](const size_t i) { out[i] = select(rank[i]); });
+	}
+
+	/** Selects a batch of ranks of zeros, prefetching the data needed by each query in advance.
+	 *
+	 * @param rank an array of `n` ranks of zeros in the bit vector.
+	 * @param out an array of `n` elements that will be filled with the positions of the zeros of given rank.
+	 * @param n the number of ranks.
+	 */
+	void selectZero(const uint64_t *rank, uint64_t *out, const size_t n) const {
+		batch_pipeline(n, [&](const size_t i) { prefetchInventoryZero(rank[i]); }, [&](const size_t i) { prefetchBitsZero(rank[i]); }, [&](const size_t i) { out[i] = selectZero(rank[i]); });
+	}
+
+	uint64_t select(const uint64_t rank, uint64_t *const next) const { return select<false>(rank, next); }
+
+	uint64_t selectZero(const uint64_t rank, uint64_t *const next) const { return select<true>(rank, next); }
+
+	/** Returns the number of words that select(uint64_t) scans for a given rank after the one
+	 * containing the position given by the inventories (e.g., to instrument queries).
+	 *
+	 * @param rank the rank of a one in the bit vector.
+	 */
+	uint64_t scannedWords(const uint64_t rank) const {
+		int residual;
+		return select(rank) / 64 - start<false>(rank, residual) / 64;
+	}
+
+	/** Returns an estimate of the size (in bits) of this structure. */
+	size_t bitCount() const { return inventory.bitCount() - sizeof(inventory) * 8 + sizeof(*this) * 8; };
+};
+
+} // namespace sux::bits
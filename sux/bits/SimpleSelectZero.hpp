@@ -75,8 +75,7 @@ template <util::AllocType AT = util::AllocType::MALLOC> class SimpleSelectZero {
 		num_words = (num_bits + 63) / 64;
 
 		// Init rank/select structure
-		uint64_t c = 0;
-		for (uint64_t i = 0; i < num_words; i++) c += __builtin_popcountll(~bits[i]);
+		uint64_t c = num_words * 64 - popcount_words(bits, num_words);
 		num_zeros = c;
 
 		if (num_bits % 64 != 0) c -= 64 - num_bits % 64;
@@ -255,17 +254,7 @@ template <util::AllocType AT = util::AllocType::MALLOC> class SimpleSelectZero {
 
 		if (residual == 0) return start;
 
-		uint64_t word_index = start / 64;
-		uint64_t word = ~bits[word_index] & -1ULL << start % 64;
-
-		for (;;) {
-			const int bit_count = __builtin_popcountll(word);
-			if (residual < bit_count) break;
-			word = ~bits[++word_index];
-			residual -= bit_count;
-		}
-
-		return word_index * 64 + select64(word, residual);
+		return select_from<true>(bits, num_words, start, residual);
 	}
 
 	/** Returns an estimate of the size (in bits) of this structure. */
@@ -70,6 +70,42 @@ template <util::AllocType AT = util::AllocType::MALLOC> class SimpleSelectZeroHa
 
 	uint64_t num_words, inventory_size, num_zeros;
 
+	// Fills the subinventories of the inventory entries [first..last), given the number c of zeros in the bit vector
+	void fill_subinventory(const uint64_t first, const uint64_t last, const uint64_t c) {
+		const uint64_t end = min(last * zeros_per_inventory, c);
+		uint16_t *p16;
+		int64_t *p64;
+		uint64_t start, span, inventory_index;
+		int offset;
+
+		for (uint64_t d = first * zeros_per_inventory, p = inventory[first * (longwords_per_subinventory + 1)]; d < end; p++)
+			if (~bits[p / 64] & 1ULL << p % 64) {
+				if ((d & zeros_per_inventory_mask) == 0) {
+					inventory_index = (d >> log2_zeros_per_inventory) * (longwords_per_subinventory + 1);
+					start = inventory[inventory_index];
+					span = inventory[inventory_index + longwords_per_subinventory + 1] - start;
+					offset = 0;
+					p64 = &inventory[inventory_index + 1];
+					p16 = (uint16_t *)p64;
+				}
+
+				if (span < (1 << 16)) {
+					assert(p - start <= (1 << 16));
+					if ((d & zeros_per_sub16_mask) == 0) {
+						assert(offset < longwords_per_subinventory * 4);
+						p16[offset++] = p - start;
+					}
+				} else {
+					if ((d & zeros_per_sub64_mask) == 0) {
+						assert(offset < longwords_per_subinventory);
+						p64[offset++] = p - start;
+					}
+				}
+
+				d++;
+			}
+	}
+
   public:
 	SimpleSelectZeroHalf() {}
 
@@ -77,14 +113,14 @@ template <util::AllocType AT = util::AllocType::MALLOC> class SimpleSelectZeroHa
 	 *
 	 * @param bits a bit vector of 64-bit words.
 	 * @param num_bits the length (in bits) of the bit vector.
+	 * @param num_threads the number of threads used to build the structure.
 	 */
 
-	SimpleSelectZeroHalf(const uint64_t *const bits, const uint64_t num_bits) : bits(bits) {
+	SimpleSelectZeroHalf(const uint64_t *const bits, const uint64_t num_bits, const size_t num_threads = 1) : bits(bits) {
 		num_words = (num_bits + 63) / 64;
 
 		// Init rank/select structure
-		uint64_t c = 0;
-		for (uint64_t i = 0; i < num_words; i++) c += __builtin_popcountll(~bits[i]);
+		uint64_t c = num_words * 64 - popcount_words(bits, num_words);
 		num_zeros = c;
 
 		if (num_bits % 64 != 0) c -= 64 - num_bits % 64;
@@ -100,64 +136,34 @@ template <util::AllocType AT = util::AllocType::MALLOC> class SimpleSelectZeroHa
 
 		inventory.size(inventory_size * (longwords_per_subinventory + 1) + 1);
 
-		uint64_t d = 0;
-		const uint64_t mask = zeros_per_inventory - 1;
-
-		// First phase: we build an inventory for each one out of zeros_per_inventory.
-		for (uint64_t i = 0; i < num_words; i++)
-			for (int j = 0; j < 64; j++) {
-				if (i * 64 + j >= num_bits) break;
-				if (~bits[i] & 1ULL << j) {
-					if ((d & mask) == 0) inventory[(d >> log2_zeros_per_inventory) * (longwords_per_subinventory + 1)] = i * 64 + j;
-					d++;
+		// First phase: we build an inventory for each zero out of zeros_per_inventory.
+		parallel_word_ranges<true>(bits, num_words, num_threads, 1, [&](const uint64_t begin, const uint64_t end, uint64_t d) {
+			for (uint64_t i = begin; i < end; i++)
+				for (int j = 0; j < 64; j++) {
+					if (i * 64 + j >= num_bits) break;
+					if (~bits[i] & 1ULL << j) {
+						if ((d & zeros_per_inventory_mask) == 0) inventory[(d >> log2_zeros_per_inventory) * (longwords_per_subinventory + 1)] = i * 64 + j;
+						d++;
+					}
 				}
-			}
+		});
 
-		assert(c == d);
 		inventory[inventory_size * (longwords_per_subinventory + 1)] = num_bits;
 
 #ifdef DEBUG
 		printf("Inventory entries filled: %" PRId64 "\n", inventory_size + 1);
 #endif
 
-		uint16_t *p16;
-		int64_t *p64;
+		// Each thread fills the subinventories of a range of inventory entries
+		const uint64_t chunk = (inventory_size + num_threads - 1) / num_threads;
+		parallel(num_threads, [&](const size_t t) {
+			const uint64_t first = min(inventory_size, t * chunk), last = min(inventory_size, first + chunk);
+			if (first < last) fill_subinventory(first, last, c);
+		});
 
-		d = 0;
-		uint64_t exact = 0, start, span, inventory_index;
-		int offset;
-
-		for (uint64_t i = 0; i < num_words; i++)
-			for (int j = 0; j < 64; j++) {
-				if (i * 64 + j >= num_bits) break;
-				if (~bits[i] & 1ULL << j) {
-					if ((d & mask) == 0) {
-						inventory_index = (d >> log2_zeros_per_inventory) * (longwords_per_subinventory + 1);
-						start = inventory[inventory_index];
-						span = inventory[inventory_index + longwords_per_subinventory + 1] - start;
-						if (span > (1 << 16)) inventory[inventory_index] = -inventory[inventory_index] - 1;
-						offset = 0;
-						p64 = &inventory[inventory_index + 1];
-						p16 = (uint16_t *)p64;
-					}
-
-					if (span < (1 << 16)) {
-						assert(i * 64 + j - start <= (1 << 16));
-						if ((d & zeros_per_sub16_mask) == 0) {
-							assert(offset < longwords_per_subinventory * 4);
-							p16[offset++] = i * 64 + j - start;
-						}
-					} else {
-						if ((d & zeros_per_sub64_mask) == 0) {
-							assert(offset < longwords_per_subinventory);
-							p64[offset++] = i * 64 + j - start;
-							exact++;
-						}
-					}
-
-					d++;
-				}
-			}
+		// Inventories with a large span are marked only now, as their start is needed by the previous ones
+		for (uint64_t inventory_index = 0; inventory_index < inventory_size * (longwords_per_subinventory + 1); inventory_index += longwords_per_subinventory + 1)
+			if (inventory[inventory_index + longwords_per_subinventory + 1] - inventory[inventory_index] > (1 << 16)) inventory[inventory_index] = -inventory[inventory_index] - 1;
 
 #ifdef DEBUG
 			// printf("Exact entries: %" PRId64 "\n", exact);
@@ -166,7 +172,36 @@ template <util::AllocType AT = util::AllocType::MALLOC> class SimpleSelectZeroHa
 #endif
 	}
 
-	uint64_t selectZero(const uint64_t rank) {
+	/** Prefetches the inventory entries that selectZero(uint64_t) will read for a given rank.
+	 *
+	 * @param rank the rank of a zero in the bit vector.
+	 */
+	void prefetchInventory(const uint64_t rank) const {
+		const uint64_t inventory_index = rank >> log2_zeros_per_inventory;
+		const int64_t *const inventory_start = &inventory + (inventory_index << log2_longwords_per_subinventory) + inventory_index;
+		__builtin_prefetch(inventory_start);
+		__builtin_prefetch(inventory_start + longwords_per_subinventory);
+	}
+
+	/** Reads the inventory entries for a given rank and prefetches the data that selectZero(uint64_t) will read next.
+	 *
+	 * The inventory entries should have been prefetched in advance using prefetchInventory().
+	 *
+	 * @param rank the rank of a zero in the bit vector.
+	 */
+	void prefetchBits(const uint64_t rank) const {
+		const uint64_t inventory_index = rank >> log2_zeros_per_inventory;
+		const int64_t *const inventory_start = &inventory + (inventory_index << log2_longwords_per_subinventory) + inventory_index;
+		const int64_t inventory_rank = *inventory_start;
+		const int subrank = rank & zeros_per_inventory_mask;
+
+		if (inventory_rank >= 0)
+			__builtin_prefetch(bits + (inventory_rank + ((uint16_t *)(inventory_start + 1))[subrank >> log2_zeros_per_sub16]) / 64);
+		else
+			__builtin_prefetch(bits + (-inventory_rank - 1 + *(inventory_start + 1 + (subrank >> log2_zeros_per_sub64))) / 64);
+	}
+
+	uint64_t selectZero(const uint64_t rank) const {
 #ifdef DEBUG
 		printf("Selecting %" PRId64 "\n...", rank);
 #endif
@@ -201,20 +236,20 @@ template <util::AllocType AT = util::AllocType::MALLOC> class SimpleSelectZeroHa
 
 		if (residual == 0) return start;
 
-		uint64_t word_index = start / 64;
-		uint64_t word = ~bits[word_index] & -1ULL << start % 64;
-
-		for (;;) {
-			const int bit_count = __builtin_popcountll(word);
-			if (residual < bit_count) break;
-			word = ~bits[++word_index];
-			residual -= bit_count;
-		}
+		return select_from<true>(bits, num_words, start, residual);
+	}
 
-		return word_index * 64 + select64(word, residual);
+	/** Selects a batch of ranks, prefetching the data needed by each query in advance.
+	 *
+	 * @param rank an array of `n` ranks of zeros in the bit vector.
+	 * @param out an array of `n` elements that will be filled with the positions of the zeros of given rank.
+	 * @param n the number of ranks.
+	 */
+	void selectZero(const uint64_t *rank, uint64_t *out, const size_t n) const {
+		batch_pipeline(n, [&](const size_t i) { prefetchInventory(rank[i]); }, [&](const size_t i) { prefetchBits(rank[i]); }, [&](const size_t i) { out[i] = selectZero(rank[i]); });
 	}
 
-	uint64_t selectZero(const uint64_t rank, uint64_t *const next) {
+	uint64_t selectZero(const uint64_t rank, uint64_t *const next) const {
 		const uint64_t s = selectZero(rank);
 		int curr = s / 64;
 
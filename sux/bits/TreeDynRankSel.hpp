@@ -0,0 +1,500 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2019-2020 Stefano Marchini
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../support/common.hpp"
+#include "../util/Vector.hpp"
+#include "DynamicBitVector.hpp"
+#include "Rank.hpp"
+#include "Select.hpp"
+#include "SelectZero.hpp"
+
+#include <algorithm>
+
+namespace sux::bits {
+
+/** Ranking and selection in a dynamic bit vector supporting
+ * insertions and deletions at arbitrary positions.
+ *
+ * The bit vector is split into leaves of at most `WORDS` words,
+ * which are the leaves of a B+-tree whose internal nodes store,
+ * for each child, the number of bits and ones in its subtree.
+ * All operations descend the tree and then scan a leaf. A full
+ * leaf is split in two halves; leaves are never merged, but the
+ * whole structure is rebuilt when deletions leave it less than
+ * one quarter full, so deletions have constant amortized overhead.
+ *
+ * Differently from WordDynRankSel and StrideDynRankSel, the bit
+ * vector is always owned by the instance, and it is not stored
+ * contiguously: words can be replaced using update(), but they
+ * cannot be accessed directly.
+ *
+ * @tparam WORDS the maximum length (in words) of a leaf, which must be even.
+ * @tparam AT a type of memory allocation for the underlying structure.
+ */
+template <size_t WORDS = 32, util::AllocType AT = util::AllocType::MALLOC> class TreeDynRankSel : public DynamicBitVector, public Rank, public Select, public SelectZero {
+	static_assert(WORDS >= 2 && WORDS % 2 == 0, "WORDS must be even and positive");
+
+  private:
+	static constexpr size_t LEAF_BITS = WORDS * 64;
+	static constexpr size_t ARITY = 16;
+	// Words per leaf and children per node of a newly built tree
+	static constexpr size_t FILL_WORDS = WORDS * 3 / 4, FILL_ARITY = ARITY * 3 / 4;
+	static constexpr size_t MAX_HEIGHT = 32;
+
+	// An internal node; its children are leaves if it is at depth Height - 1, internal nodes otherwise
+	struct Node {
+		uint64_t bits[ARITY];
+		uint64_t ones[ARITY];
+		uint64_t child[ARITY];
+		uint64_t count;
+	};
+
+	// A step of a path from the root: an internal node and the index of one of its children
+	struct Step {
+		size_t node, slot;
+	};
+
+	util::Vector<uint64_t, AT> Leaves;
+	util::Vector<Node, AT> Nodes;
+	size_t Root, Height, Size, Ones;
+
+  public:
+	/** Creates an empty instance. */
+	TreeDynRankSel() { build(nullptr, 0); }
+
+	/** Creates a new instance containing a copy of a given bit vector.
+	 *
+	 * @param bitvector a bit vector of 64-bit words.
+	 * @param size the length (in bits) of the bit vector.
+	 */
+	TreeDynRankSel(const uint64_t bitvector[], size_t size) { build(bitvector, size); }
+
+	using Rank::rank;
+	using Rank::rankZero;
+	virtual uint64_t rank(size_t pos) {
+		if (pos >= Size) return Ones;
+		size_t node = Root;
+		uint64_t rank = 0;
+		for (size_t d = 0; d < Height; d++) {
+			const Node &n = Nodes[node];
+			size_t i = 0;
+			for (; pos >= n.bits[i]; i++) {
+				pos -= n.bits[i];
+				rank += n.ones[i];
+			}
+			node = n.child[i];
+		}
+
+		const uint64_t *const leaf = &Leaves + node * WORDS;
+		for (size_t i = 0; i < pos / 64; i++) rank += nu(leaf[i]);
+		return rank + nu(leaf[pos / 64] & ((UINT64_C(1) << pos % 64) - 1));
+	}
+
+	virtual size_t select(uint64_t rank) {
+		if (rank >= Ones) return SIZE_MAX;
+		size_t node = Root, pos = 0;
+		for (size_t d = 0; d < Height; d++) {
+			const Node &n = Nodes[node];
+			size_t i = 0;
+			for (; rank >= n.ones[i]; i++) {
+				rank -= n.ones[i];
+				pos += n.bits[i];
+			}
+			node = n.child[i];
+		}
+
+		const uint64_t *const leaf = &Leaves + node * WORDS;
+		for (size_t i = 0;; i++) {
+			const uint64_t rank_chunk = nu(leaf[i]);
+			if (rank < rank_chunk) return pos + i * 64 + select64(leaf[i], rank);
+			rank -= rank_chunk;
+		}
+	}
+
+	virtual size_t selectZero(uint64_t rank) {
+		if (rank >= Size - Ones) return SIZE_MAX;
+		size_t node = Root, pos = 0;
+		for (size_t d = 0; d < Height; d++) {
+			const Node &n = Nodes[node];
+			size_t i = 0;
+			for (; rank >= n.bits[i] - n.ones[i]; i++) {
+				rank -= n.bits[i] - n.ones[i];
+				pos += n.bits[i];
+			}
+			node = n.child[i];
+		}
+
+		// The bits after the end of the leaf are zeroes, but they follow the one we are looking for
+		const uint64_t *const leaf = &Leaves + node * WORDS;
+		for (size_t i = 0;; i++) {
+			const uint64_t rank_chunk = nu(~leaf[i]);
+			if (rank < rank_chunk) return pos + i * 64 + select64(~leaf[i], rank);
+			rank -= rank_chunk;
+		}
+	}
+
+	/** Inserts a bit at a given position, shifting the following bits.
+	 *
+	 * @param pos a position from 0 to size() (included).
+	 * @param bit the bit to insert.
+	 */
+	void insert(size_t pos, bool bit) {
+		assert(pos <= Size);
+		Step path[MAX_HEIGHT];
+		for (;;) {
+			size_t offset = pos;
+			uint64_t *const leaf = descend(offset, path, true);
+			const size_t length = Nodes[path[Height - 1].node].bits[path[Height - 1].slot];
+			if (length == LEAF_BITS) {
+				split(path);
+				continue;
+			}
+
+			const size_t first = offset / 64;
+			const uint64_t mask = (UINT64_C(1) << offset % 64) - 1;
+			uint64_t carry = leaf[first] >> 63;
+			leaf[first] = (leaf[first] & mask) | uint64_t(bit) << offset % 64 | (leaf[first] & ~mask) << 1;
+			for (size_t i = first + 1; i <= length / 64; i++) {
+				const uint64_t w = leaf[i];
+				leaf[i] = w << 1 | carry;
+				carry = w >> 63;
+			}
+
+			adjust(path, 1, bit);
+			return;
+		}
+	}
+
+	/** Removes the bit at a given position, shifting the following bits.
+	 *
+	 * @param pos a position from 0 to size() (excluded).
+	 * @return the removed bit.
+	 */
+	bool erase(size_t pos) {
+		assert(pos < Size);
+		Step path[MAX_HEIGHT];
+		uint64_t *const leaf = descend(pos, path, false);
+		const size_t length = Nodes[path[Height - 1].node].bits[path[Height - 1].slot];
+
+		const size_t first = pos / 64;
+		const uint64_t mask = (UINT64_C(1) << pos % 64) - 1;
+		const bool bit = leaf[first] >> pos % 64 & 1;
+		leaf[first] = (leaf[first] & mask) | (leaf[first] >> 1 & ~mask);
+		for (size_t i = first + 1; i <= (length - 1) / 64; i++) {
+			leaf[i - 1] |= leaf[i] << 63;
+			leaf[i] >>= 1;
+		}
+
+		adjust(path, -1, -int64_t(bit));
+		if (Leaves.size() / WORDS * LEAF_BITS > 4 * (Size + LEAF_BITS)) rebuild();
+		return bit;
+	}
+
+	/** Appends a bit at the end of the bit vector.
+	 *
+	 * @param bit the bit to append.
+	 */
+	void pushBack(bool bit) { insert(Size, bit); }
+
+	/** Removes the bit at the end of the bit vector.
+	 *
+	 * @return the removed bit.
+	 */
+	bool popBack() { return erase(Size - 1); }
+
+	/** Replaces the bits from position 64 `index` (included) to 64 (`index` + 1) (excluded).
+	 *
+	 * Bits beyond the end of the bit vector are ignored.
+	 *
+	 * @param index index (in words) in the bitvector.
+	 * @param word new value for the bits.
+	 * @return the replaced bits.
+	 */
+	virtual uint64_t update(size_t index, uint64_t word) {
+		Step path[MAX_HEIGHT];
+		uint64_t old = 0;
+		for (size_t pos = index * 64, end = std::min(pos + 64, Size); pos < end;) {
+			// The word might span several leaves
+			size_t offset = pos;
+			uint64_t *const leaf = descend(offset, path, false);
+			const size_t length = Nodes[path[Height - 1].node].bits[path[Height - 1].slot];
+			const size_t width = std::min(length - offset, end - pos), shift = pos - index * 64, b = offset % 64;
+			const uint64_t mask = width == 64 ? UINT64_MAX : (UINT64_C(1) << width) - 1;
+
+			uint64_t *const w = leaf + offset / 64;
+			uint64_t prev = w[0] >> b;
+			if (b + width > 64) prev |= w[1] << (64 - b);
+			prev &= mask;
+			const uint64_t next = word >> shift & mask;
+			w[0] = (w[0] & ~(mask << b)) | next << b;
+			if (b + width > 64) w[1] = (w[1] & ~(mask >> (64 - b))) | next >> (64 - b);
+
+			old |= prev << shift;
+			adjust(path, 0, int64_t(nu(next)) - nu(prev));
+			pos += width;
+		}
+
+		return old;
+	}
+
+	virtual bool set(size_t index) {
+		return modify(index, [](bool) { return true; });
+	}
+
+	virtual bool clear(size_t index) {
+		return modify(index, [](bool) { return false; });
+	}
+
+	virtual bool toggle(size_t index) {
+		return modify(index, [](bool bit) { return !bit; });
+	}
+
+	virtual size_t size() const { return Size; }
+
+	virtual size_t bitCount() const { return Leaves.bitCount() - sizeof(Leaves) * 8 + Nodes.bitCount() - sizeof(Nodes) * 8 + sizeof(*this) * 8; }
+
+  private:
+	// Descends from the root to the leaf containing a given position, replacing the position with its
+	// offset in the leaf and recording the path; when inserting, the leaf can also end at the position
+	uint64_t *descend(size_t &pos, Step *path, const bool insert) {
+		size_t node = Root;
+		for (size_t d = 0; d < Height; d++) {
+			const Node &n = Nodes[node];
+			size_t i = 0;
+			while (i < n.count - 1 && (pos > n.bits[i] || (!insert && pos == n.bits[i]))) pos -= n.bits[i++];
+			path[d] = {node, i};
+			node = n.child[i];
+		}
+
+		return &Leaves + node * WORDS;
+	}
+
+	// Adds given numbers of bits and ones to the counts along a path
+	void adjust(const Step *path, const int64_t bits, const int64_t ones) {
+		for (size_t d = 0; d < Height; d++) {
+			Node &n = Nodes[path[d].node];
+			n.bits[path[d].slot] += bits;
+			n.ones[path[d].slot] += ones;
+		}
+
+		Size += bits;
+		Ones += ones;
+	}
+
+	// Replaces the bit of given index with f(bit), returning the previous bit
+	template <typename F> bool modify(size_t index, F f) {
+		assert(index < Size);
+		Step path[MAX_HEIGHT];
+		uint64_t *const leaf = descend(index, path, false);
+		const uint64_t bit = UINT64_C(1) << index % 64;
+		const bool old = (leaf[index / 64] & bit) != 0;
+		if (f(old) != old) {
+			leaf[index / 64] ^= bit;
+			adjust(path, 0, old ? -1 : 1);
+		}
+
+		return old;
+	}
+
+	// Moves the second half of the (full) leaf at the end of a path to a new leaf
+	void split(const Step *path) {
+		const size_t leaf = Leaves.size() / WORDS;
+		Leaves.resize(Leaves.size() + WORDS);
+		const Step &last = path[Height - 1];
+		uint64_t *const src = &Leaves + Nodes[last.node].child[last.slot] * WORDS + WORDS / 2, *const dst = &Leaves + leaf * WORDS;
+
+		uint64_t ones = 0;
+		for (size_t i = 0; i < WORDS / 2; i++) {
+			ones += nu(src[i]);
+			dst[i] = src[i];
+			src[i] = 0;
+		}
+
+		insertChild(path, Height - 1, leaf, LEAF_BITS / 2, ones);
+	}
+
+	// Inserts a new child, containing given numbers of bits and ones moved out of the child at a given depth of
+	// a path, right after the latter; a full node is split in two halves, and the split might propagate to the root
+	void insertChild(const Step *path, const size_t depth, const size_t child, const uint64_t bits, const uint64_t ones) {
+		size_t node = path[depth].node, slot = path[depth].slot;
+
+		if (Nodes[node].count == ARITY) {
+			const size_t sibling = Nodes.size();
+			Nodes.resize(sibling + 1);
+			Node &n = Nodes[node], &s = Nodes[sibling];
+			uint64_t kept_bits = 0, kept_ones = 0, moved_bits = 0, moved_ones = 0;
+			for (size_t i = 0; i < ARITY / 2; i++) {
+				kept_bits += n.bits[i];
+				kept_ones += n.ones[i];
+				s.bits[i] = n.bits[ARITY / 2 + i];
+				s.ones[i] = n.ones[ARITY / 2 + i];
+				s.child[i] = n.child[ARITY / 2 + i];
+				moved_bits += s.bits[i];
+				moved_ones += s.ones[i];
+			}
+			n.count = s.count = ARITY / 2;
+
+			if (depth == 0) {
+				assert(Height < MAX_HEIGHT);
+				Root = Nodes.size();
+				Nodes.resize(Root + 1);
+				Node &r = Nodes[Root];
+				r.bits[0] = kept_bits;
+				r.ones[0] = kept_ones;
+				r.child[0] = node;
+				r.bits[1] = moved_bits;
+				r.ones[1] = moved_ones;
+				r.child[1] = sibling;
+				r.count = 2;
+				Height++;
+			} else
+				insertChild(path, depth - 1, sibling, moved_bits, moved_ones);
+
+			if (slot >= ARITY / 2) {
+				node = sibling;
+				slot -= ARITY / 2;
+			}
+		}
+
+		Node &n = Nodes[node];
+		for (size_t i = n.count; i > slot + 1; i--) {
+			n.bits[i] = n.bits[i - 1];
+			n.ones[i] = n.ones[i - 1];
+			n.child[i] = n.child[i - 1];
+		}
+		n.bits[slot] -= bits;
+		n.ones[slot] -= ones;
+		n.bits[slot + 1] = bits;
+		n.ones[slot + 1] = ones;
+		n.child[slot + 1] = child;
+		n.count++;
+	}
+
+	// Builds a tree containing a copy of a given bit vector, filling leaves and nodes to three quarters of their capacity
+	void build(const uint64_t *const bitvector, const size_t size) {
+		const size_t words = (size + 63) / 64, leaves = std::max(size_t(1), (words + FILL_WORDS - 1) / FILL_WORDS);
+		Leaves = util::Vector<uint64_t, AT>(leaves * WORDS);
+		Nodes = util::Vector<Node, AT>();
+		Size = size;
+		Ones = 0;
+
+		// The counts and the indices of the children of the level under construction
+		unique_ptr<uint64_t[]> bits = make_unique<uint64_t[]>(leaves), ones = make_unique<uint64_t[]>(leaves), child = make_unique<uint64_t[]>(leaves);
+		for (size_t l = 0; l < leaves; l++) {
+			for (size_t i = l * FILL_WORDS; i < std::min(words, (l + 1) * FILL_WORDS); i++) {
+				const uint64_t w = i == words - 1 && size % 64 != 0 ? bitvector[i] & ((UINT64_C(1) << size % 64) - 1) : bitvector[i];
+				Leaves[l * WORDS + i - l * FILL_WORDS] = w;
+				ones[l] += nu(w);
+			}
+			bits[l] = std::min(FILL_WORDS * 64, size - l * FILL_WORDS * 64);
+			child[l] = l;
+			Ones += ones[l];
+		}
+
+		Height = 0;
+		for (size_t m = leaves;; Height++) {
+			if (Height != 0 && m == 1) break;
+			const size_t nodes = (m + FILL_ARITY - 1) / FILL_ARITY;
+			for (size_t j = 0; j < nodes; j++) {
+				const size_t node = Nodes.size();
+				Nodes.resize(node + 1);
+				Node &n = Nodes[node];
+				uint64_t b = 0, o = 0;
+				for (size_t i = j * FILL_ARITY; i < std::min(m, (j + 1) * FILL_ARITY); i++) {
+					n.bits[n.count] = bits[i];
+					n.ones[n.count] = ones[i];
+					n.child[n.count++] = child[i];
+					b += bits[i];
+					o += ones[i];
+				}
+				bits[j] = b;
+				ones[j] = o;
+				child[j] = node;
+			}
+			m = nodes;
+		}
+
+		Root = child[0];
+	}
+
+	// Rebuilds the tree from a copy of the bit vector
+	void rebuild() {
+		util::Vector<uint64_t, AT> bitvector(Size / 64 + 1);
+		size_t pos = 0;
+		copy(Root, 0, &bitvector, pos);
+		build(&bitvector, Size);
+	}
+
+	// Appends the bits of the subtree of a node at a given depth to a zeroed bit vector, starting at a given position
+	void copy(const size_t node, const size_t depth, uint64_t *const bitvector, size_t &pos) const {
+		const Node &n = Nodes[node];
+		for (size_t i = 0; i < n.count; i++) {
+			if (depth + 1 < Height) {
+				copy(n.child[i], depth + 1, bitvector, pos);
+				continue;
+			}
+
+			// The bits after the end of the leaf are zeroes
+			const uint64_t *const leaf = &Leaves + n.child[i] * WORDS;
+			for (size_t j = 0; j * 64 < n.bits[i]; j++) {
+				const size_t width = std::min(size_t(64), n.bits[i] - j * 64);
+				bitvector[pos / 64] |= leaf[j] << pos % 64;
+				if (pos % 64 + width > 64) bitvector[pos / 64 + 1] |= leaf[j] >> (64 - pos % 64);
+				pos += width;
+			}
+		}
+	}
+
+	friend std::ostream &operator<<(std::ostream &os, const TreeDynRankSel<WORDS, AT> &bv) {
+		util::Vector<uint64_t, AT> bitvector(bv.Size / 64 + 1);
+		size_t pos = 0;
+		bv.copy(bv.Root, 0, &bitvector, pos);
+		serialization::writeHeader(os, serialization::tag("TreeDyRS"), {WORDS}, {bv.Size});
+		serialization::writeSection(os, &bitvector, (bv.Size + 63) / 64);
+		return os;
+	}
+
+	// Only the bit vector is serialized, and the tree is rebuilt when reading it
+	friend std::istream &operator>>(std::istream &is, TreeDynRankSel<WORDS, AT> &bv) {
+		uint64_t size, words, sum;
+		if (!serialization::readHeader(is, serialization::tag("TreeDyRS"), {WORDS}, {&size})) return is;
+		if (!serialization::readSectionHeader(is, sizeof(uint64_t), words, sum)) return is;
+		if (words != (size + 63) / 64) {
+			is.setstate(std::ios::failbit);
+			return is;
+		}
+		util::Vector<uint64_t, AT> bitvector(words + 1);
+		if (!serialization::readSectionData(is, &bitvector, words, sum)) return is;
+		bv.build(&bitvector, size);
+		return is;
+	}
+};
+
+} // namespace sux::bits
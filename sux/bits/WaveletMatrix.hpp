@@ -0,0 +1,335 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2007-2020 Sebastiano Vigna
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../support/common.hpp"
+#include "../util/Vector.hpp"
+#include "Rank9.hpp"
+#include "SimpleSelectBoth.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace sux::bits {
+
+/** A wavelet matrix, providing access, rank and select on sequences of integers.
+ *
+ * A sequence of integers of <var>w</var> bits is represented by <var>w</var> bit planes of the
+ * same length: the first plane contains the most significant bit of each element; then the
+ * elements are stably partitioned by that bit (zeros first), and the next plane contains the
+ * second most significant bit of the permuted elements, and so on. Each plane is indexed by
+ * a Rank9 and by a SimpleSelectBoth, so all queries perform <var>w</var> constant-time rank or select
+ * operations.
+ *
+ * The elements are stably partitioned level by level, as each permutation depends on the previous
+ * one, but each level is split among threads, and the rank/select structures of the planes
+ * are built in parallel.
+ *
+ * @tparam AT a type of memory allocation out of util::AllocType.
+ */
+
+template <util::AllocType AT = util::AllocType::MALLOC> class WaveletMatrix {
+	size_t length = 0;
+	int width = 0;
+	uint64_t words_per_plane = 0;
+	// The planes; each takes words_per_plane words, leaving a free bit for rank(length)
+	util::Vector<uint64_t, AT> bits;
+	// The number of zeros of each plane
+	std::vector<uint64_t> zeros;
+	std::vector<Rank9<AT>> ranks;
+	std::vector<SimpleSelectBoth<AT>> selects;
+
+	const uint64_t *plane(const int l) const { return &bits + l * words_per_plane; }
+
+	uint64_t bit(const int l, const size_t pos) const { return plane(l)[pos / 64] >> pos % 64 & 1; }
+
+	// Maps a position on level l to the next level, following a given bit
+	uint64_t down(const int l, const uint64_t b, const size_t pos) {
+		const uint64_t ones = ranks[l].rank(pos);
+		return b ? zeros[l] + ones : pos - ones;
+	}
+
+	// Maps the range of positions [begin..end) to the range of the elements with a given
+	// value on the last level; returns false if the value has more than width bits
+	bool range(const uint64_t value, size_t &begin, size_t &end) {
+		if (width < 64 && value >> width != 0) return false;
+		for (int l = 0; l < width; l++) {
+			const uint64_t b = value >> (width - 1 - l) & 1;
+			begin = down(l, b, begin);
+			end = down(l, b, end);
+		}
+		return true;
+	}
+
+  public:
+	WaveletMatrix() {}
+
+	/** Creates a new instance from a given sequence of integers.
+	 *
+	 * @param values the sequence of integers.
+	 * @param length the length of the sequence.
+	 * @param num_threads the number of threads used to build the structure.
+	 */
+	WaveletMatrix(const uint64_t *const values, const size_t length, const size_t num_threads = 1) : length(length) {
+		uint64_t max = 0;
+		for (size_t i = 0; i < length; i++) max = std::max(max, values[i]);
+		width = max == 0 ? 1 : lambda(max) + 1;
+		words_per_plane = length / 64 + 1;
+		bits.size(words_per_plane * width);
+		zeros.resize(width);
+
+		// Each thread handles a range of whole words of the planes
+		const uint64_t num_words = (length + 63) / 64;
+		const size_t threads = std::max(size_t(1), std::min(num_threads, size_t(num_words)));
+		auto first_word = [&](const size_t t) { return t * num_words / threads; };
+		std::vector<uint64_t> cur(values, values + length), next(length), zeros_before(threads + 1);
+
+		for (int l = 0; l < width; l++) {
+			const int shift = width - 1 - l;
+			uint64_t *const p = &bits + l * words_per_plane;
+			parallel(threads, [&](const size_t t) {
+				const size_t begin = first_word(t) * 64, end = std::min(uint64_t(length), first_word(t + 1) * 64);
+				uint64_t z = 0;
+				for (size_t i = begin; i < end; i++) {
+					const uint64_t b = cur[i] >> shift & 1;
+					p[i / 64] |= b << i % 64;
+					z += b ^ 1;
+				}
+				zeros_before[t + 1] = z;
+			});
+
+			for (size_t t = 0; t < threads; t++) zeros_before[t + 1] += zeros_before[t];
+			zeros[l] = zeros_before[threads];
+			if (l == width - 1) break;
+
+			// Stable partition by the current bit
+			parallel(threads, [&](const size_t t) {
+				const size_t begin = first_word(t) * 64, end = std::min(uint64_t(length), first_word(t + 1) * 64);
+				uint64_t z = zeros_before[t], o = zeros[l] + begin - zeros_before[t];
+				for (size_t i = begin; i < end; i++) next[cur[i] >> shift & 1 ? o++ : z++] = cur[i];
+			});
+			cur.swap(next);
+		}
+
+		// The rank/select structures of the planes are independent
+		ranks.resize(width);
+		selects.resize(width);
+		const size_t plane_threads = std::max(size_t(1), std::min(num_threads, size_t(width)));
+		const size_t threads_per_plane = std::max(size_t(1), num_threads / width);
+		parallel(plane_threads, [&](const size_t t) {
+			for (int l = t; l < width; l += plane_threads) {
+				ranks[l] = Rank9<AT>(plane(l), length, threads_per_plane);
+				selects[l] = SimpleSelectBoth<AT>(plane(l), length, threads_per_plane);
+			}
+		});
+	}
+
+	/** Creates a new instance from a given sequence of integers.
+	 *
+	 * @param values the sequence of integers.
+	 * @param num_threads the number of threads used to build the structure.
+	 */
+	WaveletMatrix(const std::vector<uint64_t> &values, const size_t num_threads = 1) : WaveletMatrix(values.data(), values.size(), num_threads) {}
+
+	/** Returns the element at a given position.
+	 *
+	 * @param pos a position smaller than size().
+	 */
+	uint64_t access(size_t pos) {
+		assert(pos < length);
+		uint64_t value = 0;
+		for (int l = 0; l < width; l++) {
+			const uint64_t b = bit(l, pos);
+			pos = down(l, b, pos);
+			value = value << 1 | b;
+		}
+		return value;
+	}
+
+	/** Returns the elements at given positions, prefetching the data needed by several queries at a time.
+	 *
+	 * @param pos the positions.
+	 * @param out an array where the elements will be stored.
+	 * @param n the number of positions.
+	 */
+	void access(const size_t *pos, uint64_t *out, const size_t n) {
+		std::vector<size_t> p(pos, pos + n);
+		std::fill(out, out + n, 0);
+		for (int l = 0; l < width; l++) {
+			batch_pipeline(
+				n, [&](const size_t i) { ranks[l].prefetch(p[i]); }, [](size_t) {},
+				[&](const size_t i) {
+					const uint64_t b = bit(l, p[i]);
+					p[i] = down(l, b, p[i]);
+					out[i] = out[i] << 1 | b;
+				});
+		}
+	}
+
+	/** Returns the number of occurrences of a value before a given position.
+	 *
+	 * @param value a value.
+	 * @param pos a position smaller than or equal to size().
+	 */
+	uint64_t rank(const uint64_t value, const size_t pos) {
+		assert(pos <= length);
+		size_t begin = 0, end = pos;
+		return range(value, begin, end) ? end - begin : 0;
+	}
+
+	/** Returns the number of occurrences of values before positions, prefetching the data needed by several queries at a time.
+	 *
+	 * @param value the values.
+	 * @param pos the positions.
+	 * @param out an array where the ranks will be stored.
+	 * @param n the number of queries.
+	 */
+	void rank(const uint64_t *value, const size_t *pos, uint64_t *out, const size_t n) {
+		std::vector<size_t> begin(n);
+		std::copy(pos, pos + n, out);
+		for (size_t i = 0; i < n; i++)
+			// Values with more than width bits never occur
+			if (width < 64 && value[i] >> width != 0) out[i] = 0;
+
+		for (int l = 0; l < width; l++) {
+			batch_pipeline(
+				n,
+				[&](const size_t i) {
+					ranks[l].prefetch(begin[i]);
+					ranks[l].prefetch(out[i]);
+				},
+				[](size_t) {},
+				[&](const size_t i) {
+					const uint64_t b = value[i] >> (width - 1 - l) & 1;
+					begin[i] = down(l, b, begin[i]);
+					out[i] = down(l, b, out[i]);
+				});
+		}
+
+		for (size_t i = 0; i < n; i++) out[i] -= begin[i];
+	}
+
+	/** Returns the position of the occurrence of a value of given rank.
+	 *
+	 * @param value a value.
+	 * @param rank the rank of an occurrence of the value (starting from zero).
+	 * @return the position of the occurrence, or `SIZE_MAX` if there are at most `rank` occurrences.
+	 */
+	size_t select(const uint64_t value, const uint64_t rank) {
+		size_t begin = 0, end = length;
+		if (!range(value, begin, end) || rank >= end - begin) return SIZE_MAX;
+
+		uint64_t pos = begin + rank;
+		for (int l = width; l-- != 0;) pos = value >> (width - 1 - l) & 1 ? selects[l].select(pos - zeros[l]) : selects[l].selectZero(pos);
+		return pos;
+	}
+
+	/** Returns the element of given rank (starting from zero) in increasing order among the elements in a range of positions.
+	 *
+	 * @param begin the first position of the range.
+	 * @param end the position after the last one of the range.
+	 * @param k a rank smaller than `end - begin`.
+	 */
+	uint64_t quantile(size_t begin, size_t end, uint64_t k) {
+		assert(begin <= end && end <= length && k < end - begin);
+		uint64_t value = 0;
+		for (int l = 0; l < width; l++) {
+			const uint64_t ones_begin = ranks[l].rank(begin), ones_end = ranks[l].rank(end);
+			const uint64_t z = (end - begin) - (ones_end - ones_begin);
+			if (k < z) {
+				begin -= ones_begin;
+				end -= ones_end;
+				value <<= 1;
+			} else {
+				k -= z;
+				begin = zeros[l] + ones_begin;
+				end = zeros[l] + ones_end;
+				value = value << 1 | 1;
+			}
+		}
+		return value;
+	}
+
+	/** Returns the most frequent values in a range of positions.
+	 *
+	 * Values are expanded from the most significant bit, most frequent prefixes first,
+	 * so the cost is proportional to the width times the number of distinct prefixes that
+	 * are at least as frequent as the k-th most frequent value.
+	 *
+	 * @param begin the first position of the range.
+	 * @param end the position after the last one of the range.
+	 * @param k the maximum number of values to return.
+	 * @return the (at most `k`) most frequent values, with their number of occurrences,
+	 * in nonincreasing order of frequency; ties are broken arbitrarily.
+	 */
+	std::vector<std::pair<uint64_t, uint64_t>> topK(const size_t begin, const size_t end, const size_t k) {
+		assert(begin <= end && end <= length);
+		struct Node {
+			size_t begin, end;
+			int level;
+			uint64_t prefix;
+			bool operator<(const Node &n) const { return end - begin < n.end - n.begin; }
+		};
+
+		std::vector<std::pair<uint64_t, uint64_t>> result;
+		std::priority_queue<Node> queue;
+		if (begin < end) queue.push({begin, end, 0, 0});
+		while (!queue.empty() && result.size() < k) {
+			const Node n = queue.top();
+			queue.pop();
+			if (n.level == width) {
+				result.emplace_back(n.prefix, n.end - n.begin);
+				continue;
+			}
+			const uint64_t ones_begin = ranks[n.level].rank(n.begin), ones_end = ranks[n.level].rank(n.end);
+			if (ones_end - ones_begin != n.end - n.begin) queue.push({n.begin - ones_begin, n.end - ones_end, n.level + 1, n.prefix << 1});
+			if (ones_end != ones_begin) queue.push({zeros[n.level] + ones_begin, zeros[n.level] + ones_end, n.level + 1, n.prefix << 1 | 1});
+		}
+		return result;
+	}
+
+	/** Returns the number of bits of the elements (i.e., the number of planes). */
+	int bitWidth() const { return width; }
+
+	/** Returns an estimate of the size in bits of this structure. */
+	size_t bitCount() const {
+		size_t count = bits.bitCount() - sizeof(bits) * 8 + zeros.capacity() * 64 + sizeof(*this) * 8;
+		for (int l = 0; l < width; l++) count += ranks[l].bitCount() + selects[l].bitCount();
+		return count;
+	}
+
+	/** Returns the length of the sequence. */
+	size_t size() const { return length; }
+};
+
+} // namespace sux::bits
@@ -28,6 +28,7 @@
 
 #pragma once
 
+#include "../util/CowVector.hpp"
 #include "../util/Vector.hpp"
 #include "DynamicBitVector.hpp"
 #include "Rank.hpp"
@@ -49,6 +50,28 @@ namespace sux::bits {
  * argument size(), you must have at least one additional
  * free bit at the end of the provided bit vector.
  *
+ * Alternatively, an instance can own its bit vector (see the
+ * constructors taking no bit vector or a util::Vector), in which
+ * case bits can be appended and removed at the end using
+ * pushBack() and popBack(): the storage grows geometrically, so
+ * appends take amortized constant time plus an SPS::push(). For
+ * insertions and deletions in the middle, see TreeDynRankSel.
+ *
+ * If SPS supports concurrent updates (e.g., sux::util::FenwickAtomicF),
+ * the mutation methods can be called concurrently, as the words of the
+ * bit vector are then modified atomically. Ranking and selection are
+ * exact when there are no concurrent mutations; otherwise, they are not
+ * linearizable, as they might see a concurrent mutation partially, or
+ * concurrent mutations in an order different from the actual one (so, e.g.,
+ * rank() and select() might disagree). Queries that must be consistent
+ * while the vector changes require an SPS supporting snapshots.
+ *
+ * If SPS supports snapshots (e.g., sux::util::FenwickPersistentL), the
+ * bit vector is always owned and stored in a sux::util::CowVector, and
+ * snapshot() returns in constant time an instance that is not affected
+ * by subsequent mutations, and that can be queried by another thread
+ * without locking.
+ *
  * @tparam SPS underlying sux::util::SearchablePrefixSums implementation.
  * @tparam AT a type of memory allocation for the underlying structure.
  */
@@ -56,9 +79,18 @@ namespace sux::bits {
 template <template <size_t, util::AllocType AT> class SPS, util::AllocType AT = util::AllocType::MALLOC> class WordDynRankSel : public DynamicBitVector, public Rank, public Select, public SelectZero {
   private:
 	static constexpr size_t BOUND = 64;
-	uint64_t *const Vector;
+	// Whether SPS supports concurrent updates, in which case the bit vector is accessed atomically
+	static constexpr bool CONCURRENT = SPS<BOUND, AT>::CONCURRENT;
+	// Whether SPS supports snapshots, in which case the bit vector is stored in Words
+	static constexpr bool PERSISTENT = SPS<BOUND, AT>::PERSISTENT;
+	static_assert(!CONCURRENT || !PERSISTENT, "Concurrent updates and snapshots cannot be combined");
+	uint64_t *Vector;
 	size_t Size;
 	SPS<BOUND, AT> SrcPrefSum;
+	// The bit vector, if owned by this instance; it always contains at least one word more than necessary
+	util::Vector<uint64_t, AT> Storage;
+	// The bit vector, if SPS supports snapshots (with the same size as Storage)
+	util::CowVector Words;
 
   public:
 	/** Creates a new instance using a given bit vector.
@@ -75,18 +107,108 @@ template <template <size_t, util::AllocType AT> class SPS, util::AllocType AT =
 	 * @param bitvector a bit vector of 64-bit words.
 	 * @param size the length (in bits) of the bit vector.
 	 */
-	WordDynRankSel(uint64_t bitvector[], size_t size) : Vector(bitvector), Size(size), SrcPrefSum(buildSrcPrefSum(bitvector, divRoundup(size, BOUND))) {}
+	WordDynRankSel(uint64_t bitvector[], size_t size) : Vector(bitvector), Size(size), SrcPrefSum(buildSrcPrefSum(bitvector, divRoundup(size, BOUND))) {
+		if constexpr (PERSISTENT) persist();
+	}
+
+	/** Creates a new instance owning a given bit vector.
+	 *
+	 * The bit vector is enlarged, if necessary, so that rank(size_t) can be called with argument size().
+	 *
+	 * @param bitvector a bit vector of 64-bit words, which will be moved into this instance.
+	 * @param size the length (in bits) of the bit vector.
+	 */
+	WordDynRankSel(util::Vector<uint64_t, AT> bitvector, size_t size) : Size(size), Storage(std::move(bitvector)) {
+		if (Storage.size() < size / 64 + 1) Storage.resize(size / 64 + 1);
+		Vector = &Storage;
+		SrcPrefSum = buildSrcPrefSum(Vector, divRoundup(size, BOUND));
+		if constexpr (PERSISTENT) persist();
+	}
 
+	/** Creates an empty instance owning its bit vector, which can be filled using pushBack(). */
+	WordDynRankSel() : WordDynRankSel(util::Vector<uint64_t, AT>(1), 0) {}
+
+	/** Returns the bit vector, or `nullptr` if SPS supports snapshots. */
 	uint64_t *bitvector() const { return Vector; }
 
+	/** Returns whether this instance owns its bit vector, and thus supports pushBack() and popBack(). */
+	bool ownsBits() const { return PERSISTENT || Vector == &Storage; }
+
+	/** Returns a snapshot of this instance in constant time.
+	 *
+	 * This method is available only if SPS supports snapshots. The snapshot is not
+	 * affected by subsequent mutations of this instance (and vice versa), and it can
+	 * be used by another thread while this instance is mutated. This method must not be
+	 * called concurrently with mutations.
+	 */
+	WordDynRankSel snapshot() const {
+		static_assert(PERSISTENT, "Snapshots require a persistent SPS");
+		WordDynRankSel snapshot;
+		snapshot.Size = Size;
+		snapshot.SrcPrefSum = SrcPrefSum.snapshot();
+		snapshot.Words = Words;
+		return snapshot;
+	}
+
+	/** Appends a bit at the end of the bit vector.
+	 *
+	 * This method can be called only if this instance owns its bit vector,
+	 * and it must not be called concurrently with other methods.
+	 *
+	 * @param bit the bit to append.
+	 */
+	void pushBack(bool bit) {
+		assert(ownsBits());
+		if constexpr (PERSISTENT) {
+			Words.resize(Size / 64 + 2);
+			if (bit) modify(Size / 64, [this](uint64_t w) { return w | uint64_t(1) << Size % 64; });
+		} else {
+			Storage.resize(Size / 64 + 2);
+			Vector = &Storage;
+			Vector[Size / 64] |= uint64_t(bit) << Size % 64;
+		}
+		if (Size % 64 == 0)
+			SrcPrefSum.push(bit);
+		else if (bit)
+			SrcPrefSum.add(Size / 64 + 1, 1);
+		Size++;
+	}
+
+	/** Removes the bit at the end of the bit vector.
+	 *
+	 * This method can be called only if this instance owns its bit vector,
+	 * and it must not be called concurrently with other methods.
+	 *
+	 * @return the removed bit.
+	 */
+	bool popBack() {
+		assert(ownsBits() && Size > 0);
+		Size--;
+		const bool bit = word(Size / 64) >> Size % 64 & 1;
+		if constexpr (PERSISTENT) {
+			if (bit) modify(Size / 64, [this](uint64_t w) { return w & ~(uint64_t(1) << Size % 64); });
+		} else
+			Vector[Size / 64] &= ~(uint64_t(1) << Size % 64);
+		if (Size % 64 == 0)
+			SrcPrefSum.pop();
+		else if (bit)
+			SrcPrefSum.add(Size / 64 + 1, -1);
+		if constexpr (PERSISTENT)
+			Words.resize(Size / 64 + 1);
+		else
+			Storage.resize(Size / 64 + 1);
+		return bit;
+	}
+
 	using Rank::rank;
 	using Rank::rankZero;
-	virtual uint64_t rank(size_t pos) { return SrcPrefSum.prefix(pos / 64) + nu(Vector[pos / 64] & ((1ULL << (pos % 64)) - 1)); }
+	virtual uint64_t rank(size_t pos) { return SrcPrefSum.prefix(pos / 64) + nu(word(pos / 64) & ((1ULL << (pos % 64)) - 1)); }
 
 	virtual size_t select(uint64_t rank) {
 		size_t idx = SrcPrefSum.find(&rank);
-		uint64_t rank_chunk = nu(Vector[idx]);
-		if (rank < rank_chunk) return idx * 64 + select64(Vector[idx], rank);
+		const uint64_t w = word(idx);
+		uint64_t rank_chunk = nu(w);
+		if (rank < rank_chunk) return idx * 64 + select64(w, rank);
 
 		return SIZE_MAX;
 	}
@@ -94,25 +216,25 @@ template <template <size_t, util::AllocType AT> class SPS, util::AllocType AT =
 	virtual size_t selectZero(uint64_t rank) {
 		const size_t idx = SrcPrefSum.compFind(&rank);
 
-		uint64_t rank_chunk = nu(~Vector[idx]);
-		if (rank < rank_chunk) return idx * 64 + select64(~Vector[idx], rank);
+		const uint64_t w = ~word(idx);
+		uint64_t rank_chunk = nu(w);
+		if (rank < rank_chunk) return idx * 64 + select64(w, rank);
 
 		return SIZE_MAX;
 	}
 
 	virtual uint64_t update(size_t index, uint64_t word) {
-		uint64_t old = Vector[index];
-		Vector[index] = word;
+		const uint64_t old = modify(index, [word](uint64_t) { return word; });
 		SrcPrefSum.add(index + 1, nu(word) - nu(old));
 
 		return old;
 	}
 
 	virtual bool set(size_t index) {
-		uint64_t old = Vector[index / 64];
-		Vector[index / 64] |= uint64_t(1) << (index % 64);
+		const uint64_t bit = uint64_t(1) << (index % 64);
+		const uint64_t old = modify(index / 64, [bit](uint64_t w) { return w | bit; });
 
-		if (Vector[index / 64] != old) {
+		if ((old & bit) == 0) {
 			SrcPrefSum.add(index / 64 + 1, 1);
 			return false;
 		}
@@ -121,10 +243,10 @@ template <template <size_t, util::AllocType AT> class SPS, util::AllocType AT =
 	}
 
 	virtual bool clear(size_t index) {
-		uint64_t old = Vector[index / 64];
-		Vector[index / 64] &= ~(uint64_t(1) << (index % 64));
+		const uint64_t bit = uint64_t(1) << (index % 64);
+		const uint64_t old = modify(index / 64, [bit](uint64_t w) { return w & ~bit; });
 
-		if (Vector[index / 64] != old) {
+		if ((old & bit) != 0) {
 			SrcPrefSum.add(index / 64 + 1, -1);
 			return true;
 		}
@@ -133,9 +255,9 @@ template <template <size_t, util::AllocType AT> class SPS, util::AllocType AT =
 	}
 
 	virtual bool toggle(size_t index) {
-		uint64_t old = Vector[index / 64];
-		Vector[index / 64] ^= uint64_t(1) << (index % 64);
-		bool was_set = Vector[index / 64] < old;
+		const uint64_t bit = uint64_t(1) << (index % 64);
+		const uint64_t old = modify(index / 64, [bit](uint64_t w) { return w ^ bit; });
+		bool was_set = (old & bit) != 0;
 		SrcPrefSum.add(index / 64 + 1, was_set ? -1 : 1);
 
 		return was_set;
@@ -143,11 +265,51 @@ template <template <size_t, util::AllocType AT> class SPS, util::AllocType AT =
 
 	virtual size_t size() const { return Size; }
 
-	virtual size_t bitCount() const { return SrcPrefSum.bitCount() - sizeof(SrcPrefSum) * 8 + sizeof(*this) * 8 + ((Size + 63) & ~63); }
+	virtual size_t bitCount() const {
+		return SrcPrefSum.bitCount() - sizeof(SrcPrefSum) * 8 + sizeof(*this) * 8 + (PERSISTENT ? Words.bitCount() - sizeof(Words) * 8 : (Size + 63) & ~63);
+	}
 
   private:
 	static size_t divRoundup(size_t x, size_t y) { return (x + y - 1) / y; }
 
+	// Copies the bit vector into Words, which will be used instead of Vector
+	void persist() {
+		Words.resize(Size / 64 + 1);
+		for (size_t i = 0; i < divRoundup(Size, 64); i++) memcpy(Words.write(i), &Vector[i], sizeof(uint64_t));
+		Storage = util::Vector<uint64_t, AT>();
+		Vector = nullptr;
+	}
+
+	// Returns a word of the bit vector, atomically if SPS supports concurrent updates
+	uint64_t word(const size_t i) const {
+		if constexpr (PERSISTENT)
+			return *reinterpret_cast<const uint64_t *>(Words.read(i));
+		else if constexpr (CONCURRENT)
+			return __atomic_load_n(&Vector[i], __ATOMIC_RELAXED);
+		else
+			return Vector[i];
+	}
+
+	// Replaces a word of the bit vector with f(word) and returns the previous value; if SPS supports concurrent
+	// updates, the replacement is atomic, so that concurrent mutations of the same word are not lost
+	template <typename F> uint64_t modify(const size_t i, F f) {
+		if constexpr (PERSISTENT) {
+			uint64_t *const w = reinterpret_cast<uint64_t *>(Words.write(i));
+			const uint64_t old = *w;
+			*w = f(old);
+			return old;
+		} else if constexpr (CONCURRENT) {
+			uint64_t old = __atomic_load_n(&Vector[i], __ATOMIC_RELAXED);
+			while (!__atomic_compare_exchange_n(&Vector[i], &old, f(old), true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			}
+			return old;
+		} else {
+			const uint64_t old = Vector[i];
+			Vector[i] = f(old);
+			return old;
+		}
+	}
+
 	SPS<BOUND, AT> buildSrcPrefSum(const uint64_t bitvector[], size_t size) {
 		unique_ptr<uint64_t[]> sequence = make_unique<uint64_t[]>(size);
 		for (size_t i = 0; i < size; i++) sequence[i] = nu(bitvector[i]);
@@ -155,13 +317,40 @@ template <template <size_t, util::AllocType AT> class SPS, util::AllocType AT =
 	}
 
 	friend std::ostream &operator<<(std::ostream &os, const WordDynRankSel<SPS, AT> &bv) {
-		os.write((char *)&bv.Size, sizeof(uint64_t));
-		return os << bv.SrcPrefSum << bv.Vector;
+		serialization::writeHeader(os, serialization::tag("WordDyRS"), {}, {bv.Size});
+		os << bv.SrcPrefSum;
+		if constexpr (PERSISTENT) {
+			std::vector<uint64_t> words(divRoundup(bv.Size, 64));
+			for (size_t i = 0; i < words.size(); i++) words[i] = bv.word(i);
+			serialization::writeSection(os, words.data(), words.size());
+		} else
+			serialization::writeSection(os, bv.Vector, divRoundup(bv.Size, 64));
+		return os;
 	}
 
+	// The bit vector is read into the one provided at construction, which must have the same size,
+	// unless the instance owns its bit vector, which is then resized (and copied into Words, if SPS supports snapshots)
 	friend std::istream &operator>>(std::istream &is, WordDynRankSel<SPS, AT> &bv) {
-		is.read((char *)&bv.Size, sizeof(uint64_t));
-		return is >> bv.SrcPrefSum >> bv.Vector;
+		uint64_t size, words, sum;
+		if (!serialization::readHeader(is, serialization::tag("WordDyRS"), {}, {&size})) return is;
+		if (bv.ownsBits()) {
+			bv.Storage.size(size / 64 + 1);
+			std::fill(&bv.Storage, &bv.Storage + bv.Storage.size(), 0);
+			bv.Vector = &bv.Storage;
+			bv.Size = size;
+		} else if (size != bv.Size) {
+			is.setstate(std::ios::failbit);
+			return is;
+		}
+		is >> bv.SrcPrefSum;
+		if (!serialization::readSectionHeader(is, sizeof(uint64_t), words, sum)) return is;
+		if (words != divRoundup(bv.Size, 64)) {
+			is.setstate(std::ios::failbit);
+			return is;
+		}
+		serialization::readSectionData(is, bv.Vector, words, sum);
+		if constexpr (PERSISTENT) bv.persist();
+		return is;
 	}
 };
 
@@ -0,0 +1,201 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2019-2020 Emmanuel Esposito and Sebastiano Vigna
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../support/common.hpp"
+#include "../util/Vector.hpp"
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace sux::function {
+
+using namespace sux;
+
+/** A directory of RecSplit buckets answering each query with a single cache line.
+ *
+ * This class is a drop-in replacement for DoubleEF (see the `DIRECTORY` parameter of RecSplit).
+ * Buckets are grouped in blocks of 2<sup><var>b</var></sup> ≤ 16, and each block is described by a
+ * 64-byte record containing the cumulative number of keys and the descriptor position of its
+ * first bucket, followed by fixed-width deltas from these bases for the other buckets and for the
+ * end of the block. The block size is the largest one whose deltas fit a record.
+ *
+ * A query thus reads a single record, whereas DoubleEF performs three or four dependent
+ * accesses to different arrays. The price is space: 512 bits every 2<sup><var>b</var></sup> buckets
+ * (e.g., with leaves of size 8 and buckets of 100 keys, a RecSplit goes from 1.79 to 1.98 bits per key).
+ * Records are aligned to a cache line if the underlying memory is (i.e., for all allocation
+ * types but util::MALLOC, and for views of data aligned to a cache line).
+ *
+ * This class exists solely to implement RecSplit.
+ * @tparam AT a type of memory allocation out of util::AllocType.
+ */
+
+template <util::AllocType AT = util::AllocType::MALLOC> class BucketDirectory {
+	static constexpr size_t RECORD_WORDS = 8;
+	static constexpr int MAX_LOG2_BLOCK = 4;
+	// Bits of a record available for deltas (after the two bases)
+	static constexpr int DELTA_BITS = RECORD_WORDS * 64 - 128;
+
+	// The records, followed by a word of padding for unaligned reads
+	util::Vector<uint64_t, AT> records;
+	uint64_t num_buckets = 0, log2_block = 0, width_keys = 0, width_position = 0;
+
+	size_t num_records() const { return (num_buckets + (uint64_t(1) << log2_block) - 1) >> log2_block; }
+
+	// Reads a delta of the given width starting at the given bit of a record
+	static uint64_t read(const uint64_t *record, const uint64_t bit, const int width) {
+		uint64_t t;
+		memcpy(&t, (const uint8_t *)record + 16 + bit / 8, 8);
+		return (ltoh(t) >> bit % 8) & ((uint64_t(1) << width) - 1);
+	}
+
+	static void write(uint64_t *record, const uint64_t bit, const int width, uint64_t value) {
+		assert(width == 64 || value < uint64_t(1) << width);
+		// A wider value would overwrite the following fields
+		value &= width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+		uint64_t t;
+		memcpy(&t, (uint8_t *)record + 16 + bit / 8, 8);
+		t = htol(ltoh(t) | value << bit % 8);
+		memcpy((uint8_t *)record + 16 + bit / 8, &t, 8);
+	}
+
+	static int width(const uint64_t max) { return max == 0 ? 0 : lambda(max) + 1; }
+
+	// Whether the header fields are consistent with the size of the records
+	bool valid() const {
+		const uint64_t block = uint64_t(1) << log2_block;
+		return log2_block <= MAX_LOG2_BLOCK && width_keys <= 56 && width_position <= 56 && block * width_keys + (block - 1) * width_position <= DELTA_BITS &&
+			   records.size() == num_records() * RECORD_WORDS + 1;
+	}
+
+	friend std::ostream &operator<<(std::ostream &os, const BucketDirectory<AT> &dir) {
+		serialization::writeHeader(os, serialization::tag("BucketDr"), {}, {dir.num_buckets, dir.log2_block, dir.width_keys, dir.width_position});
+		return os << dir.records;
+	}
+
+	friend std::istream &operator>>(std::istream &is, BucketDirectory<AT> &dir) {
+		if (!serialization::readHeader(is, serialization::tag("BucketDr"), {}, {&dir.num_buckets, &dir.log2_block, &dir.width_keys, &dir.width_position})) return is;
+		is >> dir.records;
+		if (is && !dir.valid()) is.setstate(std::ios::failbit);
+		return is;
+	}
+
+  public:
+	BucketDirectory() {}
+
+	/** Builds a directory.
+	 *
+	 * @param cum_keys the cumulative number of keys of the buckets (one more element than the buckets).
+	 * @param position the positions of the bucket descriptors (as many elements as cum_keys).
+	 */
+	BucketDirectory(const std::vector<uint64_t> &cum_keys, const std::vector<uint64_t> &position) {
+		assert(cum_keys.size() == position.size());
+		num_buckets = cum_keys.size() - 1;
+
+		// The largest block whose deltas fit in a record
+		for (log2_block = MAX_LOG2_BLOCK;; log2_block--) {
+			const uint64_t block = uint64_t(1) << log2_block;
+			uint64_t max_keys = 0, max_position = 0;
+			for (uint64_t b = 0; b < num_buckets; b += block) {
+				const uint64_t end = std::min(b + block, num_buckets);
+				max_keys = std::max(max_keys, cum_keys[end] - cum_keys[b]);
+				max_position = std::max(max_position, position[end - 1] - position[b]);
+			}
+			width_keys = width(max_keys);
+			width_position = width(max_position);
+			if (log2_block == 0 || block * width_keys + (block - 1) * width_position <= DELTA_BITS) break;
+		}
+		assert(width_keys <= 56 && width_position <= 56);
+
+		const uint64_t block = uint64_t(1) << log2_block;
+		records.size(num_records() * RECORD_WORDS + 1);
+		for (uint64_t b = 0; b < num_buckets; b += block) {
+			uint64_t *record = &records + (b >> log2_block) * RECORD_WORDS;
+			record[0] = cum_keys[b];
+			record[1] = position[b];
+			for (uint64_t j = 1; j <= block; j++) {
+				// Past the last bucket, the end of the last bucket is repeated
+				const uint64_t i = std::min(b + j, num_buckets);
+				write(record, (j - 1) * width_keys, width_keys, cum_keys[i] - cum_keys[b]);
+				if (j < block) write(record, block * width_keys + (j - 1) * width_position, width_position, position[std::min(i, num_buckets - 1)] - position[b]);
+			}
+		}
+
+#ifndef NDEBUG
+		for (uint64_t i = 0; i < num_buckets; i++) {
+			uint64_t x, x2, y;
+			get(i, x, x2, y);
+			assert(x == cum_keys[i]);
+			assert(x2 == cum_keys[i + 1]);
+			assert(y == position[i]);
+		}
+#endif
+	}
+
+	/** Makes this instance a read-only view of an instance serialized by operator<<().
+	 *
+	 * @param p a pointer to the serialized instance, aligned to 8 bytes, or `nullptr`.
+	 * @param end a pointer to the end of the available data.
+	 * @param check whether to verify the checksum of the data.
+	 * @return a pointer just after the serialized instance, or `nullptr` if `p` is `nullptr`
+	 * or the data is not valid.
+	 */
+	const char *view(const char *p, const char *end, const bool check = false) {
+		p = records.view(serialization::viewHeader(p, end, serialization::tag("BucketDr"), {}, {&num_buckets, &log2_block, &width_keys, &width_position}), end, check);
+		return p == nullptr || !valid() ? nullptr : p;
+	}
+
+	/** Prefetches the record used by get() for the i-th bucket. */
+	void prefetch(const uint64_t i) const { __builtin_prefetch(&records + (i >> log2_block) * RECORD_WORDS); }
+
+	/** Does nothing, as all data is prefetched by prefetch(); provided for compatibility with DoubleEF. */
+	void prefetchUpper(const uint64_t) const {}
+
+	void get(const uint64_t i, uint64_t &cum_keys, uint64_t &cum_keys_next, uint64_t &position) const {
+		const uint64_t *record = &records + (i >> log2_block) * RECORD_WORDS;
+		const uint64_t j = i & ((uint64_t(1) << log2_block) - 1);
+		const uint64_t keys_delta = j == 0 ? 0 : read(record, (j - 1) * width_keys, width_keys);
+		cum_keys = record[0] + keys_delta;
+		cum_keys_next = record[0] + read(record, j * width_keys, width_keys);
+		position = record[1] + (j == 0 ? 0 : read(record, (width_keys << log2_block) + (j - 1) * width_position, width_position));
+	}
+
+	void get(const uint64_t i, uint64_t &cum_keys, uint64_t &position) const {
+		uint64_t cum_keys_next;
+		get(i, cum_keys, cum_keys_next, position);
+	}
+
+	uint64_t bitCountCumKeys() const { return num_records() * (64 + (width_keys << log2_block)); }
+
+	uint64_t bitCountPosition() const { return records.size() * 64 - bitCountCumKeys(); }
+};
+
+} // namespace sux::function
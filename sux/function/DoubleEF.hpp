@@ -90,41 +90,36 @@ template <util::AllocType AT = util::AllocType::MALLOC> class DoubleEF {
 		return size;
 	}
 
+	// Computes the positions in the upper bits from which the scan for the i-th elements starts
+	__inline void get_jumps(const uint64_t i, uint64_t &jump_cum_keys, uint64_t &jump_position) const {
+		const uint64_t jump_super_q = (i / super_q) * super_q_size * 2;
+		const uint64_t jump_inside_super_q = (i % super_q) / q;
+		jump_cum_keys = jump[jump_super_q] + ((const uint16_t *)(&jump + jump_super_q + 2))[2 * jump_inside_super_q];
+		jump_position = jump[jump_super_q + 1] + ((const uint16_t *)(&jump + jump_super_q + 2))[2 * jump_inside_super_q + 1];
+	}
+
+	// Computes the parameters that are not serialized
+	void set_parameters() {
+		l_position = u_position / (num_buckets + 1) == 0 ? 0 : lambda(u_position / (num_buckets + 1));
+		l_cum_keys = u_cum_keys / (num_buckets + 1) == 0 ? 0 : lambda(u_cum_keys / (num_buckets + 1));
+		assert(l_cum_keys * 2 + l_position <= 56);
+
+		lower_bits_mask_cum_keys = (UINT64_C(1) << l_cum_keys) - 1;
+		lower_bits_mask_position = (UINT64_C(1) << l_position) - 1;
+	}
+
 	friend std::ostream &operator<<(std::ostream &os, const DoubleEF<AT> &ef) {
-		os.write((char *)&ef.num_buckets, sizeof(ef.num_buckets));
-		os.write((char *)&ef.u_cum_keys, sizeof(ef.u_cum_keys));
-		os.write((char *)&ef.u_position, sizeof(ef.u_position));
-		os.write((char *)&ef.cum_keys_min_delta, sizeof(ef.cum_keys_min_delta));
-		os.write((char *)&ef.min_diff, sizeof(ef.min_diff));
-		os.write((char *)&ef.bits_per_key_fixed_point, sizeof(ef.bits_per_key_fixed_point));
-
-		os << ef.lower_bits;
-		os << ef.upper_bits_cum_keys;
-		os << ef.upper_bits_position;
-		os << ef.jump;
-		return os;
+		serialization::writeHeader(os, serialization::tag("DoubleEF"), {log2q},
+								   {ef.num_buckets, ef.u_cum_keys, ef.u_position, uint64_t(ef.cum_keys_min_delta), uint64_t(ef.min_diff), ef.bits_per_key_fixed_point});
+		return os << ef.lower_bits << ef.upper_bits_cum_keys << ef.upper_bits_position << ef.jump;
 	}
 
 	friend std::istream &operator>>(std::istream &is, DoubleEF<AT> &ef) {
-		is.read((char *)&ef.num_buckets, sizeof(ef.num_buckets));
-		is.read((char *)&ef.u_cum_keys, sizeof(ef.u_cum_keys));
-		is.read((char *)&ef.u_position, sizeof(ef.u_position));
-		is.read((char *)&ef.cum_keys_min_delta, sizeof(ef.cum_keys_min_delta));
-		is.read((char *)&ef.min_diff, sizeof(ef.min_diff));
-		is.read((char *)&ef.bits_per_key_fixed_point, sizeof(ef.bits_per_key_fixed_point));
-
-		ef.l_position = ef.u_position / (ef.num_buckets + 1) == 0 ? 0 : lambda(ef.u_position / (ef.num_buckets + 1));
-		ef.l_cum_keys = ef.u_cum_keys / (ef.num_buckets + 1) == 0 ? 0 : lambda(ef.u_cum_keys / (ef.num_buckets + 1));
-		assert(ef.l_cum_keys * 2 + ef.l_position <= 56);
-
-		ef.lower_bits_mask_cum_keys = (UINT64_C(1) << ef.l_cum_keys) - 1;
-		ef.lower_bits_mask_position = (UINT64_C(1) << ef.l_position) - 1;
-
-		is >> ef.lower_bits;
-		is >> ef.upper_bits_cum_keys;
-		is >> ef.upper_bits_position;
-		is >> ef.jump;
-		return is;
+		if (!serialization::readHeader(is, serialization::tag("DoubleEF"), {log2q},
+									   {&ef.num_buckets, &ef.u_cum_keys, &ef.u_position, (uint64_t *)&ef.cum_keys_min_delta, (uint64_t *)&ef.min_diff, &ef.bits_per_key_fixed_point}))
+			return is;
+		ef.set_parameters();
+		return is >> ef.lower_bits >> ef.upper_bits_cum_keys >> ef.upper_bits_position >> ef.jump;
 	}
 
   public:
@@ -226,16 +221,58 @@ template <util::AllocType AT = util::AllocType::MALLOC> class DoubleEF {
 #endif
 	}
 
-	void get(const uint64_t i, uint64_t &cum_keys, uint64_t &cum_keys_next, uint64_t &position) {
+	/** Makes this instance a read-only view of an instance serialized by operator<<().
+	 *
+	 * @param p a pointer to the serialized instance, aligned to 8 bytes, or `nullptr`.
+	 * @param end a pointer to the end of the available data.
+	 * @param check whether to verify the checksums of the data.
+	 * @return a pointer just after the serialized instance, or `nullptr` if `p` is `nullptr`
+	 * or the data is not valid.
+	 */
+	const char *view(const char *p, const char *end, const bool check = false) {
+		p = serialization::viewHeader(p, end, serialization::tag("DoubleEF"), {log2q},
+									  {&num_buckets, &u_cum_keys, &u_position, (uint64_t *)&cum_keys_min_delta, (uint64_t *)&min_diff, &bits_per_key_fixed_point});
+		if (p == nullptr) return nullptr;
+		set_parameters();
+		p = lower_bits.view(p, end, check);
+		p = upper_bits_cum_keys.view(p, end, check);
+		p = upper_bits_position.view(p, end, check);
+		return jump.view(p, end, check);
+	}
+
+	/** Prefetches the lower bits and the jump entries used by get() for the i-th elements.
+	 *
+	 * This is the first stage of a batched lookup; see prefetchUpper().
+	 *
+	 * @param i the index of the elements.
+	 */
+	void prefetch(const uint64_t i) const {
+		__builtin_prefetch((const uint8_t *)&lower_bits + i * (l_cum_keys + l_position) / 8);
+		__builtin_prefetch(&jump + (i / super_q) * super_q_size * 2);
+		__builtin_prefetch(&jump + (i / super_q) * super_q_size * 2 + 2 + (i % super_q) / q / 2);
+	}
+
+	/** Prefetches the upper bits used by get() for the i-th elements.
+	 *
+	 * This method reads the jump entries, so it should be called some time after prefetch().
+	 *
+	 * @param i the index of the elements.
+	 */
+	void prefetchUpper(const uint64_t i) const {
+		uint64_t jump_cum_keys, jump_position;
+		get_jumps(i, jump_cum_keys, jump_position);
+		__builtin_prefetch(&upper_bits_cum_keys + jump_cum_keys / 64);
+		__builtin_prefetch(&upper_bits_position + jump_position / 64);
+	}
+
+	void get(const uint64_t i, uint64_t &cum_keys, uint64_t &cum_keys_next, uint64_t &position) const {
 		const uint64_t pos_lower = i * (l_cum_keys + l_position);
 		uint64_t lower;
-		memcpy(&lower, (uint8_t *)&lower_bits + pos_lower / 8, 8);
+		memcpy(&lower, (const uint8_t *)&lower_bits + pos_lower / 8, 8);
 		lower >>= pos_lower % 8;
 
-		const uint64_t jump_super_q = (i / super_q) * super_q_size * 2;
-		const uint64_t jump_inside_super_q = (i % super_q) / q;
-		const uint64_t jump_cum_keys = jump[jump_super_q] + ((uint16_t *)(&jump + jump_super_q + 2))[2 * jump_inside_super_q];
-		const uint64_t jump_position = jump[jump_super_q + 1] + ((uint16_t *)(&jump + jump_super_q + 2))[2 * jump_inside_super_q + 1];
+		uint64_t jump_cum_keys, jump_position;
+		get_jumps(i, jump_cum_keys, jump_position);
 
 		uint64_t curr_word_cum_keys = jump_cum_keys / 64;
 		uint64_t curr_word_position = jump_position / 64;
@@ -263,16 +300,14 @@ template <util::AllocType AT = util::AllocType::MALLOC> class DoubleEF {
 		cum_keys_next = ((curr_word_cum_keys * 64 + rho(window_cum_keys) - i - 1) << l_cum_keys | (lower & lower_bits_mask_cum_keys)) + cum_delta + cum_keys_min_delta;
 	}
 
-	void get(const uint64_t i, uint64_t &cum_keys, uint64_t &position) {
+	void get(const uint64_t i, uint64_t &cum_keys, uint64_t &position) const {
 		const uint64_t pos_lower = i * (l_cum_keys + l_position);
 		uint64_t lower;
-		memcpy(&lower, (uint8_t *)&lower_bits + pos_lower / 8, 8);
+		memcpy(&lower, (const uint8_t *)&lower_bits + pos_lower / 8, 8);
 		lower >>= pos_lower % 8;
 
-		const uint64_t jump_super_q = (i / super_q) * super_q_size * 2;
-		const uint64_t jump_inside_super_q = (i % super_q) / q;
-		const uint64_t jump_cum_keys = jump[jump_super_q] + ((uint16_t *)(&jump + jump_super_q + 2))[2 * jump_inside_super_q];
-		const uint64_t jump_position = jump[jump_super_q + 1] + ((uint16_t *)(&jump + jump_super_q + 2))[2 * jump_inside_super_q + 1];
+		uint64_t jump_cum_keys, jump_position;
+		get_jumps(i, jump_cum_keys, jump_position);
 
 		uint64_t curr_word_cum_keys = jump_cum_keys / 64;
 		uint64_t curr_word_position = jump_position / 64;
@@ -294,9 +329,9 @@ template <util::AllocType AT = util::AllocType::MALLOC> class DoubleEF {
 				   int64_t(bits_per_key_fixed_point * cum_keys >> 20);
 	}
 
-	uint64_t bitCountCumKeys() { return (num_buckets + 1) * l_cum_keys + num_buckets + 1 + (u_cum_keys >> l_cum_keys) + jump_size_words() / 2; }
+	uint64_t bitCountCumKeys() const { return (num_buckets + 1) * l_cum_keys + num_buckets + 1 + (u_cum_keys >> l_cum_keys) + jump_size_words() / 2; }
 
-	uint64_t bitCountPosition() { return (num_buckets + 1) * l_position + num_buckets + 1 + (u_position >> l_position) + jump_size_words() / 2; }
+	uint64_t bitCountPosition() const { return (num_buckets + 1) * l_position + num_buckets + 1 + (u_position >> l_position) + jump_size_words() / 2; }
 };
 
 } // namespace sux::function
@@ -28,15 +28,27 @@
 
 #pragma once
 
+#include "../support/Instrumentation.hpp"
 #include "../support/SpookyV2.hpp"
+#include "../util/MappedFile.hpp"
 #include "../util/Vector.hpp"
+#include "BucketDirectory.hpp"
 #include "DoubleEF.hpp"
 #include "RiceBitVector.hpp"
+#include "SeedSearch.hpp"
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <cmath>
+#include <iterator>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
 #include <vector>
 #include <fstream>
 
@@ -55,42 +67,132 @@ static const int MAX_FANOUT = 32;
 #define STATS
 #endif
 
-#ifdef MORESTATS
-
 #define MAX_LEVEL_TIME (20)
 
 static constexpr double log2e = 1.44269504089;
-static uint64_t num_bij_trials[MAX_LEAF_SIZE], num_split_trials;
-static uint64_t num_bij_evals[MAX_LEAF_SIZE], num_split_evals;
-static uint64_t bij_count[MAX_LEAF_SIZE], split_count;
-static uint64_t expected_split_trials, expected_split_evals;
-static uint64_t bij_unary, bij_fixed, bij_unary_golomb, bij_fixed_golomb;
-static uint64_t split_unary, split_fixed, split_unary_golomb, split_fixed_golomb;
-static uint64_t max_split_code, min_split_code, sum_split_codes;
-static uint64_t max_bij_code, min_bij_code, sum_bij_codes;
-static uint64_t sum_depths;
-static uint64_t time_bij;
-static uint64_t time_split[MAX_LEVEL_TIME];
-#endif
 
-// Starting seed at given distance from the root (extracted at random).
-static const uint64_t start_seed[] = {0x106393c187cae21a, 0x6453cec3f7376937, 0x643e521ddbd2be98, 0x3740c6412f6572cb, 0x717d47562f1ce470, 0x4cd6eb4c63befb7c, 0x9bfd8c5e18c8da73,
-									  0x082f20e10092a9a3, 0x2ada2ce68d21defc, 0xe33cb4f3e7c6466b, 0x3980be458c509c59, 0xc466fd9584828e8c, 0x45f0aabe1a61ede6, 0xf6e7b8b33ad9b98d,
-									  0x4ef95e25f4b4983d, 0x81175195173b92d3, 0x4e50927d8dd15978, 0x1ea2099d1fafae7f, 0x425c8a06fbaaa815, 0xcd4216006c74052a};
+/** Construction statistics of a RecSplit instance.
+ *
+ * Statistics are gathered only if `MORESTATS` is defined. Each building thread
+ * accumulates its own instance, and the instances are merged at the end of the
+ * construction, so concurrent constructions do not interfere.
+ */
+struct RecSplitStats {
+	uint64_t num_bij_trials[MAX_LEAF_SIZE] = {}, num_split_trials = 0;
+	uint64_t num_bij_evals[MAX_LEAF_SIZE] = {}, num_split_evals = 0;
+	uint64_t bij_count[MAX_LEAF_SIZE] = {}, split_count = 0;
+	uint64_t expected_split_trials = 0, expected_split_evals = 0;
+	uint64_t bij_unary = 0, bij_fixed = 0, bij_unary_golomb = 0, bij_fixed_golomb = 0;
+	uint64_t split_unary = 0, split_fixed = 0, split_unary_golomb = 0, split_fixed_golomb = 0;
+	uint64_t max_split_code = 0, min_split_code = UINT64_C(1) << 63, sum_split_codes = 0;
+	uint64_t max_bij_code = 0, min_bij_code = UINT64_C(1) << 63, sum_bij_codes = 0;
+	uint64_t sum_depths = 0;
+	uint64_t time_bij = 0;
+	uint64_t time_split[MAX_LEVEL_TIME] = {};
+	uint64_t min_bucket_size = UINT64_MAX, max_bucket_size = 0;
+	double ub_split_bits = 0, ub_bij_bits = 0;
+	double ub_split_evals = 0, ub_bij_evals = 0;
+
+	/** Adds the statistics of another construction (or part of it) to these. */
+	void merge(const RecSplitStats &o) {
+		for (int i = 0; i < MAX_LEAF_SIZE; i++) {
+			num_bij_trials[i] += o.num_bij_trials[i];
+			num_bij_evals[i] += o.num_bij_evals[i];
+			bij_count[i] += o.bij_count[i];
+		}
+		for (int i = 0; i < MAX_LEVEL_TIME; i++) time_split[i] += o.time_split[i];
+		num_split_trials += o.num_split_trials;
+		num_split_evals += o.num_split_evals;
+		split_count += o.split_count;
+		expected_split_trials += o.expected_split_trials;
+		expected_split_evals += o.expected_split_evals;
+		bij_unary += o.bij_unary;
+		bij_fixed += o.bij_fixed;
+		bij_unary_golomb += o.bij_unary_golomb;
+		bij_fixed_golomb += o.bij_fixed_golomb;
+		split_unary += o.split_unary;
+		split_fixed += o.split_fixed;
+		split_unary_golomb += o.split_unary_golomb;
+		split_fixed_golomb += o.split_fixed_golomb;
+		max_split_code = std::max(max_split_code, o.max_split_code);
+		min_split_code = std::min(min_split_code, o.min_split_code);
+		sum_split_codes += o.sum_split_codes;
+		max_bij_code = std::max(max_bij_code, o.max_bij_code);
+		min_bij_code = std::min(min_bij_code, o.min_bij_code);
+		sum_bij_codes += o.sum_bij_codes;
+		sum_depths += o.sum_depths;
+		time_bij += o.time_bij;
+		min_bucket_size = std::min(min_bucket_size, o.min_bucket_size);
+		max_bucket_size = std::max(max_bucket_size, o.max_bucket_size);
+		ub_split_bits += o.ub_split_bits;
+		ub_bij_bits += o.ub_bij_bits;
+		ub_split_evals += o.ub_split_evals;
+		ub_bij_evals += o.ub_bij_evals;
+	}
+};
 
-/** David Stafford's (http://zimbry.blogspot.com/2011/09/better-bit-mixing-improving-on.html)
- * 13th variant of the 64-bit finalizer function in Austin Appleby's
- * MurmurHash3 (https://github.com/aappleby/smhasher).
+/** Construction profile of a RecSplit instance.
  *
- * @param z a 64-bit integer.
- * @return a 64-bit integer obtained by mixing the bits of `z`.
+ * Differently from RecSplitStats, the profile is always gathered, as it costs just a few
+ * clock readings per construction. Phases are sequential, and their times (in nanoseconds)
+ * are wall-clock times, so they add up to the construction time.
  */
+struct RecSplitProfile {
+	uint64_t keys = 0, buckets = 0, threads = 0;
+	// Hashing of the keys (including, for the external construction, writing temporary files)
+	uint64_t time_hash = 0;
+	// Reading and splitting temporary files (external construction only)
+	uint64_t time_spill = 0;
+	// Sorting hashes by bucket
+	uint64_t time_sort = 0;
+	// Finding splittings and bijections, and their concatenation
+	uint64_t time_buckets = 0, time_concat = 0;
+	// Building the final structures
+	uint64_t time_descriptors = 0, time_ef = 0;
+	// Allocations of the scratch buffers of the building threads
+	uint64_t scratch_allocations = 0;
+	// Largest temporary memory used for sorting, and bytes written to temporary files
+	uint64_t sort_bytes = 0, spill_bytes = 0;
+	// Sizes of the resulting structures
+	uint64_t descriptor_bits = 0, ef_bits = 0;
+
+	/** Returns the overall construction time in nanoseconds. */
+	uint64_t time() const { return time_hash + time_spill + time_sort + time_buckets + time_concat + time_descriptors + time_ef; }
+
+	/** Returns the profile as a JSON object. */
+	string json() const {
+		string j = "{";
+		const auto field = [&](const char *name, const uint64_t value) {
+			if (j.size() > 1) j += ", ";
+			j += string("\"") + name + "\": " + to_string(value);
+		};
+		field("keys", keys);
+		field("buckets", buckets);
+		field("threads", threads);
+		field("time_hash", time_hash);
+		field("time_spill", time_spill);
+		field("time_sort", time_sort);
+		field("time_buckets", time_buckets);
+		field("time_concat", time_concat);
+		field("time_descriptors", time_descriptors);
+		field("time_ef", time_ef);
+		field("time", time());
+		field("scratch_allocations", scratch_allocations);
+		field("sort_bytes", sort_bytes);
+		field("spill_bytes", spill_bytes);
+		field("descriptor_bits", descriptor_bits);
+		field("ef_bits", ef_bits);
+		return j + "}";
+	}
+};
 
-uint64_t inline remix(uint64_t z) {
-	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
-	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
-	return z ^ (z >> 31);
-}
+// Nanoseconds elapsed since the given time point
+static inline uint64_t nanos_since(const high_resolution_clock::time_point start) { return duration_cast<nanoseconds>(high_resolution_clock::now() - start).count(); }
+
+// Starting seed at given distance from the root (extracted at random).
+static const uint64_t start_seed[] = {0x106393c187cae21a, 0x6453cec3f7376937, 0x643e521ddbd2be98, 0x3740c6412f6572cb, 0x717d47562f1ce470, 0x4cd6eb4c63befb7c, 0x9bfd8c5e18c8da73,
+									  0x082f20e10092a9a3, 0x2ada2ce68d21defc, 0xe33cb4f3e7c6466b, 0x3980be458c509c59, 0xc466fd9584828e8c, 0x45f0aabe1a61ede6, 0xf6e7b8b33ad9b98d,
+									  0x4ef95e25f4b4983d, 0x81175195173b92d3, 0x4e50927d8dd15978, 0x1ea2099d1fafae7f, 0x425c8a06fbaaa815, 0xcd4216006c74052a};
 
 /** 128-bit hashes.
  *
@@ -122,6 +224,98 @@ hash128_t inline spooky(const void *data, const size_t length, const uint64_t se
 	return {h1, h0};
 }
 
+/** Hashers mapping keys to 128-bit hashes.
+ *
+ * A hasher is a class with a static method `hash128_t hash(const void *data, size_t length)`
+ * and a static constant `uint64_t ID` identifying it, which is stored in serialized instances
+ * so that a function cannot be loaded with a hasher different from the one used to build it.
+ * Hashers are used only to map keys to 128-bit hashes: they must be fast and have good
+ * statistical properties, but they need not be cryptographically strong.
+ */
+
+/** The default hasher, SpookyHash V2. */
+struct SpookyHasher {
+	static constexpr uint64_t ID = serialization::tag("SpookyV2");
+	static hash128_t hash(const void *data, const size_t length) { return spooky(data, length, 0); }
+};
+
+/** A hasher based on wyhash (final version 4), by Wang Yi, which is much faster than SpookyHash on short keys.
+ *
+ * The two halves of the hash are obtained by two different final mixes of the internal 128-bit state.
+ */
+struct WyHasher {
+	static constexpr uint64_t ID = serialization::tag("WyHash-4");
+
+	static hash128_t hash(const void *data, const size_t length) {
+		static constexpr uint64_t secret[4] = {0x2d358dccaa6c78a5, 0x8bb84b93962eacc9, 0x4b33a62ed433d4a3, 0x4d5a2da51de1aa47};
+		const uint8_t *p = (const uint8_t *)data;
+		uint64_t seed = mix(secret[0], secret[1]), a, b;
+		if (likely(length <= 16)) {
+			if (likely(length >= 4)) {
+				a = read4(p) << 32 | read4(p + ((length >> 3) << 2));
+				b = read4(p + length - 4) << 32 | read4(p + length - 4 - ((length >> 3) << 2));
+			} else if (length > 0) {
+				a = uint64_t(p[0]) << 16 | uint64_t(p[length >> 1]) << 8 | p[length - 1];
+				b = 0;
+			} else
+				a = b = 0;
+		} else {
+			size_t i = length;
+			if (unlikely(i > 48)) {
+				uint64_t seed1 = seed, seed2 = seed;
+				do {
+					seed = mix(read8(p) ^ secret[1], read8(p + 8) ^ seed);
+					seed1 = mix(read8(p + 16) ^ secret[2], read8(p + 24) ^ seed1);
+					seed2 = mix(read8(p + 32) ^ secret[3], read8(p + 40) ^ seed2);
+					p += 48;
+					i -= 48;
+				} while (likely(i > 48));
+				seed ^= seed1 ^ seed2;
+			}
+			for (; i > 16; i -= 16, p += 16) seed = mix(read8(p) ^ secret[1], read8(p + 8) ^ seed);
+			a = read8(p + i - 16);
+			b = read8(p + i - 8);
+		}
+		a ^= secret[1];
+		b ^= seed;
+		mum(a, b);
+		return {mix(a ^ secret[0] ^ length, b ^ secret[1]), mix(a ^ secret[2] ^ length, b ^ secret[3])};
+	}
+
+  private:
+	static uint64_t read8(const uint8_t *p) {
+		uint64_t v;
+		memcpy(&v, p, sizeof v);
+		return ltoh(v);
+	}
+
+	static uint64_t read4(const uint8_t *p) {
+		uint32_t v;
+		memcpy(&v, p, sizeof v);
+		return ltoh(v);
+	}
+
+	// Replaces a and b with the low and high halves of their 128-bit product
+	static void mum(uint64_t &a, uint64_t &b) {
+#ifdef __SIZEOF_INT128__
+		const __uint128_t r = __uint128_t(a) * b;
+		a = uint64_t(r);
+		b = uint64_t(r >> 64);
+#else
+		const uint64_t ha = a >> 32, hb = b >> 32, la = uint32_t(a), lb = uint32_t(b);
+		const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32);
+		const uint64_t lo = t + (rm1 << 32);
+		b = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+		a = lo;
+#endif
+	}
+
+	static uint64_t mix(uint64_t a, uint64_t b) {
+		mum(a, b);
+		return a ^ b;
+	}
+};
+
 // Quick replacements for min/max on not-so-large integers.
 
 static constexpr inline uint64_t min(int64_t x, int64_t y) { return y + ((x - y) & ((x - y) >> 63)); }
@@ -281,6 +475,11 @@ static constexpr array<uint8_t, MAX_LEAF_SIZE> fill_bij_midstop() {
 	return memo;
 }
 
+/** Whether a type can be used as a key by the range constructor of RecSplit: any type
+ * convertible to `string_view` (e.g., `string`), or a pair made of a pointer and a length in bytes. */
+template <typename K> static constexpr bool is_key_v = is_convertible_v<K, string_view> || is_convertible_v<K, pair<const void *, size_t>>;
+
+// Hashes with the default hasher (HASHER::hash() should be used instead)
 #define first_hash(k, len) spooky(k, len, 0)
 #define golomb_param(m) (memo[m] >> 27)
 #define skip_bits(m) (memo[m] & 0xFFFF)
@@ -295,9 +494,23 @@ static constexpr array<uint8_t, MAX_LEAF_SIZE> fill_bij_midstop() {
  * @tparam LEAF_SIZE the size of a leaf; typicals value range from 6 to 8
  * for fast, small maps, or up to 16 for very compact functions.
  * @tparam AT a type of memory allocation out of sux::util::AllocType.
+ * @tparam HASHER the hasher mapping keys to 128-bit hashes (e.g., SpookyHasher or WyHasher).
+ * @tparam ALIGN_BUCKETS whether the descriptor of each bucket is padded so that it spans as few cache
+ * lines as possible; usually, a bucket can then be decoded reading a single cache line, at the cost of a
+ * few more bits per key. This parameter affects only construction: the serialized format is the same, and
+ * it can be loaded by instances with a different value of the parameter. Buckets are aligned with respect
+ * to the start of the descriptors, which is aligned to a cache line for all allocation types but
+ * util::MALLOC, and for views of data aligned to a cache line.
+ * @tparam DIRECTORY the structure storing the number of keys and the descriptor position of each bucket:
+ * DoubleEF (the default, more compact), or BucketDirectory (a single cache miss per query, at the cost of
+ * some space). The choice is recorded in the serialized data.
+ * @tparam INSTR an instrumentation policy out of those in sux::instrumentation; for each sampled query,
+ * the walk of the splitting tree records the counters listed in Counter.
  */
 
-template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC> class RecSplit {
+template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC, typename HASHER = SpookyHasher, bool ALIGN_BUCKETS = false,
+		  template <util::AllocType> class DIRECTORY = DoubleEF, typename INSTR = instrumentation::None>
+class RecSplit {
 	using SplitStrat = SplittingStrategy<LEAF_SIZE>;
 
 	static constexpr size_t _leaf = LEAF_SIZE;
@@ -309,13 +522,27 @@ template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC> class
 	static constexpr array<uint32_t, MAX_BUCKET_SIZE> memo = fill_golomb_rice<LEAF_SIZE>();
 	static constexpr array<uint8_t, MAX_LEAF_SIZE> bij_midstop = fill_bij_midstop();
 
-	size_t bucket_size;
-	size_t nbuckets;
-	size_t keys_count;
+	size_t bucket_size = 0;
+	size_t nbuckets = 0;
+	size_t keys_count = 0;
 	RiceBitVector<AT> descriptors;
-	DoubleEF<AT> ef;
+	DIRECTORY<AT> ef;
+#ifdef MORESTATS
+	RecSplitStats stats;
+#endif
+	RecSplitProfile profile;
+	INSTR instr;
 
   public:
+	/** The number of queries whose memory accesses are interleaved by lookup(). */
+	static constexpr size_t LOOKUP_BATCH = 32;
+
+	/** The counters recorded by the instrumentation policy, whose names are in COUNTER_NAMES:
+	 * the size of the bucket of the key, the number of inner nodes walked to reach its leaf, the
+	 * number of subtrees skipped (at all levels, leaves included) and the overall number of nodes skipped. */
+	enum Counter { BUCKET_SIZE, DEPTH, SKIPPED_SUBTREES, SKIPPED_NODES };
+	static constexpr const char *COUNTER_NAMES[] = {"bucket_size", "depth", "skipped_subtrees", "skipped_nodes"};
+
 	RecSplit() {}
 
 	/** Builds a RecSplit instance using a given list of keys and bucket size.
@@ -326,18 +553,75 @@ template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC> class
 	 * @param bucket_size the desired bucket size; typical sizes go from
 	 * 100 to 2000, with smaller buckets giving slightly larger but faster
 	 * functions.
+	 * @param num_threads the number of threads used to hash keys and build buckets; the
+	 * resulting function does not depend on this parameter.
 	 */
-	RecSplit(const vector<string> &keys, const size_t bucket_size) {
+	RecSplit(const vector<string> &keys, const size_t bucket_size, const size_t num_threads = 1) {
 		this->bucket_size = bucket_size;
 		this->keys_count = keys.size();
+		profile = RecSplitProfile();
+		const auto start = high_resolution_clock::now();
 		hash128_t *h = (hash128_t *)malloc(this->keys_count * sizeof(hash128_t));
-		for (size_t i = 0; i < this->keys_count; ++i) {
-			h[i] = first_hash(keys[i].c_str(), keys[i].size());
-		}
-		hash_gen(h);
+		hash(keys.begin(), this->keys_count, h, num_threads);
+		profile.time_hash = nanos_since(start);
+		hash_gen(h, num_threads);
+		free(h);
+	}
+
+	/** Builds a RecSplit instance using a range of keys and bucket size.
+	 *
+	 * Keys are hashed where they are, without copying them: for example, they can be
+	 * `string_view`s or (pointer, length) pairs into a memory-mapped file.
+	 *
+	 * **Warning**: duplicate keys will cause this method to never return.
+	 *
+	 * @param begin an iterator to the first key; keys can have any type convertible to `string_view`,
+	 * or they can be pairs made of a pointer and a length in bytes. Forward iterators suffice, but random-access
+	 * iterators make parallel hashing faster.
+	 * @param end an iterator past the last key.
+	 * @param bucket_size the desired bucket size.
+	 * @param num_threads the number of threads used to hash keys and build buckets; the
+	 * resulting function does not depend on this parameter.
+	 */
+	template <typename It, typename = enable_if_t<is_key_v<typename iterator_traits<It>::value_type>>>
+	RecSplit(It begin, It end, const size_t bucket_size, const size_t num_threads = 1) {
+		this->bucket_size = bucket_size;
+		this->keys_count = distance(begin, end);
+		profile = RecSplitProfile();
+		const auto start = high_resolution_clock::now();
+		hash128_t *h = (hash128_t *)malloc(this->keys_count * sizeof(hash128_t));
+		hash(begin, this->keys_count, h, num_threads);
+		profile.time_hash = nanos_since(start);
+		hash_gen(h, num_threads);
 		free(h);
 	}
 
+	/** Builds a RecSplit instance using keys returned in chunks by a function and bucket size.
+	 *
+	 * The function is called with a buffer of `string_view`s and its capacity, and it must store
+	 * in the buffer the next keys, returning their number, or zero when there are no more keys.
+	 * Keys must stay valid only until the next call, so the function can reuse its own buffers.
+	 * Each chunk is hashed in parallel.
+	 *
+	 * **Warning**: duplicate keys will cause this method to never return.
+	 *
+	 * @param next a function `size_t next(string_view *keys, size_t max)` returning keys in chunks.
+	 * @param bucket_size the desired bucket size.
+	 * @param num_threads the number of threads used to hash keys and build buckets; the
+	 * resulting function does not depend on this parameter.
+	 */
+	template <typename F, typename = enable_if_t<is_invocable_r_v<size_t, F &, string_view *, size_t>>>
+	RecSplit(F &&next, const size_t bucket_size, const size_t num_threads = 1) {
+		this->bucket_size = bucket_size;
+		profile = RecSplitProfile();
+		const auto start = high_resolution_clock::now();
+		vector<hash128_t> h;
+		hash_chunks(next, num_threads, [&](const hash128_t *b, const size_t n) { h.insert(h.end(), b, b + n); });
+		this->keys_count = h.size();
+		profile.time_hash = nanos_since(start);
+		hash_gen(&h[0], num_threads);
+	}
+
 	/** Builds a RecSplit instance using a given list of 128-bit hashes and bucket size.
 	 *
 	 * **Warning**: duplicate keys will cause this method to never return.
@@ -347,11 +631,14 @@ template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC> class
 	 * @param bucket_size the desired bucket size; typical sizes go from
 	 * 100 to 2000, with smaller buckets giving slightly larger but faster
 	 * functions.
+	 * @param num_threads the number of threads used to build buckets; the
+	 * resulting function does not depend on this parameter.
 	 */
-	RecSplit(vector<hash128_t> &keys, const size_t bucket_size) {
+	RecSplit(vector<hash128_t> &keys, const size_t bucket_size, const size_t num_threads = 1) {
 		this->bucket_size = bucket_size;
 		this->keys_count = keys.size();
-		hash_gen(&keys[0]);
+		profile = RecSplitProfile();
+		hash_gen(&keys[0], num_threads);
 	}
 
 	/** Builds a RecSplit instance using a list of keys returned by a stream and bucket size.
@@ -360,13 +647,52 @@ template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC> class
 	 *
 	 * @param input an open input stream returning a list of keys, one per line.
 	 * @param bucket_size the desired bucket size.
+	 * @param num_threads the number of threads used to hash keys and build buckets; the
+	 * resulting function does not depend on this parameter.
 	 */
-	RecSplit(ifstream& input, const size_t bucket_size) {
+	RecSplit(ifstream& input, const size_t bucket_size, const size_t num_threads = 1) {
 		this->bucket_size = bucket_size;
+		profile = RecSplitProfile();
+		const auto start = high_resolution_clock::now();
 		vector<hash128_t> h;
-		for(string key; getline(input, key);) h.push_back(first_hash(key.c_str(), key.size()));
+		hash(input, num_threads, [&](const hash128_t *b, const size_t n) { h.insert(h.end(), b, b + n); });
 		this->keys_count = h.size();
-		hash_gen(&h[0]);
+		profile.time_hash = nanos_since(start);
+		hash_gen(&h[0], num_threads);
+	}
+
+	/** Builds a RecSplit instance using a list of keys returned by a stream and bucket size, with bounded memory usage.
+	 *
+	 * Hashes are first written to temporary files partitioned by bucket range, and
+	 * then buckets are built one range at a time. Memory usage is bounded by `memory_budget`,
+	 * plus 16 bytes per bucket and the space used by the resulting function. The
+	 * resulting function is identical to the one built by the other constructors.
+	 *
+	 * **Warning**: duplicate keys will cause this method to never return.
+	 *
+	 * @param input an open input stream returning a list of keys, one per line.
+	 * @param bucket_size the desired bucket size.
+	 * @param num_threads the number of threads used to hash keys and build buckets.
+	 * @param memory_budget the approximate maximum memory used by the construction, in bytes.
+	 * @param tmp_dir a directory for temporary files.
+	 */
+	RecSplit(ifstream &input, const size_t bucket_size, const size_t num_threads, const size_t memory_budget, const string &tmp_dir = "/tmp") {
+		this->bucket_size = bucket_size;
+		this->keys_count = 0;
+		profile = RecSplitProfile();
+		const auto start = high_resolution_clock::now();
+		SpillFiles spill(tmp_dir, 0, SpillFiles::MAX_BITS, 0, memory_budget);
+		hash(input, num_threads, [&](const hash128_t *b, const size_t n) {
+			for (size_t i = 0; i < n; i++) spill.add(b[i]);
+			keys_count += n;
+		});
+		spill.flush();
+		profile.time_hash = nanos_since(start);
+		profile.spill_bytes = keys_count * sizeof(hash128_t);
+
+		util::Vector<hash128_t> keys;
+		size_t first_bucket = 0;
+		hash_gen([&](vector<int64_t> &bucket_size_acc, const auto &build) { build_spill(spill, keys, first_bucket, bucket_size_acc, build, tmp_dir, memory_budget, num_threads); }, num_threads);
 	}
 
 	/** Returns the value associated with the given 128-bit hash.
@@ -375,16 +701,117 @@ template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC> class
 	 * @param hash a 128-bit hash.
 	 * @return the associated value.
 	 */
-	size_t operator()(const hash128_t &hash) {
+	size_t operator()(const hash128_t &hash) const {
 		const size_t bucket = hash128_to_bucket(hash);
 		uint64_t cum_keys, cum_keys_next, bit_pos;
 		ef.get(bucket, cum_keys, cum_keys_next, bit_pos);
+		return search(hash, cum_keys, cum_keys_next - cum_keys, bit_pos);
+	}
+
+	/** Returns the value associated with the given 128-bit hash, reporting the values of its bucket in advance.
+	 *
+	 * The values of the keys of a bucket form an interval, which is known after a first access
+	 * to the double Elias-Fano list, that is, before the splitting tree is walked. The interval
+	 * is passed to `bucket(first, last)`, which can, for example, prefetch data associated
+	 * with the values, so that the memory access overlaps with the walk.
+	 *
+	 * @param hash a 128-bit hash.
+	 * @param bucket a function receiving the first value of the bucket and the value after the last one.
+	 * @return the associated value.
+	 */
+	template <typename F> size_t operator()(const hash128_t &hash, const F &bucket) const {
+		uint64_t cum_keys, cum_keys_next, bit_pos;
+		ef.get(hash128_to_bucket(hash), cum_keys, cum_keys_next, bit_pos);
+		bucket(cum_keys, cum_keys_next);
+		return search(hash, cum_keys, cum_keys_next - cum_keys, bit_pos);
+	}
+
+	/** Computes the values associated with a batch of 128-bit hashes.
+	 *
+	 * The result is the same as that of calling operator()() on each hash, but queries
+	 * are processed in groups of LOOKUP_BATCH: the memory accesses to the
+	 * double Elias-Fano list and to the descriptors of all queries in a group are
+	 * prefetched before the trees are walked, so that their latencies overlap.
+	 * This method is much faster than a loop on large functions.
+	 *
+	 * @param in an array of `n` 128-bit hashes.
+	 * @param out an array of `n` elements that will be filled with the associated values.
+	 * @param n the number of hashes.
+	 */
+	void lookup(const hash128_t *in, size_t *out, const size_t n) const {
+		uint64_t bucket[LOOKUP_BATCH], cum_keys[LOOKUP_BATCH], cum_keys_next[LOOKUP_BATCH], bit_pos[LOOKUP_BATCH];
+
+		for (size_t base = 0; base < n; base += LOOKUP_BATCH) {
+			const hash128_t *h = in + base;
+			const size_t b = min(LOOKUP_BATCH, n - base);
+
+			for (size_t i = 0; i < b; i++) ef.prefetch(bucket[i] = hash128_to_bucket(h[i]));
+			for (size_t i = 0; i < b; i++) ef.prefetchUpper(bucket[i]);
+			for (size_t i = 0; i < b; i++) {
+				ef.get(bucket[i], cum_keys[i], cum_keys_next[i], bit_pos[i]);
+				descriptors.prefetch(bit_pos[i], skip_bits(cum_keys_next[i] - cum_keys[i]));
+			}
+			for (size_t i = 0; i < b; i++) out[base + i] = search(h[i], cum_keys[i], cum_keys_next[i] - cum_keys[i], bit_pos[i]);
+		}
+	}
+
+	/** Returns the value associated with the given key.
+	 *
+	 * @param key a key.
+	 * @return the associated value.
+	 */
+	size_t operator()(const string &key) const { return operator()(HASHER::hash(key.c_str(), key.size())); }
+
+	/** Returns the number of keys used to build this RecSplit instance. */
+	inline size_t size() const { return this->keys_count; }
+
+#ifdef MORESTATS
+	/** Returns the statistics of the construction of this RecSplit instance. */
+	const RecSplitStats &buildStats() const { return stats; }
+#endif
+
+	/** Returns the profile of the construction of this RecSplit instance.
+	 *
+	 * The profile of an instance that has been loaded or viewed is empty.
+	 */
+	const RecSplitProfile &buildProfile() const { return profile; }
+
+	/** Returns the instrumentation policy of this instance, from which counters can be read. */
+	const INSTR &instrumentation() const { return instr; }
+
+	/** Makes this instance a read-only view of an instance serialized by operator<<().
+	 *
+	 * The serialized data is not copied: in particular, if `p` points into a
+	 * util::MappedFile, the function can be queried immediately, and its pages are
+	 * shared by all processes mapping the same file. The memory must remain
+	 * valid as long as this instance is used.
+	 *
+	 * @param p a pointer to the serialized instance, aligned to 8 bytes, or `nullptr`.
+	 * @param end a pointer to the end of the available data.
+	 * @param check whether to verify the checksums of the data, which requires reading it entirely.
+	 * @return a pointer just after the serialized instance, or `nullptr` if `p` is `nullptr`
+	 * or the data is not valid.
+	 */
+	const char *view(const char *p, const char *end, const bool check = false) {
+		uint64_t bucket_size, keys_count;
+		if ((p = serialization::viewHeader(p, end, serialization::tag("RecSplit"), {LEAF_SIZE, HASHER::ID}, {&bucket_size, &keys_count})) == nullptr) return nullptr;
+		this->bucket_size = bucket_size;
+		this->keys_count = keys_count;
+		nbuckets = max(1, (keys_count + bucket_size - 1) / bucket_size);
+		profile = RecSplitProfile();
+		return ef.view(descriptors.view(p, end, check), end, check);
+	}
 
-		// Number of keys in this bucket
-		size_t m = cum_keys_next - cum_keys;
+  private:
+	// Walks the splitting tree of a bucket with m keys whose descriptor starts at bit_pos,
+	// returning the value associated with hash.
+	size_t search(const hash128_t &hash, uint64_t cum_keys, size_t m, const uint64_t bit_pos) const {
 		auto reader = descriptors.reader();
 		reader.readReset(bit_pos, skip_bits(m));
 		int level = 0;
+		// Used only by the instrumentation (dead code otherwise)
+		const size_t bucket_keys = m;
+		uint64_t skipped_subtrees = 0, skipped_nodes = 0;
 
 		while (m > upper_aggr) { // fanout = 2
 			const auto d = reader.readNext(golomb_param(m));
@@ -395,11 +822,16 @@ template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC> class
 				m = split;
 			} else {
 				reader.skipSubtree(skip_nodes(split), skip_bits(split));
+				skipped_subtrees++;
+				skipped_nodes += skip_nodes(split);
 				m -= split;
 				cum_keys += split;
 			}
 			level++;
 		}
+
+		// The subtrees preceding the selected child are skipped while its code is read
+		size_t nodes = 0, fixed_len = 0;
 		if (m > lower_aggr) {
 			const auto d = reader.readNext(golomb_param(m));
 			const size_t hmod = remap16(remix(hash.second + d + start_seed[level]), m);
@@ -407,108 +839,145 @@ template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC> class
 			const int part = uint16_t(hmod) / lower_aggr;
 			m = min(lower_aggr, m - part * lower_aggr);
 			cum_keys += lower_aggr * part;
-			if (part) reader.skipSubtree(skip_nodes(lower_aggr) * part, skip_bits(lower_aggr) * part);
+			nodes = skip_nodes(lower_aggr) * part;
+			fixed_len = skip_bits(lower_aggr) * part;
+			skipped_subtrees += part;
 			level++;
 		}
 
 		if (m > _leaf) {
-			const auto d = reader.readNext(golomb_param(m));
+			skipped_nodes += nodes;
+			const auto d = reader.skipAndReadNext(nodes, fixed_len, golomb_param(m));
 			const size_t hmod = remap16(remix(hash.second + d + start_seed[level]), m);
 
 			const int part = uint16_t(hmod) / _leaf;
 			m = min(_leaf, m - part * _leaf);
 			cum_keys += _leaf * part;
-			if (part) reader.skipSubtree(part, skip_bits(_leaf) * part);
+			nodes = part;
+			fixed_len = skip_bits(_leaf) * part;
+			skipped_subtrees += part;
 			level++;
 		}
 
-		const auto b = reader.readNext(golomb_param(m));
+		const auto b = reader.skipAndReadNext(nodes, fixed_len, golomb_param(m));
+		if (instr.sample()) {
+			instr.record(BUCKET_SIZE, bucket_keys);
+			instr.record(DEPTH, level);
+			instr.record(SKIPPED_SUBTREES, skipped_subtrees);
+			instr.record(SKIPPED_NODES, skipped_nodes + nodes);
+		}
 		return cum_keys + remap16(remix(hash.second + b + start_seed[level]), m);
 	}
 
-	/** Returns the value associated with the given key.
-	 *
-	 * @param key a key.
-	 * @return the associated value.
-	 */
-	size_t operator()(const string &key) { return operator()(first_hash(key.c_str(), key.size())); }
+	// Number of keys hashed together by the stream and chunk constructors
+	static constexpr size_t HASH_BATCH = 1 << 16;
 
-	/** Returns the number of keys used to build this RecSplit instance. */
-	inline size_t size() { return this->keys_count; }
+	static hash128_t hash_key(const string_view &key) { return HASHER::hash(key.data(), key.size()); }
+	static hash128_t hash_key(const pair<const void *, size_t> &key) { return HASHER::hash(key.first, key.second); }
+
+	// Hashes n keys in parallel, giving each thread at least HASH_BATCH / 16 keys
+	template <typename It> static void hash(const It keys, const size_t n, hash128_t *h, const size_t num_threads) {
+		const size_t threads = max(1, min(num_threads, n / (HASH_BATCH / 16)));
+		parallel(threads, [&](const size_t t) {
+			size_t i = t * n / threads;
+			auto key = std::next(keys, i);
+			for (const size_t end = (t + 1) * n / threads; i < end; i++, ++key) h[i] = hash_key(*key);
+		});
+	}
+
+	// Hashes the keys returned by next(keys, max) in chunks, passing each chunk of hashes to consume(hashes, n)
+	template <typename F, typename C> static void hash_chunks(F &next, const size_t num_threads, const C &consume) {
+		vector<string_view> keys(HASH_BATCH);
+		hash128_t *h = (hash128_t *)malloc(HASH_BATCH * sizeof(hash128_t));
+		for (size_t n; (n = next(keys.data(), HASH_BATCH)) != 0;) {
+			hash(keys.begin(), n, h, num_threads);
+			consume(h, n);
+		}
+		free(h);
+	}
+
+	// Hashes the lines of a stream in chunks, passing each chunk of hashes to consume(hashes, n)
+	template <typename C> static void hash(ifstream &input, const size_t num_threads, const C &consume) {
+		vector<string> lines(HASH_BATCH);
+		auto next = [&](string_view *keys, const size_t max) {
+			size_t n = 0;
+			for (; n < max && getline(input, lines[n]); n++) keys[n] = lines[n];
+			return n;
+		};
+		hash_chunks(next, num_threads, consume);
+	}
 
-  private:
 	// Maps a 128-bit to a bucket using the first 64-bit half.
 	inline uint64_t hash128_to_bucket(const hash128_t &hash) const { return remap128(hash.first, nbuckets); }
 
-	// Computes and stores the splittings and bijections of a bucket.
-	void recSplit(vector<uint64_t> &bucket, typename RiceBitVector<AT>::Builder &builder, vector<uint32_t> &unary) {
-		const auto m = bucket.size();
-		vector<uint64_t> temp(m);
-		recSplit(bucket, temp, 0, bucket.size(), builder, unary, 0);
+	/* Scratch space used by a thread to build buckets. Buffers are reused from bucket to
+	 * bucket, and they are allocated again only if a bucket is larger than MAX_BUCKET_SIZE,
+	 * so no memory is allocated for each bucket.
+	 */
+	struct Scratch {
+		util::Vector<uint64_t> bucket, temp;
+		vector<uint32_t> unary;
+		// Number of allocations of the buffers
+		size_t allocations = 0;
+
+		Scratch() { reserve(MAX_BUCKET_SIZE); }
+
+		// Makes room for a bucket of m keys.
+		void reserve(const size_t m) {
+			if (m <= bucket.size() && m <= unary.capacity()) return;
+			bucket.size(m);
+			temp.size(m);
+			unary.reserve(m);
+			allocations += 3;
+		}
+	};
+
+	// Computes and stores the splittings and bijections of the m keys in scratch.bucket.
+	// Statistics are accumulated in stats, which belongs to the calling thread.
+	static void recSplit(Scratch &scratch, const size_t m, typename RiceBitVector<AT>::Builder &builder, RecSplitStats &stats) {
+		scratch.unary.clear();
+		recSplit(&scratch.bucket, &scratch.temp, 0, m, builder, scratch.unary, 0, stats);
+		// The number of nodes is smaller than the number of keys, so unary never grows
+		builder.appendUnaryAll(scratch.unary);
 	}
 
-	void recSplit(vector<uint64_t> &bucket, vector<uint64_t> &temp, size_t start, size_t end, typename RiceBitVector<AT>::Builder &builder, vector<uint32_t> &unary, const int level) {
+	static void recSplit(uint64_t *const bucket, uint64_t *const temp, size_t start, size_t end, typename RiceBitVector<AT>::Builder &builder, vector<uint32_t> &unary, const int level,
+						 [[maybe_unused]] RecSplitStats &stats) {
 		const auto m = end - start;
 		assert(m > 1);
 		uint64_t x = start_seed[level];
 
 		if (m <= _leaf) {
 #ifdef MORESTATS
-			sum_depths += m * level;
+			stats.sum_depths += m * level;
 			auto start_time = high_resolution_clock::now();
 #endif
-			uint32_t mask;
-			const uint32_t found = (1 << m) - 1;
-			if constexpr (_leaf <= 8) {
-				for (;;) {
-					mask = 0;
-					for (size_t i = start; i < end; i++) mask |= uint32_t(1) << remap16(remix(bucket[i] + x), m);
-#ifdef MORESTATS
-					num_bij_evals[m] += m;
-#endif
-					if (mask == found) break;
-					x++;
-				}
-			} else {
-				const size_t midstop = bij_midstop[m];
-				for (;;) {
-					mask = 0;
-					size_t i;
-					for (i = start; i < start + midstop; i++) mask |= uint32_t(1) << remap16(remix(bucket[i] + x), m);
-#ifdef MORESTATS
-					num_bij_evals[m] += midstop;
-#endif
-					if (nu(mask) == midstop) {
-						for (; i < end; i++) mask |= uint32_t(1) << remap16(remix(bucket[i] + x), m);
+			[[maybe_unused]] uint64_t evals = 0;
+			x = find_bijection(&bucket[start], m, _leaf <= 8 ? m : bij_midstop[m], x, evals);
 #ifdef MORESTATS
-						num_bij_evals[m] += m - midstop;
+			stats.num_bij_evals[m] += evals;
 #endif
-						if (mask == found) break;
-					}
-					x++;
-				}
-			}
 #ifdef MORESTATS
-			time_bij += duration_cast<nanoseconds>(high_resolution_clock::now() - start_time).count();
+			stats.time_bij += duration_cast<nanoseconds>(high_resolution_clock::now() - start_time).count();
 #endif
 			x -= start_seed[level];
 			const auto log2golomb = golomb_param(m);
 			builder.appendFixed(x, log2golomb);
 			unary.push_back(x >> log2golomb);
 #ifdef MORESTATS
-			bij_count[m]++;
-			num_bij_trials[m] += x + 1;
-			bij_unary += 1 + (x >> log2golomb);
-			bij_fixed += log2golomb;
+			stats.bij_count[m]++;
+			stats.num_bij_trials[m] += x + 1;
+			stats.bij_unary += 1 + (x >> log2golomb);
+			stats.bij_fixed += log2golomb;
 
-			min_bij_code = min(min_bij_code, x);
-			max_bij_code = max(max_bij_code, x);
-			sum_bij_codes += x;
+			stats.min_bij_code = min(stats.min_bij_code, x);
+			stats.max_bij_code = max(stats.max_bij_code, x);
+			stats.sum_bij_codes += x;
 
 			auto b = bij_memo_golomb[m];
 			auto log2b = lambda(b);
-			bij_unary_golomb += x / b + 1;
-			bij_fixed_golomb += x % b < ((1 << log2b + 1) - b) ? log2b : log2b + 1;
+			stats.bij_unary_golomb += x / b + 1;
+			stats.bij_fixed_golomb += x % b < ((1 << log2b + 1) - b) ? log2b : log2b + 1;
 #endif
 		} else {
 #ifdef MORESTATS
@@ -517,19 +986,13 @@ template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC> class
 			if (m > upper_aggr) { // fanout = 2
 				const size_t split = ((uint16_t(m / 2 + upper_aggr - 1) / upper_aggr)) * upper_aggr;
 
-				size_t count[2];
-				for (;;) {
-					count[0] = 0;
-					for (size_t i = start; i < end; i++) {
-						count[remap16(remix(bucket[i] + x), m) >= split]++;
+				[[maybe_unused]] uint64_t evals = 0;
+				x = find_split(&bucket[start], m, split, 2, x, evals);
 #ifdef MORESTATS
-						++num_split_evals;
+				stats.num_split_evals += evals;
 #endif
-					}
-					if (count[0] == split) break;
-					x++;
-				}
 
+				size_t count[2];
 				count[0] = 0;
 				count[1] = split;
 				for (size_t i = start; i < end; i++) {
@@ -542,30 +1005,23 @@ template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC> class
 				unary.push_back(x >> log2golomb);
 
 #ifdef MORESTATS
-				time_split[min(MAX_LEVEL_TIME, level)] += duration_cast<nanoseconds>(high_resolution_clock::now() - start_time).count();
+				stats.time_split[min(MAX_LEVEL_TIME, level)] += duration_cast<nanoseconds>(high_resolution_clock::now() - start_time).count();
 #endif
-				recSplit(bucket, temp, start, start + split, builder, unary, level + 1);
-				if (m - split > 1) recSplit(bucket, temp, start + split, end, builder, unary, level + 1);
+				recSplit(bucket, temp, start, start + split, builder, unary, level + 1, stats);
+				if (m - split > 1) recSplit(bucket, temp, start + split, end, builder, unary, level + 1, stats);
 #ifdef MORESTATS
 				else
-					sum_depths += level;
+					stats.sum_depths += level;
 #endif
 			} else if (m > lower_aggr) { // 2nd aggregation level
 				const size_t fanout = uint16_t(m + lower_aggr - 1) / lower_aggr;
-				size_t count[fanout]; // Note that we never read count[fanout-1]
-				for (;;) {
-					memset(count, 0, sizeof count - sizeof *count);
-					for (size_t i = start; i < end; i++) {
-						count[uint16_t(remap16(remix(bucket[i] + x), m)) / lower_aggr]++;
+				[[maybe_unused]] uint64_t evals = 0;
+				x = find_split(&bucket[start], m, lower_aggr, fanout, x, evals);
 #ifdef MORESTATS
-						++num_split_evals;
+				stats.num_split_evals += evals;
 #endif
-					}
-					size_t broken = 0;
-					for (size_t i = 0; i < fanout - 1; i++) broken |= count[i] - lower_aggr;
-					if (!broken) break;
-					x++;
-				}
+
+				size_t count[fanout];
 
 				for (size_t i = 0, c = 0; i < fanout; i++, c += lower_aggr) count[i] = c;
 				for (size_t i = start; i < end; i++) {
@@ -579,33 +1035,26 @@ template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC> class
 				unary.push_back(x >> log2golomb);
 
 #ifdef MORESTATS
-				time_split[min(MAX_LEVEL_TIME, level)] += duration_cast<nanoseconds>(high_resolution_clock::now() - start_time).count();
+				stats.time_split[min(MAX_LEVEL_TIME, level)] += duration_cast<nanoseconds>(high_resolution_clock::now() - start_time).count();
 #endif
 				size_t i;
 				for (i = 0; i < m - lower_aggr; i += lower_aggr) {
-					recSplit(bucket, temp, start + i, start + i + lower_aggr, builder, unary, level + 1);
+					recSplit(bucket, temp, start + i, start + i + lower_aggr, builder, unary, level + 1, stats);
 				}
-				if (m - i > 1) recSplit(bucket, temp, start + i, end, builder, unary, level + 1);
+				if (m - i > 1) recSplit(bucket, temp, start + i, end, builder, unary, level + 1, stats);
 #ifdef MORESTATS
 				else
-					sum_depths += level;
+					stats.sum_depths += level;
 #endif
 			} else { // First aggregation level, m <= lower_aggr
 				const size_t fanout = uint16_t(m + _leaf - 1) / _leaf;
-				size_t count[fanout]; // Note that we never read count[fanout-1]
-				for (;;) {
-					memset(count, 0, sizeof count - sizeof *count);
-					for (size_t i = start; i < end; i++) {
-						count[uint16_t(remap16(remix(bucket[i] + x), m)) / _leaf]++;
+				[[maybe_unused]] uint64_t evals = 0;
+				x = find_split(&bucket[start], m, _leaf, fanout, x, evals);
 #ifdef MORESTATS
-						++num_split_evals;
+				stats.num_split_evals += evals;
 #endif
-					}
-					size_t broken = 0;
-					for (size_t i = 0; i < fanout - 1; i++) broken |= count[i] - _leaf;
-					if (!broken) break;
-					x++;
-				}
+
+				size_t count[fanout];
 				for (size_t i = 0, c = 0; i < fanout; i++, c += _leaf) count[i] = c;
 				for (size_t i = start; i < end; i++) {
 					temp[count[uint16_t(remap16(remix(bucket[i] + x), m)) / _leaf]++] = bucket[i];
@@ -618,22 +1067,22 @@ template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC> class
 				unary.push_back(x >> log2golomb);
 
 #ifdef MORESTATS
-				time_split[min(MAX_LEVEL_TIME, level)] += duration_cast<nanoseconds>(high_resolution_clock::now() - start_time).count();
+				stats.time_split[min(MAX_LEVEL_TIME, level)] += duration_cast<nanoseconds>(high_resolution_clock::now() - start_time).count();
 #endif
 				size_t i;
 				for (i = 0; i < m - _leaf; i += _leaf) {
-					recSplit(bucket, temp, start + i, start + i + _leaf, builder, unary, level + 1);
+					recSplit(bucket, temp, start + i, start + i + _leaf, builder, unary, level + 1, stats);
 				}
-				if (m - i > 1) recSplit(bucket, temp, start + i, end, builder, unary, level + 1);
+				if (m - i > 1) recSplit(bucket, temp, start + i, end, builder, unary, level + 1, stats);
 #ifdef MORESTATS
 				else
-					sum_depths += level;
+					stats.sum_depths += level;
 #endif
 			}
 
 #ifdef MORESTATS
-			++split_count;
-			num_split_trials += x + 1;
+			++stats.split_count;
+			stats.num_split_trials += x + 1;
 			double e_trials = 1;
 			size_t aux = m;
 			SplitStrat strat{m};
@@ -644,38 +1093,232 @@ template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC> class
 					e_trials *= (double)j / aux;
 				}
 			}
-			expected_split_trials += (size_t)e_trials;
-			expected_split_evals += (size_t)e_trials * m;
+			stats.expected_split_trials += (size_t)e_trials;
+			stats.expected_split_evals += (size_t)e_trials * m;
 			const auto log2golomb = golomb_param(m);
-			split_unary += 1 + (x >> log2golomb);
-			split_fixed += log2golomb;
+			stats.split_unary += 1 + (x >> log2golomb);
+			stats.split_fixed += log2golomb;
 
-			min_split_code = min(min_split_code, x);
-			max_split_code = max(max_split_code, x);
-			sum_split_codes += x;
+			stats.min_split_code = min(stats.min_split_code, x);
+			stats.max_split_code = max(stats.max_split_code, x);
+			stats.sum_split_codes += x;
 
 			auto b = split_golomb_b<LEAF_SIZE>(m);
 			auto log2b = lambda(b);
-			split_unary_golomb += x / b + 1;
-			split_fixed_golomb += x % b < ((1ULL << log2b + 1) - b) ? log2b : log2b + 1;
+			stats.split_unary_golomb += x / b + 1;
+			stats.split_fixed_golomb += x % b < ((1ULL << log2b + 1) - b) ? log2b : log2b + 1;
 #endif
 		}
 	}
 
-	void hash_gen(hash128_t *hashes) {
+	/* Sorts by bucket n hashes whose buckets are in [first_bucket, first_bucket + nb), and stores
+	 * cumulative bucket sizes in bucket_size_acc[first_bucket + 1..first_bucket + nb], starting
+	 * from bucket_size_acc[first_bucket].
+	 *
+	 * The bucket of each key is computed just once. In a first parallel pass each thread
+	 * scatters a contiguous chunk of the keys into a temporary array, partitioning them by the
+	 * high bits of their bucket; then each partition is put in bucket order by counting on
+	 * the low bits, which are at most 16, so that counters and write positions fit in cache.
+	 * The partition is stable, and thus its result does not depend on the number of threads.
+	 */
+	void partition(hash128_t *hashes, const size_t n, const size_t first_bucket, const size_t nb, vector<int64_t> &bucket_size_acc, const size_t num_threads) {
+		const auto start = high_resolution_clock::now();
+		profile.sort_bytes = std::max(profile.sort_bytes, uint64_t(n * (sizeof(hash128_t) + sizeof(uint64_t) + sizeof(uint16_t))));
+		const int bits = nb > 1 ? lambda(nb - 1) + 1 : 0;
+		const int shift = min(16, bits - bits / 2);
+		const size_t nparts = ((nb - 1) >> shift) + 1;
+		const size_t chunk = (n + num_threads - 1) / num_threads;
+
+		vector<uint64_t> bucket(n);
+		vector<vector<size_t>> part_pos(num_threads, vector<size_t>(nparts));
+		parallel(num_threads, [&](const size_t t) {
+			vector<size_t> &count = part_pos[t];
+			for (size_t i = min(n, t * chunk), end = min(n, (t + 1) * chunk); i < end; i++) count[(bucket[i] = hash128_to_bucket(hashes[i]) - first_bucket) >> shift]++;
+		});
+
+		// Thread t writes the keys of partition p starting after those of threads 0, 1, ..., t - 1
+		vector<size_t> part_start(nparts + 1);
+		for (size_t p = 0, s = 0; p < nparts; p++) {
+			part_start[p] = s;
+			for (size_t t = 0; t < num_threads; t++) {
+				const size_t c = part_pos[t][p];
+				part_pos[t][p] = s;
+				s += c;
+			}
+		}
+		part_start[nparts] = n;
+
+		hash128_t *temp = (hash128_t *)malloc(n * sizeof(hash128_t));
+		vector<uint16_t> low(n);
+		parallel(num_threads, [&](const size_t t) {
+			vector<size_t> &pos = part_pos[t];
+			for (size_t i = min(n, t * chunk), end = min(n, (t + 1) * chunk); i < end; i++) {
+				const size_t j = pos[bucket[i] >> shift]++;
+				temp[j] = hashes[i];
+				low[j] = bucket[i] & ((uint64_t(1) << shift) - 1);
+			}
+		});
+		bucket = vector<uint64_t>();
+
+		const int64_t base = bucket_size_acc[first_bucket];
+		atomic<size_t> next_part(0);
+		parallel(num_threads, [&](const size_t) {
+			vector<size_t> pos(size_t(1) << shift);
+			for (size_t p; (p = next_part++) < nparts;) {
+				const size_t first = p << shift, m = min(nb - first, size_t(1) << shift);
+				fill(pos.begin(), pos.begin() + m, 0);
+				for (size_t j = part_start[p]; j < part_start[p + 1]; j++) pos[low[j]]++;
+				for (size_t b = 0, s = part_start[p]; b < m; b++) {
+					const size_t c = pos[b];
+					pos[b] = s;
+					s += c;
+					bucket_size_acc[first_bucket + first + b + 1] = base + s;
+				}
+				for (size_t j = part_start[p]; j < part_start[p + 1]; j++) hashes[pos[low[j]]++] = temp[j];
+			}
+		});
+		free(temp);
+		profile.time_sort += nanos_since(start);
+	}
+
+	/* Temporary files containing hashes partitioned by `bits` bits of their first half,
+	 * starting after the first `shift` bits, and thus by bucket range. Hashes are buffered
+	 * in memory and written when a buffer is full. The files are unlinked immediately
+	 * after creation, so they are removed even if the process is killed.
+	 */
+	class SpillFiles {
+	  public:
+		static constexpr int MAX_BITS = 8;
+		const int shift, bits;
+		const uint64_t base;
+		FILE *file[size_t(1) << MAX_BITS];
+		size_t count[size_t(1) << MAX_BITS] = {};
+
+	  private:
+		util::Vector<hash128_t> buffer[size_t(1) << MAX_BITS];
+		size_t buffer_size;
+
+	  public:
+		SpillFiles(const string &tmp_dir, const int shift, const int bits, const uint64_t base, const size_t memory_budget) : shift(shift), bits(bits), base(base) {
+			buffer_size = max(size_t(1), memory_budget / (fanout() * sizeof(hash128_t)));
+			for (size_t p = 0; p < fanout(); p++) {
+				string name = tmp_dir + "/recsplit.XXXXXX";
+				const int fd = mkstemp(&name[0]);
+				if (fd == -1 || (file[p] = fdopen(fd, "w+b")) == nullptr) {
+					fprintf(stderr, "Cannot create temporary file in %s\n", tmp_dir.c_str());
+					abort();
+				}
+				unlink(name.c_str());
+				buffer[p].reserve(buffer_size);
+			}
+		}
+
+		~SpillFiles() {
+			for (size_t p = 0; p < fanout(); p++) fclose(file[p]);
+		}
+
+		size_t fanout() const { return size_t(1) << bits; }
+
+		// Returns the smallest first half of a hash in file p; p can be fanout().
+		uint64_t start(const size_t p) const { return base + (uint64_t(p) << (64 - bits - shift)); }
+
+		void add(const hash128_t &hash) {
+			const size_t p = bits == 0 ? 0 : (hash.first << shift) >> (64 - bits);
+			buffer[p].pushBack(hash);
+			if (buffer[p].size() == buffer_size) write(p);
+		}
+
+		/** Writes all buffers and rewinds the files so that they can be read. */
+		void flush() {
+			for (size_t p = 0; p < fanout(); p++) {
+				write(p);
+				buffer[p] = util::Vector<hash128_t>();
+				rewind(file[p]);
+			}
+		}
+
+	  private:
+		void write(const size_t p) {
+			if (fwrite(&buffer[p], sizeof(hash128_t), buffer[p].size(), file[p]) != buffer[p].size()) {
+				fprintf(stderr, "Cannot write temporary file\n");
+				abort();
+			}
+			count[p] += buffer[p].size();
+			buffer[p].resize(0);
+		}
+	};
+
+	// Approximate number of bytes per key needed to build buckets in memory
+	static constexpr size_t EXTERNAL_BYTES_PER_KEY = 3 * sizeof(hash128_t) + sizeof(uint64_t) + sizeof(uint16_t);
+
+	/* Builds buckets from spilled hashes. Files are processed in order: the hashes of a file are
+	 * loaded after those left over from the previous file, which can belong only to a single
+	 * bucket, and all buckets that are complete are built. Files with too many hashes for the
+	 * memory budget are partitioned again recursively.
+	 */
+	template <typename B> void build_spill(SpillFiles &spill, util::Vector<hash128_t> &keys, size_t &first_bucket, vector<int64_t> &bucket_size_acc, const B &build, const string &tmp_dir, const size_t memory_budget, const size_t num_threads) {
+		for (size_t p = 0; p < spill.fanout(); p++) {
+			const size_t n = keys.size() + spill.count[p];
+			const bool last = spill.start(p + 1) == 0;
+
+			// Leftover hashes belong to a single bucket, so their number is small; splitting
+			// files smaller than a bucket would be pointless
+			const int shift = spill.shift + spill.bits;
+			if (spill.count[p] * EXTERNAL_BYTES_PER_KEY > memory_budget && spill.count[p] > MAX_BUCKET_SIZE && shift < 64) {
+				// Just enough files so that, on average, each one fits the budget
+				const int bits = min(SpillFiles::MAX_BITS, min(64 - shift, lambda((spill.count[p] * EXTERNAL_BYTES_PER_KEY - 1) / memory_budget) + 1));
+				const auto start = high_resolution_clock::now();
+				SpillFiles sub(tmp_dir, shift, bits, spill.start(p), memory_budget);
+				util::Vector<hash128_t> block(max(size_t(1), memory_budget / (4 * sizeof(hash128_t))));
+				for (size_t r; (r = fread(&block, sizeof(hash128_t), block.size(), spill.file[p])) != 0;)
+					for (size_t i = 0; i < r; i++) sub.add(block[i]);
+				block = util::Vector<hash128_t>();
+				sub.flush();
+				profile.time_spill += nanos_since(start);
+				profile.spill_bytes += spill.count[p] * sizeof(hash128_t);
+				build_spill(sub, keys, first_bucket, bucket_size_acc, build, tmp_dir, memory_budget, num_threads);
+				continue;
+			}
+
+			const auto start = high_resolution_clock::now();
+			const size_t old_size = keys.size();
+			keys.reserve(n);
+			keys.resize(n);
+			if (fread(&keys + old_size, sizeof(hash128_t), spill.count[p], spill.file[p]) != spill.count[p]) {
+				fprintf(stderr, "Cannot read temporary file\n");
+				abort();
+			}
+			profile.time_spill += nanos_since(start);
+
+			// The bucket containing the start of the next file might continue in the next file
+			const size_t end_bucket = last ? nbuckets : hash128_to_bucket(hash128_t(spill.start(p + 1), 0));
+			partition(&keys, n, first_bucket, min(end_bucket + 1, nbuckets) - first_bucket, bucket_size_acc, max(1, min(num_threads, n)));
+			build(&keys, first_bucket, end_bucket);
+
+			const size_t built = bucket_size_acc[end_bucket] - bucket_size_acc[first_bucket];
+			memmove(&keys, &keys + built, (n - built) * sizeof(hash128_t));
+			keys.resize(n - built);
+			first_bucket = end_bucket;
+		}
+	}
+
+	void hash_gen(hash128_t *hashes, const size_t num_threads) {
+		hash_gen(
+			[&](vector<int64_t> &bucket_size_acc, const auto &build) {
+				partition(hashes, keys_count, 0, nbuckets, bucket_size_acc, max(1, min(num_threads, keys_count)));
+				build(hashes, 0, nbuckets);
+			},
+			num_threads);
+	}
+
+	/* Builds the function. The producer is passed the vector of cumulative bucket sizes
+	 * and a function build(hashes, from, to) that must be called, with increasing
+	 * bucket ranges covering all buckets, on the hashes of the buckets in [from, to),
+	 * sorted by bucket, after bucket_size_acc[from..to] has been filled.
+	 */
+	template <typename P> void hash_gen(const P &produce, size_t num_threads) {
 #ifdef MORESTATS
-		time_bij = 0;
-		memset(time_split, 0, sizeof time_split);
-		split_unary = split_fixed = 0;
-		bij_unary = bij_fixed = 0;
-		min_split_code = 1UL << 63;
-		max_split_code = sum_split_codes = 0;
-		min_bij_code = 1UL << 63;
-		max_bij_code = sum_bij_codes = 0;
-		sum_depths = 0;
-		size_t minsize = keys_count, maxsize = 0;
-		double ub_split_bits = 0, ub_bij_bits = 0;
-		double ub_split_evals = 0, ub_bij_evals = 0;
+		stats = RecSplitStats();
 #endif
 
 #ifndef __SIZEOF_INT128__
@@ -688,36 +1331,100 @@ template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC> class
 		auto bucket_size_acc = vector<int64_t>(nbuckets + 1);
 		auto bucket_pos_acc = vector<int64_t>(nbuckets + 1);
 
-		sort(hashes, hashes + keys_count, [this](const hash128_t &a, const hash128_t &b) { return hash128_to_bucket(a) < hash128_to_bucket(b); });
-		typename RiceBitVector<AT>::Builder builder;
-
 		bucket_size_acc[0] = bucket_pos_acc[0] = 0;
-		for (size_t i = 0, last = 0; i < nbuckets; i++) {
-			vector<uint64_t> bucket;
-			for (; last < keys_count && hash128_to_bucket(hashes[last]) == i; last++) bucket.push_back(hashes[last].second);
-
-			const size_t s = bucket.size();
-			bucket_size_acc[i + 1] = bucket_size_acc[i] + s;
-			if (bucket.size() > 1) {
-				vector<uint32_t> unary;
-				recSplit(bucket, builder, unary);
-				builder.appendUnaryAll(unary);
+
+		num_threads = max(1, min(num_threads, nbuckets));
+		profile.keys = keys_count;
+		profile.buckets = nbuckets;
+		profile.threads = num_threads;
+
+		// Each thread writes only its own builder and its own range of bucket_pos_acc
+		vector<typename RiceBitVector<AT>::Builder> builders(num_threads);
+		vector<RecSplitStats> thread_stats(num_threads);
+		vector<Scratch> scratch(num_threads);
+		vector<size_t> first_bucket(num_threads + 1);
+		const hash128_t *hashes;
+		auto build_buckets = [&](const size_t t) {
+			typename RiceBitVector<AT>::Builder &builder = builders[t];
+			[[maybe_unused]] RecSplitStats &stats = thread_stats[t];
+			Scratch &sc = scratch[t];
+			for (size_t i = first_bucket[t]; i < first_bucket[t + 1]; i++) {
+				const size_t s = bucket_size_acc[i + 1] - bucket_size_acc[i];
+				sc.reserve(s);
+				const hash128_t *const h = hashes + (bucket_size_acc[i] - bucket_size_acc[first_bucket[0]]);
+				for (size_t j = 0; j < s; j++) sc.bucket[j] = h[j].second;
+
+				if (s > 1) recSplit(sc, s, builder, stats);
+				bucket_pos_acc[i + 1] = builder.getBits();
+#ifdef MORESTATS
+				auto upper_leaves = (s + _leaf - 1) / _leaf;
+				auto upper_height = ceil(log(upper_leaves) / log(2)); // TODO: check
+				auto upper_s = _leaf * pow(2, upper_height);
+				stats.ub_split_bits += (double)upper_s / (_leaf * 2) * log2(2 * M_PI * _leaf) - .5 * log2(2 * M_PI * upper_s);
+				stats.ub_bij_bits += upper_leaves * _leaf * (log2e - .5 / _leaf * log2(2 * M_PI * _leaf));
+				stats.ub_split_evals += 4 * upper_s * sqrt(pow(2 * M_PI * upper_s, 2 - 1) / pow(2, 2));
+				stats.min_bucket_size = std::min(stats.min_bucket_size, uint64_t(s));
+				stats.max_bucket_size = std::max(stats.max_bucket_size, uint64_t(s));
+#endif
 			}
-			bucket_pos_acc[i + 1] = builder.getBits();
+		};
+
+		// With aligned buckets, the buckets of all threads are copied one by one to a separate builder
+		typename RiceBitVector<AT>::Builder aligned;
+		typename RiceBitVector<AT>::Builder &builder = ALIGN_BUCKETS ? aligned : builders[0];
+		produce(bucket_size_acc, [&](const hash128_t *const h, const size_t from, const size_t to) {
+			// Buckets are assigned to threads in contiguous ranges containing approximately the same number of keys
+			const size_t n = bucket_size_acc[to] - bucket_size_acc[from];
+			hashes = h;
+			first_bucket[0] = from;
+			for (size_t t = 1; t < num_threads; t++)
+				first_bucket[t] = upper_bound(bucket_size_acc.begin() + from, bucket_size_acc.begin() + to + 1, int64_t(bucket_size_acc[from] + n * t / num_threads)) - bucket_size_acc.begin() - 1;
+			first_bucket[num_threads] = to;
+
+			auto start = high_resolution_clock::now();
+			parallel(num_threads, build_buckets);
+			profile.time_buckets += nanos_since(start);
+
+			// Concatenation in bucket order makes the result independent of the number of threads
+			start = high_resolution_clock::now();
+			if constexpr (ALIGN_BUCKETS) {
+				for (size_t t = 0; t < num_threads; t++) {
+					// Positions in builders[t] are relative to its start
+					for (size_t i = first_bucket[t], pos = 0; i < first_bucket[t + 1]; i++) {
+						const size_t next = bucket_pos_acc[i + 1];
+						builder.alignToCacheLine(next - pos);
+						bucket_pos_acc[i] = builder.getBits();
+						builder.append(builders[t], pos, next - pos);
+						bucket_pos_acc[i + 1] = builder.getBits();
+						pos = next;
+					}
+					builders[t] = typename RiceBitVector<AT>::Builder();
+				}
+			} else {
+				for (size_t t = 1; t < num_threads; t++) {
+					const uint64_t offset = builder.getBits();
+					for (size_t i = first_bucket[t]; i < first_bucket[t + 1]; i++) bucket_pos_acc[i + 1] += offset;
+					builder.append(builders[t]);
+					builders[t] = typename RiceBitVector<AT>::Builder();
+				}
+			}
+			profile.time_concat += nanos_since(start);
+		});
+
 #ifdef MORESTATS
-			auto upper_leaves = (s + _leaf - 1) / _leaf;
-			auto upper_height = ceil(log(upper_leaves) / log(2)); // TODO: check
-			auto upper_s = _leaf * pow(2, upper_height);
-			ub_split_bits += (double)upper_s / (_leaf * 2) * log2(2 * M_PI * _leaf) - .5 * log2(2 * M_PI * upper_s);
-			ub_bij_bits += upper_leaves * _leaf * (log2e - .5 / _leaf * log2(2 * M_PI * _leaf));
-			ub_split_evals += 4 * upper_s * sqrt(pow(2 * M_PI * upper_s, 2 - 1) / pow(2, 2));
-			minsize = min(minsize, s);
-			maxsize = max(maxsize, s);
+		for (const auto &t : thread_stats) stats.merge(t);
 #endif
-		}
+
+		auto start = high_resolution_clock::now();
 		builder.appendFixed(1, 1); // Sentinel (avoids checking for parts of size 1)
+		profile.descriptor_bits = builder.getBits();
 		descriptors = builder.build();
-		ef = DoubleEF<AT>(vector<uint64_t>(bucket_size_acc.begin(), bucket_size_acc.end()), vector<uint64_t>(bucket_pos_acc.begin(), bucket_pos_acc.end()));
+		profile.time_descriptors = nanos_since(start);
+		start = high_resolution_clock::now();
+		ef = DIRECTORY<AT>(vector<uint64_t>(bucket_size_acc.begin(), bucket_size_acc.end()), vector<uint64_t>(bucket_pos_acc.begin(), bucket_pos_acc.end()));
+		profile.time_ef = nanos_since(start);
+		profile.ef_bits = ef.bitCountCumKeys() + ef.bitCountPosition();
+		for (const auto &sc : scratch) profile.scratch_allocations += sc.allocations;
 
 #ifdef STATS
 		// Evaluation purposes only
@@ -730,18 +1437,21 @@ template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC> class
 		printf("Elias-Fano cumul bits:   %f bits/key\n", ef_bits);
 		printf("Rice-Golomb descriptors: %f bits/key\n", rice_desc);
 		printf("Total bits:              %f bits/key\n", ef_sizes + ef_bits + rice_desc);
+		size_t allocations = 0;
+		for (const auto &sc : scratch) allocations += sc.allocations;
+		printf("Scratch allocations:     %zu (%zu threads)\n", allocations, num_threads);
 #endif
 #ifdef MORESTATS
 
 		printf("\n");
-		printf("Min bucket size: %lu\n", minsize);
-		printf("Max bucket size: %lu\n", maxsize);
+		printf("Min bucket size: %lu\n", stats.min_bucket_size);
+		printf("Max bucket size: %lu\n", stats.max_bucket_size);
 
 		printf("\n");
-		printf("Bijections: %13.3f ms\n", time_bij * 1E-6);
+		printf("Bijections: %13.3f ms\n", stats.time_bij * 1E-6);
 		for (int i = 0; i < MAX_LEVEL_TIME; i++) {
-			if (time_split[i] > 0) {
-				printf("Split level %d: %10.3f ms\n", i, time_split[i] * 1E-6);
+			if (stats.time_split[i] > 0) {
+				printf("Split level %d: %10.3f ms\n", i, stats.time_split[i] * 1E-6);
 			}
 		}
 
@@ -749,81 +1459,75 @@ template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC> class
 		printf("\n");
 		printf("Bij               count              trials                 exp               evals                 exp           tot evals\n");
 		for (int i = 0; i < MAX_LEAF_SIZE; i++) {
-			if (num_bij_trials[i] != 0) {
-				tot_bij_count += bij_count[i];
-				tot_bij_evals += num_bij_evals[i];
-				printf("%-3d%20d%20.2f%20.2f%20.2f%20.2f%20lld\n", i, bij_count[i], (double)num_bij_trials[i] / bij_count[i], pow(i, i) / fact, (double)num_bij_evals[i] / bij_count[i],
-					   (_leaf <= 8 ? i : bij_midstop[i]) * pow(i, i) / fact, num_bij_evals[i]);
+			if (stats.num_bij_trials[i] != 0) {
+				tot_bij_count += stats.bij_count[i];
+				tot_bij_evals += stats.num_bij_evals[i];
+				printf("%-3d%20d%20.2f%20.2f%20.2f%20.2f%20lld\n", i, stats.bij_count[i], (double)stats.num_bij_trials[i] / stats.bij_count[i], pow(i, i) / fact, (double)stats.num_bij_evals[i] / stats.bij_count[i],
+					   (_leaf <= 8 ? i : bij_midstop[i]) * pow(i, i) / fact, stats.num_bij_evals[i]);
 			}
 			fact *= (i + 1);
 		}
 
 		printf("\n");
-		printf("Split count:       %16zu\n", split_count);
+		printf("Split count:       %16zu\n", stats.split_count);
 
-		printf("Total split evals: %16lld\n", num_split_evals);
+		printf("Total split evals: %16lld\n", stats.num_split_evals);
 		printf("Total bij evals:   %16lld\n", tot_bij_evals);
-		printf("Total evals:       %16lld\n", num_split_evals + tot_bij_evals);
+		printf("Total evals:       %16lld\n", stats.num_split_evals + tot_bij_evals);
 
 		printf("\n");
-		printf("Average depth:        %f\n", (double)sum_depths / keys_count);
+		printf("Average depth:        %f\n", (double)stats.sum_depths / keys_count);
 		printf("\n");
-		printf("Trials per split:     %16.3f\n", (double)num_split_trials / split_count);
-		printf("Exp trials per split: %16.3f\n", (double)expected_split_trials / split_count);
-		printf("Evals per split:      %16.3f\n", (double)num_split_evals / split_count);
-		printf("Exp evals per split:  %16.3f\n", (double)expected_split_evals / split_count);
+		printf("Trials per split:     %16.3f\n", (double)stats.num_split_trials / stats.split_count);
+		printf("Exp trials per split: %16.3f\n", (double)stats.expected_split_trials / stats.split_count);
+		printf("Evals per split:      %16.3f\n", (double)stats.num_split_evals / stats.split_count);
+		printf("Exp evals per split:  %16.3f\n", (double)stats.expected_split_evals / stats.split_count);
 
 		printf("\n");
-		printf("Unary bits per bij: %10.5f\n", (double)bij_unary / tot_bij_count);
-		printf("Fixed bits per bij: %10.5f\n", (double)bij_fixed / tot_bij_count);
-		printf("Total bits per bij: %10.5f\n", (double)(bij_unary + bij_fixed) / tot_bij_count);
+		printf("Unary bits per bij: %10.5f\n", (double)stats.bij_unary / tot_bij_count);
+		printf("Fixed bits per bij: %10.5f\n", (double)stats.bij_fixed / tot_bij_count);
+		printf("Total bits per bij: %10.5f\n", (double)(stats.bij_unary + stats.bij_fixed) / tot_bij_count);
 
 		printf("\n");
-		printf("Unary bits per split: %10.5f\n", (double)split_unary / split_count);
-		printf("Fixed bits per split: %10.5f\n", (double)split_fixed / split_count);
-		printf("Total bits per split: %10.5f\n", (double)(split_unary + split_fixed) / split_count);
-		printf("Total bits per key:   %10.5f\n", (double)(bij_unary + bij_fixed + split_unary + split_fixed) / keys_count);
+		printf("Unary bits per split: %10.5f\n", (double)stats.split_unary / stats.split_count);
+		printf("Fixed bits per split: %10.5f\n", (double)stats.split_fixed / stats.split_count);
+		printf("Total bits per split: %10.5f\n", (double)(stats.split_unary + stats.split_fixed) / stats.split_count);
+		printf("Total bits per key:   %10.5f\n", (double)(stats.bij_unary + stats.bij_fixed + stats.split_unary + stats.split_fixed) / keys_count);
 
 		printf("\n");
-		printf("Unary bits per bij (Golomb): %10.5f\n", (double)bij_unary_golomb / tot_bij_count);
-		printf("Fixed bits per bij (Golomb): %10.5f\n", (double)bij_fixed_golomb / tot_bij_count);
-		printf("Total bits per bij (Golomb): %10.5f\n", (double)(bij_unary_golomb + bij_fixed_golomb) / tot_bij_count);
+		printf("Unary bits per bij (Golomb): %10.5f\n", (double)stats.bij_unary_golomb / tot_bij_count);
+		printf("Fixed bits per bij (Golomb): %10.5f\n", (double)stats.bij_fixed_golomb / tot_bij_count);
+		printf("Total bits per bij (Golomb): %10.5f\n", (double)(stats.bij_unary_golomb + stats.bij_fixed_golomb) / tot_bij_count);
 
 		printf("\n");
-		printf("Unary bits per split (Golomb): %10.5f\n", (double)split_unary_golomb / split_count);
-		printf("Fixed bits per split (Golomb): %10.5f\n", (double)split_fixed_golomb / split_count);
-		printf("Total bits per split (Golomb): %10.5f\n", (double)(split_unary_golomb + split_fixed_golomb) / split_count);
-		printf("Total bits per key (Golomb):   %10.5f\n", (double)(bij_unary_golomb + bij_fixed_golomb + split_unary_golomb + split_fixed_golomb) / keys_count);
+		printf("Unary bits per split (Golomb): %10.5f\n", (double)stats.split_unary_golomb / stats.split_count);
+		printf("Fixed bits per split (Golomb): %10.5f\n", (double)stats.split_fixed_golomb / stats.split_count);
+		printf("Total bits per split (Golomb): %10.5f\n", (double)(stats.split_unary_golomb + stats.split_fixed_golomb) / stats.split_count);
+		printf("Total bits per key (Golomb):   %10.5f\n", (double)(stats.bij_unary_golomb + stats.bij_fixed_golomb + stats.split_unary_golomb + stats.split_fixed_golomb) / keys_count);
 
 		printf("\n");
 
-		printf("Total split bits        %16.3f\n", (double)split_fixed + split_unary);
-		printf("Upper bound split bits: %16.3f\n", ub_split_bits);
-		printf("Total bij bits:         %16.3f\n", (double)bij_fixed + bij_unary);
-		printf("Upper bound bij bits:   %16.3f\n\n", ub_bij_bits);
+		printf("Total split bits        %16.3f\n", (double)stats.split_fixed + stats.split_unary);
+		printf("Upper bound split bits: %16.3f\n", stats.ub_split_bits);
+		printf("Total bij bits:         %16.3f\n", (double)stats.bij_fixed + stats.bij_unary);
+		printf("Upper bound bij bits:   %16.3f\n\n", stats.ub_bij_bits);
 #endif
 	}
 
-	friend ostream &operator<<(ostream &os, const RecSplit<LEAF_SIZE, AT> &rs) {
-		const size_t leaf_size = LEAF_SIZE;
-		os.write((char *)&leaf_size, sizeof(leaf_size));
-		os.write((char *)&rs.bucket_size, sizeof(rs.bucket_size));
-		os.write((char *)&rs.keys_count, sizeof(rs.keys_count));
+	friend ostream &operator<<(ostream &os, const RecSplit &rs) {
+		serialization::writeHeader(os, serialization::tag("RecSplit"), {LEAF_SIZE, HASHER::ID}, {rs.bucket_size, rs.keys_count});
 		os << rs.descriptors;
 		os << rs.ef;
 		return os;
 	}
 
-	friend istream &operator>>(istream &is, RecSplit<LEAF_SIZE, AT> &rs) {
-		size_t leaf_size;
-		is.read((char *)&leaf_size, sizeof(leaf_size));
-		if (leaf_size != LEAF_SIZE) {
-			fprintf(stderr, "Serialized leaf size %d, code leaf size %d\n", int(leaf_size), int(LEAF_SIZE));
-			abort();
-		}
-		is.read((char *)&rs.bucket_size, sizeof(bucket_size));
-		is.read((char *)&rs.keys_count, sizeof(keys_count));
+	friend istream &operator>>(istream &is, RecSplit &rs) {
+		uint64_t bucket_size, keys_count;
+		if (!serialization::readHeader(is, serialization::tag("RecSplit"), {LEAF_SIZE, HASHER::ID}, {&bucket_size, &keys_count})) return is;
+		rs.bucket_size = bucket_size;
+		rs.keys_count = keys_count;
 		rs.nbuckets = max(1, (rs.keys_count + rs.bucket_size - 1) / rs.bucket_size);
+		rs.profile = RecSplitProfile();
 
 		is >> rs.descriptors;
 		is >> rs.ef;
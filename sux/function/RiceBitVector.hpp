@@ -32,6 +32,7 @@
 #include "../util/Vector.hpp"
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 
 namespace sux::function {
@@ -48,6 +49,9 @@ using namespace sux;
 template <util::AllocType AT = util::AllocType::MALLOC> class RiceBitVector {
 
   public:
+	/** The number of bits in a cache line. */
+	static constexpr size_t CACHE_LINE_BITS = 512;
+
 	class Builder {
 		util::Vector<uint64_t, AT> data;
 		size_t bit_count = 0;
@@ -76,7 +80,7 @@ template <util::AllocType AT = util::AllocType::MALLOC> class RiceBitVector {
 			bit_count += log2golomb;
 		}
 
-		void appendUnaryAll(const std::vector<uint32_t> unary) {
+		void appendUnaryAll(const std::vector<uint32_t> &unary) {
 			size_t bit_inc = 0;
 			for (const auto &u : unary) {
 				bit_inc += u + 1;
@@ -92,6 +96,75 @@ template <util::AllocType AT = util::AllocType::MALLOC> class RiceBitVector {
 			}
 		}
 
+		/** Appends the bits of another builder to this builder.
+		 *
+		 * The resulting content is identical to what would have been
+		 * obtained by performing on this builder the appends performed on `other`.
+		 *
+		 * @param other a builder whose bits will be appended.
+		 */
+		void append(const Builder &other) {
+			const size_t words = (other.bit_count + 63) / 64;
+			const size_t final_words = (((bit_count + other.bit_count + 7) / 8) + 7 + 7) / 8;
+			const int shift = bit_count & 63;
+
+			data.resize(max(final_words, bit_count / 64 + words + 1));
+
+			uint64_t *append_ptr = &data + bit_count / 64;
+			const uint64_t *src = &other.data;
+			if (shift == 0) {
+				for (size_t i = 0; i < words; i++) append_ptr[i] = src[i];
+			} else {
+				for (size_t i = 0; i < words; i++) {
+					append_ptr[i] |= src[i] << shift;
+					append_ptr[i + 1] = src[i] >> (64 - shift);
+				}
+			}
+
+			// Bits past the end are zero, so reducing the size is safe
+			data.resize(final_words);
+			bit_count += other.bit_count;
+		}
+
+		/** Appends a range of bits of another builder to this builder.
+		 *
+		 * @param other a builder.
+		 * @param from the position of the first bit to append.
+		 * @param length the number of bits to append.
+		 */
+		void append(const Builder &other, const size_t from, const size_t length) {
+			data.resize((((bit_count + length + 7) / 8) + 7 + 7) / 8);
+			const uint64_t *src = &other.data;
+			for (size_t pos = from, end = from + length; pos < end; pos += 64) {
+				const int len = min(size_t(64), end - pos), shift = pos % 64;
+				uint64_t v = src[pos / 64] >> shift;
+				if (shift != 0 && shift + len > 64) v |= src[pos / 64 + 1] << (64 - shift);
+				if (len < 64) v &= (uint64_t(1) << len) - 1;
+
+				uint64_t *append_ptr = &data + bit_count / 64;
+				const int used_bits = bit_count % 64;
+				append_ptr[0] |= v << used_bits;
+				if (used_bits + len > 64) append_ptr[1] = v >> (64 - used_bits);
+				bit_count += len;
+			}
+		}
+
+		/** Pads this builder with zeroes, if necessary, so that the next `length` bits
+		 * will span as few cache lines as possible (assuming that the final bit vector
+		 * is aligned to a cache line).
+		 *
+		 * @param length the number of bits that will be appended next; if zero, nothing happens.
+		 */
+		void alignToCacheLine(const size_t length) {
+			// Nothing will be read, so there is nothing to align (e.g., buckets with at most one key)
+			if (length == 0) return;
+			const size_t offset = bit_count % CACHE_LINE_BITS;
+			if ((offset + length + CACHE_LINE_BITS - 1) / CACHE_LINE_BITS > (length + CACHE_LINE_BITS - 1) / CACHE_LINE_BITS) {
+				bit_count += CACHE_LINE_BITS - offset;
+				data.resize((((bit_count + 7) / 8) + 7 + 7) / 8);
+			}
+		}
+
 		uint64_t getBits() { return bit_count; }
 
 		RiceBitVector<AT> build() {
@@ -104,11 +177,13 @@ template <util::AllocType AT = util::AllocType::MALLOC> class RiceBitVector {
 	util::Vector<uint64_t, AT> data;
 
 	friend std::ostream &operator<<(std::ostream &os, const RiceBitVector<AT> &rbv) {
+		serialization::writeHeader(os, serialization::tag("RiceBitV"), {}, {});
 		os << rbv.data;
 		return os;
 	}
 
 	friend std::istream &operator>>(std::istream &is, RiceBitVector<AT> &rbv) {
+		if (!serialization::readHeader(is, serialization::tag("RiceBitV"), {}, {})) return is;
 		is >> rbv.data;
 		return is;
 	}
@@ -119,72 +194,142 @@ template <util::AllocType AT = util::AllocType::MALLOC> class RiceBitVector {
 
 	size_t getBits() const { return data.size() * sizeof(uint64_t); }
 
+	/** Makes this instance a read-only view of an instance serialized by operator<<().
+	 *
+	 * @param p a pointer to the serialized instance, aligned to 8 bytes, or `nullptr`.
+	 * @param end a pointer to the end of the available data.
+	 * @param check whether to verify the checksum of the data.
+	 * @return a pointer just after the serialized instance, or `nullptr` if `p` is `nullptr`
+	 * or the data is not valid.
+	 */
+	const char *view(const char *p, const char *end, const bool check = false) { return data.view(serialization::viewHeader(p, end, serialization::tag("RiceBitV"), {}, {}), end, check); }
+
+	/** Prefetches the words that a Reader reset with the same arguments will read first.
+	 *
+	 * @param bit_pos the position of the fixed part, as passed to Reader::readReset().
+	 * @param unary_offset the offset of the unary part, as passed to Reader::readReset().
+	 */
+	void prefetch(const size_t bit_pos, const size_t unary_offset) const {
+		__builtin_prefetch(&data + bit_pos / 64);
+		__builtin_prefetch(&data + (bit_pos + unary_offset) / 64);
+	}
+
+	/** A reader decoding the Golomb-Rice codes of a bucket.
+	 *
+	 * The unary parts are decoded from a window containing the unread bits of the current word,
+	 * so most codes require just a `tzcnt` and a shift; fixed parts are extracted by a single
+	 * unaligned load (and `bzhi` with BMI2). Skipping a subtree selects the end of its
+	 * unary parts directly in the window (by `pdep` with BMI2) unless it spans more words.
+	 */
 	class Reader {
-		size_t curr_fixed_offset = 0;
+		const uint64_t *data;
+		const uint64_t *curr_ptr_unary;
 		uint64_t curr_window_unary = 0;
-		uint64_t *curr_ptr_unary;
+		size_t curr_fixed_offset = 0;
 		int valid_lower_bits_unary = 0;
-		util::Vector<uint64_t, AT> &data;
-
-	  public:
-		Reader(util::Vector<uint64_t, AT> &data) : data(data) {}
 
-		uint64_t readNext(const int log2golomb) {
-			uint64_t result = 0;
+		// Reads words until a nonzero one is found, returning the number of zeroes skipped
+		uint64_t refill() {
+			uint64_t skipped = valid_lower_bits_unary;
+			curr_window_unary = *(curr_ptr_unary++);
+			valid_lower_bits_unary = 64;
+			while (unlikely(curr_window_unary == 0)) {
+				skipped += 64;
+				curr_window_unary = *(curr_ptr_unary++);
+			}
+			return skipped;
+		}
 
-			if (curr_window_unary == 0) {
-				result += valid_lower_bits_unary;
+		// Skips the unary parts of nodes codes when they span more than the current window
+		void skipUnary(size_t missing) {
+			size_t cnt;
+			while ((cnt = nu(curr_window_unary)) < missing) {
 				curr_window_unary = *(curr_ptr_unary++);
+				missing -= cnt;
 				valid_lower_bits_unary = 64;
-				while (__builtin_expect(curr_window_unary == 0, 0)) {
-					result += 64;
-					curr_window_unary = *(curr_ptr_unary++);
-				}
 			}
+			skipWindow(missing);
+		}
 
-			const size_t pos = rho(curr_window_unary);
+		// Skips the unary parts of nodes codes, all contained in the current window
+		void skipWindow(const size_t nodes) {
+			const int cnt = select64(curr_window_unary, nodes - 1);
+			curr_window_unary >>= cnt;
+			curr_window_unary >>= 1;
+			valid_lower_bits_unary -= cnt + 1;
+		}
 
+		// Reads the next fixed part
+		uint64_t readFixed(const int log2golomb) {
+			uint64_t fixed;
+			memcpy(&fixed, (const uint8_t *)data + curr_fixed_offset / 8, 8);
+			fixed = ltoh(fixed) >> curr_fixed_offset % 8;
+			curr_fixed_offset += log2golomb;
+#ifdef SUX_BMI2
+			return _bzhi_u64(fixed, log2golomb);
+#else
+			return fixed & ((uint64_t(1) << log2golomb) - 1);
+#endif
+		}
+
+	  public:
+		Reader(const util::Vector<uint64_t, AT> &data) : data(&data) {}
+
+		uint64_t readNext(const int log2golomb) {
+			uint64_t result = 0;
+			if (unlikely(curr_window_unary == 0)) result = refill();
+
+			const int pos = rho(curr_window_unary);
 			curr_window_unary >>= pos;
 			curr_window_unary >>= 1;
 			valid_lower_bits_unary -= pos + 1;
-
 			result += pos;
-			result <<= log2golomb;
 
-			uint64_t fixed;
-			memcpy(&fixed, (uint8_t *)&data + curr_fixed_offset / 8, 8);
-			result |= (fixed >> curr_fixed_offset % 8) & ((uint64_t(1) << log2golomb) - 1);
-			curr_fixed_offset += log2golomb;
-			return result;
+			return result << log2golomb | readFixed(log2golomb);
 		}
 
 		void skipSubtree(const size_t nodes, const size_t fixed_len) {
 			assert(nodes > 0);
-			size_t missing = nodes, cnt;
-			while ((cnt = nu(curr_window_unary)) < missing) {
-				curr_window_unary = *(curr_ptr_unary++);
-				missing -= cnt;
-				valid_lower_bits_unary = 64;
+			if (likely(nodes <= size_t(nu(curr_window_unary)))) skipWindow(nodes);
+			else skipUnary(nodes);
+			curr_fixed_offset += fixed_len;
+		}
+
+		/** Skips the codes of a subtree (possibly empty) and reads the next code.
+		 *
+		 * This is equivalent to `skipSubtree(nodes, fixed_len)` (if nodes is not zero) followed by
+		 * `readNext(log2golomb)`, but when the window contains all the unary parts involved (the
+		 * common case) they are decoded together, and without branching on the number of nodes.
+		 */
+		uint64_t skipAndReadNext(const size_t nodes, const size_t fixed_len, const int log2golomb) {
+			const uint64_t window = curr_window_unary;
+			if (unlikely(size_t(nu(window)) <= nodes)) {
+				if (nodes != 0) skipSubtree(nodes, fixed_len);
+				return readNext(log2golomb);
 			}
-			cnt = select64(curr_window_unary, missing - 1);
-			curr_window_unary >>= cnt;
-			curr_window_unary >>= 1;
-			valid_lower_bits_unary -= cnt + 1;
 
+			// Positions of the ends of the unary parts of the last skipped code and of the code to read
+			const int start = nodes == 0 ? -1 : int(select64(window, nodes - 1)), end = select64(window, nodes);
+			curr_window_unary = window >> end >> 1;
+			valid_lower_bits_unary -= end + 1;
 			curr_fixed_offset += fixed_len;
+			return uint64_t(end - start - 1) << log2golomb | readFixed(log2golomb);
 		}
 
 		void readReset(const size_t bit_pos, const size_t unary_offset) {
-			// assert(bit_pos < bit_count);
 			curr_fixed_offset = bit_pos;
-			size_t unary_pos = bit_pos + unary_offset;
-			curr_ptr_unary = &data + unary_pos / 64;
+			const size_t unary_pos = bit_pos + unary_offset;
+			curr_ptr_unary = data + unary_pos / 64;
 			curr_window_unary = *(curr_ptr_unary++) >> (unary_pos & 63);
 			valid_lower_bits_unary = 64 - (unary_pos & 63);
 		}
 	};
 
-	Reader reader() { return Reader(data); }
+	/** Returns a reader for this bit vector.
+	 *
+	 * Readers only read the underlying data, so any number of them can be used concurrently.
+	 */
+	Reader reader() const { return Reader(data); }
 };
 
 } // namespace sux::function
@@ -0,0 +1,261 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2019-2020 Emmanuel Esposito and Sebastiano Vigna
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../support/common.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <x86intrin.h>
+
+namespace sux::function {
+
+/** David Stafford's (http://zimbry.blogspot.com/2011/09/better-bit-mixing-improving-on.html)
+ * 13th variant of the 64-bit finalizer function in Austin Appleby's
+ * MurmurHash3 (https://github.com/aappleby/smhasher).
+ *
+ * @param z a 64-bit integer.
+ * @return a 64-bit integer obtained by mixing the bits of `z`.
+ */
+
+uint64_t inline remix(uint64_t z) {
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	return z ^ (z >> 31);
+}
+
+/* Vectorized seed search for RecSplit.
+ *
+ * find_bijection() searches for the seed of a leaf, and find_split() for the seed of an
+ * inner node. The kernels below evaluate several consecutive candidate seeds in parallel, one per
+ * vector lane, and return the first one that works: thus, they return exactly the seed
+ * the scalar search would find. The kernel is chosen at compile time depending on the
+ * available instruction set (AVX-512DQ, or AVX2); if neither is available, SEED_LANES
+ * is one and find_bijection() is scalar.
+ */
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+
+static constexpr int SEED_LANES = 8;
+
+namespace simd {
+
+typedef __m512i vec;
+
+static inline vec set1(const uint64_t x) { return _mm512_set1_epi64(x); }
+static inline vec lanes() { return _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0); }
+static inline vec add(const vec a, const vec b) { return _mm512_add_epi64(a, b); }
+static inline vec mul(const vec a, const vec b) { return _mm512_mullo_epi64(a, b); }
+static inline vec mul32(const vec a, const vec b) { return _mm512_mul_epu32(a, b); }
+static inline vec xor_srl(const vec a, const int s) { return _mm512_xor_si512(a, _mm512_srli_epi64(a, s)); }
+static inline vec srl(const vec a, const int s) { return _mm512_srli_epi64(a, s); }
+static inline vec sllv(const vec a, const vec s) { return _mm512_sllv_epi64(a, s); }
+static inline vec vand(const vec a, const vec b) { return _mm512_and_si512(a, b); }
+static inline vec vor(const vec a, const vec b) { return _mm512_or_si512(a, b); }
+// Returns a bit mask of the lanes of a that are zero
+static inline uint32_t zero_lanes(const vec a) { return _mm512_cmpeq_epi64_mask(a, _mm512_setzero_si512()); }
+// Returns a bit mask of the lanes in which a and b are equal
+static inline uint32_t eq_lanes(const vec a, const vec b) { return _mm512_cmpeq_epi64_mask(a, b); }
+// Increments the lanes of c in which a < b
+static inline vec count_lt(const vec c, const vec a, const vec b) { return _mm512_mask_add_epi64(c, _mm512_cmplt_epu64_mask(a, b), c, _mm512_set1_epi64(1)); }
+
+} // namespace simd
+
+#elif defined(__AVX2__)
+
+static constexpr int SEED_LANES = 4;
+
+namespace simd {
+
+typedef __m256i vec;
+
+static inline vec set1(const uint64_t x) { return _mm256_set1_epi64x(x); }
+static inline vec lanes() { return _mm256_set_epi64x(3, 2, 1, 0); }
+static inline vec add(const vec a, const vec b) { return _mm256_add_epi64(a, b); }
+// Low 64 bits of the products, from three 32x32->64-bit multiplications
+static inline vec mul(const vec a, const vec b) {
+	const vec lo = _mm256_mul_epu32(a, b);
+	const vec cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+	return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+static inline vec mul32(const vec a, const vec b) { return _mm256_mul_epu32(a, b); }
+static inline vec xor_srl(const vec a, const int s) { return _mm256_xor_si256(a, _mm256_srli_epi64(a, s)); }
+static inline vec srl(const vec a, const int s) { return _mm256_srli_epi64(a, s); }
+static inline vec sllv(const vec a, const vec s) { return _mm256_sllv_epi64(a, s); }
+static inline vec vand(const vec a, const vec b) { return _mm256_and_si256(a, b); }
+static inline vec vor(const vec a, const vec b) { return _mm256_or_si256(a, b); }
+// Returns a bit mask of the lanes of a that are zero
+static inline uint32_t zero_lanes(const vec a) { return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(a, _mm256_setzero_si256()))); }
+// Returns a bit mask of the lanes in which a and b are equal
+static inline uint32_t eq_lanes(const vec a, const vec b) { return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(a, b))); }
+// Increments the lanes of c in which a < b (values must be smaller than 2^63)
+static inline vec count_lt(const vec c, const vec a, const vec b) { return _mm256_sub_epi64(c, _mm256_cmpgt_epi64(b, a)); }
+
+} // namespace simd
+
+#else
+
+static constexpr int SEED_LANES = 1;
+
+#endif
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__) || defined(__AVX2__)
+
+namespace simd {
+
+// Computes remap16(remix(z), m) in each lane
+static inline vec remix_remap16(vec z, const vec m) {
+	z = mul(xor_srl(z, 30), set1(0xbf58476d1ce4e5b9));
+	z = mul(xor_srl(z, 27), set1(0x94d049bb133111eb));
+	z = xor_srl(z, 31);
+	// The product of the lower 48 bits by m < 2^32, using two 32x32->64-bit multiplications
+	const vec lo = mul32(z, m), hi = mul32(vand(srl(z, 32), set1(0xFFFF)), m);
+	return srl(add(srl(lo, 32), hi), 16);
+}
+
+} // namespace simd
+
+/** Finds the first seed, starting from `x`, that maps a leaf bijectively.
+ *
+ * Each lane tests a different seed and records in a bit mask the values
+ * of remap16(remix(key + seed), m) of the keys examined so far; a lane dies
+ * as soon as a value repeats. After the first `midstop` keys, the search moves to
+ * the next group of seeds if all lanes are dead.
+ *
+ * @param keys the keys of the leaf.
+ * @param m the number of keys, at most 31.
+ * @param midstop the number of keys after which dead lanes are checked.
+ * @param x the first seed to test.
+ * @param evals incremented by the number of hash evaluations performed.
+ * @return the first seed `x` or larger such that remap16(remix(keys[i] + x), m) are distinct.
+ */
+static inline uint64_t find_bijection(const uint64_t *keys, const size_t m, const size_t midstop, uint64_t x, uint64_t &evals) {
+	using namespace simd;
+	const vec vm = set1(m), one = set1(1);
+	for (;; x += SEED_LANES) {
+		const vec seeds = add(set1(x), lanes());
+		vec mask = set1(0), dead = set1(0);
+		size_t i = 0;
+		for (; i < midstop; i++) {
+			const vec bit = sllv(one, remix_remap16(add(set1(keys[i]), seeds), vm));
+			dead = vor(dead, vand(mask, bit));
+			mask = vor(mask, bit);
+		}
+		if (zero_lanes(dead) == 0) {
+			evals += midstop * SEED_LANES;
+			continue;
+		}
+		for (; i < m; i++) {
+			const vec bit = sllv(one, remix_remap16(add(set1(keys[i]), seeds), vm));
+			dead = vor(dead, vand(mask, bit));
+			mask = vor(mask, bit);
+		}
+		evals += m * SEED_LANES;
+		const uint32_t alive = zero_lanes(dead);
+		if (alive != 0) return x + __builtin_ctz(alive);
+	}
+}
+
+/** Finds the first seed, starting from `x`, that splits keys in parts of a given size.
+ *
+ * The part of a key is remap16(remix(key + seed), m) / `part_size`. A seed is
+ * accepted if all the first `fanout` - 1 parts have exactly `part_size` keys: equivalently,
+ * if for each 0 < j < `fanout` exactly j * `part_size` keys have a value smaller than
+ * j * `part_size`. Each lane tests a different seed by counting such keys.
+ *
+ * @param keys the keys to split.
+ * @param m the number of keys.
+ * @param part_size the size of all parts except the last one.
+ * @param fanout the number of parts, at least two.
+ * @param x the first seed to test.
+ * @param evals incremented by the number of hash evaluations performed.
+ * @return the first seed `x` or larger satisfying the constraints above.
+ */
+static inline uint64_t find_split(const uint64_t *keys, const size_t m, const size_t part_size, const size_t fanout, uint64_t x, uint64_t &evals) {
+	using namespace simd;
+	const vec vm = set1(m);
+	vec count[fanout - 1];
+	for (;; x += SEED_LANES) {
+		const vec seeds = add(set1(x), lanes());
+		for (size_t j = 0; j < fanout - 1; j++) count[j] = set1(0);
+		if (fanout == 2) {
+			const vec split = set1(part_size);
+			for (size_t i = 0; i < m; i++) count[0] = count_lt(count[0], remix_remap16(add(set1(keys[i]), seeds), vm), split);
+		} else {
+			for (size_t i = 0; i < m; i++) {
+				const vec r = remix_remap16(add(set1(keys[i]), seeds), vm);
+				for (size_t j = 0; j < fanout - 1; j++) count[j] = count_lt(count[j], r, set1((j + 1) * part_size));
+			}
+		}
+		evals += m * SEED_LANES;
+		uint32_t ok = (uint32_t(1) << SEED_LANES) - 1;
+		for (size_t j = 0; j < fanout - 1; j++) ok &= eq_lanes(count[j], set1((j + 1) * part_size));
+		if (ok != 0) return x + __builtin_ctz(ok);
+	}
+}
+
+#else
+
+// Scalar version: tests one seed at a time, moving to the next one if the first midstop keys collide
+static inline uint64_t find_bijection(const uint64_t *keys, const size_t m, const size_t midstop, uint64_t x, uint64_t &evals) {
+	const uint32_t found = (uint32_t(1) << m) - 1;
+	for (;; x++) {
+		uint32_t mask = 0;
+		size_t i;
+		for (i = 0; i < midstop; i++) mask |= uint32_t(1) << remap16(remix(keys[i] + x), m);
+		evals += midstop;
+		if (nu(mask) == midstop) {
+			for (; i < m; i++) mask |= uint32_t(1) << remap16(remix(keys[i] + x), m);
+			evals += m - midstop;
+			if (mask == found) return x;
+		}
+	}
+}
+
+// Scalar version: tests one seed at a time, counting the keys in each part
+static inline uint64_t find_split(const uint64_t *keys, const size_t m, const size_t part_size, const size_t fanout, uint64_t x, uint64_t &evals) {
+	size_t count[fanout];
+	for (;; x++) {
+		if (fanout == 2) {
+			count[0] = 0;
+			for (size_t i = 0; i < m; i++) count[0] += remap16(remix(keys[i] + x), m) < part_size;
+		} else {
+			memset(count, 0, sizeof count - sizeof *count); // Note that we never read count[fanout - 1]
+			for (size_t i = 0; i < m; i++) count[uint16_t(remap16(remix(keys[i] + x), m)) / part_size]++;
+		}
+		evals += m;
+		size_t broken = 0;
+		for (size_t i = 0; i < fanout - 1; i++) broken |= count[i] - part_size;
+		if (!broken) return x;
+	}
+}
+
+#endif
+
+} // namespace sux::function
@@ -0,0 +1,241 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2019-2020 Emmanuel Esposito and Sebastiano Vigna
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../util/Vector.hpp"
+#include "RecSplit.hpp"
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace sux::function {
+
+/** A minimal perfect hash function made of independent RecSplit shards.
+ *
+ * Keys are routed to one of a given number of shards using the high bits of the first
+ * half of their 128-bit hash, and each shard is a RecSplit instance on the keys routed to it. A
+ * table of prefix sums of the shard sizes maps the value returned by a shard to a global value,
+ * so the overall function is still minimal. A lookup costs just one access to the table in
+ * addition to a standard RecSplit lookup.
+ *
+ * Shards are built in parallel, and they can be rebuilt (or replaced with instances built
+ * elsewhere) one at a time using rebuild() and setShard(): when the key set changes
+ * slightly, only the shards containing changed keys need to be rebuilt. Note that the
+ * values of the keys of all following shards change, too.
+ *
+ * The RecSplit shards see the first half of hashes multiplied by the number of shards (modulo 2^64),
+ * so that the bits used for routing are removed and their buckets are uniformly filled.
+ *
+ * @tparam LEAF_SIZE the leaf size of the shards.
+ * @tparam AT a type of memory allocation out of util::AllocType.
+ * @tparam HASHER the hasher mapping keys to 128-bit hashes.
+ */
+template <size_t LEAF_SIZE, util::AllocType AT = util::AllocType::MALLOC, typename HASHER = SpookyHasher> class ShardedRecSplit {
+	size_t num_shards = 0;
+	std::vector<RecSplit<LEAF_SIZE, AT, HASHER>> shards;
+	// offset[s] is the number of keys in shards 0, 1, ..., s - 1
+	util::Vector<uint64_t, AT> offset;
+
+  public:
+	ShardedRecSplit() {}
+
+	/** Builds a sharded instance using a given list of keys.
+	 *
+	 * **Warning**: duplicate keys will cause this method to never return.
+	 *
+	 * @param keys a vector of strings.
+	 * @param bucket_size the bucket size of the shards.
+	 * @param num_shards the number of shards; a power of two routes keys using the high bits of their hash.
+	 * @param num_threads the number of threads used to build the shards.
+	 */
+	ShardedRecSplit(const vector<string> &keys, const size_t bucket_size, const size_t num_shards, const size_t num_threads = 1) : num_shards(num_shards), shards(num_shards) {
+		build(route(keys), bucket_size, num_threads);
+	}
+
+	/** Builds a sharded instance using a given list of 128-bit hashes.
+	 *
+	 * **Warning**: duplicate keys will cause this method to never return.
+	 *
+	 * @param keys a vector of 128-bit hashes.
+	 * @param bucket_size the bucket size of the shards.
+	 * @param num_shards the number of shards; a power of two routes keys using the high bits of their hash.
+	 * @param num_threads the number of threads used to build the shards.
+	 */
+	ShardedRecSplit(const vector<hash128_t> &keys, const size_t bucket_size, const size_t num_shards, const size_t num_threads = 1) : num_shards(num_shards), shards(num_shards) {
+		build(route(keys), bucket_size, num_threads);
+	}
+
+	/** Returns the shard of a 128-bit hash. */
+	size_t shard(const hash128_t &hash) const { return remap128(hash.first, num_shards); }
+
+	/** Returns the shard of a key. */
+	size_t shard(const string &key) const { return shard(HASHER::hash(key.c_str(), key.size())); }
+
+	/** Returns the value associated with the given 128-bit hash.
+	 *
+	 * @param hash a 128-bit hash.
+	 * @return the associated value.
+	 */
+	size_t operator()(const hash128_t &hash) const {
+		const size_t s = shard(hash);
+		// Empty shards have no function to query
+		if (offset[s] == offset[s + 1]) return offset[s];
+		return offset[s] + shards[s](local(hash));
+	}
+
+	/** Returns the value associated with the given key.
+	 *
+	 * @param key a key.
+	 * @return the associated value.
+	 */
+	size_t operator()(const string &key) const { return operator()(HASHER::hash(key.c_str(), key.size())); }
+
+	/** Returns the number of keys. */
+	size_t size() const { return num_shards == 0 ? 0 : offset[num_shards]; }
+
+	/** Returns the number of shards. */
+	size_t numShards() const { return num_shards; }
+
+	/** Returns a shard, which can be serialized independently of the others. */
+	const RecSplit<LEAF_SIZE, AT, HASHER> &getShard(const size_t s) const { return shards[s]; }
+
+	/** Replaces a shard, for example with a newer version built elsewhere by rebuild() and serialized.
+	 *
+	 * @param s a shard.
+	 * @param rs a RecSplit instance built on the keys routed to shard `s`.
+	 */
+	void setShard(const size_t s, RecSplit<LEAF_SIZE, AT, HASHER> &&rs) {
+		shards[s] = std::move(rs);
+		update();
+	}
+
+	/** Rebuilds a shard on a new list of keys.
+	 *
+	 * @param s a shard.
+	 * @param keys a vector of keys; keys routed to shards other than `s` are ignored, so it can be the
+	 * whole new key set.
+	 * @param bucket_size the bucket size of the shard.
+	 * @param num_threads the number of threads used to build the shard.
+	 */
+	template <typename K> void rebuild(const size_t s, const vector<K> &keys, const size_t bucket_size, const size_t num_threads = 1) {
+		vector<hash128_t> h;
+		for (const auto &k : keys) {
+			const hash128_t hash = hash_of(k);
+			if (shard(hash) == s) h.push_back(local(hash));
+		}
+		shards[s] = h.empty() ? RecSplit<LEAF_SIZE, AT, HASHER>() : RecSplit<LEAF_SIZE, AT, HASHER>(h, bucket_size, num_threads);
+		update();
+	}
+
+	/** Makes this instance a read-only view of an instance serialized by operator<<().
+	 *
+	 * @param p a pointer to the serialized instance, aligned to 8 bytes, or `nullptr`.
+	 * @param end a pointer to the end of the available data.
+	 * @param check whether to verify the checksums of the data.
+	 * @return a pointer just after the serialized instance, or `nullptr` if `p` is `nullptr`
+	 * or the data is not valid.
+	 * @see RecSplit::view()
+	 */
+	const char *view(const char *p, const char *end, const bool check = false) {
+		uint64_t n;
+		if ((p = serialization::viewHeader(p, end, serialization::tag("ShardsRS"), {LEAF_SIZE}, {&n})) == nullptr) return nullptr;
+		num_shards = n;
+		shards = std::vector<RecSplit<LEAF_SIZE, AT, HASHER>>(num_shards);
+		for (size_t s = 0; s < num_shards && p != nullptr; s++) {
+			uint64_t keys;
+			if ((p = serialization::viewHeader(p, end, serialization::tag("ShardLen"), {}, {&keys})) != nullptr && keys != 0) p = shards[s].view(p, end, check);
+			if (p != nullptr && shards[s].size() != keys) p = nullptr;
+		}
+		update();
+		return p;
+	}
+
+	// Each shard is preceded by its number of keys, as empty shards are not serialized
+	friend ostream &operator<<(ostream &os, const ShardedRecSplit<LEAF_SIZE, AT, HASHER> &rs) {
+		serialization::writeHeader(os, serialization::tag("ShardsRS"), {LEAF_SIZE}, {rs.num_shards});
+		for (const auto &shard : rs.shards) {
+			serialization::writeHeader(os, serialization::tag("ShardLen"), {}, {shard.size()});
+			if (shard.size() != 0) os << shard;
+		}
+		return os;
+	}
+
+	friend istream &operator>>(istream &is, ShardedRecSplit<LEAF_SIZE, AT, HASHER> &rs) {
+		uint64_t n;
+		if (!serialization::readHeader(is, serialization::tag("ShardsRS"), {LEAF_SIZE}, {&n})) return is;
+		rs.num_shards = n;
+		rs.shards = std::vector<RecSplit<LEAF_SIZE, AT, HASHER>>(rs.num_shards);
+		for (auto &shard : rs.shards) {
+			uint64_t keys;
+			if (!serialization::readHeader(is, serialization::tag("ShardLen"), {}, {&keys})) return is;
+			if (keys != 0) is >> shard;
+		}
+		rs.update();
+		return is;
+	}
+
+  private:
+	// The hash seen by the shard of a hash: the routing bits are shifted out
+	hash128_t local(const hash128_t &hash) const { return hash128_t(hash.first * num_shards, hash.second); }
+
+	static hash128_t hash_of(const hash128_t &hash) { return hash; }
+	static hash128_t hash_of(const string &key) { return HASHER::hash(key.c_str(), key.size()); }
+
+	template <typename K> vector<vector<hash128_t>> route(const vector<K> &keys) const {
+		vector<vector<hash128_t>> h(num_shards);
+		for (const auto &k : keys) {
+			const hash128_t hash = hash_of(k);
+			h[shard(hash)].push_back(local(hash));
+		}
+		return h;
+	}
+
+	// Builds the shards in parallel, splitting the threads among the shards being built
+	void build(vector<vector<hash128_t>> &&h, const size_t bucket_size, const size_t num_threads) {
+		const size_t threads = max(1, min(num_threads, num_shards)), per_shard = max(1, num_threads / threads);
+		atomic<size_t> next(0);
+		parallel(threads, [&](const size_t) {
+			for (size_t s; (s = next++) < num_shards;) {
+				if (!h[s].empty()) shards[s] = RecSplit<LEAF_SIZE, AT, HASHER>(h[s], bucket_size, per_shard);
+				h[s] = vector<hash128_t>();
+			}
+		});
+		update();
+	}
+
+	// Recomputes the prefix sums of the shard sizes
+	void update() {
+		offset.size(num_shards + 1);
+		offset[0] = 0;
+		for (size_t s = 0; s < num_shards; s++) offset[s + 1] = offset[s] + shards[s].size();
+	}
+};
+
+} // namespace sux::function
@@ -0,0 +1,231 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2019-2020 Emmanuel Esposito and Sebastiano Vigna
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../support/common.hpp"
+#include "../util/Vector.hpp"
+#include "RecSplit.hpp"
+#include <string>
+#include <vector>
+
+namespace sux::function {
+
+/** A static function mapping a set of keys to values of a fixed number of bits.
+ *
+ * A StaticMap is a RecSplit minimal perfect hash function followed by a bit-packed array
+ * of values, whose slots are indexed by the function. Optionally, each slot contains also a
+ * fingerprint of its key, so that most keys outside the set can be rejected: a key
+ * outside the set is accepted with probability 2^-`FINGERPRINT_BITS`.
+ *
+ * Since the values of the keys of a RecSplit bucket are contiguous, and they are known
+ * before the splitting tree of the bucket is walked, the slots of the bucket are prefetched
+ * while the function is decoding, provided that they span at most #PREFETCH_LINES cache
+ * lines (e.g., buckets of 100 keys with 12-bit slots). Thus, the access to the value
+ * array mostly overlaps with the function lookup.
+ *
+ * @tparam LEAF_SIZE the leaf size of the RecSplit function.
+ * @tparam VALUE_BITS the number of bits of a value (at most 64).
+ * @tparam FINGERPRINT_BITS the number of bits of a fingerprint (0 for no fingerprints).
+ * @tparam AT a type of memory allocation out of util::AllocType.
+ * @tparam HASHER the hasher mapping keys to 128-bit hashes.
+ */
+template <size_t LEAF_SIZE, int VALUE_BITS, int FINGERPRINT_BITS = 0, util::AllocType AT = util::AllocType::MALLOC, typename HASHER = SpookyHasher> class StaticMap {
+	static_assert(VALUE_BITS >= 1 && FINGERPRINT_BITS >= 0 && VALUE_BITS + FINGERPRINT_BITS <= 64, "slots must fit a word");
+	// A slot contains a value followed by a fingerprint
+	static constexpr int SLOT_BITS = VALUE_BITS + FINGERPRINT_BITS;
+
+	RecSplit<LEAF_SIZE, AT, HASHER> mphf;
+	util::Vector<uint64_t, AT> slots;
+
+  public:
+	/** The maximum number of cache lines of the slots of a bucket that are prefetched. */
+	static constexpr size_t PREFETCH_LINES = 4;
+
+	StaticMap() {}
+
+	/** Builds a static map from a list of keys and their values.
+	 *
+	 * **Warning**: duplicate keys will cause this method to never return.
+	 *
+	 * @param keys a vector of strings.
+	 * @param values a vector of values, each fitting `VALUE_BITS` bits, one for each key.
+	 * @param bucket_size the bucket size of the RecSplit function.
+	 * @param num_threads the number of threads used to build the function.
+	 */
+	StaticMap(const vector<string> &keys, const vector<uint64_t> &values, const size_t bucket_size, const size_t num_threads = 1) : mphf(keys, bucket_size, num_threads) { fill(keys, values); }
+
+	/** Builds a static map from a list of 128-bit hashes and their values.
+	 *
+	 * **Warning**: duplicate keys will cause this method to never return.
+	 *
+	 * @param keys a vector of 128-bit hashes.
+	 * @param values a vector of values, each fitting `VALUE_BITS` bits, one for each key.
+	 * @param bucket_size the bucket size of the RecSplit function.
+	 * @param num_threads the number of threads used to build the function.
+	 */
+	StaticMap(const vector<hash128_t> &keys, const vector<uint64_t> &values, const size_t bucket_size, const size_t num_threads = 1) {
+		vector<hash128_t> h(keys); // RecSplit reorders the hashes
+		mphf = RecSplit<LEAF_SIZE, AT, HASHER>(h, bucket_size, num_threads);
+		fill(keys, values);
+	}
+
+	/** Returns the value associated with a 128-bit hash in the set, or an unspecified value for other hashes.
+	 *
+	 * @param hash a 128-bit hash.
+	 * @return the associated value.
+	 */
+	uint64_t operator()(const hash128_t &hash) const { return slot(hash) & VALUE_MASK; }
+
+	/** Returns the value associated with a key in the set, or an unspecified value for other keys.
+	 *
+	 * @param key a key.
+	 * @return the associated value.
+	 */
+	uint64_t operator()(const string &key) const { return operator()(HASHER::hash(key.c_str(), key.size())); }
+
+	/** Retrieves the value associated with a 128-bit hash, rejecting hashes not in the set using fingerprints.
+	 *
+	 * Without fingerprints, this method is equivalent to operator()() and always returns true.
+	 *
+	 * @param hash a 128-bit hash.
+	 * @param value will contain the associated value if this method returns true.
+	 * @return false if the hash is certainly not in the set.
+	 */
+	bool get(const hash128_t &hash, uint64_t &value) const {
+		const uint64_t s = slot(hash);
+		value = s & VALUE_MASK;
+		return FINGERPRINT_BITS == 0 || s >> VALUE_BITS % 64 == fingerprint(hash);
+	}
+
+	/** Retrieves the value associated with a key, rejecting keys not in the set using fingerprints.
+	 *
+	 * @param key a key.
+	 * @param value will contain the associated value if this method returns true.
+	 * @return false if the key is certainly not in the set.
+	 */
+	bool get(const string &key, uint64_t &value) const { return get(HASHER::hash(key.c_str(), key.size()), value); }
+
+	/** Computes the values associated with a batch of 128-bit hashes in the set.
+	 *
+	 * The function is queried using RecSplit::lookup(), and then all slots are prefetched
+	 * before being read.
+	 *
+	 * @param in an array of `n` 128-bit hashes.
+	 * @param out an array of `n` elements that will be filled with the associated values.
+	 * @param n the number of hashes.
+	 */
+	void lookup(const hash128_t *in, uint64_t *out, const size_t n) const {
+		size_t pos[RecSplit<LEAF_SIZE, AT, HASHER>::LOOKUP_BATCH];
+		for (size_t base = 0; base < n; base += RecSplit<LEAF_SIZE, AT, HASHER>::LOOKUP_BATCH) {
+			const size_t b = min(RecSplit<LEAF_SIZE, AT, HASHER>::LOOKUP_BATCH, n - base);
+			mphf.lookup(in + base, pos, b);
+			for (size_t i = 0; i < b; i++) __builtin_prefetch(&slots + pos[i] * SLOT_BITS / 64);
+			for (size_t i = 0; i < b; i++) out[base + i] = read(pos[i]) & VALUE_MASK;
+		}
+	}
+
+	/** Returns the number of keys. */
+	size_t size() const { return mphf.size(); }
+
+	/** Returns the underlying minimal perfect hash function. */
+	const RecSplit<LEAF_SIZE, AT, HASHER> &function() const { return mphf; }
+
+	/** Returns the size in bits of the slot array (the function excluded). */
+	size_t bitCountValues() const { return slots.size() * 64; }
+
+	/** Makes this instance a read-only view of an instance serialized by operator<<().
+	 *
+	 * @param p a pointer to the serialized instance, aligned to 8 bytes, or `nullptr`.
+	 * @param end a pointer to the end of the available data.
+	 * @param check whether to verify the checksums of the data.
+	 * @return a pointer just after the serialized instance, or `nullptr` if `p` is `nullptr`
+	 * or the data is not valid.
+	 * @see RecSplit::view()
+	 */
+	const char *view(const char *p, const char *end, const bool check = false) {
+		uint64_t n;
+		if ((p = serialization::viewHeader(p, end, serialization::tag("StaticMp"), {LEAF_SIZE, VALUE_BITS, FINGERPRINT_BITS}, {&n})) == nullptr) return nullptr;
+		if ((p = slots.view(mphf.view(p, end, check), end, check)) == nullptr) return nullptr;
+		return mphf.size() == n && slots.size() == words(n) ? p : nullptr;
+	}
+
+	friend ostream &operator<<(ostream &os, const StaticMap &map) {
+		serialization::writeHeader(os, serialization::tag("StaticMp"), {LEAF_SIZE, VALUE_BITS, FINGERPRINT_BITS}, {map.size()});
+		return os << map.mphf << map.slots;
+	}
+
+	friend istream &operator>>(istream &is, StaticMap &map) {
+		uint64_t n;
+		if (!serialization::readHeader(is, serialization::tag("StaticMp"), {LEAF_SIZE, VALUE_BITS, FINGERPRINT_BITS}, {&n})) return is;
+		is >> map.mphf >> map.slots;
+		if (map.mphf.size() != n || map.slots.size() != words(n)) is.setstate(std::ios::failbit);
+		return is;
+	}
+
+  private:
+	static constexpr uint64_t VALUE_MASK = -1ULL >> (64 - VALUE_BITS);
+
+	// Slots, plus a word so that bitread() can always read two words
+	static size_t words(const size_t n) { return (n * SLOT_BITS + 63) / 64 + 1; }
+
+	// The fingerprint of a hash, independent of the bits used by RecSplit
+	static uint64_t fingerprint(const hash128_t &hash) { return FINGERPRINT_BITS == 0 ? 0 : remix(hash.first ^ remix(hash.second)) >> (64 - FINGERPRINT_BITS) % 64; }
+
+	uint64_t read(const size_t i) const {
+		const uint64_t pos = uint64_t(i) * SLOT_BITS;
+		return bitread(&slots + pos / 64, pos % 64, SLOT_BITS);
+	}
+
+	// Queries the function, prefetching the slots of the bucket of the hash
+	uint64_t slot(const hash128_t &hash) const {
+		return read(mphf(hash, [&](const uint64_t first, const uint64_t last) {
+			// The slots might start anywhere in a cache line, so we start from the beginning of the line
+			const uintptr_t begin = uintptr_t(&slots + first * SLOT_BITS / 64) & ~uintptr_t(63), end = uintptr_t(&slots + (last * SLOT_BITS + 63) / 64);
+			if (end - begin <= PREFETCH_LINES * 64)
+				for (uintptr_t p = begin; p < end; p += 64) __builtin_prefetch((const void *)p);
+		}));
+	}
+
+	template <typename K> void fill(const vector<K> &keys, const vector<uint64_t> &values) {
+		assert(keys.size() == values.size());
+		slots.size(words(keys.size()));
+		for (size_t i = 0; i < keys.size(); i++) {
+			assert(values[i] <= VALUE_MASK);
+			const hash128_t hash = hash_of(keys[i]);
+			const uint64_t pos = uint64_t(mphf(hash)) * SLOT_BITS;
+			bitwrite(&slots + pos / 64, pos % 64, SLOT_BITS, fingerprint(hash) << VALUE_BITS % 64 | values[i]);
+		}
+	}
+
+	static hash128_t hash_of(const hash128_t &hash) { return hash; }
+	static hash128_t hash_of(const string &key) { return HASHER::hash(key.c_str(), key.size()); }
+};
+
+} // namespace sux::function
@@ -0,0 +1,174 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2007-2020 Sebastiano Vigna
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "common.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+namespace sux::instrumentation {
+
+/** \file
+ * Instrumentation policies for the query methods of some structures.
+ *
+ * Instrumented classes (bits::EliasFano, bits::SimpleSelect, function::RecSplit and
+ * util::InstrumentedPrefixSums) have a template parameter `INSTR` specifying a policy, and
+ * list in an enumeration `Counter` and in an array `COUNTER_NAMES` the quantities they record for
+ * a query: for example, the depth reached in a splitting tree. The policy decides whether a query is
+ * sampled, using sample(), and collects the values recorded for sampled queries using record().
+ *
+ * The default policy, None, records nothing, and its methods compile to nothing. With
+ * Sampled, each instance keeps, for each counter, the number of samples, their sum, their
+ * maximum and a histogram, which can be polled at any time, even while the instance is queried,
+ * using summary().
+ */
+
+/** The summary of the values recorded for a counter by Sampled. */
+struct Summary {
+	uint64_t samples = 0, sum = 0, max = 0;
+	/** The number of values in each bucket: bucket 0 contains zeros, and bucket <var>b</var> &gt; 0 the values in
+	 * [2<sup><var>b</var> &minus; 1</sup>..2<sup><var>b</var></sup>). */
+	uint64_t histogram[65] = {};
+
+	/** Returns the average recorded value, or zero if no value has been recorded. */
+	double mean() const { return samples == 0 ? 0 : double(sum) / samples; }
+};
+
+/** An instrumentation policy recording nothing. */
+class None {
+  public:
+	static constexpr bool ENABLED = false;
+
+	static constexpr bool sample() { return false; }
+
+	static constexpr void record(int, uint64_t) {}
+};
+
+/** An instrumentation policy recording one query out of 2<sup>`LOG2_PERIOD`</sup>.
+ *
+ * Whether a query is sampled depends on a count of the queries to the instance kept by the querying
+ * thread, so threads querying the same instance do not share cache lines until a query is sampled; then,
+ * the values of its counters are added atomically to those of the instance. Each thread keeps the counts
+ * of a few recently queried instances in a small table indexed by their address; when an instance
+ * takes the place of another one, its count restarts from a random value, so instances that keep
+ * replacing each other are still sampled with the right probability. Copies of an instance start
+ * with empty counters.
+ *
+ * @tparam LOG2_PERIOD the base-2 logarithm of the sampling period.
+ * @tparam NUM_COUNTERS the maximum number of counters of an instrumented class.
+ */
+template <int LOG2_PERIOD = 6, int NUM_COUNTERS = 4> class Sampled {
+	static_assert(LOG2_PERIOD >= 0 && LOG2_PERIOD < 64, "The logarithm of the sampling period must be smaller than 64");
+
+	// Each counter lies on its own cache lines
+	struct alignas(64) Counter {
+		std::atomic<uint64_t> samples, sum, max, histogram[65];
+	};
+
+	mutable Counter counters[NUM_COUNTERS];
+
+	// The number of entries of the per-thread table of query counts
+	static constexpr int LOG2_SLOTS = 4;
+
+	struct Slot {
+		const Sampled *owner;
+		uint64_t queries;
+	};
+
+  public:
+	static constexpr bool ENABLED = true;
+
+	Sampled() { reset(); }
+	Sampled(const Sampled &) { reset(); }
+	Sampled &operator=(const Sampled &) {
+		reset();
+		return *this;
+	}
+
+	/** Returns whether the current query must be sampled. */
+	bool sample() const {
+		static thread_local Slot slots[1 << LOG2_SLOTS];
+		static thread_local uint64_t seed = uint64_t(uintptr_t(&seed));
+		// Instances are aligned to a cache line
+		Slot &slot = slots[(uintptr_t(this) >> 6) * UINT64_C(0x9E3779B97F4A7C15) >> (64 - LOG2_SLOTS)];
+		if (unlikely(slot.owner != this)) {
+			slot.owner = this;
+			// SplitMix64
+			uint64_t z = seed += UINT64_C(0x9E3779B97F4A7C15);
+			z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+			z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+			slot.queries = z ^ (z >> 31);
+		}
+		return unlikely((++slot.queries & ((UINT64_C(1) << LOG2_PERIOD) - 1)) == 0);
+	}
+
+	/** Records the value of a counter for a sampled query.
+	 *
+	 * @param counter a counter (smaller than `NUM_COUNTERS`).
+	 * @param value the value of the counter.
+	 */
+	void record(const int counter, const uint64_t value) const {
+		assert(counter >= 0 && counter < NUM_COUNTERS);
+		Counter &c = counters[counter];
+		c.samples.fetch_add(1, std::memory_order_relaxed);
+		c.sum.fetch_add(value, std::memory_order_relaxed);
+		c.histogram[value == 0 ? 0 : lambda(value) + 1].fetch_add(1, std::memory_order_relaxed);
+		for (uint64_t max = c.max.load(std::memory_order_relaxed); value > max && !c.max.compare_exchange_weak(max, value, std::memory_order_relaxed);)
+			;
+	}
+
+	/** Returns the summary of the values recorded for a counter.
+	 *
+	 * If queries are running, the fields of the summary might reflect slightly different sets of samples.
+	 */
+	Summary summary(const int counter) const {
+		assert(counter >= 0 && counter < NUM_COUNTERS);
+		const Counter &c = counters[counter];
+		Summary s;
+		s.samples = c.samples.load(std::memory_order_relaxed);
+		s.sum = c.sum.load(std::memory_order_relaxed);
+		s.max = c.max.load(std::memory_order_relaxed);
+		for (int b = 0; b < 65; b++) s.histogram[b] = c.histogram[b].load(std::memory_order_relaxed);
+		return s;
+	}
+
+	/** Empties all counters. */
+	void reset() const {
+		for (Counter &c : counters) {
+			c.samples.store(0, std::memory_order_relaxed);
+			c.sum.store(0, std::memory_order_relaxed);
+			c.max.store(0, std::memory_order_relaxed);
+			for (auto &h : c.histogram) h.store(0, std::memory_order_relaxed);
+		}
+	}
+};
+
+} // namespace sux::instrumentation
@@ -0,0 +1,262 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2019-2020 Stefano Marchini
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "SpookyV2.hpp"
+#include "common.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+namespace sux::serialization {
+
+/** \file
+ * The common container format of serialized structures.
+ *
+ * Every structure starts with a _header_ containing a magic number, the format version,
+ * a tag identifying the structure type, its template parameters and its scalar fields.
+ * Arrays follow in _sections_, each one made of a descriptor (element size, number of
+ * elements and checksum of the data) followed by the data. Headers and sections are
+ * padded to a multiple of #ALIGNMENT bytes, so the data of every section of a
+ * serialized structure that starts at an aligned address (for example, at the start of a
+ * util::MappedFile) is aligned, too. All integers are stored in little-endian order.
+ *
+ * Loading operators set `failbit` on the stream when the data is truncated, corrupted
+ * or incompatible; `view()` methods return `nullptr` instead.
+ */
+
+/** The alignment of headers and sections, in bytes. */
+static constexpr size_t ALIGNMENT = 64;
+
+/** The current version of the format. */
+static constexpr uint32_t VERSION = 1;
+
+/** Returns the little-endian 64-bit integer whose bytes are the given eight characters. */
+constexpr uint64_t tag(const char (&s)[9]) {
+	uint64_t t = 0;
+	for (int i = 8; i-- != 0;) t = t << 8 | uint8_t(s[i]);
+	return t;
+}
+
+static constexpr uint64_t HEADER_MAGIC = tag("SUX\r\n\x1a\n\0");
+static constexpr uint64_t SECTION_MAGIC = tag("SUXSECT\0");
+
+// Words of a header before parameters and fields
+static constexpr size_t HEADER_WORDS = 4;
+// Words of a section descriptor
+static constexpr size_t SECTION_WORDS = ALIGNMENT / sizeof(uint64_t);
+
+inline size_t padding(const size_t bytes) { return -bytes & (ALIGNMENT - 1); }
+
+// Checksums are computed on the little-endian representation
+inline uint64_t checksum(const void *data, const size_t bytes) { return SpookyHash::Hash64(data, bytes, VERSION); }
+
+inline std::vector<uint64_t> header(const uint64_t type, std::initializer_list<uint64_t> params, std::initializer_list<uint64_t> fields) {
+	const size_t words = HEADER_WORDS + params.size() + fields.size();
+	std::vector<uint64_t> block(words + padding(words * sizeof(uint64_t)) / sizeof(uint64_t));
+	block[0] = HEADER_MAGIC;
+	block[1] = VERSION | uint64_t(params.size() + fields.size()) << 32;
+	block[2] = type;
+	std::copy(params.begin(), params.end(), block.begin() + HEADER_WORDS);
+	std::copy(fields.begin(), fields.end(), block.begin() + HEADER_WORDS + params.size());
+	for (auto &w : block) w = htol(w);
+	block[3] = htol(checksum(block.data(), words * sizeof(uint64_t)));
+	return block;
+}
+
+// Checks a little-endian header, whose first HEADER_WORDS words are in block, and stores the fields
+inline bool check_header(std::vector<uint64_t> &block, std::initializer_list<uint64_t> params, std::initializer_list<uint64_t *> fields) {
+	const size_t words = HEADER_WORDS + params.size() + fields.size();
+	const uint64_t sum = ltoh(block[3]);
+	block[3] = 0;
+	if (checksum(block.data(), words * sizeof(uint64_t)) != sum) return false;
+	auto p = params.begin();
+	for (size_t i = HEADER_WORDS; i < HEADER_WORDS + params.size(); i++)
+		if (ltoh(block[i]) != *p++) return false;
+	auto f = fields.begin();
+	for (size_t i = HEADER_WORDS + params.size(); i < words; i++) **f++ = ltoh(block[i]);
+	return true;
+}
+
+inline bool check_header_start(const uint64_t *start, const uint64_t type, const size_t nwords) {
+	return ltoh(start[0]) == HEADER_MAGIC && ltoh(start[1]) == (VERSION | uint64_t(nwords) << 32) && ltoh(start[2]) == type;
+}
+
+/** Writes a header.
+ *
+ * @param os an output stream.
+ * @param type the tag of the serialized type.
+ * @param params the template parameters of the serialized type.
+ * @param fields the scalar fields of the serialized instance.
+ */
+inline void writeHeader(std::ostream &os, const uint64_t type, std::initializer_list<uint64_t> params, std::initializer_list<uint64_t> fields) {
+	const auto block = header(type, params, fields);
+	os.write((char *)block.data(), block.size() * sizeof(uint64_t));
+}
+
+/** Reads and checks a header written by writeHeader().
+ *
+ * @param is an input stream; `failbit` is set if the header is not valid.
+ * @param type the expected tag of the serialized type.
+ * @param params the expected template parameters.
+ * @param fields pointers to the scalar fields that will be read.
+ * @return true if the header is valid.
+ */
+inline bool readHeader(std::istream &is, const uint64_t type, std::initializer_list<uint64_t> params, std::initializer_list<uint64_t *> fields) {
+	const size_t words = HEADER_WORDS + params.size() + fields.size();
+	std::vector<uint64_t> block(words + padding(words * sizeof(uint64_t)) / sizeof(uint64_t));
+	if (is.read((char *)block.data(), HEADER_WORDS * sizeof(uint64_t)) && check_header_start(block.data(), type, params.size() + fields.size()) &&
+		is.read((char *)(block.data() + HEADER_WORDS), (block.size() - HEADER_WORDS) * sizeof(uint64_t)) && check_header(block, params, fields))
+		return true;
+	is.setstate(std::ios::failbit);
+	return false;
+}
+
+/** Checks a header written by writeHeader() in memory.
+ *
+ * @param p a pointer to the header, or `nullptr`.
+ * @param end a pointer to the end of the available data.
+ * @param type the expected tag of the serialized type.
+ * @param params the expected template parameters.
+ * @param fields pointers to the scalar fields that will be read.
+ * @return a pointer just after the header, or `nullptr` if `p` is `nullptr` or the header is not valid.
+ */
+inline const char *viewHeader(const char *p, const char *end, const uint64_t type, std::initializer_list<uint64_t> params, std::initializer_list<uint64_t *> fields) {
+	const size_t words = HEADER_WORDS + params.size() + fields.size();
+	std::vector<uint64_t> block(words + padding(words * sizeof(uint64_t)) / sizeof(uint64_t));
+	if (p == nullptr || size_t(end - p) < block.size() * sizeof(uint64_t)) return nullptr;
+	memcpy(block.data(), p, block.size() * sizeof(uint64_t));
+	if (!check_header_start(block.data(), type, params.size() + fields.size()) || !check_header(block, params, fields)) return nullptr;
+	return p + block.size() * sizeof(uint64_t);
+}
+
+// Converts in place an array between host and little-endian order
+template <typename T> void swap_array(T *data, const size_t n) {
+	if constexpr (std::is_integral_v<T> && sizeof(T) > 1) {
+		if (is_big_endian())
+			for (size_t i = 0; i < n; i++) data[i] = swap_endian(data[i]);
+	}
+}
+
+/** Writes an array as a section.
+ *
+ * @param os an output stream.
+ * @param data the array.
+ * @param n the number of elements of the array.
+ */
+template <typename T> void writeSection(std::ostream &os, const T *data, const size_t n) {
+	const size_t bytes = n * sizeof(T);
+	std::vector<T> copy;
+	if (is_big_endian()) {
+		copy.assign(data, data + n);
+		swap_array(copy.data(), n);
+		data = copy.data();
+	}
+	uint64_t desc[SECTION_WORDS] = {SECTION_MAGIC, sizeof(T), n, checksum(data, bytes)};
+	for (size_t i = 0; i < 4; i++) desc[i] = htol(desc[i]);
+	desc[4] = htol(checksum(desc, 4 * sizeof(uint64_t)));
+	os.write((char *)desc, sizeof desc);
+	os.write((char *)data, bytes);
+	static const char zero[ALIGNMENT] = {};
+	os.write(zero, padding(bytes));
+}
+
+inline bool check_section(uint64_t *desc, const size_t elem_size, uint64_t &n, uint64_t &sum) {
+	if (ltoh(desc[4]) != checksum(desc, 4 * sizeof(uint64_t)) || ltoh(desc[0]) != SECTION_MAGIC || ltoh(desc[1]) != elem_size) return false;
+	n = ltoh(desc[2]);
+	sum = ltoh(desc[3]);
+	return true;
+}
+
+/** Reads a section descriptor written by writeSection().
+ *
+ * After a successful call, readSectionData() must be called to read the data.
+ *
+ * @param is an input stream; `failbit` is set if the descriptor is not valid.
+ * @param elem_size the expected size of an element.
+ * @param n the number of elements of the section will be stored here.
+ * @param sum the checksum of the data will be stored here.
+ * @return true if the descriptor is valid.
+ */
+inline bool readSectionHeader(std::istream &is, const size_t elem_size, uint64_t &n, uint64_t &sum) {
+	uint64_t desc[SECTION_WORDS];
+	if (is.read((char *)desc, sizeof desc) && check_section(desc, elem_size, n, sum)) return true;
+	is.setstate(std::ios::failbit);
+	return false;
+}
+
+/** Reads the data of a section whose descriptor has been read by readSectionHeader().
+ *
+ * @param is an input stream; `failbit` is set if the data is truncated or corrupted.
+ * @param data an array of `n` elements where the data will be stored.
+ * @param n the number of elements returned by readSectionHeader().
+ * @param sum the checksum returned by readSectionHeader().
+ * @return true if the data has been read correctly.
+ */
+template <typename T> bool readSectionData(std::istream &is, T *data, const size_t n, const uint64_t sum) {
+	const size_t bytes = n * sizeof(T);
+	char pad[ALIGNMENT];
+	if (is.read((char *)data, bytes) && is.read(pad, padding(bytes)) && checksum(data, bytes) == sum) {
+		swap_array(data, n);
+		return true;
+	}
+	is.setstate(std::ios::failbit);
+	return false;
+}
+
+/** Checks a section written by writeSection() in memory.
+ *
+ * Since data is not copied, sections of multibyte elements cannot be
+ * viewed on big-endian architectures.
+ *
+ * @param p a pointer to the section, aligned to `alignof(T)`, or `nullptr`.
+ * @param end a pointer to the end of the available data.
+ * @param data a pointer to the data of the section will be stored here.
+ * @param n the number of elements of the section will be stored here.
+ * @param check whether to verify the checksum of the data, which requires reading it entirely.
+ * @return a pointer just after the section, or `nullptr` if `p` is `nullptr` or the section is not valid.
+ */
+template <typename T> const char *viewSection(const char *p, const char *end, const T *&data, uint64_t &n, const bool check = false) {
+	uint64_t desc[SECTION_WORDS], sum;
+	if (p == nullptr || size_t(end - p) < sizeof desc || (sizeof(T) > 1 && is_big_endian())) return nullptr;
+	memcpy(desc, p, sizeof desc);
+	if (!check_section(desc, sizeof(T), n, sum)) return nullptr;
+	p += sizeof desc;
+	const size_t bytes = n * sizeof(T);
+	if (bytes / sizeof(T) != n || size_t(end - p) < bytes + padding(bytes) || (uintptr_t)p % alignof(T) != 0) return nullptr;
+	if (check && checksum(p, bytes) != sum) return nullptr;
+	data = (const T *)p;
+	return p + bytes + padding(bytes);
+}
+
+} // namespace sux::serialization
@@ -26,6 +26,8 @@
 // slower than MD5.
 //
 
+#pragma once
+
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -36,6 +38,19 @@ class SpookyHash {
   private:
 	static inline uint64_t Rot64(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
 
+	// Reads the i-th word of possibly unaligned data (unaligned keys are read in place)
+	static inline uint64_t Read64(const void *data, const size_t i) {
+		uint64_t x;
+		memcpy(&x, (const uint8_t *)data + i * sizeof x, sizeof x);
+		return x;
+	}
+
+	static inline uint32_t Read32(const void *data, const size_t i) {
+		uint32_t x;
+		memcpy(&x, (const uint8_t *)data + i * sizeof x, sizeof x);
+		return x;
+	}
+
 	//
 	// This is used if the input is 96 bytes long or longer.
 	//
@@ -49,64 +64,64 @@ class SpookyHash {
 	//   When run forward or backwards one Mix
 	// I tried 3 pairs of each; they all differed by at least 212 bits.
 	//
-	static inline void Mix(const uint64_t *data, uint64_t &s0, uint64_t &s1, uint64_t &s2, uint64_t &s3, uint64_t &s4, uint64_t &s5, uint64_t &s6, uint64_t &s7, uint64_t &s8, uint64_t &s9,
+	static inline void Mix(const void *data, uint64_t &s0, uint64_t &s1, uint64_t &s2, uint64_t &s3, uint64_t &s4, uint64_t &s5, uint64_t &s6, uint64_t &s7, uint64_t &s8, uint64_t &s9,
 						   uint64_t &s10, uint64_t &s11) {
-		s0 += data[0];
+		s0 += Read64(data, 0);
 		s2 ^= s10;
 		s11 ^= s0;
 		s0 = Rot64(s0, 11);
 		s11 += s1;
-		s1 += data[1];
+		s1 += Read64(data, 1);
 		s3 ^= s11;
 		s0 ^= s1;
 		s1 = Rot64(s1, 32);
 		s0 += s2;
-		s2 += data[2];
+		s2 += Read64(data, 2);
 		s4 ^= s0;
 		s1 ^= s2;
 		s2 = Rot64(s2, 43);
 		s1 += s3;
-		s3 += data[3];
+		s3 += Read64(data, 3);
 		s5 ^= s1;
 		s2 ^= s3;
 		s3 = Rot64(s3, 31);
 		s2 += s4;
-		s4 += data[4];
+		s4 += Read64(data, 4);
 		s6 ^= s2;
 		s3 ^= s4;
 		s4 = Rot64(s4, 17);
 		s3 += s5;
-		s5 += data[5];
+		s5 += Read64(data, 5);
 		s7 ^= s3;
 		s4 ^= s5;
 		s5 = Rot64(s5, 28);
 		s4 += s6;
-		s6 += data[6];
+		s6 += Read64(data, 6);
 		s8 ^= s4;
 		s5 ^= s6;
 		s6 = Rot64(s6, 39);
 		s5 += s7;
-		s7 += data[7];
+		s7 += Read64(data, 7);
 		s9 ^= s5;
 		s6 ^= s7;
 		s7 = Rot64(s7, 57);
 		s6 += s8;
-		s8 += data[8];
+		s8 += Read64(data, 8);
 		s10 ^= s6;
 		s7 ^= s8;
 		s8 = Rot64(s8, 55);
 		s7 += s9;
-		s9 += data[9];
+		s9 += Read64(data, 9);
 		s11 ^= s7;
 		s8 ^= s9;
 		s9 = Rot64(s9, 54);
 		s8 += s10;
-		s10 += data[10];
+		s10 += Read64(data, 10);
 		s0 ^= s8;
 		s9 ^= s10;
 		s10 = Rot64(s10, 22);
 		s9 += s11;
-		s11 += data[11];
+		s11 += Read64(data, 11);
 		s1 ^= s9;
 		s10 ^= s11;
 		s11 = Rot64(s11, 46);
@@ -347,17 +362,17 @@ class SpookyHash {
 
 			// handle all complete sets of 32 bytes
 			for (; u.p64 < end; u.p64 += 4) {
-				c += u.p64[0];
-				d += u.p64[1];
+				c += Read64(u.p64, 0);
+				d += Read64(u.p64, 1);
 				ShortMix(a, b, c, d);
-				a += u.p64[2];
-				b += u.p64[3];
+				a += Read64(u.p64, 2);
+				b += Read64(u.p64, 3);
 			}
 
 			// Handle the case of 16+ remaining bytes.
 			if (remainder >= 16) {
-				c += u.p64[0];
-				d += u.p64[1];
+				c += Read64(u.p64, 0);
+				d += Read64(u.p64, 1);
 				ShortMix(a, b, c, d);
 				u.p64 += 2;
 				remainder -= 16;
@@ -369,36 +384,47 @@ class SpookyHash {
 		switch (remainder) {
 		case 15:
 			d += ((uint64_t)u.p8[14]) << 48;
+			[[fallthrough]];
 		case 14:
 			d += ((uint64_t)u.p8[13]) << 40;
+			[[fallthrough]];
 		case 13:
 			d += ((uint64_t)u.p8[12]) << 32;
+			[[fallthrough]];
 		case 12:
-			d += u.p32[2];
-			c += u.p64[0];
+			d += Read32(u.p32, 2);
+			c += Read64(u.p64, 0);
 			break;
 		case 11:
 			d += ((uint64_t)u.p8[10]) << 16;
+			[[fallthrough]];
 		case 10:
 			d += ((uint64_t)u.p8[9]) << 8;
+			[[fallthrough]];
 		case 9:
 			d += (uint64_t)u.p8[8];
+			[[fallthrough]];
 		case 8:
-			c += u.p64[0];
+			c += Read64(u.p64, 0);
 			break;
 		case 7:
 			c += ((uint64_t)u.p8[6]) << 48;
+			[[fallthrough]];
 		case 6:
 			c += ((uint64_t)u.p8[5]) << 40;
+			[[fallthrough]];
 		case 5:
 			c += ((uint64_t)u.p8[4]) << 32;
+			[[fallthrough]];
 		case 4:
-			c += u.p32[0];
+			c += Read32(u.p32, 0);
 			break;
 		case 3:
 			c += ((uint64_t)u.p8[2]) << 16;
+			[[fallthrough]];
 		case 2:
 			c += ((uint64_t)u.p8[1]) << 8;
+			[[fallthrough]];
 		case 1:
 			c += (uint64_t)u.p8[0];
 			break;
@@ -34,8 +34,21 @@
 #include <cstring>
 #include <inttypes.h>
 #include <memory>
+#include <thread>
+#include <vector>
 #include <x86intrin.h>
 #include <arm_neon.h>
+// Specialised kernels, selected from the target instruction set; -DNOBMI2, -DNOAVX2 and -DNOVPOPCNT disable them
+#if (defined(__BMI2__) || defined(__haswell__)) && !defined(NOBMI2)
+#define SUX_BMI2
+#endif
+#if defined(__AVX2__) && !defined(NOAVX2)
+#define SUX_AVX2
+#endif
+#if defined(__AVX512F__) && defined(__AVX512VPOPCNTDQ__) && !defined(NOVPOPCNT)
+#define SUX_VPOPCNT
+#endif
+
 // Macro stringification
 #define __STRINGIFY(s) #s
 #define STRINGIFY(s) __STRINGIFY(s)
@@ -370,7 +383,7 @@ inline size_t updroot(size_t j, size_t n) { return n & (SIZE_MAX << lambda((j ^
  *
  */
 inline uint64_t select64(uint64_t x, uint64_t k) {
-#ifndef __haswell__
+#ifndef SUX_BMI2
 	constexpr uint64_t kOnesStep4 = 0x1111111111111111ULL;
 	constexpr uint64_t kOnesStep8 = 0x0101010101010101ULL;
 	constexpr uint64_t kLAMBDAsStep8 = 0x80ULL * kOnesStep8;
@@ -401,6 +414,153 @@ inline uint64_t select64(uint64_t x, uint64_t k) {
 #endif
 }
 
+/** Returns the number of ones in an array of words.
+ *
+ * When AVX-512 VPOPCNTDQ is available, eight words are counted at a time.
+ *
+ * @param words an array of words.
+ * @param n the number of words.
+ */
+inline uint64_t popcount_words(const uint64_t *const words, const uint64_t n) {
+#ifdef SUX_VPOPCNT
+	__m512i count = _mm512_setzero_si512();
+	for (uint64_t i = 0; i < n; i += 8) {
+		const __mmask8 valid = n - i >= 8 ? 0xFF : (1 << (n - i)) - 1;
+		count = _mm512_add_epi64(count, _mm512_popcnt_epi64(_mm512_maskz_loadu_epi64(valid, words + i)));
+	}
+	return _mm512_reduce_add_epi64(count);
+#else
+	uint64_t count = 0;
+	for (uint64_t i = 0; i < n; i++) count += __builtin_popcountll(words[i]);
+	return count;
+#endif
+}
+
+/** Returns the position of the one (or zero) of given rank in a bit vector, counting from a given position.
+ *
+ * The scan proceeds word by word; when AVX-512 VPOPCNTDQ is available, past the first word
+ * it proceeds eight words at a time, using a prefix sum of their bit counts.
+ *
+ * @param bits a bit vector of 64-bit words.
+ * @param num_words the number of words of the bit vector.
+ * @param start the starting position.
+ * @param rank the rank of the desired bit, counting from `start` (included); such a bit must exist.
+ * @tparam ZERO whether to select zeros instead of ones.
+ */
+template <bool ZERO = false> inline uint64_t select_from(const uint64_t *const bits, [[maybe_unused]] const uint64_t num_words, const uint64_t start, uint64_t rank) {
+	uint64_t word_index = start / 64;
+	uint64_t word = (ZERO ? ~bits[word_index] : bits[word_index]) & -1ULL << start % 64;
+
+#ifdef SUX_VPOPCNT
+	const uint64_t bit_count = __builtin_popcountll(word);
+	if (rank < bit_count) return word_index * 64 + select64(word, rank);
+	rank -= bit_count;
+
+	for (word_index++;; word_index += 8) {
+		const __mmask8 valid = num_words - word_index >= 8 ? 0xFF : (1 << (num_words - word_index)) - 1;
+		__m512i words = _mm512_maskz_loadu_epi64(valid, bits + word_index);
+		if (ZERO) words = _mm512_maskz_ternarylogic_epi64(valid, words, words, words, 0x55);
+		const __m512i counts = _mm512_popcnt_epi64(words);
+		// Inclusive prefix sums of the counts, shifting lanes up by 1, 2 and 4
+		const __m512i zero = _mm512_setzero_si512();
+		__m512i prefix = _mm512_add_epi64(counts, _mm512_alignr_epi64(counts, zero, 7));
+		prefix = _mm512_add_epi64(prefix, _mm512_alignr_epi64(prefix, zero, 6));
+		prefix = _mm512_add_epi64(prefix, _mm512_alignr_epi64(prefix, zero, 4));
+
+		const __mmask8 over = _mm512_cmpgt_epu64_mask(prefix, _mm512_set1_epi64(rank));
+		if (over != 0) {
+			const int lane = __builtin_ctz(over);
+			uint64_t before[8];
+			_mm512_storeu_si512(before, _mm512_sub_epi64(prefix, counts));
+			word = ZERO ? ~bits[word_index + lane] : bits[word_index + lane];
+			return (word_index + lane) * 64 + select64(word, rank - before[lane]);
+		}
+		rank -= _mm512_reduce_add_epi64(counts);
+	}
+#else
+	for (;;) {
+		const uint64_t bit_count = __builtin_popcountll(word);
+		if (rank < bit_count) break;
+		word = ZERO ? ~bits[++word_index] : bits[++word_index];
+		rank -= bit_count;
+	}
+
+	return word_index * 64 + select64(word, rank);
+#endif
+}
+
+/** Returns the position of the one (or zero) of given rank in a short array of words, or SIZE_MAX if there is no such bit.
+ *
+ * The bit counts of the words are computed in parallel and the target word is located using their prefix sums:
+ * eight words at a time when AVX-512 VPOPCNTDQ is available, four words at a time when AVX2 is available
+ * (counting bits through a nibble lookup table), and one word at a time otherwise.
+ *
+ * @param words an array of words.
+ * @param n the number of words.
+ * @param rank the rank of the desired bit.
+ * @tparam ZERO whether to select zeros instead of ones.
+ */
+template <bool ZERO = false> inline size_t select_in_words(const uint64_t *const words, const uint64_t n, uint64_t rank) {
+	uint64_t i = 0;
+#ifdef SUX_VPOPCNT
+	const __m512i zero = _mm512_setzero_si512();
+	for (; i < n; i += 8) {
+		const __mmask8 valid = n - i >= 8 ? 0xFF : (1 << (n - i)) - 1;
+		__m512i w = _mm512_maskz_loadu_epi64(valid, words + i);
+		if (ZERO) w = _mm512_maskz_ternarylogic_epi64(valid, w, w, w, 0x55);
+		const __m512i counts = _mm512_popcnt_epi64(w);
+		// Inclusive prefix sums of the counts, shifting lanes up by 1, 2 and 4
+		__m512i prefix = _mm512_add_epi64(counts, _mm512_alignr_epi64(counts, zero, 7));
+		prefix = _mm512_add_epi64(prefix, _mm512_alignr_epi64(prefix, zero, 6));
+		prefix = _mm512_add_epi64(prefix, _mm512_alignr_epi64(prefix, zero, 4));
+
+		const __mmask8 over = _mm512_cmpgt_epu64_mask(prefix, _mm512_set1_epi64(rank));
+		if (over != 0) {
+			const int lane = __builtin_ctz(over);
+			uint64_t before[8];
+			_mm512_storeu_si512(before, _mm512_sub_epi64(prefix, counts));
+			return (i + lane) * 64 + select64(ZERO ? ~words[i + lane] : words[i + lane], rank - before[lane]);
+		}
+		rank -= _mm512_reduce_add_epi64(counts);
+	}
+	return SIZE_MAX;
+#else
+#ifdef SUX_AVX2
+	const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i nibble = _mm256_set1_epi8(0x0F), zero = _mm256_setzero_si256();
+	// Ranks are compared as signed integers, so they must stay below 2^63
+	for (; i + 4 <= n && rank < INT64_MAX; i += 4) {
+		__m256i w = _mm256_loadu_si256((const __m256i *)(words + i));
+		if (ZERO) w = _mm256_xor_si256(w, _mm256_set1_epi8(-1));
+		const __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(w, nibble));
+		const __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(w, 4), nibble));
+		const __m256i counts = _mm256_sad_epu8(_mm256_add_epi8(lo, hi), zero);
+		// Inclusive prefix sums of the counts, shifting lanes up by 1 and 2
+		__m256i prefix = _mm256_add_epi64(counts, _mm256_blend_epi32(_mm256_permute4x64_epi64(counts, 0x90), zero, 0x03));
+		prefix = _mm256_add_epi64(prefix, _mm256_blend_epi32(_mm256_permute4x64_epi64(prefix, 0x40), zero, 0x0F));
+
+		const int over = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(prefix, _mm256_set1_epi64x(rank))));
+		if (over != 0) {
+			const int lane = __builtin_ctz(over);
+			uint64_t before[4];
+			_mm256_storeu_si256((__m256i *)before, _mm256_sub_epi64(prefix, counts));
+			return (i + lane) * 64 + select64(ZERO ? ~words[i + lane] : words[i + lane], rank - before[lane]);
+		}
+		uint64_t total[4];
+		_mm256_storeu_si256((__m256i *)total, prefix);
+		rank -= total[3];
+	}
+#endif
+	for (; i < n; i++) {
+		const uint64_t w = ZERO ? ~words[i] : words[i];
+		const uint64_t bit_count = nu(w);
+		if (rank < bit_count) return i * 64 + select64(w, rank);
+		rank -= bit_count;
+	}
+	return SIZE_MAX;
+#endif
+}
+
 /** Check if the architecture is big endian */
 bool inline is_big_endian(void) {
 	union {
@@ -442,6 +602,74 @@ template <class T> typename std::enable_if<std::is_integral<T>::value, T>::type
  */
 template <class T> T hton(T value) { return is_little_endian() ? swap_endian<T>(value) : value; }
 
+/** Distance, in queries, at which batched queries prefetch the data they will need. */
+static constexpr size_t BATCH_PREFETCH_DISTANCE = 8;
+
+/** Answers a batch of queries using a three-stage software pipeline.
+ *
+ * For each query index i, `first(i)` is invoked 2 BATCH_PREFETCH_DISTANCE queries before `query(i)`,
+ * and `second(i)` BATCH_PREFETCH_DISTANCE queries before. Typically, `first()` prefetches the
+ * index entries of a query, `second()` reads them and prefetches the data they point to, and `query()`
+ * computes the answer, so that the lookups of several queries are in flight at the same time.
+ *
+ * @param n the number of queries.
+ * @param first the first stage.
+ * @param second the second stage.
+ * @param query the final stage.
+ */
+template <typename F, typename S, typename Q> inline void batch_pipeline(const size_t n, F &&first, S &&second, Q &&query) {
+	constexpr size_t d = BATCH_PREFETCH_DISTANCE;
+	for (size_t i = 0; i < n + 2 * d; i++) {
+		if (i < n) first(i);
+		if (i >= d && i - d < n) second(i - d);
+		if (i >= 2 * d) query(i - 2 * d);
+	}
+}
+
+/** Runs f(0), f(1), ..., f(num_threads - 1) in parallel, using the current thread for f(0). */
+template <typename F> inline void parallel(const size_t num_threads, const F &f) {
+	std::vector<std::thread> workers;
+	for (size_t t = 1; t < num_threads; t++) workers.emplace_back(f, t);
+	f(0);
+	for (auto &w : workers) w.join();
+}
+
+/** Processes in parallel contiguous ranges of an array of words, knowing the number of ones (or zeros) preceding each range.
+ *
+ * The words are split into (at most) `num_threads` ranges. In a first parallel pass each thread counts
+ * the ones (or zeros) in its range; an exclusive prefix sum of the counts yields the number of ones
+ * (or zeros) preceding each range, and in a second parallel pass `f(begin, end, before)` is invoked
+ * on each nonempty range of words [`begin`..`end`), where `before` is the number of ones (or zeros) in
+ * words [0..`begin`). With a single thread, `f(0, num_words, 0)` is invoked directly.
+ *
+ * @param bits an array of words.
+ * @param num_words the number of words.
+ * @param num_threads the number of threads.
+ * @param align the ranges start at multiples of this number of words.
+ * @param f the function processing a range.
+ * @tparam ZERO whether to count zeros instead of ones.
+ */
+template <bool ZERO = false, typename F> inline void parallel_word_ranges(const uint64_t *const bits, const uint64_t num_words, const size_t num_threads, const uint64_t align, const F &f) {
+	if (num_threads <= 1) {
+		if (num_words != 0) f(0, num_words, 0);
+		return;
+	}
+
+	const uint64_t chunk = ((num_words + num_threads - 1) / num_threads + align - 1) / align * align;
+	std::vector<uint64_t> before(num_threads);
+	// The last range need not be counted
+	parallel(num_threads - 1, [&](const size_t t) {
+		const uint64_t begin = min(t * chunk, num_words), end = min(begin + chunk, num_words);
+		const uint64_t ones = popcount_words(bits + begin, end - begin);
+		before[t + 1] = ZERO ? (end - begin) * 64 - ones : ones;
+	});
+	for (size_t t = 1; t < num_threads; t++) before[t] += before[t - 1];
+	parallel(num_threads, [&](const size_t t) {
+		const uint64_t begin = min(t * chunk, num_words), end = min(begin + chunk, num_words);
+		if (begin < end) f(begin, end, before[t]);
+	});
+}
+
 /** Network to host endianness converter
  * @param value integral value
  *
@@ -0,0 +1,202 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2019-2020 Sebastiano Vigna
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../support/common.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace sux::util {
+
+/** A vector of fixed-size elements stored in pages that are shared copy-on-write.
+ *
+ * Elements are sequences of bytes of a length fixed at construction time, and they are stored in pages of
+ * 2<sup>#LOG2_PAGE_ELEMENTS</sup> elements. Copying an instance takes constant time, as the copy shares
+ * the table of pages with the original; the first write to either instance copies the table (a pointer per page),
+ * and each write copies the page it modifies, unless the page is no longer shared. Thus, a copy is a
+ * snapshot whose content does not change, and the cost of each write after a snapshot is proportional to
+ * the number of pages it touches for the first time.
+ *
+ * Reference counts are atomic, so different instances sharing pages can be used (and destroyed) concurrently
+ * by different threads without locking; an instance, however, must not be copied while it is being modified.
+ *
+ * Each page is followed by #SLACK bytes, so a word can be read at the start of any element and
+ * modified in place as long as the bytes beyond the element do not change (see, e.g., ::bytewrite()).
+ */
+class CowVector {
+  public:
+	static constexpr int LOG2_PAGE_ELEMENTS = 9;
+	static constexpr size_t PAGE_ELEMENTS = size_t(1) << LOG2_PAGE_ELEMENTS;
+	static constexpr size_t SLACK = 8;
+
+  private:
+	// A page is a reference count followed by its elements and by SLACK bytes
+	using Page = uint8_t;
+
+	struct Table {
+		std::atomic<uint64_t> refs{1};
+		std::vector<Page *> pages;
+	};
+
+	Table *table = nullptr;
+	size_t element_bytes, length = 0;
+
+	size_t page_bytes() const { return sizeof(std::atomic<uint64_t>) + (element_bytes << LOG2_PAGE_ELEMENTS) + SLACK; }
+
+	static std::atomic<uint64_t> &refs(Page *const page) { return *reinterpret_cast<std::atomic<uint64_t> *>(page); }
+
+	Page *new_page() const {
+		Page *const page = static_cast<Page *>(calloc(1, page_bytes()));
+		if (page == nullptr) throw std::bad_alloc();
+		new (page) std::atomic<uint64_t>(1);
+		return page;
+	}
+
+	static void release(Page *const page) {
+		if (refs(page).fetch_sub(1, std::memory_order_acq_rel) == 1) free(page);
+	}
+
+	static void release(Table *const table) {
+		if (table == nullptr || table->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+		for (Page *const page : table->pages) release(page);
+		delete table;
+	}
+
+	// Makes the table private to this instance
+	void unshare() {
+		if (table == nullptr) {
+			table = new Table();
+			return;
+		}
+		if (likely(table->refs.load(std::memory_order_acquire) == 1)) return;
+		Table *const copy = new Table();
+		copy->pages = table->pages;
+		for (Page *const page : copy->pages) refs(page).fetch_add(1, std::memory_order_relaxed);
+		release(table);
+		table = copy;
+	}
+
+	// Returns a pointer to an element, copying its page if it is shared
+	uint8_t *writable(const size_t i) {
+		unshare();
+		Page *&page = table->pages[i >> LOG2_PAGE_ELEMENTS];
+		if (unlikely(refs(page).load(std::memory_order_acquire) != 1)) {
+			Page *const copy = new_page();
+			memcpy(copy + sizeof(std::atomic<uint64_t>), page + sizeof(std::atomic<uint64_t>), page_bytes() - sizeof(std::atomic<uint64_t>));
+			release(page);
+			page = copy;
+		}
+		return element(page, i);
+	}
+
+	uint8_t *element(Page *const page, const size_t i) const { return page + sizeof(std::atomic<uint64_t>) + (i & (PAGE_ELEMENTS - 1)) * element_bytes; }
+
+  public:
+	/** Creates a new empty vector.
+	 *
+	 * @param element_bytes the number of bytes of an element.
+	 */
+	explicit CowVector(const size_t element_bytes = sizeof(uint64_t)) : element_bytes(element_bytes) {}
+
+	/** Creates a snapshot of a given vector in constant time. */
+	CowVector(const CowVector &other) : table(other.table), element_bytes(other.element_bytes), length(other.length) {
+		if (table != nullptr) table->refs.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	CowVector(CowVector &&other) : table(std::exchange(other.table, nullptr)), element_bytes(other.element_bytes), length(std::exchange(other.length, 0)) {}
+
+	CowVector &operator=(CowVector other) {
+		std::swap(table, other.table);
+		std::swap(element_bytes, other.element_bytes);
+		std::swap(length, other.length);
+		return *this;
+	}
+
+	~CowVector() { release(table); }
+
+	/** Returns the number of elements. */
+	size_t size() const { return length; }
+
+	/** Returns the number of bytes of an element. */
+	size_t elementBytes() const { return element_bytes; }
+
+	/** Changes the number of elements; new elements are set to zero. */
+	void resize(const size_t size) {
+		unshare();
+		// Elements past the end in the last page might have been set before shrinking
+		const size_t end = std::min(size, table->pages.size() << LOG2_PAGE_ELEMENTS);
+		if (length < end) memset(writable(length), 0, (end - length) * element_bytes);
+
+		const size_t num_pages = (size + PAGE_ELEMENTS - 1) >> LOG2_PAGE_ELEMENTS, old_pages = table->pages.size();
+		for (size_t p = num_pages; p < old_pages; p++) release(table->pages[p]);
+		table->pages.resize(num_pages);
+		for (size_t p = old_pages; p < num_pages; p++) table->pages[p] = new_page();
+		length = size;
+	}
+
+	/** Returns a pointer to an element for reading.
+	 *
+	 * The pointer is valid until the next call to a method modifying this instance.
+	 *
+	 * @param i the index of an element.
+	 * @return a pointer to the element, followed by at least #SLACK readable bytes.
+	 */
+	const uint8_t *read(const size_t i) const {
+		assert(i < length);
+		return element(table->pages[i >> LOG2_PAGE_ELEMENTS], i);
+	}
+
+	/** Returns a pointer to an element for writing, copying its page if it is shared.
+	 *
+	 * The pointer is valid until the next call to a method modifying this instance.
+	 * Different threads can write concurrently different elements, provided that no
+	 * page is shared and the table is not shared.
+	 *
+	 * @param i the index of an element.
+	 * @return a pointer to the element, followed by at least #SLACK bytes.
+	 */
+	uint8_t *write(const size_t i) {
+		assert(i < length);
+		return writable(i);
+	}
+
+	/** Returns the number of pages, shared or not. */
+	size_t pages() const { return table == nullptr ? 0 : table->pages.size(); }
+
+	/** Returns an estimate of the size in bits of this vector, including pages shared with other instances. */
+	size_t bitCount() const { return sizeof(*this) * 8 + (table == nullptr ? 0 : (sizeof(Table) + pages() * (sizeof(Page *) + page_bytes())) * 8); }
+};
+
+} // namespace sux::util
@@ -0,0 +1,210 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2019-2020 Stefano Marchini
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "SearchablePrefixSums.hpp"
+#include "Vector.hpp"
+
+namespace sux::util {
+
+/** A standard (fixed-size) Fenwick tree in classical layout supporting concurrent updates.
+ *
+ * This tree is laid out as a FenwickFixedF, but every node is read and written
+ * atomically: add(size_t, int64_t) and addBatch() perform an atomic fetch-and-add on
+ * each node of the update path, so they can be called concurrently by any number of
+ * threads without locking, and concurrently with queries.
+ *
+ * Since the query path of a prefix intersects the update path of an element in at most
+ * one node, prefix(size_t) sees every concurrent increment either entirely or not at all,
+ * and it sees every increment that happened before it; increments that are concurrent with
+ * it might be seen in an order different from the one in which they happened, though.
+ * find(uint64_t *) and compFind(uint64_t *) read the nodes along their descent atomically,
+ * but they might see only part of a concurrent increment. When there are no concurrent
+ * increments, all queries are exact.
+ *
+ * Thus, queries concurrent with increments are neither linearizable nor consistent with a snapshot
+ * of the values: for example, two calls to prefix(size_t) might see two concurrent increments in
+ * opposite orders. This tree is meant for counters that are updated by many threads and read
+ * approximately while they change, or exactly once updates have stopped.
+ *
+ * push(), pop() and the methods of Expandable change the size of the tree, and they cannot
+ * be called concurrently with any other method.
+ *
+ * Because of the static member CONCURRENT, sux::bits::WordDynRankSel and
+ * sux::bits::StrideDynRankSel access their bit vector atomically when
+ * they are based on this tree, so their mutation methods can be called concurrently, too.
+ *
+ * @tparam BOUND maximum representable value (at most the maximum value of a `uint64_t`).
+ * @tparam AT a type of memory allocation out of ::AllocType.
+ */
+
+template <size_t BOUND, AllocType AT = MALLOC> class FenwickAtomicF : public SearchablePrefixSums, public Expandable {
+  public:
+	static constexpr size_t BOUNDSIZE = ceil_log2_plus1(BOUND);
+	static constexpr bool FENWICK = true;
+	static_assert(BOUNDSIZE >= 1 && BOUNDSIZE <= 64, "Leaves can't be stored in a 64-bit word");
+	static constexpr bool CONCURRENT = true;
+
+  protected:
+	Vector<uint64_t, AT> Tree;
+	size_t Size;
+
+  public:
+	/** Creates a new instance with no values (empty tree). */
+	FenwickAtomicF() : Size(0) {}
+
+	/** Creates a new instance with given vector of values.
+	 *
+	 * Note that the provided sequence is read at construction time but
+	 * it will not be referenced afterwards.
+	 *
+	 * @param sequence a sequence of nonnegative integers smaller than or equal to the template parameter `BOUND`.
+	 * @param size the number of elements in the sequence.
+	 * @param num_threads the number of threads used to fill the tree.
+	 */
+	FenwickAtomicF(uint64_t sequence[], size_t size, size_t num_threads = 1) : Tree(pos(size) + 1), Size(size) {
+		fill(sequence, size, num_threads, false, [&](const size_t node, const uint64_t value) { Tree[pos(node)] = value; });
+	}
+
+	virtual uint64_t prefix(size_t idx) {
+		uint64_t sum = 0;
+
+		while (idx != 0) {
+			sum += read(idx);
+			idx = clear_rho(idx);
+		}
+
+		return sum;
+	}
+
+	virtual void add(size_t idx, int64_t inc) {
+		while (idx <= Size) {
+			__atomic_fetch_add(&Tree[pos(idx)], inc, __ATOMIC_RELAXED);
+			idx += mask_rho(idx);
+		}
+	}
+
+	virtual void prefix(const size_t *length, uint64_t *out, size_t n) {
+		batch_prefix(length, out, n, [&](const size_t idx) { return read(idx); });
+	}
+
+	virtual void addBatch(const size_t *idx, const int64_t *inc, size_t n) {
+		batch_add(Size, idx, inc, n, [&](const size_t node, const int64_t c) { __atomic_fetch_add(&Tree[pos(node)], c, __ATOMIC_RELAXED); });
+	}
+
+	virtual void rangeAdd(size_t from, size_t to, int64_t inc) {
+		range_add(Size, from, to, inc, [&](const size_t node, const int64_t c) { __atomic_fetch_add(&Tree[pos(node)], c, __ATOMIC_RELAXED); });
+	}
+
+	using SearchablePrefixSums::find;
+	virtual size_t find(uint64_t *val) {
+		size_t node = 0;
+
+		for (size_t m = mask_lambda(Size); m != 0; m >>= 1) {
+			if (node + m > Size) continue;
+
+			uint64_t value = read(node + m);
+
+			if (*val >= value) {
+				node += m;
+				*val -= value;
+			}
+		}
+
+		return node;
+	}
+
+	using SearchablePrefixSums::compFind;
+	virtual size_t compFind(uint64_t *val) {
+		size_t node = 0;
+
+		for (size_t m = mask_lambda(Size); m != 0; m >>= 1) {
+			if (node + m > Size) continue;
+
+			uint64_t value = (BOUND << rho(node + m)) - read(node + m);
+
+			if (*val >= value) {
+				node += m;
+				*val -= value;
+			}
+		}
+
+		return node;
+	}
+
+	virtual void push(uint64_t val) {
+		size_t p = pos(++Size);
+		Tree.resize(p + 1);
+		Tree[p] = val;
+
+		if ((Size & 1) == 0) {
+			for (size_t idx = Size - 1; idx != 0 && rho(idx) < rho(Size); idx = clear_rho(idx)) Tree[p] += Tree[pos(idx)];
+		}
+	}
+
+	virtual void pop() {
+		Size--;
+		Tree.popBack();
+	}
+
+	virtual void grow(size_t space) { Tree.grow(space); }
+
+	virtual void reserve(size_t space) { Tree.reserve(space); }
+
+	using Expandable::trimToFit;
+	virtual void trim(size_t space) { Tree.trim(space); };
+
+	virtual void resize(size_t space) { Tree.resize(space); }
+
+	virtual void size(size_t space) { Tree.size(space); }
+
+	virtual size_t size() const { return Size; }
+
+	virtual size_t bitCount() const { return Tree.bitCount() - sizeof(Tree) * 8 + sizeof(*this) * 8; }
+
+  private:
+	static inline size_t holes(size_t idx) { return idx >> 14; }
+
+	static inline size_t pos(size_t idx) { return idx + holes(idx); }
+
+	inline uint64_t read(size_t idx) { return __atomic_load_n(&Tree[pos(idx)], __ATOMIC_RELAXED); }
+
+	friend std::ostream &operator<<(std::ostream &os, const FenwickAtomicF<BOUND, AT> &ft) {
+		serialization::writeHeader(os, serialization::tag("FenwAtoF"), {BOUND}, {ft.Size});
+		return os << ft.Tree;
+	}
+
+	friend std::istream &operator>>(std::istream &is, FenwickAtomicF<BOUND, AT> &ft) {
+		uint64_t size;
+		if (!serialization::readHeader(is, serialization::tag("FenwAtoF"), {BOUND}, {&size})) return is;
+		ft.Size = size;
+		return is >> ft.Tree;
+	}
+};
+
+} // namespace sux::util
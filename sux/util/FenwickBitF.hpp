@@ -42,6 +42,7 @@ namespace sux::util {
 template <size_t BOUND, AllocType AT = MALLOC> class FenwickBitF : public SearchablePrefixSums, public Expandable {
   public:
 	static constexpr size_t BOUNDSIZE = ceil_log2_plus1(BOUND);
+	static constexpr bool FENWICK = true;
 	static constexpr size_t STARTING_OFFSET = 1;
 	static constexpr size_t END_PADDING = 56;
 	static_assert(BOUNDSIZE >= 1 && BOUNDSIZE <= 55, "Some nodes will span on multiple words");
@@ -61,13 +62,11 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickBitF : public Search
 	 *
 	 * @param sequence a sequence of nonnegative integers smaller than or equal to the template parameter `BOUND`.
 	 * @param size the number of elements in the sequence.
+	 * @param num_threads the number of threads used to fill the tree.
 	 */
 
-	FenwickBitF(uint64_t sequence[], size_t size) : Tree((first_bit_after(size) + END_PADDING + 7) >> 3), Size(size) {
-		for (size_t idx = 1; idx <= Size; idx++) addToPartialFrequency(idx, sequence[idx - 1]);
-
-		for (size_t m = 2; m <= Size; m <<= 1)
-			for (size_t idx = m; idx <= Size; idx += m) addToPartialFrequency(idx, getPartialFrequency(idx - m / 2));
+	FenwickBitF(uint64_t sequence[], size_t size, size_t num_threads = 1) : Tree((first_bit_after(size) + END_PADDING + 7) >> 3), Size(size) {
+		fill(sequence, size, num_threads, false, [&](const size_t node, const uint64_t value) { addToPartialFrequency(node, value); });
 	}
 
 	virtual uint64_t prefix(size_t idx) {
@@ -88,6 +87,18 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickBitF : public Search
 		}
 	}
 
+	virtual void prefix(const size_t *length, uint64_t *out, size_t n) {
+		batch_prefix(length, out, n, [&](const size_t node) { return getPartialFrequency(node); });
+	}
+
+	virtual void addBatch(const size_t *idx, const int64_t *inc, size_t n) {
+		batch_add(Size, idx, inc, n, [&](const size_t node, const int64_t c) { addToPartialFrequency(node, c); });
+	}
+
+	virtual void rangeAdd(size_t from, size_t to, int64_t inc) {
+		range_add(Size, from, to, inc, [&](const size_t node, const int64_t c) { addToPartialFrequency(node, c); });
+	}
+
 	using SearchablePrefixSums::find;
 	virtual size_t find(uint64_t *val) {
 		size_t node = 0;
@@ -130,11 +141,15 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickBitF : public Search
 		addToPartialFrequency(Size, val);
 
 		if ((Size & 1) == 0) {
-			for (size_t idx = Size - 1; rho(idx) < rho(Size); idx = clear_rho(idx)) addToPartialFrequency(Size, getPartialFrequency(idx));
+			for (size_t idx = Size - 1; idx != 0 && rho(idx) < rho(Size); idx = clear_rho(idx)) addToPartialFrequency(Size, getPartialFrequency(idx));
 		}
 	}
 
-	virtual void pop() { Tree.resize((first_bit_after(--Size) + END_PADDING + 7) >> 3); }
+	virtual void pop() {
+		// The node must be cleared, as push() adds to it
+		addToPartialFrequency(Size, -getPartialFrequency(Size));
+		Tree.resize((first_bit_after(--Size) + END_PADDING + 7) >> 3);
+	}
 
 	virtual void grow(size_t space) { Tree.grow((first_bit_after(space) + END_PADDING + 7) >> 3); }
 
@@ -193,12 +208,14 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickBitF : public Search
 	}
 
 	friend std::ostream &operator<<(std::ostream &os, const FenwickBitF<BOUND, AT> &ft) {
-		os.write((char *)&ft.Size, sizeof(uint64_t));
+		serialization::writeHeader(os, serialization::tag("FenwBitF"), {BOUND}, {ft.Size});
 		return os << ft.Tree;
 	}
 
 	friend std::istream &operator>>(std::istream &is, FenwickBitF<BOUND, AT> &ft) {
-		is.read((char *)&ft.Size, sizeof(uint64_t));
+		uint64_t size;
+		if (!serialization::readHeader(is, serialization::tag("FenwBitF"), {BOUND}, {&size})) return is;
+		ft.Size = size;
 		return is >> ft.Tree;
 	}
 };
@@ -42,6 +42,7 @@ namespace sux::util {
 template <size_t BOUND, AllocType AT = MALLOC> class FenwickBitL : public SearchablePrefixSums, public Expandable {
   public:
 	static constexpr size_t BOUNDSIZE = ceil_log2_plus1(BOUND);
+	static constexpr bool FENWICK = true;
 	static_assert(BOUNDSIZE >= 1 && BOUNDSIZE <= 64, "Leaves can't be stored in a 64-bit word");
 
   protected:
@@ -59,25 +60,15 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickBitL : public Search
 	 *
 	 * @param sequence a sequence of nonnegative integers smaller than or equal to the template parameter `BOUND`.
 	 * @param size the number of elements in the sequence.
+	 * @param num_threads the number of threads used to fill the tree.
 	 */
-	FenwickBitL(uint64_t sequence[], size_t size) : Levels(size != 0 ? lambda(size) + 1 : 1), Size(size) {
+	FenwickBitL(uint64_t sequence[], size_t size, size_t num_threads = 1) : Levels(size != 0 ? lambda(size) + 1 : 1), Size(size) {
 		this->size(size ? size : 1);
-
-		for (size_t l = 0; l < Levels; l++) {
-			for (size_t node = 1ULL << l; node <= size; node += 1ULL << (l + 1)) {
-				size_t sequence_idx = node - 1;
-				uint64_t value = sequence[sequence_idx];
-
-				for (size_t j = 0; j < l; j++) {
-					sequence_idx >>= 1;
-					const size_t lowpos = (BOUNDSIZE + j) * sequence_idx;
-					value += bitread(&Tree[j][lowpos / 8], lowpos % 8, BOUNDSIZE + j);
-				}
-
-				const size_t highpos = (BOUNDSIZE + l) * (node >> (l + 1));
-				bitwrite_inc(&Tree[l][highpos / 8], highpos % 8, BOUNDSIZE + l, value);
-			}
-		}
+		fill(sequence, size, num_threads, true, [&](const size_t node, const uint64_t value) {
+			const int height = rho(node);
+			const size_t pos = (node >> (1 + height)) * (BOUNDSIZE + height);
+			bitwrite_inc(&Tree[height][pos / 8], pos % 8, BOUNDSIZE + height, value);
+		});
 	}
 
 	virtual uint64_t prefix(size_t idx) {
@@ -104,6 +95,30 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickBitL : public Search
 		}
 	}
 
+	virtual void prefix(const size_t *length, uint64_t *out, size_t n) {
+		batch_prefix(length, out, n, [&](const size_t node) {
+			const int height = rho(node);
+			const size_t pos = (node >> (1 + height)) * (BOUNDSIZE + height);
+			return bitread(&Tree[height][pos / 8], pos % 8, BOUNDSIZE + height);
+		});
+	}
+
+	virtual void addBatch(const size_t *idx, const int64_t *inc, size_t n) {
+		batch_add(Size, idx, inc, n, [&](const size_t node, const int64_t c) {
+			const int height = rho(node);
+			const size_t pos = (node >> (1 + height)) * (BOUNDSIZE + height);
+			bitwrite_inc(&Tree[height][pos / 8], pos % 8, BOUNDSIZE + height, c);
+		});
+	}
+
+	virtual void rangeAdd(size_t from, size_t to, int64_t inc) {
+		range_add(Size, from, to, inc, [&](const size_t node, const int64_t c) {
+			const int height = rho(node);
+			const size_t pos = (node >> (1 + height)) * (BOUNDSIZE + height);
+			bitwrite_inc(&Tree[height][pos / 8], pos % 8, BOUNDSIZE + height, c);
+		});
+	}
+
 	using SearchablePrefixSums::find;
 	virtual size_t find(uint64_t *val) {
 		size_t node = 0, idx = 0;
@@ -113,7 +128,7 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickBitL : public Search
 
 			idx <<= 1;
 
-			if ((pos + BOUNDSIZE + height) / 8 + 7 >= Tree[height].size()) continue;
+			if (node + (1ULL << height) > Size) continue;
 
 			const uint64_t value = bitread(&Tree[height][pos / 8], pos % 8, BOUNDSIZE + height);
 
@@ -136,7 +151,7 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickBitL : public Search
 
 			idx <<= 1;
 
-			if ((pos + BOUNDSIZE + height) / 8 + 7 >= Tree[height].size()) continue;
+			if (node + (1ULL << height) > Size) continue;
 
 			const uint64_t value = (BOUND << height) - bitread(&Tree[height][pos / 8], pos % 8, BOUNDSIZE + height);
 
@@ -157,7 +172,7 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickBitL : public Search
 		size_t idx = Size >> (1 + height);
 		size_t hipos = (BOUNDSIZE + height) * idx;
 
-		Tree[height].resize(hipos / 8 + 8);
+		Tree[height].resize((hipos + BOUNDSIZE + height) / 8 + 8);
 		bitwrite_inc(&Tree[height][hipos / 8], hipos % 8, BOUNDSIZE + height, val);
 
 		idx <<= 1;
@@ -173,7 +188,9 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickBitL : public Search
 	virtual void pop() {
 		int height = rho(Size);
 		size_t pos = (BOUNDSIZE + height) * (Size >> (1 + height));
-		Tree[height].resize(pos / 8);
+		// The node must be cleared, as push() adds to it
+		bitwrite(&Tree[height][pos / 8], pos % 8, BOUNDSIZE + height, 0);
+		Tree[height].resize(pos / 8 + 8);
 		Size--;
 	}
 
@@ -213,15 +230,16 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickBitL : public Search
 
   private:
 	friend std::ostream &operator<<(std::ostream &os, const FenwickBitL<BOUND, AT> &ft) {
-		os.write((char *)&ft.Size, sizeof(uint64_t));
-		os.write((char *)&ft.Levels, sizeof(uint64_t));
+		serialization::writeHeader(os, serialization::tag("FenwBitL"), {BOUND}, {ft.Size, ft.Levels});
 		for (size_t i = 0; i < ft.Levels; i++) os << ft.Tree[i];
 		return os;
 	}
 
 	friend std::istream &operator>>(std::istream &is, FenwickBitL<BOUND, AT> &ft) {
-		is.read((char *)&ft.Size, sizeof(uint64_t));
-		is.read((char *)&ft.Levels, sizeof(uint64_t));
+		uint64_t size, levels;
+		if (!serialization::readHeader(is, serialization::tag("FenwBitL"), {BOUND}, {&size, &levels})) return is;
+		ft.Size = size;
+		ft.Levels = levels;
 		for (size_t i = 0; i < ft.Levels; i++) is >> ft.Tree[i];
 		return is;
 	}
@@ -41,6 +41,7 @@ namespace sux::util {
 template <size_t BOUND, AllocType AT = MALLOC> class FenwickByteF : public SearchablePrefixSums, public Expandable {
   public:
 	static constexpr size_t BOUNDSIZE = ceil_log2_plus1(BOUND);
+	static constexpr bool FENWICK = true;
 	static_assert(BOUNDSIZE >= 1 && BOUNDSIZE <= 64, "Leaves can't be stored in a 64-bit word");
 
   protected:
@@ -58,17 +59,10 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickByteF : public Searc
 	 *
 	 * @param sequence a sequence of nonnegative integers smaller than or equal to the template parameter `BOUND`.
 	 * @param size the number of elements in the sequence.
+	 * @param num_threads the number of threads used to fill the tree.
 	 */
-	FenwickByteF(uint64_t sequence[], size_t size) : Tree(pos(size + 1) + 8), Size(size) {
-		for (size_t i = 1; i <= Size; i++) bytewrite(&Tree[pos(i)], bytesize(i), sequence[i - 1]);
-
-		for (size_t m = 2; m <= Size; m <<= 1) {
-			for (size_t idx = m; idx <= Size; idx += m) {
-				const uint64_t left = byteread(&Tree[pos(idx)], bytesize(idx));
-				const uint64_t right = byteread(&Tree[pos(idx - m / 2)], bytesize(idx - m / 2));
-				bytewrite(&Tree[pos(idx)], bytesize(idx), left + right);
-			}
-		}
+	FenwickByteF(uint64_t sequence[], size_t size, size_t num_threads = 1) : Tree(pos(size + 1) + 8), Size(size) {
+		fill(sequence, size, num_threads, false, [&](const size_t node, const uint64_t value) { bytewrite(&Tree[pos(node)], bytesize(node), value); });
 	}
 
 	virtual uint64_t prefix(size_t idx) {
@@ -89,6 +83,18 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickByteF : public Searc
 		}
 	}
 
+	virtual void prefix(const size_t *length, uint64_t *out, size_t n) {
+		batch_prefix(length, out, n, [&](const size_t node) { return byteread(&Tree[pos(node)], bytesize(node)); });
+	}
+
+	virtual void addBatch(const size_t *idx, const int64_t *inc, size_t n) {
+		batch_add(Size, idx, inc, n, [&](const size_t node, const int64_t c) { bytewrite_inc(&Tree[pos(node)], c); });
+	}
+
+	virtual void rangeAdd(size_t from, size_t to, int64_t inc) {
+		range_add(Size, from, to, inc, [&](const size_t node, const int64_t c) { bytewrite_inc(&Tree[pos(node)], c); });
+	}
+
 	using SearchablePrefixSums::find;
 	virtual size_t find(uint64_t *val) {
 		size_t node = 0;
@@ -131,7 +137,7 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickByteF : public Searc
 		bytewrite(&Tree[p], bytesize(Size), val);
 
 		if ((Size & 1) == 0) {
-			for (size_t idx = Size - 1; rho(idx) < rho(Size); idx = clear_rho(idx)) {
+			for (size_t idx = Size - 1; idx != 0 && rho(idx) < rho(Size); idx = clear_rho(idx)) {
 				uint64_t inc = byteread(&Tree[pos(idx)], bytesize(idx));
 				bytewrite_inc(&Tree[p], inc);
 			}
@@ -185,12 +191,14 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickByteF : public Searc
 	}
 
 	friend std::ostream &operator<<(std::ostream &os, const FenwickByteF<BOUND, AT> &ft) {
-		os.write((char *)&ft.Size, sizeof(uint64_t));
+		serialization::writeHeader(os, serialization::tag("FenwBytF"), {BOUND}, {ft.Size});
 		return os << ft.Tree;
 	}
 
 	friend std::istream &operator>>(std::istream &is, FenwickByteF<BOUND, AT> &ft) {
-		is.read((char *)(&ft.Size), sizeof(uint64_t));
+		uint64_t size;
+		if (!serialization::readHeader(is, serialization::tag("FenwBytF"), {BOUND}, {&size})) return is;
+		ft.Size = size;
 		return is >> ft.Tree;
 	}
 };
@@ -42,6 +42,7 @@ namespace sux::util {
 template <size_t BOUND, AllocType AT = MALLOC> class FenwickByteL : public SearchablePrefixSums, public Expandable {
   public:
 	static constexpr size_t BOUNDSIZE = ceil_log2_plus1(BOUND);
+	static constexpr bool FENWICK = true;
 	static_assert(BOUNDSIZE >= 1 && BOUNDSIZE <= 64, "Leaves can't be stored in a 64-bit word");
 
   protected:
@@ -59,25 +60,15 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickByteL : public Searc
 	 *
 	 * @param sequence a sequence of nonnegative integers smaller than or equal to the template parameter `BOUND`.
 	 * @param size the number of elements in the sequence.
+	 * @param num_threads the number of threads used to fill the tree.
 	 */
-	FenwickByteL(uint64_t sequence[], size_t size) : Levels(size != 0 ? lambda(size) + 1 : 1), Size(size) {
+	FenwickByteL(uint64_t sequence[], size_t size, size_t num_threads = 1) : Levels(size != 0 ? lambda(size) + 1 : 1), Size(size) {
 		this->size(size ? size : 1);
-
-		for (size_t l = 0; l < Levels; l++) {
-			for (size_t node = 1ULL << l; node <= Size; node += 1ULL << (l + 1)) {
-				size_t sequence_idx = node - 1;
-				uint64_t value = sequence[sequence_idx];
-
-				for (size_t j = 0; j < l; j++) {
-					sequence_idx >>= 1;
-					size_t lowpos = heightsize(j) * sequence_idx;
-					value += byteread(&Tree[j][lowpos], heightsize(j));
-				}
-
-				size_t highpos = heightsize(l) * (node >> (l + 1));
-				bytewrite(&Tree[l][highpos], heightsize(l), value);
-			}
-		}
+		fill(sequence, size, num_threads, true, [&](const size_t node, const uint64_t value) {
+			const int height = rho(node);
+			const size_t isize = heightsize(height);
+			bytewrite(&Tree[height][(node >> (1 + height)) * isize], isize, value);
+		});
 	}
 
 	virtual uint64_t prefix(size_t idx) {
@@ -106,6 +97,28 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickByteL : public Searc
 		}
 	}
 
+	virtual void prefix(const size_t *length, uint64_t *out, size_t n) {
+		batch_prefix(length, out, n, [&](const size_t node) {
+			const int height = rho(node);
+			const size_t isize = heightsize(height);
+			return byteread(&Tree[height][(node >> (1 + height)) * isize], isize);
+		});
+	}
+
+	virtual void addBatch(const size_t *idx, const int64_t *inc, size_t n) {
+		batch_add(Size, idx, inc, n, [&](const size_t node, const int64_t c) {
+			const int height = rho(node);
+			bytewrite_inc(&Tree[height][(node >> (1 + height)) * heightsize(height)], c);
+		});
+	}
+
+	virtual void rangeAdd(size_t from, size_t to, int64_t inc) {
+		range_add(Size, from, to, inc, [&](const size_t node, const int64_t c) {
+			const int height = rho(node);
+			bytewrite_inc(&Tree[height][(node >> (1 + height)) * heightsize(height)], c);
+		});
+	}
+
 	using SearchablePrefixSums::find;
 	virtual size_t find(uint64_t *val) {
 		size_t node = 0, idx = 0;
@@ -162,7 +175,7 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickByteL : public Searc
 		size_t hisize = heightsize(height);
 		size_t highpos = idx * hisize;
 
-		Tree[height].resize(highpos + 8);
+		Tree[height].resize(highpos + hisize + 8);
 		bytewrite(&Tree[height][highpos], hisize, val);
 
 		idx <<= 1;
@@ -180,7 +193,7 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickByteL : public Searc
 
 	virtual void pop() {
 		int height = rho(Size);
-		Tree[height].resize((Size >> (1 + height)) * heightsize(height) + 7);
+		Tree[height].resize((Size >> (1 + height)) * heightsize(height) + 8);
 		Size--;
 	}
 
@@ -222,15 +235,16 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickByteL : public Searc
 	static inline size_t heightsize(size_t height) { return ((height + BOUNDSIZE - 1) >> 3) + 1; }
 
 	friend std::ostream &operator<<(std::ostream &os, const FenwickByteL<BOUND, AT> &ft) {
-		os.write((char *)&ft.Size, sizeof(uint64_t));
-		os.write((char *)&ft.Levels, sizeof(uint64_t));
+		serialization::writeHeader(os, serialization::tag("FenwBytL"), {BOUND}, {ft.Size, ft.Levels});
 		for (size_t i = 0; i < ft.Levels; i++) os << ft.Tree[i];
 		return os;
 	}
 
 	friend std::istream &operator>>(std::istream &is, FenwickByteL<BOUND, AT> &ft) {
-		is.read((char *)&ft.Size, sizeof(uint64_t));
-		is.read((char *)&ft.Levels, sizeof(uint64_t));
+		uint64_t size, levels;
+		if (!serialization::readHeader(is, serialization::tag("FenwBytL"), {BOUND}, {&size, &levels})) return is;
+		ft.Size = size;
+		ft.Levels = levels;
 		for (size_t i = 0; i < ft.Levels; i++) is >> ft.Tree[i];
 		return is;
 	}
@@ -42,6 +42,7 @@ namespace sux::util {
 template <size_t BOUND, AllocType AT = MALLOC> class FenwickFixedF : public SearchablePrefixSums, public Expandable {
   public:
 	static constexpr size_t BOUNDSIZE = ceil_log2_plus1(BOUND);
+	static constexpr bool FENWICK = true;
 	static_assert(BOUNDSIZE >= 1 && BOUNDSIZE <= 64, "Leaves can't be stored in a 64-bit word");
 
   protected:
@@ -59,13 +60,10 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickFixedF : public Sear
 	 *
 	 * @param sequence a sequence of nonnegative integers smaller than or equal to the template parameter `BOUND`.
 	 * @param size the number of elements in the sequence.
+	 * @param num_threads the number of threads used to fill the tree.
 	 */
-	FenwickFixedF(uint64_t sequence[], size_t size) : Tree(pos(size) + 1), Size(size) {
-		for (size_t j = 1; j <= Size; j++) Tree[pos(j)] = sequence[j - 1];
-
-		for (size_t m = 2; m <= Size; m <<= 1) {
-			for (size_t idx = m; idx <= Size; idx += m) Tree[pos(idx)] += Tree[pos(idx - m / 2)];
-		}
+	FenwickFixedF(uint64_t sequence[], size_t size, size_t num_threads = 1) : Tree(pos(size) + 1), Size(size) {
+		fill(sequence, size, num_threads, false, [&](const size_t node, const uint64_t value) { Tree[pos(node)] = value; });
 	}
 
 	virtual uint64_t prefix(size_t idx) {
@@ -86,6 +84,18 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickFixedF : public Sear
 		}
 	}
 
+	virtual void prefix(const size_t *length, uint64_t *out, size_t n) {
+		batch_prefix(length, out, n, [&](const size_t node) { return Tree[pos(node)]; });
+	}
+
+	virtual void addBatch(const size_t *idx, const int64_t *inc, size_t n) {
+		batch_add(Size, idx, inc, n, [&](const size_t node, const int64_t c) { Tree[pos(node)] += c; });
+	}
+
+	virtual void rangeAdd(size_t from, size_t to, int64_t inc) {
+		range_add(Size, from, to, inc, [&](const size_t node, const int64_t c) { Tree[pos(node)] += c; });
+	}
+
 	using SearchablePrefixSums::find;
 	virtual size_t find(uint64_t *val) {
 		size_t node = 0;
@@ -128,7 +138,7 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickFixedF : public Sear
 		Tree[p] = val;
 
 		if ((Size & 1) == 0) {
-			for (size_t idx = Size - 1; rho(idx) < rho(Size); idx = clear_rho(idx)) Tree[p] += Tree[pos(idx)];
+			for (size_t idx = Size - 1; idx != 0 && rho(idx) < rho(Size); idx = clear_rho(idx)) Tree[p] += Tree[pos(idx)];
 		}
 	}
 
@@ -158,12 +168,14 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickFixedF : public Sear
 	static inline size_t pos(size_t idx) { return idx + holes(idx); }
 
 	friend std::ostream &operator<<(std::ostream &os, const FenwickFixedF<BOUND, AT> &ft) {
-		os.write((char *)&ft.Size, sizeof(uint64_t));
+		serialization::writeHeader(os, serialization::tag("FenwFixF"), {BOUND}, {ft.Size});
 		return os << ft.Tree;
 	}
 
 	friend std::istream &operator>>(std::istream &is, FenwickFixedF<BOUND, AT> &ft) {
-		is.read((char *)&ft.Size, sizeof(uint64_t));
+		uint64_t size;
+		if (!serialization::readHeader(is, serialization::tag("FenwFixF"), {BOUND}, {&size})) return is;
+		ft.Size = size;
 		return is >> ft.Tree;
 	}
 };
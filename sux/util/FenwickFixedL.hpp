@@ -42,6 +42,7 @@ namespace sux::util {
 template <size_t BOUND, AllocType AT = MALLOC> class FenwickFixedL : public SearchablePrefixSums, public Expandable {
   public:
 	static constexpr size_t BOUNDSIZE = ceil_log2_plus1(BOUND);
+	static constexpr bool FENWICK = true;
 	static_assert(BOUNDSIZE >= 1 && BOUNDSIZE <= 64, "Leaves can't be stored in a 64-bit word");
 
   protected:
@@ -59,22 +60,14 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickFixedL : public Sear
 	 *
 	 * @param sequence a sequence of nonnegative integers smaller than or equal to the template parameter `BOUND`.
 	 * @param size the number of elements in the sequence.
+	 * @param num_threads the number of threads used to fill the tree.
 	 */
-	FenwickFixedL(uint64_t sequence[], size_t size) : Levels(size != 0 ? lambda(size) + 1 : 1), Size(size) {
+	FenwickFixedL(uint64_t sequence[], size_t size, size_t num_threads = 1) : Levels(size != 0 ? lambda(size) + 1 : 1), Size(size) {
 		this->size(size ? size : 1);
-
-		for (size_t l = 0; l < Levels; l++) {
-			for (size_t node = 1ULL << l; node <= size; node += 1ULL << (l + 1)) {
-				size_t sequence_idx = node - 1;
-				uint64_t value = sequence[sequence_idx];
-				for (size_t j = 0; j < l; j++) {
-					sequence_idx >>= 1;
-					value += Tree[j][sequence_idx];
-				}
-
-				Tree[l][node >> (l + 1)] = value;
-			}
-		}
+		fill(sequence, size, num_threads, false, [&](const size_t node, const uint64_t value) {
+			const int height = rho(node);
+			Tree[height][node >> (1 + height)] = value;
+		});
 	}
 
 	virtual uint64_t prefix(size_t idx) {
@@ -101,6 +94,27 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickFixedL : public Sear
 		}
 	}
 
+	virtual void prefix(const size_t *length, uint64_t *out, size_t n) {
+		batch_prefix(length, out, n, [&](const size_t node) {
+			const int height = rho(node);
+			return Tree[height][node >> (1 + height)];
+		});
+	}
+
+	virtual void addBatch(const size_t *idx, const int64_t *inc, size_t n) {
+		batch_add(Size, idx, inc, n, [&](const size_t node, const int64_t c) {
+			const int height = rho(node);
+			Tree[height][node >> (1 + height)] += c;
+		});
+	}
+
+	virtual void rangeAdd(size_t from, size_t to, int64_t inc) {
+		range_add(Size, from, to, inc, [&](const size_t node, const int64_t c) {
+			const int height = rho(node);
+			Tree[height][node >> (1 + height)] += c;
+		});
+	}
+
 	using SearchablePrefixSums::find;
 	virtual size_t find(uint64_t *val) {
 		size_t node = 0, idx = 0;
@@ -202,15 +216,16 @@ template <size_t BOUND, AllocType AT = MALLOC> class FenwickFixedL : public Sear
 
   private:
 	friend std::ostream &operator<<(std::ostream &os, const FenwickFixedL<BOUND, AT> &ft) {
-		os.write((char *)&ft.Size, sizeof(uint64_t));
-		os.write((char *)&ft.Levels, sizeof(uint64_t));
-		for (size_t i = 0; i < 64; i++) os << ft.Tree[i];
+		serialization::writeHeader(os, serialization::tag("FenwFixL"), {BOUND}, {ft.Size, ft.Levels});
+		for (size_t i = 0; i < ft.Levels; i++) os << ft.Tree[i];
 		return os;
 	}
 
 	friend std::istream &operator>>(std::istream &is, FenwickFixedL<BOUND, AT> &ft) {
-		is.read((char *)&ft.Size, sizeof(uint64_t));
-		is.read((char *)&ft.Levels, sizeof(uint64_t));
+		uint64_t size, levels;
+		if (!serialization::readHeader(is, serialization::tag("FenwFixL"), {BOUND}, {&size, &levels})) return is;
+		ft.Size = size;
+		ft.Levels = levels;
 		for (size_t i = 0; i < ft.Levels; i++) is >> ft.Tree[i];
 		return is;
 	}
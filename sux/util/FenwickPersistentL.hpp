@@ -0,0 +1,273 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2019-2020 Stefano Marchini
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "CowVector.hpp"
+#include "SearchablePrefixSums.hpp"
+
+namespace sux::util {
+
+/** A byte-compressed Fenwick tree in level-order layout supporting constant-time snapshots.
+ *
+ * This tree is laid out as a FenwickByteL, but each level is stored in a CowVector,
+ * so snapshot() (or, equivalently, a copy) takes time proportional to the number of levels: the
+ * snapshot shares its pages with the original, and every modification of either copies
+ * only the pages it touches for the first time. A snapshot can thus be queried by a thread
+ * without locking while another thread keeps modifying the original; snapshot() itself must not
+ * be called concurrently with a modification.
+ *
+ * The price is an additional indirection per node when querying.
+ *
+ * Because of the static member PERSISTENT, sux::bits::WordDynRankSel and
+ * sux::bits::StrideDynRankSel store their bit vector in a CowVector, too,
+ * and they provide snapshots when they are based on this tree.
+ *
+ * @tparam BOUND maximum representable value (at most the maximum value of a `uint64_t`).
+ * @tparam AT a type of memory allocation out of ::AllocType (unused, as pages are allocated by CowVector).
+ */
+
+template <size_t BOUND, AllocType AT = MALLOC> class FenwickPersistentL : public SearchablePrefixSums, public Expandable {
+  public:
+	static constexpr size_t BOUNDSIZE = ceil_log2_plus1(BOUND);
+	static constexpr bool FENWICK = true;
+	static_assert(BOUNDSIZE >= 1 && BOUNDSIZE <= 64, "Leaves can't be stored in a 64-bit word");
+	static constexpr bool PERSISTENT = true;
+
+  protected:
+	CowVector Tree[64];
+	size_t Levels, Size;
+
+  public:
+	/** Creates a new instance with no values (empty tree). */
+	FenwickPersistentL() : Levels(0), Size(0) {
+		for (size_t i = 0; i < 64; i++) Tree[i] = CowVector(heightsize(i));
+	}
+
+	/** Creates a new instance with given vector of values.
+	 *
+	 * Note that the provided sequence is read at construction time but
+	 * it will not be referenced afterwards.
+	 *
+	 * @param sequence a sequence of nonnegative integers smaller than or equal to the template parameter `BOUND`.
+	 * @param size the number of elements in the sequence.
+	 * @param num_threads the number of threads used to fill the tree.
+	 */
+	FenwickPersistentL(uint64_t sequence[], size_t size, size_t num_threads = 1) : FenwickPersistentL() {
+		Levels = size != 0 ? lambda(size) + 1 : 1;
+		Size = size;
+		this->size(size ? size : 1);
+		fill(sequence, size, num_threads, true, [&](const size_t node, const uint64_t value) {
+			const int height = rho(node);
+			bytewrite(Tree[height].write(node >> (1 + height)), heightsize(height), value);
+		});
+	}
+
+	/** Returns a snapshot of this tree, which is not affected by subsequent modifications of this tree (and vice versa). */
+	FenwickPersistentL snapshot() const { return *this; }
+
+	virtual uint64_t prefix(size_t idx) {
+		uint64_t sum = 0;
+
+		while (idx != 0) {
+			sum += read(idx);
+			idx = clear_rho(idx);
+		}
+
+		return sum;
+	}
+
+	virtual void add(size_t idx, int64_t inc) {
+		while (idx <= Size) {
+			const int height = rho(idx);
+			bytewrite_inc(Tree[height].write(idx >> (1 + height)), inc);
+			idx += mask_rho(idx);
+		}
+	}
+
+	virtual void prefix(const size_t *length, uint64_t *out, size_t n) {
+		batch_prefix(length, out, n, [&](const size_t node) { return read(node); });
+	}
+
+	virtual void addBatch(const size_t *idx, const int64_t *inc, size_t n) {
+		batch_add(Size, idx, inc, n, [&](const size_t node, const int64_t c) {
+			const int height = rho(node);
+			bytewrite_inc(Tree[height].write(node >> (1 + height)), c);
+		});
+	}
+
+	virtual void rangeAdd(size_t from, size_t to, int64_t inc) {
+		range_add(Size, from, to, inc, [&](const size_t node, const int64_t c) {
+			const int height = rho(node);
+			bytewrite_inc(Tree[height].write(node >> (1 + height)), c);
+		});
+	}
+
+	using SearchablePrefixSums::find;
+	virtual size_t find(uint64_t *val) {
+		size_t node = 0, idx = 0;
+
+		for (size_t height = Levels - 1; height != SIZE_MAX; height--) {
+			const size_t pos = idx;
+
+			idx <<= 1;
+
+			if (pos >= Tree[height].size()) continue;
+
+			const uint64_t value = byteread(Tree[height].read(pos), heightsize(height));
+
+			if (*val >= value) {
+				idx++;
+				*val -= value;
+				node += 1ULL << height;
+			}
+		}
+
+		return min(node, Size);
+	}
+
+	using SearchablePrefixSums::compFind;
+	virtual size_t compFind(uint64_t *val) {
+		size_t node = 0, idx = 0;
+
+		for (size_t height = Levels - 1; height != SIZE_MAX; height--) {
+			const size_t pos = idx;
+
+			idx <<= 1;
+
+			if (pos >= Tree[height].size()) continue;
+
+			const uint64_t value = (BOUND << height) - byteread(Tree[height].read(pos), heightsize(height));
+
+			if (*val >= value) {
+				idx++;
+				*val -= value;
+				node += 1ULL << height;
+			}
+		}
+
+		return min(node, Size);
+	}
+
+	virtual void push(uint64_t val) {
+		Levels = lambda(++Size) + 1;
+
+		int height = rho(Size);
+		size_t idx = Size >> (1 + height);
+		size_t hisize = heightsize(height);
+
+		Tree[height].resize(idx + 1);
+		uint8_t *const high = Tree[height].write(idx);
+		bytewrite(high, hisize, val);
+
+		idx <<= 1;
+		for (size_t h = height - 1; h != SIZE_MAX; h--) {
+			bytewrite_inc(high, byteread(Tree[h].read(idx), heightsize(h)));
+			idx = (idx << 1) + 1;
+		}
+	}
+
+	virtual void pop() {
+		int height = rho(Size);
+		Tree[height].resize(Size >> (1 + height));
+		Size--;
+	}
+
+	/** Does nothing, as pages are allocated when needed. */
+	virtual void grow(size_t /*space*/) {}
+
+	/** Does nothing, as pages are allocated when needed. */
+	virtual void reserve(size_t /*space*/) {}
+
+	using Expandable::trimToFit;
+	/** Does nothing, as pages are allocated when needed. */
+	virtual void trim(size_t /*space*/) {}
+
+	virtual void resize(size_t space) {
+		size_t levels = lambda(space) + 1;
+		for (size_t i = 0; i < levels; i++) Tree[i].resize((space + (1ULL << i)) / (1ULL << (i + 1)));
+	}
+
+	virtual void size(size_t space) { resize(space); }
+
+	virtual size_t size() const { return Size; }
+
+	/** Returns an estimate of the size in bits of this tree, including pages shared with snapshots. */
+	virtual size_t bitCount() const {
+		size_t ret = sizeof(*this) * 8;
+		for (size_t i = 0; i < 64; i++) ret += Tree[i].bitCount() - sizeof(Tree[i]) * 8;
+		return ret;
+	}
+
+  private:
+	static inline size_t heightsize(size_t height) { return ((height + BOUNDSIZE - 1) >> 3) + 1; }
+
+	inline uint64_t read(const size_t idx) const {
+		const int height = rho(idx);
+		return byteread(Tree[height].read(idx >> (1 + height)), heightsize(height));
+	}
+
+	friend std::ostream &operator<<(std::ostream &os, const FenwickPersistentL<BOUND, AT> &ft) {
+		serialization::writeHeader(os, serialization::tag("FenwPerL"), {BOUND}, {ft.Size, ft.Levels});
+		for (size_t i = 0; i < ft.Levels; i++) {
+			const size_t isize = heightsize(i);
+			std::vector<uint8_t> level(ft.Tree[i].size() * isize);
+			for (size_t j = 0; j < ft.Tree[i].size(); j++) memcpy(&level[j * isize], ft.Tree[i].read(j), isize);
+			serialization::writeSection(os, level.data(), level.size());
+		}
+		return os;
+	}
+
+	friend std::istream &operator>>(std::istream &is, FenwickPersistentL<BOUND, AT> &ft) {
+		uint64_t size, levels;
+		if (!serialization::readHeader(is, serialization::tag("FenwPerL"), {BOUND}, {&size, &levels})) return is;
+		if (levels > 64) {
+			is.setstate(std::ios::failbit);
+			return is;
+		}
+		ft = FenwickPersistentL();
+		ft.Size = size;
+		ft.Levels = levels;
+		for (size_t i = 0; i < ft.Levels; i++) {
+			const size_t isize = heightsize(i);
+			uint64_t n, sum;
+			if (!serialization::readSectionHeader(is, sizeof(uint8_t), n, sum)) return is;
+			if (n % isize != 0) {
+				is.setstate(std::ios::failbit);
+				return is;
+			}
+			std::vector<uint8_t> level(n);
+			if (!serialization::readSectionData(is, level.data(), n, sum)) return is;
+			ft.Tree[i].resize(n / isize);
+			for (size_t j = 0; j < n / isize; j++) memcpy(ft.Tree[i].write(j), &level[j * isize], isize);
+		}
+		return is;
+	}
+};
+
+} // namespace sux::util
@@ -0,0 +1,89 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2019-2020 Stefano Marchini
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../support/Instrumentation.hpp"
+#include "../support/common.hpp"
+#include "SearchablePrefixSums.hpp"
+#include <cstdint>
+
+namespace sux::util {
+
+/** A Fenwick tree whose searches are instrumented.
+ *
+ * This class extends a Fenwick tree, overriding find() and compFind():
+ * for each search sampled by the instrumentation policy, it records the length of the search path, that
+ * is, the number of nodes of the tree read by the search. In a binary Fenwick tree (whatever its layout)
+ * this number depends only on the result and on the size of the tree, so it can be computed after the search;
+ * other implementations of SearchablePrefixSums, such as KaryPrefixSums, are not supported.
+ *
+ * @tparam SPS a Fenwick tree, that is, an implementation of SearchablePrefixSums with member FENWICK (e.g., FenwickByteL).
+ * @tparam INSTR an instrumentation policy out of those in sux::instrumentation.
+ */
+template <typename SPS, typename INSTR = instrumentation::None> class InstrumentedPrefixSums : public SPS {
+	static_assert(SPS::FENWICK, "Only the search paths of binary Fenwick trees can be instrumented");
+
+	INSTR instr;
+
+	// The number of nodes read by a search with given result: the node read at the level of m
+	// is the part of the result above m plus m, if it is in the tree
+	uint64_t path_length(const size_t result) const {
+		const size_t size = SPS::size();
+		uint64_t length = 0;
+		for (uint64_t m = size == 0 ? 0 : mask_lambda(size); m != 0; m >>= 1) length += (result & ~(2 * m - 1)) + m <= size;
+		return length;
+	}
+
+  public:
+	using SPS::SPS;
+	using SPS::compFind;
+	using SPS::find;
+
+	/** The counters recorded by the instrumentation policy, whose names are in COUNTER_NAMES. */
+	enum Counter { PATH_LENGTH };
+	static constexpr const char *COUNTER_NAMES[] = {"path_length"};
+
+	/** Returns the instrumentation policy of this instance, from which counters can be read. */
+	const INSTR &instrumentation() const { return instr; }
+
+	virtual size_t find(uint64_t *val) {
+		const size_t result = SPS::find(val);
+		if (instr.sample()) instr.record(PATH_LENGTH, path_length(result));
+		return result;
+	}
+
+	virtual size_t compFind(uint64_t *val) {
+		const size_t result = SPS::compFind(val);
+		if (instr.sample()) instr.record(PATH_LENGTH, path_length(result));
+		return result;
+	}
+};
+
+} // namespace sux::util
@@ -0,0 +1,285 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2019-2020 Stefano Marchini
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "SearchablePrefixSums.hpp"
+#include "Vector.hpp"
+
+namespace sux::util {
+
+/** A 16-ary searchable prefix-sum tree.
+ *
+ * Each node of the tree contains, for each of its sixteen children, the inclusive
+ * prefix sum of the values in the subtrees of the children up to that one; leaves
+ * contain prefix sums of the values of the sequence. Each level of the tree is stored
+ * in a separate array, and a node occupies 128 bytes, that is, two cache lines, which are
+ * aligned when using an allocation type based on `mmap()`.
+ *
+ * Thus, prefix(size_t) reads one word per level, and find(uint64_t *) and compFind(uint64_t *)
+ * compare the bound with a node per level (using AVX-512, if available, as updates do), so that they
+ * cause about log<sub>16</sub> _n_ cache misses instead of the log<sub>2</sub> _n_ of a Fenwick
+ * tree. Updates are more expensive, as they add the increment to all entries of a node
+ * from the one of the updated child on.
+ *
+ * @tparam BOUND maximum representable value (at most the maximum value of a `uint64_t`).
+ * @tparam AT a type of memory allocation out of ::AllocType.
+ */
+
+template <size_t BOUND, AllocType AT = MALLOC> class KaryPrefixSums : public SearchablePrefixSums, public Expandable {
+  public:
+	static constexpr size_t BOUNDSIZE = ceil_log2_plus1(BOUND);
+	static_assert(BOUNDSIZE >= 1 && BOUNDSIZE <= 64, "Leaves can't be stored in a 64-bit word");
+
+  private:
+	static constexpr int LOG2_ARITY = 4;
+	static constexpr size_t ARITY = 1 << LOG2_ARITY;
+	static constexpr int MAX_LEVELS = 64 / LOG2_ARITY;
+
+  protected:
+	Vector<uint64_t, AT> Tree[MAX_LEVELS];
+	size_t Levels, Size;
+
+  public:
+	/** Creates a new instance with no values (empty tree). */
+	KaryPrefixSums() : Levels(1), Size(0) {}
+
+	/** Creates a new instance with given vector of values.
+	 *
+	 * Note that the provided sequence is read at construction time but
+	 * it will not be referenced afterwards.
+	 *
+	 * @param sequence a sequence of nonnegative integers smaller than or equal to the template parameter `BOUND`.
+	 * @param size the number of elements in the sequence.
+	 */
+	KaryPrefixSums(uint64_t sequence[], size_t size) : Levels(levels(size)), Size(size) {
+		this->size(size);
+
+		for (size_t i = 0; i < size; i++) Tree[0][i] = sequence[i];
+
+		for (size_t l = 0; l < Levels; l++) {
+			// The values of the nodes of a level are the totals of the nodes of the level below
+			if (l != 0)
+				for (size_t child = 0; child < Tree[l - 1].size() / ARITY; child++) Tree[l][child] = Tree[l - 1][child * ARITY + ARITY - 1];
+
+			for (size_t node = 0; node < Tree[l].size(); node += ARITY)
+				for (size_t j = 1; j < ARITY; j++) Tree[l][node + j] += Tree[l][node + j - 1];
+		}
+	}
+
+	virtual uint64_t prefix(size_t length) {
+		uint64_t sum = 0;
+
+		for (size_t l = Levels - 1; l != SIZE_MAX; l--) {
+			// The prefix contains the children of its node before this one
+			const size_t child = length >> (LOG2_ARITY * l);
+			if (child % ARITY != 0) sum += Tree[l][child - 1];
+		}
+
+		return sum;
+	}
+
+	virtual void add(size_t idx, int64_t inc) {
+		for (size_t l = 0; l < Levels; l++) {
+			const size_t child = (idx - 1) >> (LOG2_ARITY * l);
+			uint64_t *const node = &Tree[l] + (child & ~(ARITY - 1));
+			const size_t first = child % ARITY;
+#ifdef __AVX512F__
+			const __m512i v = _mm512_set1_epi64(inc);
+			const __mmask16 mask = 0xFFFF << first;
+			_mm512_storeu_si512(node, _mm512_mask_add_epi64(_mm512_loadu_si512(node), mask, _mm512_loadu_si512(node), v));
+			_mm512_storeu_si512(node + 8, _mm512_mask_add_epi64(_mm512_loadu_si512(node + 8), mask >> 8, _mm512_loadu_si512(node + 8), v));
+#else
+			for (size_t j = first; j < ARITY; j++) node[j] += inc;
+#endif
+		}
+	}
+
+	virtual void prefix(const size_t *length, uint64_t *out, size_t n) {
+		for (size_t i = 0; i < n; i++) out[i] = prefix(length[i]);
+	}
+
+	virtual void addBatch(const size_t *idx, const int64_t *inc, size_t n) {
+		// Consecutive sorted indices share most of their nodes, which are thus in cache
+		for (size_t i = 0; i < n; i++) add(idx[i], inc[i]);
+	}
+
+	virtual void rangeAdd(size_t from, size_t to, int64_t inc) {
+		if (from >= to) return;
+
+		for (size_t l = 0; l < Levels; l++) {
+			const size_t shift = LOG2_ARITY * l;
+			// From the child containing the first element to the end of the node of the child containing the last one
+			const size_t last = ((to - 1) >> shift) | (ARITY - 1);
+			for (size_t child = from >> shift; child <= last; child++) {
+				const size_t begin = max((child & ~(ARITY - 1)) << shift, from), end = min((child + 1) << shift, to);
+				Tree[l][child] += inc * int64_t(end - begin);
+			}
+		}
+	}
+
+	using SearchablePrefixSums::find;
+	virtual size_t find(uint64_t *val) {
+		if (Size == 0) return 0;
+		size_t child = 0;
+
+		for (size_t l = Levels - 1; l != SIZE_MAX; l--) {
+			const uint64_t *const node = &Tree[l] + child * ARITY;
+			const size_t limit = children(child, l);
+			const size_t count = min(countLeq(node, *val), limit);
+
+			if (count != 0) *val -= node[count - 1];
+			// All children of the node up to the end of the sequence are in the prefix
+			if (count == limit) return Size;
+			child = child * ARITY + count;
+		}
+
+		return child;
+	}
+
+	using SearchablePrefixSums::compFind;
+	virtual size_t compFind(uint64_t *val) {
+		if (Size == 0) return 0;
+		size_t child = 0;
+
+		for (size_t l = Levels - 1; l != SIZE_MAX; l--) {
+			const uint64_t *const node = &Tree[l] + child * ARITY;
+			const size_t limit = children(child, l);
+			const size_t start = (child * ARITY) << (LOG2_ARITY * l);
+			uint64_t comp[ARITY];
+			size_t count = 0;
+
+			for (size_t j = 0; j < ARITY; j++) {
+				comp[j] = BOUND * (min((child * ARITY + j + 1) << (LOG2_ARITY * l), Size) - start) - node[j];
+				count += comp[j] <= *val;
+			}
+
+			count = min(count, limit);
+			if (count != 0) *val -= comp[count - 1];
+			if (count == limit) return Size;
+			child = child * ARITY + count;
+		}
+
+		return child;
+	}
+
+	virtual void push(uint64_t val) {
+		if (levels(++Size) > Levels) {
+			// The old root becomes the first child of the new one
+			const uint64_t total = Tree[Levels - 1][ARITY - 1];
+			Tree[Levels].resize(max(Tree[Levels].size(), ARITY));
+			for (size_t j = 0; j < ARITY; j++) Tree[Levels][j] = total;
+			Levels++;
+		}
+
+		for (size_t l = 0; l < Levels; l++) Tree[l].resize(max(Tree[l].size(), entries(Size, l)));
+
+		add(Size, val);
+	}
+
+	virtual void pop() {
+		const size_t e = Size - 1;
+		const uint64_t val = Tree[0][e] - (e % ARITY != 0 ? Tree[0][e - 1] : 0);
+		add(Size--, -val);
+	}
+
+	virtual void grow(size_t space) {
+		for (size_t l = 0; l < levels(space); l++) Tree[l].grow(entries(space, l));
+	}
+
+	virtual void reserve(size_t space) {
+		for (size_t l = 0; l < levels(space); l++) Tree[l].reserve(entries(space, l));
+	}
+
+	using Expandable::trimToFit;
+	virtual void trim(size_t space) {
+		for (size_t l = 0; l < levels(space); l++) Tree[l].trim(entries(space, l));
+	}
+
+	virtual void resize(size_t space) {
+		for (size_t l = 0; l < levels(space); l++) Tree[l].resize(entries(space, l));
+	}
+
+	virtual void size(size_t space) {
+		for (size_t l = 0; l < levels(space); l++) Tree[l].size(entries(space, l));
+	}
+
+	virtual size_t size() const { return Size; }
+
+	virtual size_t bitCount() const {
+		size_t ret = sizeof(*this) * 8;
+		for (size_t i = 0; i < MAX_LEVELS; i++) ret += Tree[i].bitCount() - sizeof(Tree[i]) * 8;
+		return ret;
+	}
+
+  private:
+	// The number of levels of a tree whose root has a child beyond the given number of elements
+	static size_t levels(size_t size) { return size == 0 ? 1 : lambda(size) / LOG2_ARITY + 1; }
+
+	// The number of entries of a level of a tree containing the given number of elements, plus one
+	static size_t entries(size_t size, size_t level) {
+		const size_t shift = LOG2_ARITY * (level + 1);
+		return ((shift < 64 ? size >> shift : 0) + 1) * ARITY;
+	}
+
+	// The number of children of a (nonempty) node of a level that start before the end of the sequence
+	size_t children(size_t node, size_t level) const { return min(((Size - 1) >> (LOG2_ARITY * level)) + 1 - node * ARITY, ARITY); }
+
+	// The number of entries of a node smaller than or equal to a given value
+	static size_t countLeq(const uint64_t *node, uint64_t val) {
+		static_assert(ARITY == 16, "The comparison is on two vectors of eight words");
+#ifdef __AVX512F__
+		const __m512i v = _mm512_set1_epi64(val);
+		return __builtin_popcount(_mm512_cmple_epu64_mask(_mm512_loadu_si512(node), v)) + __builtin_popcount(_mm512_cmple_epu64_mask(_mm512_loadu_si512(node + 8), v));
+#else
+		size_t count = 0;
+		for (size_t j = 0; j < ARITY; j++) count += node[j] <= val;
+		return count;
+#endif
+	}
+
+	friend std::ostream &operator<<(std::ostream &os, const KaryPrefixSums<BOUND, AT> &ps) {
+		serialization::writeHeader(os, serialization::tag("KaryPSum"), {BOUND}, {ps.Size, ps.Levels});
+		for (size_t i = 0; i < ps.Levels; i++) os << ps.Tree[i];
+		return os;
+	}
+
+	friend std::istream &operator>>(std::istream &is, KaryPrefixSums<BOUND, AT> &ps) {
+		uint64_t size, levels;
+		if (!serialization::readHeader(is, serialization::tag("KaryPSum"), {BOUND}, {&size, &levels})) return is;
+		if (levels > MAX_LEVELS) {
+			is.setstate(std::ios::failbit);
+			return is;
+		}
+		ps.Size = size;
+		ps.Levels = levels;
+		for (size_t i = 0; i < ps.Levels; i++) is >> ps.Tree[i];
+		return is;
+	}
+};
+
+} // namespace sux::util
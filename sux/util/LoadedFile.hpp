@@ -0,0 +1,129 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2019-2020 Stefano Marchini
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Vector.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace sux::util {
+
+/** A private, prefaulted in-memory copy of a file, possibly on huge pages.
+ *
+ * Differently from MappedFile, the whole file is read at construction into anonymous memory
+ * of the final size, which is allocated in one go and, depending on the allocation type,
+ * backed by huge pages. The file is read with large sequential reads using `O_DIRECT`,
+ * which bypasses the page cache, falling back to buffered reads if the file system does not
+ * support it (or if `AT` is ::MALLOC). Since all pages are written during the load, no page
+ * fault happens afterwards, and data structures can be queried at full speed immediately
+ * using their `view()` method:
+ *
+ *     util::LoadedFile<util::TRANSHUGEPAGE> file("mphf.bin");
+ *     RecSplit<8> rs;
+ *     if (rs.view(file.data(), file.end()) == nullptr) ... // Invalid file
+ *
+ * The instance must outlive all views of its data.
+ *
+ * @tparam AT a type of memory allocation out of sux::util::AllocType; ::TRANSHUGEPAGE and ::FORCEHUGEPAGE
+ * reduce TLB misses on large structures.
+ */
+template <AllocType AT = TRANSHUGEPAGE> class LoadedFile {
+	// The alignment of O_DIRECT transfers, and their maximum length
+	static constexpr size_t BLOCK = 4096, CHUNK = 64 * 1024 * 1024;
+
+	Vector<char, AT> buffer;
+	size_t _size = 0;
+
+  public:
+	LoadedFile() = default;
+
+	/** Loads the given file.
+	 *
+	 * @param filename the name of a file.
+	 */
+	explicit LoadedFile(const char *filename) {
+		// O_DIRECT needs page-aligned memory, which malloc() does not provide
+		int fd = AT == MALLOC ? -1 : open(filename, O_RDONLY | O_DIRECT);
+		bool direct = fd != -1;
+		if (!direct) fd = open(filename, O_RDONLY);
+		if (fd == -1) {
+			fprintf(stderr, "Cannot open file %s\n", filename);
+			abort();
+		}
+		struct stat st;
+		if (fstat(fd, &st) == -1) {
+			fprintf(stderr, "Cannot stat file %s\n", filename);
+			abort();
+		}
+		_size = st.st_size;
+		// O_DIRECT transfers must cover whole blocks, also at the end of the file
+		buffer.size((_size + BLOCK - 1) / BLOCK * BLOCK);
+		if (!direct) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+		size_t done = 0;
+		while (done < _size) {
+			const ssize_t r = pread(fd, &buffer + done, std::min(CHUNK, buffer.size() - done), done);
+			if (r < 0 && direct) {
+				// Some file systems accept O_DIRECT at open time, but not when reading
+				close(fd);
+				if ((fd = open(filename, O_RDONLY)) == -1) {
+					fprintf(stderr, "Cannot open file %s\n", filename);
+					abort();
+				}
+				direct = false;
+				continue;
+			}
+			if (r <= 0) {
+				fprintf(stderr, "Cannot read file %s\n", filename);
+				abort();
+			}
+			done += r;
+		}
+		close(fd);
+	}
+
+	/** Returns a pointer to the start of the data, which is aligned to a memory page, or `nullptr` if the file is empty. */
+	const char *data() const { return _size == 0 ? nullptr : &buffer; }
+
+	/** Returns a pointer to the end of the data. */
+	const char *end() const { return data() + _size; }
+
+	/** Returns the size of the loaded file in bytes. */
+	size_t size() const { return _size; }
+};
+
+} // namespace sux::util
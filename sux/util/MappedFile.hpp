@@ -0,0 +1,124 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2019-2020 Stefano Marchini
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace sux::util {
+
+/** A read-only memory mapping of a file.
+ *
+ * The file is mapped with `MAP_SHARED`, so processes mapping the same file share
+ * its pages through the page cache. Data structures serialized with `<<` can be
+ * queried directly from the mapping using their `view()` method, for example
+ *
+ *     util::MappedFile file("mphf.bin");
+ *     RecSplit<8> rs;
+ *     if (rs.view(file.data(), file.end()) == nullptr) ... // Invalid file
+ *
+ * Pages are read from the file when first accessed, so the first queries on a large
+ * structure are slowed down by page faults; if the file is mapped with the `populate`
+ * option, the whole file is read and mapped at construction instead. See also
+ * LoadedFile, which loads a private copy of a file, possibly on huge pages.
+ *
+ * The instance must outlive all views of its data.
+ */
+
+class MappedFile {
+	void *map = MAP_FAILED;
+	size_t _size = 0;
+
+  public:
+	MappedFile() = default;
+
+	/** Maps the given file.
+	 *
+	 * @param filename the name of a file.
+	 * @param populate whether to read the whole file and map all of its pages immediately (`MAP_POPULATE`).
+	 */
+	explicit MappedFile(const char *filename, const bool populate = false) {
+		const int fd = open(filename, O_RDONLY);
+		if (fd == -1) {
+			fprintf(stderr, "Cannot open file %s\n", filename);
+			abort();
+		}
+		struct stat st;
+		if (fstat(fd, &st) == -1) {
+			fprintf(stderr, "Cannot stat file %s\n", filename);
+			abort();
+		}
+		_size = st.st_size;
+		if (_size != 0) {
+#ifdef MAP_POPULATE
+			map = mmap(nullptr, _size, PROT_READ, MAP_SHARED | (populate ? MAP_POPULATE : 0), fd, 0);
+#else
+			map = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+#endif
+			if (map == MAP_FAILED) {
+				fprintf(stderr, "Cannot map file %s\n", filename);
+				abort();
+			}
+			if (populate) madvise(map, _size, MADV_WILLNEED);
+		}
+		close(fd);
+	}
+
+	~MappedFile() {
+		if (map != MAP_FAILED) munmap(map, _size);
+	}
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	MappedFile(MappedFile &&oth) : map(std::exchange(oth.map, MAP_FAILED)), _size(std::exchange(oth._size, 0)) {}
+
+	MappedFile &operator=(MappedFile &&oth) {
+		std::swap(map, oth.map);
+		std::swap(_size, oth._size);
+		return *this;
+	}
+
+	/** Returns a pointer to the start of the mapping, which is aligned to a memory page. */
+	const char *data() const { return map == MAP_FAILED ? nullptr : (const char *)map; }
+
+	/** Returns a pointer to the end of the mapping. */
+	const char *end() const { return data() + _size; }
+
+	/** Returns the size of the mapped file in bytes. */
+	size_t size() const { return _size; }
+};
+
+} // namespace sux::util
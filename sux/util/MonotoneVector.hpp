@@ -0,0 +1,125 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2007-2020 Sebastiano Vigna
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../bits/EliasFano.hpp"
+#include "../support/common.hpp"
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+namespace sux::util {
+
+/** A vector of nondecreasing integers stored in the Elias-Fano representation.
+ *
+ * This class is a thin wrapper around bits::EliasFano exposing the represented sequence as
+ * a vector (e.g., an array of offsets): get() is a selection, and decode() uses an
+ * EliasFano::Iterator, which decodes the upper bits a word at a time. The space
+ * used is about 2 + log(<var>u</var> / <var>n</var>) bits per element, where <var>u</var> is the last
+ * element and <var>n</var> the number of elements.
+ *
+ * @tparam AT a type of memory allocation out of util::AllocType.
+ */
+
+template <util::AllocType AT = util::AllocType::MALLOC> class MonotoneVector {
+	bits::EliasFano<AT> ef;
+
+	static bits::EliasFano<AT> build(const uint64_t *const values, const size_t length) {
+		assert(length == 0 || values[length - 1] < UINT64_MAX);
+		typename bits::EliasFano<AT>::Builder builder(length, length == 0 ? 0 : values[length - 1] + 1);
+		for (size_t i = 0; i < length; i++) builder.push(values[i]);
+		return builder.build();
+	}
+
+	friend std::ostream &operator<<(std::ostream &os, const MonotoneVector<AT> &mv) { return os << mv.ef; }
+
+	friend std::istream &operator>>(std::istream &is, MonotoneVector<AT> &mv) { return is >> mv.ef; }
+
+  public:
+	/** Creates an empty vector, which can be filled using operator>>() or view(). */
+	MonotoneVector() {}
+
+	/** Creates a vector containing given values.
+	 *
+	 * @param values nondecreasing values smaller than `UINT64_MAX`.
+	 * @param length the number of values.
+	 */
+	MonotoneVector(const uint64_t *const values, const size_t length) : ef(build(values, length)) {}
+
+	/** Creates a vector containing given values.
+	 *
+	 * @param values nondecreasing values smaller than `UINT64_MAX`.
+	 */
+	MonotoneVector(const std::vector<uint64_t> &values) : MonotoneVector(values.data(), values.size()) {}
+
+	/** Makes this instance a read-only view of an instance serialized by operator<<().
+	 *
+	 * @param p a pointer to the serialized instance, aligned to 8 bytes, or `nullptr`.
+	 * @param end a pointer to the end of the available data.
+	 * @param check whether to verify the checksums of the data.
+	 * @return a pointer just after the serialized instance, or `nullptr` if `p` is `nullptr`
+	 * or the data is not valid.
+	 */
+	const char *view(const char *p, const char *end, const bool check = false) { return ef.view(p, end, check); }
+
+	/** Returns the element of given index. */
+	uint64_t get(const size_t i) {
+		assert(i < size());
+		return ef.select(i);
+	}
+
+	/** Returns the elements of given indices, prefetching the data needed by several queries at a time.
+	 *
+	 * @param index the indices.
+	 * @param out an array where the elements will be stored.
+	 * @param n the number of indices.
+	 */
+	void get(const uint64_t *index, uint64_t *out, const size_t n) { ef.select(index, out, n); }
+
+	/** Decodes a range of consecutive elements.
+	 *
+	 * @param from the index of the first element.
+	 * @param to the index after the last element.
+	 * @param out an array of at least `to - from` elements where the elements will be stored.
+	 */
+	void decode(size_t from, const size_t to, uint64_t *out) const {
+		assert(from <= to && to <= size());
+		for (auto it = ef.iterator(from); from < to; from++, ++it) *out++ = *it;
+	}
+
+	/** Returns the number of elements. */
+	size_t size() const { return ef.end().index(); }
+
+	/** Returns an estimate of the size in bits of this structure. */
+	size_t bitCount() { return ef.bitCount() - sizeof(ef) * 8 + sizeof(*this) * 8; }
+};
+
+} // namespace sux::util
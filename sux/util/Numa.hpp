@@ -0,0 +1,201 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2019-2020 Stefano Marchini
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace sux::util {
+
+/** NUMA placement of memory on Linux.
+ *
+ * Memory is placed using the `set_mempolicy()` and `mbind()` system calls directly, so
+ * there is no dependency on `libnuma`. On systems without NUMA support all functions
+ * degrade gracefully: there is a single node, and placement requests fail harmlessly.
+ *
+ * Since all structures allocate their memory through util::Vector, the simplest way to
+ * place a whole structure is building or loading it within the scope of a NumaScope,
+ * which sets the policy of the calling thread; for example,
+ *
+ *     {
+ *         util::NumaScope interleave; // Interleave pages on all nodes
+ *         fs >> rs;
+ *     }
+ *
+ * NumaReplicas builds instead a replica of a read-mostly structure on each node, and
+ * returns the replica local to the calling thread.
+ */
+namespace numa {
+
+// Memory policies and flags from <linux/mempolicy.h>, renamed to avoid clashes with the macros of <numaif.h>
+static constexpr int POLICY_DEFAULT = 0, POLICY_BIND = 2, POLICY_INTERLEAVE = 3;
+static constexpr unsigned FLAG_MOVE = 1 << 1;
+static constexpr unsigned long FLAG_MEMS_ALLOWED = 1 << 2;
+static constexpr size_t MAX_NODES = 1024;
+
+/** Returns the number of NUMA nodes, that is, one plus the largest node on which this process can allocate memory. */
+inline int nodes() {
+#ifdef SYS_get_mempolicy
+	unsigned long mask[MAX_NODES / 64] = {};
+	if (syscall(SYS_get_mempolicy, nullptr, mask, MAX_NODES, nullptr, FLAG_MEMS_ALLOWED) == 0)
+		for (int i = MAX_NODES / 64; i-- != 0;)
+			if (mask[i] != 0) return i * 64 + 64 - __builtin_clzl(mask[i]);
+#endif
+	return 1;
+}
+
+/** Returns the NUMA node of the CPU on which the calling thread is running. */
+inline int node() {
+#ifdef SYS_getcpu
+	unsigned cpu, node;
+	if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) return node;
+#endif
+	return 0;
+}
+
+// The node mask containing a given node, or all nodes if node is negative
+inline std::vector<unsigned long> mask(const int node) {
+	std::vector<unsigned long> mask(MAX_NODES / 64);
+	if (node >= 0)
+		mask[node / 64] = 1UL << node % 64;
+	else
+		for (int i = 0; i < nodes(); i++) mask[i / 64] |= 1UL << i % 64;
+	return mask;
+}
+
+/** Places (and, if necessary, moves) existing memory on the given node, or interleaves it on all nodes.
+ *
+ * The placement applies to all memory pages overlapping the given range.
+ *
+ * @param addr the start of the memory range.
+ * @param bytes the length in bytes of the memory range.
+ * @param node a node, or -1 to interleave pages on all nodes.
+ * @return true if the memory has been placed.
+ */
+inline bool place(const void *addr, const size_t bytes, const int node) {
+#ifdef SYS_mbind
+	if (bytes == 0) return true;
+	const uintptr_t page = sysconf(_SC_PAGESIZE), start = uintptr_t(addr) & ~(page - 1);
+	const auto m = mask(node);
+	return syscall(SYS_mbind, start, uintptr_t(addr) + bytes - start, node < 0 ? POLICY_INTERLEAVE : POLICY_BIND, m.data(), MAX_NODES, FLAG_MOVE) == 0;
+#else
+	return false;
+#endif
+}
+
+} // namespace numa
+
+/** Sets the NUMA memory policy of the calling thread for the lifetime of the instance.
+ *
+ * Within the scope of an instance, memory first touched by the calling thread is allocated on a
+ * given node, or interleaved on all nodes. The default policy is restored by the destructor.
+ */
+class NumaScope {
+	bool set = false;
+
+  public:
+	/** Interleaves the memory allocated by the calling thread on all nodes. */
+	NumaScope() : NumaScope(-1) {}
+
+	/** Allocates the memory allocated by the calling thread on the given node, or interleaves it on all nodes.
+	 *
+	 * @param node a node, or -1 to interleave on all nodes.
+	 */
+	explicit NumaScope(const int node) {
+#ifdef SYS_set_mempolicy
+		const auto m = numa::mask(node);
+		set = syscall(SYS_set_mempolicy, node < 0 ? numa::POLICY_INTERLEAVE : numa::POLICY_BIND, m.data(), numa::MAX_NODES) == 0;
+#endif
+	}
+
+	~NumaScope() {
+#ifdef SYS_set_mempolicy
+		if (set) syscall(SYS_set_mempolicy, numa::POLICY_DEFAULT, nullptr, 0);
+#endif
+	}
+
+	NumaScope(const NumaScope &) = delete;
+	NumaScope &operator=(const NumaScope &) = delete;
+
+	/** Returns whether the policy has been set (it is not on systems without NUMA support). */
+	bool isSet() const { return set; }
+};
+
+/** A replica of a read-mostly structure on each NUMA node.
+ *
+ * Each replica is built by a thread whose memory is bound to a node, so all memory
+ * allocated during the construction of the replica is local to the node. Threads
+ * use local() to access the replica on their node; for example,
+ *
+ *     util::NumaReplicas<RecSplit<8>> replicas([&] {
+ *         auto rs = std::make_unique<RecSplit<8>>();
+ *         std::ifstream fs("mphf.bin");
+ *         fs >> *rs;
+ *         return rs;
+ *     });
+ *     ...
+ *     replicas.local()(key);
+ *
+ * @tparam T the type of the replicated structure.
+ */
+template <typename T> class NumaReplicas {
+	std::vector<std::unique_ptr<T>> replicas;
+
+  public:
+	/** Builds a replica on each node.
+	 *
+	 * @param build a function returning a `std::unique_ptr` to a new instance of `T`; it is
+	 * called concurrently, once on each node.
+	 */
+	template <typename F> explicit NumaReplicas(F &&build) : replicas(numa::nodes()) {
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < replicas.size(); i++)
+			threads.emplace_back([&, i] {
+				NumaScope scope(i);
+				replicas[i] = build();
+			});
+		for (auto &t : threads) t.join();
+	}
+
+	/** Returns the replica on the node of the calling thread. */
+	T &local() const { return *replicas[numa::node() % replicas.size()]; }
+
+	/** Returns the replica on a given node. */
+	T &operator[](const size_t node) const { return *replicas[node]; }
+
+	/** Returns the number of replicas. */
+	size_t size() const { return replicas.size(); }
+};
+
+} // namespace sux::util
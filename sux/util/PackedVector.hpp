@@ -0,0 +1,192 @@
+/*
+ * Sux: Succinct data structures
+ *
+ * Copyright (C) 2007-2020 Sebastiano Vigna
+ *
+ *  This library is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License as published by the Free
+ *  Software Foundation; either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * Under Section 7 of GPL version 3, you are granted additional permissions
+ * described in the GCC Runtime Library Exception, version 3.1, as published by
+ * the Free Software Foundation.
+ *
+ * You should have received a copy of the GNU General Public License and a copy of
+ * the GCC Runtime Library Exception along with this program; see the files
+ * COPYING3 and COPYING.RUNTIME respectively.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../support/common.hpp"
+#include "Vector.hpp"
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace sux::util {
+
+/** A vector of integers of fixed bit width, packed one after the other in an array of words.
+ *
+ * The bit width can be fixed at compile time, with the `WIDTH` template parameter, or at
+ * construction time, if `WIDTH` is zero. Elements can be read with get() in constant time, and
+ * ranges of consecutive elements can be decoded in bulk with decode(), which, if AVX2 is available,
+ * unpacks four elements at a time. For monotone sequences, see MonotoneVector.
+ *
+ * @tparam WIDTH the bit width of the elements (at most 64), or 0 to specify it at construction time.
+ * @tparam AT a type of memory allocation out of util::AllocType.
+ */
+
+template <int WIDTH = 0, util::AllocType AT = util::AllocType::MALLOC> class PackedVector {
+	static_assert(WIDTH >= 0 && WIDTH <= 64, "The bit width must be at most 64");
+
+	uint64_t length = 0, width = WIDTH;
+	// The elements, followed by a word of padding, so that bitread() can always read two words and
+	// decode() can read eight bytes starting at the first byte of any element
+	util::Vector<uint64_t, AT> data;
+
+	static size_t words(const uint64_t length, const uint64_t width) { return (length * width + 63) / 64 + 1; }
+
+	int w() const { return WIDTH != 0 ? WIDTH : width; }
+
+	// Reads eight bytes starting at a given byte of the data
+	uint64_t read(const uint64_t byte) const {
+		uint64_t t;
+		memcpy(&t, (const char *)&data + byte, sizeof t);
+		return t;
+	}
+
+	bool valid() const { return width >= 1 && width <= 64 && (WIDTH == 0 || width == WIDTH) && data.size() == words(length, width); }
+
+	friend std::ostream &operator<<(std::ostream &os, const PackedVector<WIDTH, AT> &pv) {
+		serialization::writeHeader(os, serialization::tag("PackedVc"), {WIDTH}, {pv.length, pv.width});
+		return os << pv.data;
+	}
+
+	friend std::istream &operator>>(std::istream &is, PackedVector<WIDTH, AT> &pv) {
+		if (!serialization::readHeader(is, serialization::tag("PackedVc"), {WIDTH}, {&pv.length, &pv.width})) return is;
+		is >> pv.data;
+		if (is && !pv.valid()) is.setstate(std::ios::failbit);
+		return is;
+	}
+
+  public:
+	/** Creates an empty vector, which can be filled using operator>>() or view(). */
+	PackedVector() {}
+
+	/** Creates a vector of given length whose elements are zero.
+	 *
+	 * @param length the number of elements.
+	 * @param width the bit width of the elements, between 1 and 64; it must be equal to `WIDTH` if the latter is not zero.
+	 */
+	PackedVector(const size_t length, const int width = WIDTH) : length(length), width(width) {
+		assert(width >= 1 && width <= 64);
+		assert(WIDTH == 0 || width == WIDTH);
+		data.size(words(length, width));
+	}
+
+	/** Creates a vector containing given values.
+	 *
+	 * @param values the values.
+	 * @param width the bit width of the elements, or 0 to use the smallest width sufficient for
+	 * the values; it must be equal to `WIDTH` if the latter is not zero.
+	 */
+	PackedVector(const std::vector<uint64_t> &values, int width = WIDTH) : length(values.size()) {
+		if (width == 0) {
+			uint64_t max = 0;
+			for (const uint64_t v : values) max |= v;
+			width = max == 0 ? 1 : lambda(max) + 1;
+		}
+		assert(width >= 1 && width <= 64);
+		assert(WIDTH == 0 || width == WIDTH);
+		this->width = width;
+		data.size(words(length, width));
+		for (size_t i = 0; i < length; i++) set(i, values[i]);
+	}
+
+	/** Makes this instance a read-only view of an instance serialized by operator<<().
+	 *
+	 * @param p a pointer to the serialized instance, aligned to 8 bytes, or `nullptr`.
+	 * @param end a pointer to the end of the available data.
+	 * @param check whether to verify the checksum of the data.
+	 * @return a pointer just after the serialized instance, or `nullptr` if `p` is `nullptr`
+	 * or the data is not valid.
+	 */
+	const char *view(const char *p, const char *end, const bool check = false) {
+		p = data.view(serialization::viewHeader(p, end, serialization::tag("PackedVc"), {WIDTH}, {&length, &width}), end, check);
+		return p == nullptr || !valid() ? nullptr : p;
+	}
+
+	/** Returns the element of given index. */
+	uint64_t get(const size_t i) const {
+		assert(i < length);
+		const uint64_t pos = uint64_t(i) * w();
+		return bitread(&data + pos / 64, pos % 64, w());
+	}
+
+	/** Sets the element of given index.
+	 *
+	 * @param i an index.
+	 * @param value a value fitting the bit width.
+	 */
+	void set(const size_t i, const uint64_t value) {
+		assert(i < length);
+		const uint64_t pos = uint64_t(i) * w();
+		bitwrite(&data + pos / 64, pos % 64, w(), value);
+	}
+
+	/** Decodes a range of consecutive elements.
+	 *
+	 * @param from the index of the first element.
+	 * @param to the index after the last element.
+	 * @param out an array of at least `to - from` elements where the elements will be stored.
+	 */
+	void decode(size_t from, const size_t to, uint64_t *out) const {
+		assert(from <= to && to <= length);
+		const int w = this->w();
+		if (w > 57) {
+			for (; from < to; from++) *out++ = get(from);
+			return;
+		}
+
+		// Each element lies within the eight bytes starting at its first byte
+		const uint64_t mask = (UINT64_C(1) << w) - 1;
+#ifdef SUX_AVX2
+		const __m256i m = _mm256_set1_epi64x(mask);
+		for (; from + 4 <= to; from += 4, out += 4) {
+			const uint64_t p0 = uint64_t(from) * w, p1 = p0 + w, p2 = p1 + w, p3 = p2 + w;
+			const __m256i v = _mm256_set_epi64x(read(p3 / 8), read(p2 / 8), read(p1 / 8), read(p0 / 8));
+			const __m256i s = _mm256_set_epi64x(p3 % 8, p2 % 8, p1 % 8, p0 % 8);
+			_mm256_storeu_si256((__m256i *)out, _mm256_and_si256(_mm256_srlv_epi64(v, s), m));
+		}
+#endif
+		for (; from < to; from++) {
+			const uint64_t p = uint64_t(from) * w;
+			*out++ = read(p / 8) >> p % 8 & mask;
+		}
+	}
+
+	/** Returns the number of elements. */
+	size_t size() const { return length; }
+
+	/** Returns the bit width of the elements. */
+	int bitWidth() const { return w(); }
+
+	/** Returns an estimate of the size in bits of this structure. */
+	size_t bitCount() const { return data.bitCount() - sizeof(data) * 8 + sizeof(*this) * 8; }
+};
+
+} // namespace sux::util
@@ -28,8 +28,12 @@
 
 #pragma once
 
+#include "../support/common.hpp"
+
 #include <cstddef>
 #include <cstdint>
+#include <utility>
+#include <vector>
 
 namespace sux::util {
 
@@ -53,6 +57,20 @@ using namespace std;
 class SearchablePrefixSums {
 
   public:
+	/** Whether add(size_t, int64_t) and addBatch() can be called concurrently, also with queries; implementations supporting concurrent updates hide this member.
+	 *
+	 * Queries concurrent with updates are not linearizable, and they do not see a snapshot of the
+	 * values: they are exact only when there are no concurrent updates (see the documentation of
+	 * each implementation for its guarantees). Consistent views of a changing structure require snapshots (see #PERSISTENT). */
+	static constexpr bool CONCURRENT = false;
+
+	/** Whether copies are constant-time snapshots sharing storage copy-on-write; implementations supporting snapshots hide this member. */
+	static constexpr bool PERSISTENT = false;
+
+	/** Whether the implementation is a binary Fenwick tree, so that the nodes read by a search depend only on its result
+	 * and on the size of the tree; Fenwick trees hide this member. */
+	static constexpr bool FENWICK = false;
+
 	virtual ~SearchablePrefixSums() = default;
 
 	/** Compute the prefix sum.
@@ -62,6 +80,18 @@ class SearchablePrefixSums {
 	 */
 	virtual uint64_t prefix(size_t length) = 0;
 
+	/** Compute several prefix sums.
+	 *
+	 * The computation of each prefix sum starts from the previous one, and visits
+	 * only the nodes of the tree in which the two computations differ: the closer
+	 * consecutive lengths are (e.g., when they are sorted), the fewer nodes are visited.
+	 *
+	 * @param length an array of `n` lengths of prefix sums (from 0 to size(), included).
+	 * @param out an array of `n` elements that will be filled with the prefix sums.
+	 * @param n the number of prefix sums.
+	 */
+	virtual void prefix(const size_t *length, uint64_t *out, size_t n) = 0;
+
 	/** Increment an element of the sequence (not the tree).
 	 *
 	 * @param idx: index of the element.
@@ -72,6 +102,29 @@ class SearchablePrefixSums {
 	 */
 	virtual void add(size_t idx, int64_t c) = 0;
 
+	/** Increment several elements of the sequence (not the tree).
+	 *
+	 * The indices must be sorted in nondecreasing order. Increments sharing a
+	 * node of the tree are accumulated, so that each node is updated once.
+	 *
+	 * @param idx an array of `n` indices of elements, sorted in nondecreasing order.
+	 * @param inc an array of `n` values to sum.
+	 * @param n the number of increments.
+	 *
+	 * The same constraints of add(size_t, int64_t) apply.
+	 */
+	virtual void addBatch(const size_t *idx, const int64_t *inc, size_t n) = 0;
+
+	/** Increment by the same value all elements of the sequence in a range.
+	 *
+	 * @param from the start of the range (from 0 to size(), included).
+	 * @param to the end of the range (from `from` to size(), included).
+	 * @param inc the value to sum to the elements in the range `(from .. to]`.
+	 *
+	 * The same constraints of add(size_t, int64_t) apply.
+	 */
+	virtual void rangeAdd(size_t from, size_t to, int64_t inc) = 0;
+
 	/** Search the length of the longest prefix whose sum is less than or equal to a given bound.
 	 *
 	 * @param val bound for the prefix sum.
@@ -119,6 +172,129 @@ class SearchablePrefixSums {
 
 	/** Returns an estimate of the size (in bits) of this structure. */
 	virtual size_t bitCount() const = 0;
+
+  protected:
+	// Calls update(node, c) once for each node of the tree on the update path of some index, where c is the sum of
+	// the increments of the indices below the node. When the path of an index reaches a node greater than or equal to
+	// the next index, it is on the path of the next index, too, so its increment is pushed on a stack of pending
+	// increments, which is kept sorted by node, and it is picked up by the walk of the next index.
+	template <typename F> static void batch_add(const size_t size, const size_t *idx, const int64_t *inc, const size_t n, F update) {
+		size_t pending_node[64];
+		int64_t pending_inc[64];
+		int top = 0;
+
+		for (size_t i = 0; i < n; i++) {
+			assert(i == 0 || idx[i - 1] <= idx[i]);
+			const size_t next = i + 1 < n ? idx[i + 1] : SIZE_MAX;
+			size_t node = idx[i];
+			int64_t c = inc[i];
+
+			while (node <= size) {
+				if (top != 0 && pending_node[top - 1] == node) c += pending_inc[--top];
+				if (node >= next) {
+					pending_node[top] = node;
+					pending_inc[top++] = c;
+					break;
+				}
+				update(node, c);
+				node += mask_rho(node);
+			}
+		}
+	}
+
+	// Calls update(node, c) once for each node of a Fenwick tree whose range (clear_rho(node)..node] intersects (from..to],
+	// where c is inc times the size of the intersection: the nodes in (from..to], and then the nodes on the update path of to.
+	template <typename F> static void range_add(const size_t size, const size_t from, const size_t to, const int64_t inc, F update) {
+		if (from >= to) return;
+		for (size_t node = from + 1; node <= to; node++) update(node, inc * int64_t(node - max(clear_rho(node), from)));
+		for (size_t node = to + mask_rho(to); node <= size; node += mask_rho(node)) update(node, inc * int64_t(to - max(clear_rho(node), from)));
+	}
+
+	// Computes in a single pass the nodes 1, 2, ..., size of a Fenwick tree on a sequence, calling set(node, value), where
+	// value is the sum of the elements in (clear_rho(node)..node], that is, the difference between the current prefix sum
+	// and the prefix sum at the last multiple of twice the lowest one of the node, which we keep for each height.
+	//
+	// With more than one thread, the nodes are split into ranges whose length is a power of two, and the prefix sums at the
+	// start of each range are computed in a first parallel pass: the multiples above are then either the start of the
+	// range or the start of another range. Even and odd ranges are filled in two parallel phases, so that set() can modify
+	// a few bytes beyond a node. If levels is true the nodes are stored by level, and nodes at the higher levels, which may
+	// be close to nodes of nonadjacent ranges, are collected and set sequentially at the end.
+	template <typename F> static void fill(const uint64_t *sequence, const size_t size, const size_t num_threads, const bool levels, F set) {
+		size_t chunk = size_t(1) << 16;
+		while (chunk * 2 * num_threads < size) chunk *= 2;
+
+		if (num_threads <= 1 || size <= chunk) {
+			uint64_t start[64] = {};
+			fill_range(sequence, 0, size, 0, start, set);
+			return;
+		}
+
+		const size_t num_ranges = (size + chunk - 1) / chunk;
+		std::vector<uint64_t> before(num_ranges + 1);
+		parallel(num_threads, [&](const size_t t) {
+			for (size_t r = t; r < num_ranges; r += num_threads) {
+				uint64_t sum = 0;
+				for (size_t i = r * chunk; i < min((r + 1) * chunk, size); i++) sum += sequence[i];
+				before[r + 1] = sum;
+			}
+		});
+		for (size_t r = 1; r <= num_ranges; r++) before[r] += before[r - 1];
+
+		const int max_height = levels ? lambda(chunk) - 8 : 64;
+		std::vector<std::vector<std::pair<size_t, uint64_t>>> deferred(num_ranges);
+		for (size_t phase = 0; phase < 2; phase++) {
+			parallel(num_threads, [&](const size_t t) {
+				for (size_t r = 2 * t + phase; r < num_ranges; r += 2 * num_threads) {
+					const size_t begin = r * chunk;
+					uint64_t start[64];
+					for (int h = 0; h < 64; h++) start[h] = before[(begin & ~((UINT64_C(2) << h) - 1)) / chunk];
+					fill_range(sequence, begin, min(begin + chunk, size), before[r], start, [&](const size_t node, const uint64_t value) {
+						if (rho(node) < max_height)
+							set(node, value);
+						else
+							deferred[r].emplace_back(node, value);
+					});
+				}
+			});
+		}
+
+		for (const auto &nodes : deferred)
+			for (const auto &[node, value] : nodes) set(node, value);
+	}
+
+	// Computes each prefix sum from the previous one: the query paths of two lengths coincide from their longest common
+	// prefix on, so we walk down the larger of the two until they meet, subtracting the nodes of the previous length
+	// and adding those of the current one.
+	template <typename F> static void batch_prefix(const size_t *length, uint64_t *out, const size_t n, F get) {
+		uint64_t sum = 0;
+		size_t prev = 0;
+
+		for (size_t i = 0; i < n; i++) {
+			size_t a = prev, b = length[i];
+			while (a != b) {
+				if (a > b) {
+					sum -= get(a);
+					a = clear_rho(a);
+				} else {
+					sum += get(b);
+					b = clear_rho(b);
+				}
+			}
+			out[i] = sum;
+			prev = length[i];
+		}
+	}
+
+  private:
+	// Sets the nodes in (begin..end], given the prefix sum at begin and the prefix sums at the last multiples of 2, 4, 8...
+	template <typename F> static void fill_range(const uint64_t *sequence, const size_t begin, const size_t end, uint64_t sum, uint64_t *start, F set) {
+		for (size_t node = begin + 1; node <= end; node++) {
+			sum += sequence[node - 1];
+			const int height = rho(node);
+			set(node, sum - start[height]);
+			for (int h = 0; h < height; h++) start[h] = sum;
+		}
+	}
 };
 
 } // namespace sux::util
@@ -28,12 +28,19 @@
 
 #pragma once
 
+#include "../support/Serialization.hpp"
 #include "../support/common.hpp"
 #include "Expandable.hpp"
+#include "Numa.hpp"
 #include <assert.h>
+#include <cstdio>
+#include <fcntl.h>
 #include <iostream>
 #include <string>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
 
 namespace sux::util {
 
@@ -54,7 +61,12 @@ enum AllocType {
 	 * In this case allocations are aligned on a huge (typically, 2MiB) memory page.
 	 * This feature is usually disabled by default and it requires the administrator
 	 * to pre-reserve space for huge memory pages as documented in the reported external references  */
-	FORCEHUGEPAGE
+	FORCEHUGEPAGE,
+	/** Persistent allocation in a file mapped with `mmap()` and `MAP_SHARED`, for vectors
+	 * built with Vector(const std::string &); the file is enlarged with `ftruncate()` and remapped
+	 * with `mremap()`. Vectors built otherwise behave as with ::SMALLPAGE, so structures
+	 * using this type of allocation internally can still be built as usual. */
+	MMAPFILE
 };
 
 /** An expandable vector with settable type of memory allocation.
@@ -69,7 +81,14 @@ enum AllocType {
  * and the allocated space can be used directly, if necessary.
  *
  * This class implements the standard `<<` and `>>` operators for simple
- * serialization and deserialization.
+ * serialization and deserialization, using the format described in Serialization.hpp.
+ * Alternatively, view() makes a vector a read-only view of serialized data, usually
+ * taken from a MappedFile, without copying.
+ *
+ * With allocation type ::MMAPFILE, Vector(const std::string &) backs a vector with a file,
+ * whose content survives the vector: opening the file again yields the same elements
+ * without any loading. For example, the words of a WordDynRankSel can be persisted
+ * by passing a file-backed vector to its constructor.
  *
  * @tparam T the data type of an element.
  * @tparam AT a type of memory allocation out of ::AllocType.
@@ -88,8 +107,19 @@ template <typename T, AllocType AT = MALLOC> class Vector : public Expandable {
 	static constexpr int FLAGS = MAP_PRIVATE | MAP_ANONYMOUS | (AT == FORCEHUGEPAGE ? MAP_HUGETLB : 0);
 
   private:
+	// The file header of a file-backed vector, followed by the elements at offset FILE_HEADER
+	struct FileHeader {
+		char magic[8];
+		uint64_t element_size;
+		uint64_t size;
+	};
+	static constexpr size_t FILE_HEADER = 4096;
+	static constexpr char FILE_MAGIC[8] = {'S', 'u', 'x', 'V', 'e', 'c', 't', '1'};
+
 	size_t _size = 0, _capacity = 0;
 	T *data = nullptr;
+	// The descriptor of the backing file, or -1
+	int fd = -1;
 
   public:
 	Vector<T, AT>() = default;
@@ -98,8 +128,66 @@ template <typename T, AllocType AT = MALLOC> class Vector : public Expandable {
 
 	explicit Vector<T, AT>(const T *data, size_t length) : Vector(length) { memcpy(this->data, data, length); }
 
+	/** Creates a vector backed by a file, which is created if it does not exist.
+	 *
+	 * If the file exists, it must have been created by this constructor with the same
+	 * element type, and the vector will contain the elements stored in the file. Changes
+	 * are written back to the file by the operating system; sync() forces a write.
+	 *
+	 * @param filename the name of a file.
+	 */
+	explicit Vector<T, AT>(const std::string &filename) {
+		static_assert(AT == MMAPFILE, "File-backed vectors require the MMAPFILE allocation type");
+		fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+		if (fd == -1) {
+			fprintf(stderr, "Cannot open file %s\n", filename.c_str());
+			abort();
+		}
+		struct stat st;
+		if (fstat(fd, &st) == -1) {
+			fprintf(stderr, "Cannot stat file %s\n", filename.c_str());
+			abort();
+		}
+		const bool created = st.st_size == 0;
+		if (created) {
+			if (ftruncate(fd, FILE_HEADER) == -1) {
+				fprintf(stderr, "Cannot resize file %s\n", filename.c_str());
+				abort();
+			}
+			st.st_size = FILE_HEADER;
+		}
+		if (size_t(st.st_size) < FILE_HEADER || (st.st_size - FILE_HEADER) % 4096 != 0) {
+			fprintf(stderr, "File %s is not a vector\n", filename.c_str());
+			abort();
+		}
+
+		void *mem = mmap(nullptr, st.st_size, PROT, MAP_SHARED, fd, 0);
+		if (mem == MAP_FAILED) {
+			fprintf(stderr, "Cannot map file %s\n", filename.c_str());
+			abort();
+		}
+		FileHeader *header = static_cast<FileHeader *>(mem);
+		if (created) {
+			memcpy(header->magic, FILE_MAGIC, sizeof FILE_MAGIC);
+			header->element_size = sizeof(T);
+		} else if (memcmp(header->magic, FILE_MAGIC, sizeof FILE_MAGIC) != 0 || header->element_size != sizeof(T)) {
+			fprintf(stderr, "File %s is not a vector of elements of %zu bytes\n", filename.c_str(), sizeof(T));
+			abort();
+		}
+
+		data = reinterpret_cast<T *>(static_cast<char *>(mem) + FILE_HEADER);
+		_capacity = (st.st_size - FILE_HEADER) / sizeof(T);
+		_size = header->size;
+		assert(_size <= _capacity);
+	}
+
 	~Vector<T, AT>() {
-		if (data) {
+		if (fd != -1) {
+			fileHeader()->size = _size;
+			int result = munmap(fileHeader(), mappedBytes());
+			assert(result == 0 && "mmunmap failed");
+			close(fd);
+		} else if (data && _capacity != 0) {
 			if (AT == MALLOC) {
 				free(data);
 			} else {
@@ -114,7 +202,7 @@ template <typename T, AllocType AT = MALLOC> class Vector : public Expandable {
 	Vector &operator=(const Vector &) = delete;
 
 	// Define move operators
-	Vector(Vector<T, AT> &&oth) : _size(std::exchange(oth._size, 0)), _capacity(std::exchange(oth._capacity, 0)), data(std::exchange(oth.data, nullptr)) {}
+	Vector(Vector<T, AT> &&oth) : _size(std::exchange(oth._size, 0)), _capacity(std::exchange(oth._capacity, 0)), data(std::exchange(oth.data, nullptr)), fd(std::exchange(oth.fd, -1)) {}
 
 	Vector<T, AT> &operator=(Vector<T, AT> &&oth) {
 		swap(*this, oth);
@@ -203,8 +291,61 @@ template <typename T, AllocType AT = MALLOC> class Vector : public Expandable {
 		std::swap(first._size, second._size);
 		std::swap(first._capacity, second._capacity);
 		std::swap(first.data, second.data);
+		std::swap(first.fd, second.fd);
 	}
 
+	/** Moves the backing array to the given NUMA node, or interleaves it on all nodes.
+	 *
+	 * The placement applies to all memory pages overlapping the backing array; it
+	 * is therefore precise only for allocation types other than ::MALLOC. Memory
+	 * allocated later to enlarge the vector follows the policy of the calling thread
+	 * (see NumaScope).
+	 *
+	 * @param node a node, or -1 to interleave the backing array on all nodes.
+	 * @return true if the backing array has been placed.
+	 */
+	bool place(const int node) { return numa::place(data, _capacity * sizeof(T), node); }
+
+	/** Returns whether this vector is backed by a file (see Vector(const std::string &)). */
+	bool isFileBacked() const { return fd != -1; }
+
+	/** Writes to the backing file, if any, the size of this vector and all modified elements.
+	 *
+	 * This method calls `msync()` and waits for its completion.
+	 *
+	 * @return true if the data has been written successfully (or if this vector is not file-backed).
+	 */
+	bool sync() {
+		if (fd == -1) return true;
+		fileHeader()->size = _size;
+		return msync(fileHeader(), mappedBytes(), MS_SYNC) == 0;
+	}
+
+	/** Makes this vector a read-only view of a vector serialized by operator<<().
+	 *
+	 * The memory containing the serialized vector is not copied, and it must remain
+	 * valid as long as this vector is used. Operations that enlarge the vector
+	 * will make a private copy of the viewed data.
+	 *
+	 * @param p a pointer to the serialized vector, aligned to `alignof(T)`, or `nullptr`.
+	 * @param end a pointer to the end of the available data.
+	 * @param check whether to verify the checksum of the data.
+	 * @return a pointer just after the serialized vector, or `nullptr` if `p` is `nullptr`
+	 * or the data is not valid (see serialization::viewSection()).
+	 */
+	const char *view(const char *p, const char *end, const bool check = false) {
+		const T *viewed;
+		uint64_t nsize;
+		if ((p = serialization::viewSection(p, end, viewed, nsize, check)) == nullptr) return nullptr;
+		*this = Vector<T, AT>();
+		_size = nsize;
+		data = (T *)viewed;
+		return p;
+	}
+
+	/** Returns whether this vector is a view of memory it does not own (see view()). */
+	bool isView() const { return data != nullptr && _capacity == 0 && fd == -1; }
+
 	/** Returns a pointer at the start of the backing array. */
 	inline T *operator&() const { return data; }
 
@@ -238,12 +379,52 @@ template <typename T, AllocType AT = MALLOC> class Vector : public Expandable {
 			return ((4 * 1024 - 1) | (size * sizeof(T) - 1)) + 1;
 	}
 
+	FileHeader *fileHeader() const { return reinterpret_cast<FileHeader *>(reinterpret_cast<char *>(data) - FILE_HEADER); }
+
+	// The length of the mapping of a file-backed vector, which always covers the whole file
+	size_t mappedBytes() const {
+		struct stat st;
+		if (fstat(fd, &st) == -1) {
+			fprintf(stderr, "Cannot stat the file of a vector\n");
+			abort();
+		}
+		return st.st_size;
+	}
+
 	void remap(size_t size) {
 		if (size == 0) return;
 
 		void *mem;
 		size_t space; // Space to allocate, in bytes
 
+		if (fd != -1) {
+			space = page_aligned(size);
+			const size_t old_space = mappedBytes() - FILE_HEADER;
+			// The file must cover the mapping before it is enlarged, and it can be shrunk only afterwards
+			if (space > old_space && ftruncate(fd, FILE_HEADER + space) == -1) {
+				fprintf(stderr, "Cannot resize the file of a vector\n");
+				abort();
+			}
+#ifndef MREMAP_MAYMOVE
+			munmap(fileHeader(), FILE_HEADER + old_space);
+			mem = mmap(nullptr, FILE_HEADER + space, PROT, MAP_SHARED, fd, 0);
+#else
+			mem = mremap(fileHeader(), FILE_HEADER + old_space, FILE_HEADER + space, MREMAP_MAYMOVE);
+#endif
+			if (mem == MAP_FAILED) {
+				fprintf(stderr, "Cannot map the file of a vector\n");
+				abort();
+			}
+			if (space < old_space && ftruncate(fd, FILE_HEADER + space) == -1) {
+				fprintf(stderr, "Cannot resize the file of a vector\n");
+				abort();
+			}
+			// New space in the file is already zeroed
+			_capacity = space / sizeof(T);
+			data = reinterpret_cast<T *>(static_cast<char *>(mem) + FILE_HEADER);
+			return;
+		}
+
 		if (AT == MALLOC) {
 			space = size * sizeof(T);
 			mem = _capacity == 0 ? malloc(space) : realloc(data, space);
@@ -268,24 +449,31 @@ template <typename T, AllocType AT = MALLOC> class Vector : public Expandable {
 			}
 		}
 
-		if (_capacity * sizeof(T) < space) memset(static_cast<char *>(mem) + _capacity * sizeof(T), 0, space - _capacity * sizeof(T));
+		size_t valid = _capacity * sizeof(T);
+		if (isView()) {
+			valid = std::min(size, _size) * sizeof(T);
+			memcpy(mem, data, valid);
+		}
+		if (valid < space) memset(static_cast<char *>(mem) + valid, 0, space - valid);
 
 		_capacity = space / sizeof(T);
 		data = static_cast<T *>(mem);
 	}
 
 	friend std::ostream &operator<<(std::ostream &os, const Vector<T, AT> &vector) {
-		const uint64_t nsize = vector.size();
-		os.write((char *)&nsize, sizeof(uint64_t));
-		os.write((char *)&vector, vector.size() * sizeof(T));
+		serialization::writeSection(os, &vector, vector.size());
 		return os;
 	}
 
 	friend std::istream &operator>>(std::istream &is, Vector<T, AT> &vector) {
-		uint64_t nsize;
-		is.read((char *)&nsize, sizeof(uint64_t));
-		vector = Vector<T, AT>(nsize);
-		is.read((char *)&vector, vector.size() * sizeof(T));
+		uint64_t nsize, sum;
+		if (!serialization::readSectionHeader(is, sizeof(T), nsize, sum)) return is;
+		// A file-backed vector is read into its file
+		if (vector.isFileBacked())
+			vector.size(nsize);
+		else
+			vector = Vector<T, AT>(nsize);
+		serialization::readSectionData(is, &vector, nsize, sum);
 		return is;
 	}
 };
@@ -1,15 +1,23 @@
 #pragma once
 
+#include <sux/util/FenwickAtomicF.hpp>
 #include <sux/util/FenwickBitF.hpp>
 #include <sux/util/FenwickBitL.hpp>
 #include <sux/util/FenwickByteF.hpp>
 #include <sux/util/FenwickByteL.hpp>
 #include <sux/util/FenwickFixedF.hpp>
 #include <sux/util/FenwickFixedL.hpp>
+#include <sux/util/FenwickPersistentL.hpp>
+#include <sux/util/KaryPrefixSums.hpp>
 
 #include <sux/bits/StrideDynRankSel.hpp>
+#include <sux/bits/TreeDynRankSel.hpp>
 #include <sux/bits/WordDynRankSel.hpp>
 
+#include <sstream>
+#include <thread>
+#include <vector>
+
 TEST(dynranksel, all_ones) {
 	using namespace sux;
 
@@ -179,12 +187,14 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 	uint64_t *bvfixedl = new uint64_t[size / 64 + 1]();
 	uint64_t *bvbytef = new uint64_t[size / 64 + 1]();
 	uint64_t *bvbytel = new uint64_t[size / 64 + 1]();
+	uint64_t *bvkary = new uint64_t[size / 64 + 1]();
 	uint64_t *bvbitf = new uint64_t[size / 64 + 1]();
 	uint64_t *bvbitl = new uint64_t[size / 64 + 1]();
 	uint64_t *bvfixedfS = new uint64_t[size / 64 + 1]();
 	uint64_t *bvfixedlS = new uint64_t[size / 64 + 1]();
 	uint64_t *bvbytefS = new uint64_t[size / 64 + 1]();
 	uint64_t *bvbytelS = new uint64_t[size / 64 + 1]();
+	uint64_t *bvkaryS = new uint64_t[size / 64 + 1]();
 	uint64_t *bvbitfS = new uint64_t[size / 64 + 1]();
 	uint64_t *bvbitlS = new uint64_t[size / 64 + 1]();
 
@@ -200,12 +210,14 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 	memcpy(bvfixedl, bvfixedf, (size / 64 + 1) * sizeof(uint64_t));
 	memcpy(bvbytef, bvfixedf, (size / 64 + 1) * sizeof(uint64_t));
 	memcpy(bvbytel, bvfixedf, (size / 64 + 1) * sizeof(uint64_t));
+	memcpy(bvkary, bvfixedf, (size / 64 + 1) * sizeof(uint64_t));
 	memcpy(bvbitf, bvfixedf, (size / 64 + 1) * sizeof(uint64_t));
 	memcpy(bvbitl, bvfixedf, (size / 64 + 1) * sizeof(uint64_t));
 	memcpy(bvfixedfS, bvfixedf, (size / 64 + 1) * sizeof(uint64_t));
 	memcpy(bvfixedlS, bvfixedf, (size / 64 + 1) * sizeof(uint64_t));
 	memcpy(bvbytefS, bvfixedf, (size / 64 + 1) * sizeof(uint64_t));
 	memcpy(bvbytelS, bvfixedf, (size / 64 + 1) * sizeof(uint64_t));
+	memcpy(bvkaryS, bvfixedf, (size / 64 + 1) * sizeof(uint64_t));
 	memcpy(bvbitfS, bvfixedf, (size / 64 + 1) * sizeof(uint64_t));
 	memcpy(bvbitlS, bvfixedf, (size / 64 + 1) * sizeof(uint64_t));
 
@@ -216,6 +228,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 	bits::WordDynRankSel<util::FenwickFixedL> fixedl(bvfixedl, size);
 	bits::WordDynRankSel<util::FenwickByteF> byte(bvbytef, size);
 	bits::WordDynRankSel<util::FenwickByteL> bytel(bvbytel, size);
+	bits::WordDynRankSel<util::KaryPrefixSums> kary(bvkary, size);
 	bits::WordDynRankSel<util::FenwickBitF> bit(bvbitf, size);
 	bits::WordDynRankSel<util::FenwickBitL> bitl(bvbitl, size);
 
@@ -226,6 +239,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 	bits::StrideDynRankSel<util::FenwickBitL, S> bitlS(bvbitlS, size);
 	bits::StrideDynRankSel<util::FenwickByteF, S> byteS(bvbytefS, size);
 	bits::StrideDynRankSel<util::FenwickByteL, S> bytelS(bvbytelS, size);
+	bits::StrideDynRankSel<util::KaryPrefixSums, S> karyS(bvkaryS, size);
 
 	// rank
 	for (size_t i = 0; i < ones; i++) {
@@ -239,6 +253,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 		EXPECT_EQ(res, bitl.rank(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, byte.rank(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, bytel.rank(i)) << "at index " << i << ", stride " << S;
+		EXPECT_EQ(res, kary.rank(i)) << "at index " << i << ", stride " << S;
 
 		EXPECT_EQ(res, fixedfS.rank(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, fixedlS.rank(i)) << "at index " << i << ", stride " << S;
@@ -246,6 +261,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 		EXPECT_EQ(res, bitlS.rank(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, byteS.rank(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, bytelS.rank(i)) << "at index " << i << ", stride " << S;
+		EXPECT_EQ(res, karyS.rank(i)) << "at index " << i << ", stride " << S;
 	}
 
 	// rankZero
@@ -260,6 +276,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 		EXPECT_EQ(res, bitl.rankZero(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, byte.rankZero(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, bytel.rankZero(i)) << "at index " << i << ", stride " << S;
+		EXPECT_EQ(res, kary.rankZero(i)) << "at index " << i << ", stride " << S;
 
 		EXPECT_EQ(res, fixedl.rankZero(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, fixedfS.rankZero(i)) << "at index " << i << "  stride " << S;
@@ -267,6 +284,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 		EXPECT_EQ(res, bitlS.rankZero(i)) << "at index " << i << "  stride " << S;
 		EXPECT_EQ(res, byteS.rankZero(i)) << "at index " << i << "  stride " << S;
 		EXPECT_EQ(res, bytelS.rankZero(i)) << "at index " << i << "  stride " << S;
+		EXPECT_EQ(res, karyS.rankZero(i)) << "at index " << i << "  stride " << S;
 	}
 
 	// select
@@ -280,6 +298,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 			EXPECT_EQ(pos, bitl.select(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_EQ(pos, byte.select(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_EQ(pos, bytel.select(res)) << "at index " << pos << ", stride " << S;
+			EXPECT_EQ(pos, kary.select(res)) << "at index " << pos << ", stride " << S;
 
 			EXPECT_EQ(pos, fixedfS.select(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_EQ(pos, fixedlS.select(res)) << "at index " << pos << ", stride " << S;
@@ -287,6 +306,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 			EXPECT_EQ(pos, bitlS.select(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_EQ(pos, byteS.select(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_EQ(pos, bytelS.select(res)) << "at index " << pos << ", stride " << S;
+			EXPECT_EQ(pos, karyS.select(res)) << "at index " << pos << ", stride " << S;
 		} else {
 			EXPECT_LT(pos, fixedf.select(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_LT(pos, fixedl.select(res)) << "at index " << pos << ", stride " << S;
@@ -294,6 +314,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 			EXPECT_LT(pos, bitl.select(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_LT(pos, byte.select(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_LT(pos, bytel.select(res)) << "at index " << pos << ", stride " << S;
+			EXPECT_LT(pos, kary.select(res)) << "at index " << pos << ", stride " << S;
 
 			EXPECT_LT(pos, fixedfS.select(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_LT(pos, fixedlS.select(res)) << "at index " << pos << ", stride " << S;
@@ -301,6 +322,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 			EXPECT_LT(pos, bitlS.select(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_LT(pos, byteS.select(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_LT(pos, bytelS.select(res)) << "at index " << pos << ", stride " << S;
+			EXPECT_LT(pos, karyS.select(res)) << "at index " << pos << ", stride " << S;
 		}
 	}
 
@@ -316,6 +338,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 			EXPECT_LT(pos, bitl.selectZero(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_LT(pos, byte.selectZero(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_LT(pos, bytel.selectZero(res)) << "at index " << pos << ", stride " << S;
+			EXPECT_LT(pos, kary.selectZero(res)) << "at index " << pos << ", stride " << S;
 
 			EXPECT_LT(pos, fixedfS.selectZero(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_LT(pos, fixedlS.selectZero(res)) << "at index " << pos << ", stride " << S;
@@ -323,6 +346,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 			EXPECT_LT(pos, bitlS.selectZero(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_LT(pos, byteS.selectZero(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_LT(pos, bytelS.selectZero(res)) << "at index " << pos << ", stride " << S;
+			EXPECT_LT(pos, karyS.selectZero(res)) << "at index " << pos << ", stride " << S;
 		} else {
 			EXPECT_EQ(pos, fixedf.selectZero(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_EQ(pos, fixedl.selectZero(res)) << "at index " << pos << ", stride " << S;
@@ -330,6 +354,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 			EXPECT_EQ(pos, bitl.selectZero(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_EQ(pos, byte.selectZero(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_EQ(pos, bytel.selectZero(res)) << "at index " << pos << ", stride " << S;
+			EXPECT_EQ(pos, kary.selectZero(res)) << "at index " << pos << ", stride " << S;
 
 			EXPECT_EQ(pos, fixedfS.selectZero(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_EQ(pos, fixedlS.selectZero(res)) << "at index " << pos << ", stride " << S;
@@ -337,6 +362,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 			EXPECT_EQ(pos, bitlS.selectZero(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_EQ(pos, byteS.selectZero(res)) << "at index " << pos << ", stride " << S;
 			EXPECT_EQ(pos, bytelS.selectZero(res)) << "at index " << pos << ", stride " << S;
+			EXPECT_EQ(pos, karyS.selectZero(res)) << "at index " << pos << ", stride " << S;
 		}
 	}
 
@@ -348,6 +374,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 		bitl.update(i, updates[i]);
 		byte.update(i, updates[i]);
 		bytel.update(i, updates[i]);
+		kary.update(i, updates[i]);
 
 		fixedfS.update(i, updates[i]);
 		fixedlS.update(i, updates[i]);
@@ -355,6 +382,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 		bitlS.update(i, updates[i]);
 		byteS.update(i, updates[i]);
 		bytelS.update(i, updates[i]);
+		karyS.update(i, updates[i]);
 	}
 
 	// select
@@ -366,6 +394,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 		EXPECT_EQ(res, bitl.select(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, byte.select(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, bytel.select(i)) << "at index " << i << ", stride " << S;
+		EXPECT_EQ(res, kary.select(i)) << "at index " << i << ", stride " << S;
 
 		EXPECT_EQ(res, fixedfS.select(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, fixedlS.select(i)) << "at index " << i << ", stride " << S;
@@ -373,6 +402,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 		EXPECT_EQ(res, bitlS.select(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, byteS.select(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, bytelS.select(i)) << "at index " << i << ", stride " << S;
+		EXPECT_EQ(res, karyS.select(i)) << "at index " << i << ", stride " << S;
 	}
 
 	// selectZero
@@ -384,6 +414,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 		EXPECT_EQ(res, bitl.selectZero(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, byte.selectZero(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, bytel.selectZero(i)) << "at index " << i << ", stride " << S;
+		EXPECT_EQ(res, kary.selectZero(i)) << "at index " << i << ", stride " << S;
 
 		EXPECT_EQ(res, fixedfS.selectZero(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, fixedlS.selectZero(i)) << "at index " << i << ", stride " << S;
@@ -391,6 +422,7 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 		EXPECT_EQ(res, bitlS.selectZero(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, byteS.selectZero(i)) << "at index " << i << ", stride " << S;
 		EXPECT_EQ(res, bytelS.selectZero(i)) << "at index " << i << ", stride " << S;
+		EXPECT_EQ(res, karyS.selectZero(i)) << "at index " << i << ", stride " << S;
 	}
 
 	delete[] updates;
@@ -398,12 +430,14 @@ template <std::size_t S> void run_dynranksel(std::size_t size) {
 	delete[] bvbitlS;
 	delete[] bvbitfS;
 	delete[] bvbytelS;
+	delete[] bvkaryS;
 	delete[] bvbytefS;
 	delete[] bvfixedlS;
 	delete[] bvfixedfS;
 	delete[] bvbitl;
 	delete[] bvbitf;
 	delete[] bvbytel;
+	delete[] bvkary;
 	delete[] bvbytef;
 	delete[] bvfixedl;
 	delete[] bvfixedf;
@@ -432,3 +466,287 @@ TEST(dynranksel, stride) {
 		run_dynranksel<1024>(i);
 	}
 }
+
+TEST(dynranksel, select_in_words) {
+	using namespace sux;
+	uint64_t words[20];
+	for (size_t n = 0; n <= 20; n++) {
+		for (size_t i = 0; i < n; i++) words[i] = i % 3 == 0 ? 0 : i % 3 == 1 ? -1ULL : next();
+		uint64_t ones = 0, zeros = 0;
+		for (size_t pos = 0; pos < n * 64; pos++) {
+			if (words[pos / 64] >> pos % 64 & 1)
+				ASSERT_EQ(pos, select_in_words(words, n, ones++)) << "at position " << pos << ", length " << n;
+			else
+				ASSERT_EQ(pos, select_in_words<true>(words, n, zeros++)) << "at position " << pos << ", length " << n;
+		}
+		EXPECT_EQ(SIZE_MAX, select_in_words(words, n, ones));
+		EXPECT_EQ(SIZE_MAX, select_in_words<true>(words, n, zeros));
+	}
+}
+
+template <class T> static void check_dynranksel_serialization(const size_t size) {
+	uint64_t *bv = new uint64_t[size / 64 + 1]();
+	uint64_t *bv_load = new uint64_t[size / 64 + 1]();
+	for (size_t i = 0; i < size / 64; i++) bv[i] = next();
+
+	T dynranksel(bv, size);
+	std::stringstream ss;
+	ss << dynranksel;
+	T loaded(bv_load, size);
+	ss >> loaded;
+	ASSERT_TRUE(ss);
+	for (size_t i = 0; i < size / 64 + 1; i++) ASSERT_EQ(bv[i], bv_load[i]);
+	for (size_t i = 0; i <= size; i++) ASSERT_EQ(dynranksel.rank(i), loaded.rank(i));
+
+	// Different size
+	uint64_t *bv_small = new uint64_t[size / 64 + 1]();
+	T small(bv_small, size - 1);
+	std::stringstream ss_small(ss.str());
+	ss_small >> small;
+	EXPECT_FALSE(ss_small);
+
+	delete[] bv;
+	delete[] bv_load;
+	delete[] bv_small;
+}
+
+TEST(dynranksel, serialization) {
+	using namespace sux;
+	check_dynranksel_serialization<bits::WordDynRankSel<util::FenwickBitF>>(10000);
+	check_dynranksel_serialization<bits::StrideDynRankSel<util::FenwickByteL, 8>>(10000);
+}
+
+template <class T> static void check_dynranksel_concurrent(const size_t size) {
+	using namespace sux;
+	const size_t num_threads = 8;
+	uint64_t *bv = new uint64_t[size / 64 + 1]();
+	uint64_t *bv_ref = new uint64_t[size / 64 + 1]();
+	for (size_t i = 0; i < size / 64; i++) bv[i] = bv_ref[i] = next();
+
+	// The threads interleave their positions, so they mutate the same words
+	T dynranksel(bv, size);
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < num_threads; t++)
+		threads.emplace_back([&, t] {
+			for (size_t i = t; i < size; i += num_threads) dynranksel.toggle(i);
+			for (size_t i = t; i < size; i += num_threads)
+				if (i / num_threads % 3 == 0) dynranksel.clear(i);
+			for (size_t i = t; i < size; i += num_threads)
+				if (i / num_threads % 5 == 0) dynranksel.set(i);
+		});
+	for (auto &thread : threads) thread.join();
+
+	for (size_t i = 0; i < size; i++) {
+		bv_ref[i / 64] ^= UINT64_C(1) << i % 64;
+		if (i / num_threads % 3 == 0) bv_ref[i / 64] &= ~(UINT64_C(1) << i % 64);
+		if (i / num_threads % 5 == 0) bv_ref[i / 64] |= UINT64_C(1) << i % 64;
+	}
+	bits::WordDynRankSel<util::FenwickFixedF> reference(bv_ref, size);
+
+	for (size_t i = 0; i < size / 64 + 1; i++) ASSERT_EQ(bv_ref[i], bv[i]) << "at word " << i;
+	for (size_t i = 0; i <= size; i++) ASSERT_EQ(reference.rank(i), dynranksel.rank(i)) << "at index " << i;
+	const uint64_t ones = reference.rank(size);
+	for (size_t i = 0; i < ones; i++) ASSERT_EQ(reference.select(i), dynranksel.select(i)) << "at index " << i;
+	for (size_t i = 0; i < size - ones; i++) ASSERT_EQ(reference.selectZero(i), dynranksel.selectZero(i)) << "at index " << i;
+
+	delete[] bv;
+	delete[] bv_ref;
+}
+
+TEST(dynranksel, concurrent) {
+	using namespace sux;
+	check_dynranksel_concurrent<bits::WordDynRankSel<util::FenwickAtomicF>>(100000);
+	check_dynranksel_concurrent<bits::StrideDynRankSel<util::FenwickAtomicF, 16>>(100000);
+}
+
+// Checks rank, select and selectZero against a reference bit vector
+template <class T> static void check_dynranksel_reference(T &dynranksel, const std::vector<uint8_t> &ref) {
+	ASSERT_EQ(ref.size(), dynranksel.size());
+	uint64_t ones = 0;
+	for (size_t i = 0; i < ref.size(); i++) {
+		ASSERT_EQ(ones, dynranksel.rank(i)) << "at index " << i;
+		if (ref[i])
+			ASSERT_EQ(i, dynranksel.select(ones++)) << "at index " << i;
+		else
+			ASSERT_EQ(i, dynranksel.selectZero(i - ones)) << "at index " << i;
+	}
+	ASSERT_EQ(ones, dynranksel.rank(ref.size()));
+}
+
+template <class T> static void check_dynranksel_push_pop(const size_t size) {
+	T dynranksel;
+	std::vector<uint8_t> ref;
+	for (size_t i = 0; i < size; i++) {
+		const bool bit = next() % 3 == 0;
+		dynranksel.pushBack(bit);
+		ref.push_back(bit);
+		if (i % 997 == 0) check_dynranksel_reference(dynranksel, ref);
+	}
+	check_dynranksel_reference(dynranksel, ref);
+
+	for (size_t i = 0; i < size / 2 + 13; i++) {
+		ASSERT_EQ(ref.back(), dynranksel.popBack()) << "at index " << i;
+		ref.pop_back();
+	}
+	check_dynranksel_reference(dynranksel, ref);
+
+	for (size_t i = 0; i < size; i++) {
+		const bool bit = next() % 2;
+		dynranksel.pushBack(bit);
+		ref.push_back(bit);
+		if (i % 1024 == 0) dynranksel.toggle(i), ref[i] = !ref[i];
+	}
+	check_dynranksel_reference(dynranksel, ref);
+
+	while (!ref.empty()) {
+		ASSERT_EQ(ref.back(), dynranksel.popBack());
+		ref.pop_back();
+	}
+	check_dynranksel_reference(dynranksel, ref);
+}
+
+TEST(dynranksel, push_pop) {
+	using namespace sux;
+	check_dynranksel_push_pop<bits::WordDynRankSel<util::FenwickFixedF>>(5000);
+	check_dynranksel_push_pop<bits::WordDynRankSel<util::FenwickBitL>>(5000);
+	check_dynranksel_push_pop<bits::WordDynRankSel<util::KaryPrefixSums>>(5000);
+	check_dynranksel_push_pop<bits::StrideDynRankSel<util::FenwickByteL, 8>>(5000);
+	check_dynranksel_push_pop<bits::StrideDynRankSel<util::FenwickFixedF, 1>>(5000);
+	check_dynranksel_push_pop<bits::WordDynRankSel<util::FenwickPersistentL>>(5000);
+	check_dynranksel_push_pop<bits::StrideDynRankSel<util::FenwickPersistentL, 4>>(5000);
+	check_dynranksel_push_pop<bits::TreeDynRankSel<>>(5000);
+	check_dynranksel_push_pop<bits::TreeDynRankSel<2>>(5000);
+
+	// An owned bit vector survives serialization
+	bits::WordDynRankSel<util::FenwickFixedF> word;
+	for (size_t i = 0; i < 1000; i++) word.pushBack(i % 7 == 0);
+	std::stringstream ss;
+	ss << word;
+	bits::WordDynRankSel<util::FenwickFixedF> word_load;
+	ss >> word_load;
+	ASSERT_TRUE(ss);
+	EXPECT_EQ(1000, word_load.size());
+	EXPECT_EQ(word.rank(1000), word_load.rank(1000));
+	word_load.pushBack(1);
+	EXPECT_EQ(word.rank(1000) + 1, word_load.rank(1001));
+}
+
+template <class T> static void check_dynranksel_snapshot(const size_t size) {
+	uint64_t *bv = new uint64_t[size / 64 + 1]();
+	for (size_t i = 0; i < size / 64; i++) bv[i] = next();
+	std::vector<uint8_t> ref(size);
+	for (size_t i = 0; i < size; i++) ref[i] = bv[i / 64] >> i % 64 & 1;
+
+	// The bit vector is copied at construction
+	T dynranksel(bv, size);
+	delete[] bv;
+
+	// A thread queries a snapshot while the original is mutated
+	T snapshot = dynranksel.snapshot();
+	std::thread reader([&] { check_dynranksel_reference(snapshot, ref); });
+	std::vector<uint8_t> mutated = ref;
+	for (size_t i = 0; i < size; i += 3) dynranksel.toggle(i), mutated[i] = !mutated[i];
+	for (size_t i = 0; i < 1000; i++) dynranksel.pushBack(i % 2), mutated.push_back(i % 2);
+	reader.join();
+
+	check_dynranksel_reference(dynranksel, mutated);
+	check_dynranksel_reference(snapshot, ref);
+
+	// Mutating the snapshot does not affect the original
+	for (size_t i = 0; i < size; i += 7) snapshot.set(i);
+	check_dynranksel_reference(dynranksel, mutated);
+
+	std::stringstream ss;
+	ss << dynranksel;
+	T loaded;
+	ss >> loaded;
+	ASSERT_TRUE(ss);
+	check_dynranksel_reference(loaded, mutated);
+}
+
+TEST(dynranksel, snapshot) {
+	using namespace sux;
+	check_dynranksel_snapshot<bits::WordDynRankSel<util::FenwickPersistentL>>(100000);
+	check_dynranksel_snapshot<bits::StrideDynRankSel<util::FenwickPersistentL, 8>>(100000);
+}
+
+template <size_t WORDS> static void check_dynranksel_tree(const size_t size) {
+	using namespace sux;
+	uint64_t *bv = new uint64_t[size / 64 + 1]();
+	std::vector<uint8_t> ref(size);
+	for (size_t i = 0; i < size; i++)
+		if (next() % 2) bv[i / 64] |= UINT64_C(1) << i % 64, ref[i] = true;
+
+	bits::TreeDynRankSel<WORDS> tree(bv, size);
+	check_dynranksel_reference(tree, ref);
+
+	// Insertions in the middle, most of them clustered to split the same leaves over and over
+	for (size_t i = 0; i < 4 * size; i++) {
+		const size_t pos = i % 2 ? next() % (ref.size() + 1) : ref.size() / 3;
+		const bool bit = next() % 2;
+		tree.insert(pos, bit);
+		ref.insert(ref.begin() + pos, bit);
+	}
+	check_dynranksel_reference(tree, ref);
+
+	// Mutations
+	for (size_t i = 0; i < size; i++) {
+		const size_t pos = next() % ref.size();
+		switch (i % 3) {
+		case 0:
+			ASSERT_EQ(ref[pos], tree.set(pos));
+			ref[pos] = true;
+			break;
+		case 1:
+			ASSERT_EQ(ref[pos], tree.clear(pos));
+			ref[pos] = false;
+			break;
+		default:
+			ASSERT_EQ(ref[pos], tree.toggle(pos));
+			ref[pos] = !ref[pos];
+		}
+	}
+	for (size_t i = 0; i < ref.size() / 64 + 1; i++) {
+		const uint64_t word = next();
+		uint64_t old = 0;
+		for (size_t j = 0; j < 64 && i * 64 + j < ref.size(); j++) {
+			old |= uint64_t(ref[i * 64 + j]) << j;
+			ref[i * 64 + j] = word >> j & 1;
+		}
+		ASSERT_EQ(old, tree.update(i, word)) << "at word " << i;
+	}
+	check_dynranksel_reference(tree, ref);
+
+	std::stringstream ss;
+	ss << tree;
+	bits::TreeDynRankSel<WORDS> tree_load;
+	ss >> tree_load;
+	ASSERT_TRUE(ss);
+	check_dynranksel_reference(tree_load, ref);
+
+	// Deletions, leaving most leaves almost empty before the structure is rebuilt
+	while (ref.size() > size / 8) {
+		const size_t pos = next() % ref.size();
+		ASSERT_EQ(ref[pos], tree.erase(pos));
+		ref.erase(ref.begin() + pos);
+	}
+	check_dynranksel_reference(tree, ref);
+	EXPECT_LT(tree.bitCount(), 16 * (ref.size() + WORDS * 64) + 8192);
+
+	for (size_t i = 0; i < size; i++) {
+		const size_t pos = next() % (ref.size() + 1);
+		tree.insert(pos, i % 5 == 0);
+		ref.insert(ref.begin() + pos, i % 5 == 0);
+	}
+	check_dynranksel_reference(tree, ref);
+
+	delete[] bv;
+}
+
+TEST(dynranksel, tree) {
+	check_dynranksel_tree<2>(0);
+	check_dynranksel_tree<2>(1);
+	check_dynranksel_tree<2>(20000);
+	check_dynranksel_tree<4>(10000);
+	check_dynranksel_tree<32>(50000);
+}
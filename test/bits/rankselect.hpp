@@ -1,12 +1,19 @@
 #pragma once
 
 #include <sux/bits/EliasFano.hpp>
+#include <sux/bits/Lazy.hpp>
+#include <sux/bits/PartitionedEliasFano.hpp>
+#include <sux/bits/RRR.hpp>
+#include <sux/bits/Rank9Interleaved.hpp>
 #include <sux/bits/Rank9Sel.hpp>
 #include <sux/bits/SimpleSelect.hpp>
+#include <sux/bits/SimpleSelectBoth.hpp>
 #include <sux/bits/SimpleSelectHalf.hpp>
 #include <sux/bits/SimpleSelectZero.hpp>
 #include <sux/bits/SimpleSelectZeroHalf.hpp>
 
+#include <sstream>
+
 TEST(rankselect, all_ones) {
 	using namespace sux::bits;
 
@@ -18,6 +25,7 @@ TEST(rankselect, all_ones) {
 		EliasFano EliasFano(bitvect, size);
 		SimpleSelect SimpleSelect(bitvect, size, 3);
 		SimpleSelectHalf SimpleSelectHalf(bitvect, size);
+		SimpleSelectBoth SimpleSelectBoth(bitvect, size);
 
 		// rank
 		for (size_t i = 0; i <= size; i++) {
@@ -37,6 +45,7 @@ TEST(rankselect, all_ones) {
 			EXPECT_EQ(i, EliasFano.select(i)) << "at index " << i;
 			EXPECT_EQ(i, SimpleSelect.select(i)) << "at index " << i;
 			EXPECT_EQ(i, SimpleSelectHalf.select(i)) << "at index " << i;
+			EXPECT_EQ(i, SimpleSelectBoth.select(i)) << "at index " << i;
 		}
 
 		delete[] bitvect;
@@ -53,6 +62,7 @@ TEST(rankselect, all_zeroes) {
 		EliasFano EliasFano(bitvect, size);
 		SimpleSelectZero SimpleSelectZero(bitvect, size, 3);
 		SimpleSelectZeroHalf SimpleSelectZeroHalf(bitvect, size);
+		SimpleSelectBoth SimpleSelectBoth(bitvect, size);
 
 		// rank
 		for (size_t i = 0; i <= size; i++) {
@@ -70,6 +80,7 @@ TEST(rankselect, all_zeroes) {
 		for (size_t i = 0; i < size; i++) {
 			EXPECT_EQ(i, SimpleSelectZero.selectZero(i)) << "at index " << i;
 			EXPECT_EQ(i, SimpleSelectZeroHalf.selectZero(i)) << "at index " << i;
+			EXPECT_EQ(i, SimpleSelectBoth.selectZero(i)) << "at index " << i;
 		}
 
 		delete[] bitvect;
@@ -98,6 +109,7 @@ static void run_rankselect(std::size_t size) {
 	SimpleSelectZero SimpleSelectZero(bitvect, size,
 									  3); // TODO: try different LONGWORDS_PER_SUBINVENTORY
 	SimpleSelectZeroHalf SimpleSelectZeroHalf(bitvect, size);
+	SimpleSelectBoth SimpleSelectBoth(bitvect, size);
 
 	// rank
 	for (size_t i = 0; i < ones; i++) {
@@ -111,6 +123,7 @@ static void run_rankselect(std::size_t size) {
 		pos = SimpleSelectHalf.select(i);
 		EXPECT_EQ(i, Rank9Sel.rank(pos));
 		EXPECT_EQ(i, EliasFano.rank(pos));
+		EXPECT_EQ(pos, SimpleSelectBoth.select(i));
 	}
 
 	// select
@@ -131,6 +144,7 @@ static void run_rankselect(std::size_t size) {
 	for (size_t i = 0; i < zeros; i++) {
 		auto pos = SimpleSelectZero.selectZero(i);
 		EXPECT_EQ(pos, SimpleSelectZeroHalf.selectZero(i));
+		EXPECT_EQ(pos, SimpleSelectBoth.selectZero(i));
 		EXPECT_EQ(i, Rank9Sel.rankZero(pos));
 		EXPECT_EQ(i, EliasFano.rankZero(pos));
 	}
@@ -157,3 +171,464 @@ TEST(rankselect, small_large) {
 	run_rankselect(1024);
 	run_rankselect(512 * 1024);
 }
+
+TEST(rankselect, batch) {
+	using namespace sux::bits;
+
+	for (size_t size : {1000, 100000, 1000000}) {
+		for (uint64_t density : {1, 64, 4096}) {
+			const size_t words = size / 64 + 1;
+			uint64_t *bitvect = new uint64_t[words]();
+			for (size_t i = 0; i < size; i++)
+				if (next() % density == 0) bitvect[i / 64] |= UINT64_C(1) << i % 64;
+
+			Rank9Sel Rank9Sel(bitvect, size);
+			EliasFano EliasFano(bitvect, size);
+			SimpleSelect SimpleSelect(bitvect, size, 3);
+			SimpleSelectHalf SimpleSelectHalf(bitvect, size);
+			SimpleSelectZeroHalf SimpleSelectZeroHalf(bitvect, size);
+			SimpleSelectBoth SimpleSelectBoth(bitvect, size);
+			const uint64_t ones = Rank9Sel.rank(size), zeros = size - ones;
+
+			for (size_t n : {0, 1, 7, 33, 1000}) {
+				std::vector<size_t> pos(n), rank(n), rank_zero(n);
+				for (size_t i = 0; i < n; i++) {
+					pos[i] = next() % (size + 1);
+					if (ones != 0) rank[i] = next() % ones;
+					if (zeros != 0) rank_zero[i] = next() % zeros;
+				}
+
+				std::vector<uint64_t> out(n);
+				Rank9Sel.rank(pos.data(), out.data(), n);
+				for (size_t i = 0; i < n; i++) EXPECT_EQ(Rank9Sel.rank(pos[i]), out[i]) << "at index " << i;
+				EliasFano.rank(pos.data(), out.data(), n);
+				for (size_t i = 0; i < n; i++) EXPECT_EQ(Rank9Sel.rank(pos[i]), out[i]) << "at index " << i;
+				static_cast<sux::Rank &>(Rank9Sel).rank(pos.data(), out.data(), n);
+				for (size_t i = 0; i < n; i++) EXPECT_EQ(Rank9Sel.rank(pos[i]), out[i]) << "at index " << i;
+
+				if (ones != 0) {
+					Rank9Sel.select(rank.data(), out.data(), n);
+					for (size_t i = 0; i < n; i++) EXPECT_EQ(Rank9Sel.select(rank[i]), out[i]) << "at index " << i;
+					EliasFano.select(rank.data(), out.data(), n);
+					for (size_t i = 0; i < n; i++) EXPECT_EQ(Rank9Sel.select(rank[i]), out[i]) << "at index " << i;
+					SimpleSelect.select(rank.data(), out.data(), n);
+					for (size_t i = 0; i < n; i++) EXPECT_EQ(Rank9Sel.select(rank[i]), out[i]) << "at index " << i;
+					SimpleSelectHalf.select(rank.data(), out.data(), n);
+					for (size_t i = 0; i < n; i++) EXPECT_EQ(Rank9Sel.select(rank[i]), out[i]) << "at index " << i;
+					SimpleSelectBoth.select(rank.data(), out.data(), n);
+					for (size_t i = 0; i < n; i++) EXPECT_EQ(Rank9Sel.select(rank[i]), out[i]) << "at index " << i;
+					static_cast<sux::Select &>(SimpleSelect).select(rank.data(), out.data(), n);
+					for (size_t i = 0; i < n; i++) EXPECT_EQ(Rank9Sel.select(rank[i]), out[i]) << "at index " << i;
+				}
+
+				if (zeros != 0) {
+					SimpleSelectZeroHalf.selectZero(rank_zero.data(), out.data(), n);
+					for (size_t i = 0; i < n; i++) EXPECT_EQ(SimpleSelectZeroHalf.selectZero(rank_zero[i]), out[i]) << "at index " << i;
+					SimpleSelectBoth.selectZero(rank_zero.data(), out.data(), n);
+					for (size_t i = 0; i < n; i++) EXPECT_EQ(SimpleSelectZeroHalf.selectZero(rank_zero[i]), out[i]) << "at index " << i;
+				}
+			}
+
+			delete[] bitvect;
+		}
+	}
+}
+
+TEST(rankselect, elias_fano_iterator) {
+	using namespace sux::bits;
+
+	for (size_t size : {0, 1, 64, 1000, 100000}) {
+		for (uint64_t density : {1, 3, 64, 4096}) {
+			std::vector<uint64_t> ones;
+			uint64_t *bitvect = new uint64_t[size / 64 + 1]();
+			for (size_t i = 0; i < size; i++)
+				if (next() % density == 0) {
+					bitvect[i / 64] |= UINT64_C(1) << i % 64;
+					ones.push_back(i);
+				}
+
+			EliasFano EliasFano(bitvect, size);
+			sux::bits::EliasFano<> EliasFanoList(ones, size);
+
+			size_t i = 0;
+			for (const auto x : EliasFano) {
+				ASSERT_LT(i, ones.size());
+				EXPECT_EQ(ones[i], x) << "at index " << i;
+				i++;
+			}
+			EXPECT_EQ(ones.size(), i);
+			EXPECT_TRUE(std::equal(EliasFanoList.begin(), EliasFanoList.end(), ones.begin(), ones.end()));
+
+			for (size_t r = 0; r < ones.size(); r += 1 + next() % 16) {
+				auto it = EliasFano.iterator(r);
+				EXPECT_EQ(r, it.index());
+				EXPECT_EQ(ones[r], *it);
+				if (r + 1 < ones.size()) {
+					EXPECT_EQ(ones[r + 1], *++it);
+				}
+			}
+			EXPECT_TRUE(EliasFano.iterator(ones.size()) == EliasFano.end());
+
+			for (size_t x = 0; x <= size; x++) {
+				const auto it = EliasFano.next_geq(x);
+				const size_t r = std::lower_bound(ones.begin(), ones.end(), x) - ones.begin();
+				EXPECT_EQ(r, it.index()) << "at " << x;
+				if (r < ones.size()) {
+					EXPECT_EQ(ones[r], *it) << "at " << x;
+				}
+			}
+
+			delete[] bitvect;
+		}
+	}
+}
+
+TEST(rankselect, elias_fano_builder) {
+	using namespace sux::bits;
+
+	for (size_t size : {0, 1, 63, 1000, 100000}) {
+		for (uint64_t density : {1, 3, 64, 4096}) {
+			std::vector<uint64_t> ones;
+			uint64_t *bitvect = new uint64_t[size / 64 + 1]();
+			for (size_t i = 0; i < size; i++)
+				if (next() % density == 0) {
+					bitvect[i / 64] |= UINT64_C(1) << i % 64;
+					ones.push_back(i);
+				}
+
+			sux::bits::EliasFano<>::Builder builder(ones.size(), size);
+			for (const auto x : ones) builder.push(x);
+			sux::bits::EliasFano<> EliasFanoBuilt = builder.build();
+			sux::bits::EliasFano<> EliasFanoList(ones, size);
+			sux::bits::EliasFano<> EliasFanoBits(bitvect, size);
+			sux::bits::EliasFano<> EliasFanoPar(bitvect, size, 3);
+			EXPECT_EQ(EliasFanoList.bitCount(), EliasFanoBuilt.bitCount());
+
+			for (size_t i = 0; i < ones.size(); i++) {
+				EXPECT_EQ(ones[i], EliasFanoBuilt.select(i)) << "at index " << i;
+				EXPECT_EQ(ones[i], EliasFanoBits.select(i)) << "at index " << i;
+				EXPECT_EQ(ones[i], EliasFanoPar.select(i)) << "at index " << i;
+			}
+			for (size_t x = 0; x <= size; x++) {
+				const size_t r = std::lower_bound(ones.begin(), ones.end(), x) - ones.begin();
+				EXPECT_EQ(r, EliasFanoBuilt.rank(x)) << "at " << x;
+				EXPECT_EQ(r, EliasFanoBits.rank(x)) << "at " << x;
+				EXPECT_EQ(r, EliasFanoPar.rank(x)) << "at " << x;
+			}
+
+			delete[] bitvect;
+		}
+	}
+}
+
+TEST(rankselect, partitioned_elias_fano) {
+	using namespace sux::bits;
+
+	for (size_t size : {0, 1, 1000, 300000}) {
+		for (int log2_chunk_size : {0, 4, 12}) {
+			// Alternate dense and sparse regions
+			std::vector<uint64_t> ones;
+			uint64_t *bitvect = new uint64_t[size / 64 + 1]();
+			for (size_t i = 0; i < size; i++)
+				if (next() % ((i / 10000) % 2 ? 1000 : 2) == 0) {
+					bitvect[i / 64] |= UINT64_C(1) << i % 64;
+					ones.push_back(i);
+				}
+
+			Rank9Sel Rank9Sel(bitvect, size);
+			PartitionedEliasFano PartitionedEliasFano(bitvect, size, log2_chunk_size);
+			sux::bits::PartitionedEliasFano<> PartitionedEliasFanoList(ones, size, log2_chunk_size);
+			if (size == 300000 && log2_chunk_size == 12) {
+				EXPECT_LT(0, PartitionedEliasFano.denseChunks());
+				EXPECT_LT(PartitionedEliasFano.denseChunks(), PartitionedEliasFano.numChunks());
+			}
+
+			for (size_t i = 0; i <= size; i++) {
+				EXPECT_EQ(Rank9Sel.rank(i), PartitionedEliasFano.rank(i)) << "at index " << i;
+				EXPECT_EQ(Rank9Sel.rank(i), PartitionedEliasFanoList.rank(i)) << "at index " << i;
+			}
+			for (size_t i = 0; i < ones.size(); i++) {
+				EXPECT_EQ(ones[i], PartitionedEliasFano.select(i)) << "at index " << i;
+				EXPECT_EQ(ones[i], PartitionedEliasFanoList.select(i)) << "at index " << i;
+			}
+
+			delete[] bitvect;
+		}
+	}
+}
+
+TEST(rankselect, parallel) {
+	using namespace sux::bits;
+
+	for (size_t size : {0, 1, 1000, 100000, 3000000}) {
+		for (uint64_t density : {1, 64, 4096}) {
+			// Alternate regions of given density and very sparse regions, so that some inventories span many words
+			const size_t words = size / 64 + 1;
+			uint64_t *bitvect = new uint64_t[words]();
+			for (size_t i = 0; i < size; i++)
+				if (next() % ((i / 500000) % 2 ? 200000 : density) == 0) bitvect[i / 64] |= UINT64_C(1) << i % 64;
+
+			Rank9Sel Rank9Sel(bitvect, size);
+			EliasFano EliasFano(bitvect, size);
+			SimpleSelect SimpleSelect(bitvect, size, 3);
+			SimpleSelectHalf SimpleSelectHalf(bitvect, size);
+			SimpleSelectZeroHalf SimpleSelectZeroHalf(bitvect, size);
+			const uint64_t ones = Rank9Sel.rank(size), zeros = size - ones;
+
+			for (size_t num_threads : {2, 3, 8}) {
+				sux::bits::Rank9Sel<> Rank9SelPar(bitvect, size, num_threads);
+				sux::bits::EliasFano<> EliasFanoPar(bitvect, size, num_threads);
+				sux::bits::SimpleSelect<> SimpleSelectPar(bitvect, size, 3, num_threads);
+				sux::bits::SimpleSelectHalf<> SimpleSelectHalfPar(bitvect, size, num_threads);
+				sux::bits::SimpleSelectZeroHalf<> SimpleSelectZeroHalfPar(bitvect, size, num_threads);
+				sux::bits::SimpleSelectBoth<> SimpleSelectBothPar(bitvect, size, num_threads);
+				EXPECT_EQ(Rank9Sel.bitCount(), Rank9SelPar.bitCount());
+				EXPECT_EQ(SimpleSelect.bitCount(), SimpleSelectPar.bitCount());
+
+				for (size_t i = 0; i <= size; i += 1 + next() % 64) {
+					EXPECT_EQ(Rank9Sel.rank(i), Rank9SelPar.rank(i)) << "at index " << i;
+					EXPECT_EQ(Rank9Sel.rank(i), EliasFanoPar.rank(i)) << "at index " << i;
+				}
+				for (size_t i = 0; i < ones; i++) {
+					const size_t pos = Rank9Sel.select(i);
+					EXPECT_EQ(pos, Rank9SelPar.select(i)) << "at index " << i;
+					EXPECT_EQ(pos, EliasFanoPar.select(i)) << "at index " << i;
+					EXPECT_EQ(pos, SimpleSelectPar.select(i)) << "at index " << i;
+					EXPECT_EQ(pos, SimpleSelectHalfPar.select(i)) << "at index " << i;
+					EXPECT_EQ(pos, SimpleSelectBothPar.select(i)) << "at index " << i;
+				}
+				for (size_t i = 0; i < zeros; i += 1 + next() % 64) {
+					EXPECT_EQ(SimpleSelectZeroHalf.selectZero(i), SimpleSelectZeroHalfPar.selectZero(i)) << "at index " << i;
+					EXPECT_EQ(SimpleSelectZeroHalf.selectZero(i), SimpleSelectBothPar.selectZero(i)) << "at index " << i;
+				}
+			}
+
+			delete[] bitvect;
+		}
+	}
+}
+
+TEST(rankselect, lazy) {
+	using namespace sux::bits;
+
+	const size_t size = 100000;
+	uint64_t *bitvect = new uint64_t[size / 64 + 1]();
+	for (size_t i = 0; i < size; i++)
+		if (next() % 3 == 0) bitvect[i / 64] |= UINT64_C(1) << i % 64;
+
+	Rank9Sel Rank9Sel(bitvect, size);
+	Lazy<sux::bits::Rank9Sel<>> LazyRank9Sel(bitvect, size, 4);
+	Lazy<sux::bits::SimpleSelect<>> LazySimpleSelect(bitvect, size, 3);
+	Lazy<sux::bits::EliasFano<>> LazyEliasFano(bitvect, size);
+	const uint64_t ones = Rank9Sel.rank(size);
+
+	// The first queries are concurrent
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < 4; t++)
+		threads.emplace_back([&] {
+			for (size_t i = 0; i < ones; i += 97) {
+				EXPECT_EQ(Rank9Sel.select(i), LazyRank9Sel.select(i));
+				EXPECT_EQ(Rank9Sel.select(i), LazySimpleSelect.select(i));
+			}
+		});
+	for (auto &t : threads) t.join();
+
+	EXPECT_EQ(size, LazyRank9Sel.size());
+	for (size_t i = 0; i <= size; i++) {
+		EXPECT_EQ(Rank9Sel.rank(i), LazyRank9Sel.rank(i)) << "at index " << i;
+		EXPECT_EQ(Rank9Sel.rank(i), LazyEliasFano.rank(i)) << "at index " << i;
+	}
+
+	delete[] bitvect;
+}
+
+TEST(rankselect, serialization) {
+	using namespace sux::bits;
+
+	for (size_t size : {0, 1, 64, 1000, 100000}) {
+		for (uint64_t density : {1, 3, 4096}) {
+			const size_t words = size / 64 + 1;
+			uint64_t *bitvect = new uint64_t[words]();
+			sux::util::Vector<uint64_t> owned(words), owned_copy(words);
+			for (size_t i = 0; i < size; i++)
+				if (next() % density == 0) bitvect[i / 64] |= UINT64_C(1) << i % 64;
+			for (size_t i = 0; i < words; i++) owned[i] = owned_copy[i] = bitvect[i];
+
+			Rank9Sel Rank9Sel(bitvect, size);
+			SimpleSelect SimpleSelect(bitvect, size, 3);
+			sux::bits::Rank9Sel<> Rank9SelOwning(std::move(owned), size);
+			sux::bits::SimpleSelect<> SimpleSelectOwning(std::move(owned_copy), size, 3);
+			EXPECT_TRUE(Rank9SelOwning.ownsBits());
+			EXPECT_FALSE(Rank9Sel.ownsBits());
+
+			std::stringstream ss;
+			ss << Rank9Sel << SimpleSelect << Rank9SelOwning << SimpleSelectOwning;
+			const std::string serialized = ss.str();
+
+			sux::bits::Rank9Sel<> Rank9SelLoad, Rank9SelOwningLoad, Rank9SelView;
+			sux::bits::SimpleSelect<> SimpleSelectLoad, SimpleSelectOwningLoad, SimpleSelectView;
+			ss >> Rank9SelLoad >> SimpleSelectLoad >> Rank9SelOwningLoad >> SimpleSelectOwningLoad;
+			ASSERT_TRUE(ss);
+			EXPECT_TRUE(Rank9SelLoad.ownsBits());
+
+			// Views need aligned data
+			std::vector<uint64_t> aligned(serialized.size() / sizeof(uint64_t));
+			memcpy(aligned.data(), serialized.data(), serialized.size());
+			const char *p = (const char *)aligned.data(), *end = p + serialized.size();
+			p = Rank9SelView.view(p, end, true);
+			p = SimpleSelectView.view(p, end, true);
+			ASSERT_NE(nullptr, p);
+
+			// The original bit vector is no longer needed
+			memset(bitvect, 0, words * sizeof(uint64_t));
+
+			const uint64_t ones = Rank9SelLoad.rank(size);
+			EXPECT_EQ(size, Rank9SelView.size());
+			for (size_t i = 0; i <= size; i++) {
+				EXPECT_EQ(Rank9SelOwning.rank(i), Rank9SelLoad.rank(i)) << "at index " << i;
+				EXPECT_EQ(Rank9SelOwning.rank(i), Rank9SelOwningLoad.rank(i)) << "at index " << i;
+				EXPECT_EQ(Rank9SelOwning.rank(i), Rank9SelView.rank(i)) << "at index " << i;
+			}
+			for (size_t i = 0; i < ones; i++) {
+				const size_t pos = Rank9SelOwning.select(i);
+				EXPECT_EQ(pos, SimpleSelectOwning.select(i)) << "at index " << i;
+				EXPECT_EQ(pos, Rank9SelLoad.select(i)) << "at index " << i;
+				EXPECT_EQ(pos, Rank9SelView.select(i)) << "at index " << i;
+				EXPECT_EQ(pos, SimpleSelectLoad.select(i)) << "at index " << i;
+				EXPECT_EQ(pos, SimpleSelectOwningLoad.select(i)) << "at index " << i;
+				EXPECT_EQ(pos, SimpleSelectView.select(i)) << "at index " << i;
+			}
+
+			// Truncated and corrupted data
+			std::stringstream truncated(serialized.substr(0, serialized.size() - 64));
+			truncated >> Rank9SelLoad >> SimpleSelectLoad >> Rank9SelOwningLoad >> SimpleSelectOwningLoad;
+			EXPECT_FALSE(truncated);
+			// Headers and section descriptors take 64 bytes: this is the first word of the bit vector of Rank9Sel
+			std::string corrupted = serialized;
+			corrupted[192] ^= 1;
+			std::stringstream corrupted_ss(corrupted);
+			corrupted_ss >> Rank9SelLoad >> SimpleSelectLoad >> Rank9SelOwningLoad >> SimpleSelectOwningLoad;
+			EXPECT_FALSE(corrupted_ss);
+
+			delete[] bitvect;
+		}
+	}
+}
+
+TEST(rankselect, rank9_interleaved) {
+	using namespace sux::bits;
+
+	for (size_t size : {0, 1, 63, 64, 383, 384, 385, 1000, 100000}) {
+		for (uint64_t density : {1, 2, 64, 4096}) {
+			uint64_t *bitvect = new uint64_t[size / 64 + 1]();
+			for (size_t i = 0; i < size; i++)
+				if (next() % density == 0) bitvect[i / 64] |= UINT64_C(1) << i % 64;
+
+			Rank9Sel Rank9Sel(bitvect, size);
+			Rank9Interleaved Rank9Interleaved(bitvect, size);
+			const uint64_t ones = Rank9Sel.rank(size);
+
+			EXPECT_EQ(size, Rank9Interleaved.size());
+			for (size_t i = 0; i <= size; i++) EXPECT_EQ(Rank9Sel.rank(i), Rank9Interleaved.rank(i)) << "at index " << i;
+			for (size_t i = 0; i < ones; i++) EXPECT_EQ(Rank9Sel.select(i), Rank9Interleaved.select(i)) << "at index " << i;
+
+			const size_t n = 100;
+			std::vector<size_t> pos(n), rank(n);
+			std::vector<uint64_t> out(n);
+			for (size_t i = 0; i < n; i++) {
+				pos[i] = next() % (size + 1);
+				if (ones != 0) rank[i] = next() % ones;
+			}
+			Rank9Interleaved.rank(pos.data(), out.data(), n);
+			for (size_t i = 0; i < n; i++) EXPECT_EQ(Rank9Sel.rank(pos[i]), out[i]) << "at index " << i;
+			if (ones != 0) {
+				Rank9Interleaved.select(rank.data(), out.data(), n);
+				for (size_t i = 0; i < n; i++) EXPECT_EQ(Rank9Sel.select(rank[i]), out[i]) << "at index " << i;
+			}
+
+			delete[] bitvect;
+		}
+	}
+}
+
+TEST(rankselect, rrr) {
+	using namespace sux::bits;
+
+	for (size_t size : {0, 1, 62, 63, 64, 2016, 2017, 100000}) {
+		for (uint64_t density : {1, 2, 10, 100}) {
+			// Dense and sparse regions
+			uint64_t *bitvect = new uint64_t[size / 64 + 1]();
+			for (size_t i = 0; i < size; i++)
+				if (next() % ((i / 5000) % 2 ? 1000 : density) == 0) bitvect[i / 64] |= UINT64_C(1) << i % 64;
+
+			Rank9Sel Rank9Sel(bitvect, size);
+			SimpleSelectZero SimpleSelectZero(bitvect, size, 3);
+			RRR RRR(bitvect, size);
+			const uint64_t ones = Rank9Sel.rank(size), zeros = size - ones;
+
+			EXPECT_EQ(size, RRR.size());
+			for (size_t i = 0; i <= size; i++) EXPECT_EQ(Rank9Sel.rank(i), RRR.rank(i)) << "at index " << i;
+			for (size_t i = 0; i < ones; i++) EXPECT_EQ(Rank9Sel.select(i), RRR.select(i)) << "at index " << i;
+			for (size_t i = 0; i < zeros; i++) EXPECT_EQ(SimpleSelectZero.selectZero(i), RRR.selectZero(i)) << "at index " << i;
+
+			const size_t n = 100;
+			std::vector<size_t> pos(n), rank(n);
+			std::vector<uint64_t> out(n);
+			for (size_t i = 0; i < n; i++) {
+				pos[i] = next() % (size + 1);
+				if (ones != 0) rank[i] = next() % ones;
+			}
+			RRR.rank(pos.data(), out.data(), n);
+			for (size_t i = 0; i < n; i++) EXPECT_EQ(Rank9Sel.rank(pos[i]), out[i]) << "at index " << i;
+			if (ones != 0) {
+				RRR.select(rank.data(), out.data(), n);
+				for (size_t i = 0; i < n; i++) EXPECT_EQ(Rank9Sel.select(rank[i]), out[i]) << "at index " << i;
+			}
+
+			delete[] bitvect;
+		}
+	}
+}
+
+TEST(rankselect, instrumentation) {
+	using namespace sux::bits;
+	using namespace sux::instrumentation;
+	const size_t size = 1000000;
+	for (uint64_t density : {2, 4096}) {
+		uint64_t *bitvect = new uint64_t[size / 64 + 1]();
+		for (size_t i = 0; i < size; i++)
+			if (next() % density == 0) bitvect[i / 64] |= UINT64_C(1) << i % 64;
+
+		SimpleSelect<> reference(bitvect, size, 3);
+		SimpleSelect<sux::util::AllocType::MALLOC, Sampled<0, 2>> simple_select(bitvect, size, 3);
+		EliasFano<sux::util::AllocType::MALLOC, Sampled<0, 1>> elias_fano(bitvect, size);
+		EliasFano<sux::util::AllocType::MALLOC, Sampled<4, 1>> elias_fano_sampled(bitvect, size);
+		const uint64_t ones = elias_fano.rank(size);
+		for (uint64_t i = 0; i < ones; i++) {
+			const size_t pos = reference.select(i);
+			ASSERT_EQ(pos, simple_select.select(i)) << "at index " << i;
+			ASSERT_EQ(pos, elias_fano.select(i)) << "at index " << i;
+			ASSERT_EQ(pos, elias_fano_sampled.select(i)) << "at index " << i;
+		}
+
+		const Summary scanned = simple_select.instrumentation().summary(simple_select.SCANNED_WORDS), spilled = simple_select.instrumentation().summary(simple_select.SPILLED);
+		EXPECT_EQ(ones, scanned.samples);
+		EXPECT_EQ(ones, spilled.samples);
+		EXPECT_LE(spilled.max, 1);
+		uint64_t histogram = 0;
+		for (const auto h : scanned.histogram) histogram += h;
+		EXPECT_EQ(ones, histogram);
+
+		EXPECT_EQ(ones, elias_fano.instrumentation().summary(elias_fano.SCANNED_WORDS).samples);
+		// The count of queries of an instance might start at any phase
+		const uint64_t samples = elias_fano_sampled.instrumentation().summary(elias_fano_sampled.SCANNED_WORDS).samples;
+		EXPECT_GE(samples, ones / 16);
+		EXPECT_LE(samples, ones / 16 + 1);
+
+		// Copies start with empty counters
+		EliasFano<sux::util::AllocType::MALLOC, Sampled<0, 1>> copy(std::move(elias_fano));
+		EXPECT_EQ(0, copy.instrumentation().summary(copy.SCANNED_WORDS).samples);
+
+		delete[] bitvect;
+	}
+}
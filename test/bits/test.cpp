@@ -3,6 +3,7 @@
 #include "../xoroshiro128pp.hpp"
 #include "dynranksel.hpp"
 #include "rankselect.hpp"
+#include "wavelet.hpp"
 #include <sux/util/FenwickBitF.hpp>
 #include <sux/util/FenwickBitL.hpp>
 #include <sux/util/FenwickByteF.hpp>
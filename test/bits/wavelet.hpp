@@ -0,0 +1,95 @@
+#pragma once
+
+#include <sux/bits/WaveletMatrix.hpp>
+
+#include <algorithm>
+#include <map>
+
+template <sux::util::AllocType AT> void test_wavelet(const std::vector<uint64_t> &values, const size_t threads) {
+	using namespace sux::bits;
+	const size_t n = values.size();
+	WaveletMatrix<AT> wm(values, threads);
+	EXPECT_EQ(n, wm.size());
+
+	uint64_t max = 0;
+	for (auto v : values) max = std::max(max, v);
+	std::map<uint64_t, std::vector<size_t>> occ;
+	for (size_t i = 0; i < n; i++) occ[values[i]].push_back(i);
+
+	for (size_t i = 0; i < n; i++) ASSERT_EQ(values[i], wm.access(i)) << "at index " << i;
+
+	for (const auto &e : occ) {
+		const std::vector<size_t> &p = e.second;
+		for (size_t i = 0, r = 0; i <= n; i += 1 + n / 64) {
+			while (r < p.size() && p[r] < i) r++;
+			ASSERT_EQ(r, wm.rank(e.first, i)) << "value " << e.first << " at index " << i;
+		}
+		ASSERT_EQ(p.size(), wm.rank(e.first, n));
+		for (size_t r = 0; r < p.size(); r++) ASSERT_EQ(p[r], wm.select(e.first, r)) << "value " << e.first << " rank " << r;
+		EXPECT_EQ(SIZE_MAX, wm.select(e.first, p.size()));
+	}
+	// Values that do not occur
+	if (max != UINT64_MAX) {
+		EXPECT_EQ(0, wm.rank(max + 1, n));
+		EXPECT_EQ(SIZE_MAX, wm.select(max + 1, 0));
+		EXPECT_EQ(0, wm.rank(UINT64_MAX, n));
+	}
+
+	if (n == 0) return;
+
+	std::vector<size_t> pos(1000);
+	std::vector<uint64_t> sym(pos.size()), out(pos.size());
+	for (size_t i = 0; i < pos.size(); i++) {
+		pos[i] = next() % (n + 1);
+		sym[i] = values[next() % n] + (i % 7 == 0);
+	}
+	std::vector<size_t> apos(pos);
+	for (auto &p : apos) p %= n;
+	wm.access(apos.data(), out.data(), apos.size());
+	for (size_t i = 0; i < apos.size(); i++) ASSERT_EQ(values[apos[i]], out[i]);
+	wm.rank(sym.data(), pos.data(), out.data(), pos.size());
+	for (size_t i = 0; i < pos.size(); i++) ASSERT_EQ(wm.rank(sym[i], pos[i]), out[i]);
+
+	for (int q = 0; q < 100; q++) {
+		size_t begin = next() % n, end = next() % (n + 1);
+		if (begin > end) std::swap(begin, end);
+		if (begin == end) end++;
+		std::vector<uint64_t> sorted(values.begin() + begin, values.begin() + end);
+		std::sort(sorted.begin(), sorted.end());
+		for (size_t k = 0; k < sorted.size(); k += 1 + sorted.size() / 16) ASSERT_EQ(sorted[k], wm.quantile(begin, end, k));
+
+		std::map<uint64_t, uint64_t> freq;
+		for (size_t i = begin; i < end; i++) freq[values[i]]++;
+		std::vector<uint64_t> counts;
+		for (const auto &e : freq) counts.push_back(e.second);
+		std::sort(counts.rbegin(), counts.rend());
+		const size_t k = 1 + q % 5;
+		const auto top = wm.topK(begin, end, k);
+		ASSERT_EQ(std::min(k, counts.size()), top.size());
+		for (size_t i = 0; i < top.size(); i++) {
+			ASSERT_EQ(counts[i], top[i].second);
+			ASSERT_EQ(freq[top[i].first], top[i].second);
+		}
+	}
+}
+
+TEST(wavelet, small) {
+	test_wavelet<sux::util::AllocType::MALLOC>({}, 1);
+	test_wavelet<sux::util::AllocType::MALLOC>({0}, 1);
+	test_wavelet<sux::util::AllocType::MALLOC>({5}, 1);
+	test_wavelet<sux::util::AllocType::MALLOC>({0, 0, 0}, 1);
+	test_wavelet<sux::util::AllocType::MALLOC>({3, 1, 4, 1, 5, 9, 2, 6, 5, 3, 5}, 1);
+	test_wavelet<sux::util::AllocType::MALLOC>({UINT64_MAX, 0, UINT64_MAX - 1, 1ULL << 63}, 1);
+}
+
+TEST(wavelet, random) {
+	for (size_t n : {63, 64, 65, 1000, 30000})
+		for (int width : {1, 3, 8, 17})
+			for (size_t threads : {1, 4}) {
+				std::vector<uint64_t> values(n);
+				// Skewed distribution, so that frequencies differ
+				for (auto &v : values) v = (next() & next()) & ((1ULL << width) - 1);
+				test_wavelet<sux::util::AllocType::MALLOC>(values, threads);
+				test_wavelet<sux::util::AllocType::SMALLPAGE>(values, threads);
+			}
+}
@@ -1,11 +1,18 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <cstring>
+#include <forward_list>
 #include <fstream>
 #include <random>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <tuple>
 #include <sux/function/RecSplit.hpp>
+#include <sux/util/LoadedFile.hpp>
 
 using namespace std;
 using namespace sux;
@@ -60,6 +67,94 @@ TEST(recsplit_test, random_hash128) {
 	fclose(keys_fp);
 }*/
 
+TEST(recsplit_test, lookup) {
+	vector<hash128_t> keys;
+	for (size_t i = 0; i < NKEYS_TEST; ++i) {
+		keys.push_back(hash128_t(next(), next()));
+	}
+
+	RecSplit2 rs(keys, BUCKET_SIZE_TEST);
+	// Not a multiple of the batch size
+	const size_t n = keys.size() - 1;
+	vector<size_t> out(n);
+	rs.lookup(&keys[0], &out[0], n);
+	for (size_t i = 0; i < n; i++) ASSERT_EQ(rs(keys[i]), out[i]) << "at index " << i << endl;
+}
+
+TEST(recsplit_test, concurrent) {
+	vector<hash128_t> keys[2];
+	for (auto &k : keys)
+		for (size_t i = 0; i < NKEYS_TEST / 4; ++i) k.push_back(hash128_t(next(), next()));
+
+	// Concurrent constructions
+	RecSplit2 rs[2];
+	vector<thread> builders;
+	for (size_t t = 0; t < 2; t++) builders.emplace_back([&, t] { rs[t] = RecSplit2(keys[t], BUCKET_SIZE_TEST); });
+	for (auto &b : builders) b.join();
+
+	for (size_t t = 0; t < 2; t++) {
+		RecSplit2 single(keys[t], BUCKET_SIZE_TEST);
+		stringstream expected, actual;
+		expected << single;
+		actual << rs[t];
+		ASSERT_EQ(expected.str(), actual.str());
+	}
+
+	// Concurrent queries on a const instance
+	const RecSplit2 &crs = rs[0];
+	vector<size_t> expected(keys[0].size());
+	for (size_t i = 0; i < keys[0].size(); i++) expected[i] = crs(keys[0][i]);
+	atomic<size_t> errors(0);
+	vector<thread> readers;
+	for (size_t t = 0; t < 4; t++)
+		readers.emplace_back([&] {
+			for (size_t i = 0; i < keys[0].size(); i++) errors += crs(keys[0][i]) != expected[i];
+		});
+	for (auto &r : readers) r.join();
+	ASSERT_EQ(0, errors);
+}
+
+TEST(recsplit_test, find_bijection) {
+	uint64_t keys[16];
+	for (size_t m = 2; m <= 16; m++) {
+		for (size_t k = 0; k < 20; k++) {
+			for (size_t i = 0; i < m; i++) keys[i] = next();
+			const uint64_t start = next();
+			// Reference: the first seed mapping the keys bijectively
+			uint64_t expected = start;
+			for (;; expected++) {
+				uint32_t mask = 0;
+				for (size_t i = 0; i < m; i++) mask |= uint32_t(1) << remap16(remix(keys[i] + expected), m);
+				if (mask == (uint32_t(1) << m) - 1) break;
+			}
+			uint64_t evals = 0;
+			ASSERT_EQ(expected, find_bijection(keys, m, m, start, evals)) << "m = " << m << endl;
+			ASSERT_EQ(expected, find_bijection(keys, m, (m + 1) / 2, start, evals)) << "m = " << m << endl;
+			ASSERT_GT(evals, 0);
+		}
+	}
+}
+
+TEST(recsplit_test, find_split) {
+	uint64_t keys[200];
+	for (const auto &[m, part_size, fanout] : {make_tuple(200, 100, 2), make_tuple(150, 96, 2), make_tuple(40, 8, 5), make_tuple(100, 32, 4), make_tuple(12, 4, 3)}) {
+		for (size_t k = 0; k < 10; k++) {
+			for (int i = 0; i < m; i++) keys[i] = next();
+			const uint64_t start = next();
+			// Reference: the first seed for which the first fanout - 1 parts contain part_size keys
+			uint64_t expected = start;
+			for (;; expected++) {
+				vector<int> count(fanout);
+				for (int i = 0; i < m; i++) count[remap16(remix(keys[i] + expected), m) / part_size]++;
+				if (count_if(count.begin(), count.end() - 1, [&](int c) { return c != part_size; }) == 0) break;
+			}
+			uint64_t evals = 0;
+			ASSERT_EQ(expected, find_split(keys, m, part_size, fanout, start, evals)) << "m = " << m << ", fanout = " << fanout << endl;
+			ASSERT_GT(evals, 0);
+		}
+	}
+}
+
 TEST(recsplit_test, dump_and_load) {
 	vector<hash128_t> keys;
 	const char *filename = "test/test_dump";
@@ -135,3 +230,395 @@ TEST(recsplit_test, small_text_dump_and_load) {
 	recsplit_unit_test(rs_load, keys);
 	remove(filename);
 }
+
+TEST(recsplit_test, threads) {
+	vector<hash128_t> keys;
+	for (size_t i = 0; i < NKEYS_TEST; ++i) {
+		keys.push_back(hash128_t(next(), next()));
+	}
+
+	RecSplit2 rs_single(keys, BUCKET_SIZE_TEST);
+	stringstream single;
+	single << rs_single;
+
+	for (size_t num_threads : {2, 3, 7}) {
+		RecSplit2 rs_multi(keys, BUCKET_SIZE_TEST, num_threads);
+		stringstream multi;
+		multi << rs_multi;
+		ASSERT_EQ(single.str(), multi.str()) << "with " << num_threads << " threads" << endl;
+	}
+
+	// More threads than buckets
+	vector<hash128_t> few_keys;
+	for (size_t i = 0; i < 3 * BUCKET_SIZE_TEST; ++i) {
+		few_keys.push_back(hash128_t(next(), next()));
+	}
+	RecSplit2 rs_few(few_keys, BUCKET_SIZE_TEST, 16);
+	recsplit_unit_test(rs_few, few_keys);
+}
+
+TEST(recsplit_test, hasher) {
+	// Keys of all lengths exercise all code paths of WyHasher
+	vector<string> keys;
+	for (size_t i = 0; i < NKEYS_TEST; ++i) {
+		string key = to_string(next());
+		while (key.size() < i % 100) key += to_string(next());
+		keys.push_back(key.substr(0, i % 100));
+	}
+	sort(keys.begin(), keys.end());
+	keys.erase(unique(keys.begin(), keys.end()), keys.end());
+
+	RecSplit<LEAF, sux::util::AllocType::MALLOC, WyHasher> rs(keys, BUCKET_SIZE_TEST);
+	recsplit_unit_test(rs, keys);
+	stringstream single;
+	single << rs;
+
+	// Parallel hashing does not change the function
+	RecSplit<LEAF, sux::util::AllocType::MALLOC, WyHasher> rs_multi(keys, BUCKET_SIZE_TEST, 3);
+	stringstream multi;
+	multi << rs_multi;
+	ASSERT_EQ(single.str(), multi.str());
+
+	const char *filename = "test/test_keys";
+	ofstream ofs(filename);
+	for (const auto &k : keys) ofs << k << endl;
+	ofs.close();
+	ifstream ifs(filename);
+	RecSplit<LEAF, sux::util::AllocType::MALLOC, WyHasher> rs_stream(ifs, BUCKET_SIZE_TEST, 4);
+	ifs.close();
+	stringstream stream;
+	stream << rs_stream;
+	ASSERT_EQ(single.str(), stream.str());
+	remove(filename);
+
+	// The two halves of the hash are independent, and the length is hashed
+	ASSERT_NE(WyHasher::hash("", 0).first, WyHasher::hash("", 0).second);
+	ASSERT_NE(WyHasher::hash("\0", 1).first, WyHasher::hash("\0\0", 2).first);
+}
+
+TEST(recsplit_test, key_ranges) {
+	// All keys in a single buffer, as in a memory-mapped file
+	string buffer;
+	vector<size_t> offset{0};
+	for (size_t i = 0; i < NKEYS_TEST; ++i) {
+		buffer += to_string(next());
+		offset.push_back(buffer.size());
+	}
+	vector<string> keys;
+	vector<string_view> views;
+	forward_list<pair<const char *, size_t>> pairs;
+	for (size_t i = NKEYS_TEST; i-- != 0;) pairs.emplace_front(buffer.data() + offset[i], offset[i + 1] - offset[i]);
+	for (size_t i = 0; i < NKEYS_TEST; ++i) {
+		keys.emplace_back(buffer, offset[i], offset[i + 1] - offset[i]);
+		views.emplace_back(buffer.data() + offset[i], offset[i + 1] - offset[i]);
+	}
+
+	RecSplit2 rs(keys, BUCKET_SIZE_TEST);
+	recsplit_unit_test(rs, keys);
+	stringstream expected;
+	expected << rs;
+
+	RecSplit2 rs_views(views.begin(), views.end(), BUCKET_SIZE_TEST, 3);
+	stringstream ss_views;
+	ss_views << rs_views;
+	ASSERT_EQ(expected.str(), ss_views.str());
+
+	RecSplit2 rs_pairs(pairs.begin(), pairs.end(), BUCKET_SIZE_TEST, 2);
+	stringstream ss_pairs;
+	ss_pairs << rs_pairs;
+	ASSERT_EQ(expected.str(), ss_pairs.str());
+
+	// Chunks of varying size
+	size_t pos = 0, calls = 0;
+	RecSplit2 rs_chunks(
+		[&](string_view *chunk, const size_t max) {
+			const size_t n = std::min({max, views.size() - pos, 1 + calls++ * 1000});
+			copy(views.begin() + pos, views.begin() + pos + n, chunk);
+			pos += n;
+			return n;
+		},
+		BUCKET_SIZE_TEST, 4);
+	stringstream ss_chunks;
+	ss_chunks << rs_chunks;
+	ASSERT_EQ(expected.str(), ss_chunks.str());
+}
+
+TEST(recsplit_test, aligned_buckets) {
+	const char *filename = "test/test_keys";
+	vector<string> keys;
+	ofstream ofs(filename);
+	for (size_t i = 0; i < NKEYS_TEST; ++i) {
+		keys.push_back(to_string(next()));
+		ofs << keys.back() << endl;
+	}
+	ofs.close();
+
+	using AlignedRecSplit = RecSplit<LEAF, sux::util::AllocType::MALLOC, SpookyHasher, true>;
+	AlignedRecSplit rs(keys, BUCKET_SIZE_TEST);
+	recsplit_unit_test(rs, keys);
+	stringstream single;
+	single << rs;
+
+	// The result does not depend on the number of threads or on external construction
+	AlignedRecSplit rs_multi(keys, BUCKET_SIZE_TEST, 3);
+	stringstream multi;
+	multi << rs_multi;
+	ASSERT_EQ(single.str(), multi.str());
+
+	ifstream ifs(filename);
+	AlignedRecSplit rs_external(ifs, BUCKET_SIZE_TEST, 2, 1 << 16, "test");
+	ifs.close();
+	stringstream external;
+	external << rs_external;
+	ASSERT_EQ(single.str(), external.str());
+	remove(filename);
+
+	// Padding costs a few bits
+	RecSplit2 rs_packed(keys, BUCKET_SIZE_TEST);
+	ASSERT_GT(rs.buildProfile().descriptor_bits, rs_packed.buildProfile().descriptor_bits);
+	ASSERT_LT(rs.buildProfile().descriptor_bits, rs_packed.buildProfile().descriptor_bits * 11 / 10);
+
+	// With tiny buckets many descriptors are empty, and they must not be padded
+	const vector<string> few_keys(keys.begin(), keys.begin() + NKEYS_TEST / 10);
+	AlignedRecSplit rs_tiny(few_keys, 2);
+	RecSplit2 rs_tiny_packed(few_keys, 2);
+	ASSERT_LT(rs_tiny.buildProfile().descriptor_bits, rs_tiny_packed.buildProfile().descriptor_bits * 11 / 10);
+	recsplit_unit_test(rs_tiny, few_keys);
+
+	// The format is the same, so an unaligned instance can load an aligned one
+	RecSplit2 rs_load;
+	single >> rs_load;
+	for (const auto &k : keys) ASSERT_EQ(rs(k), rs_load(k));
+}
+
+TEST(recsplit_test, bucket_directory) {
+	using DirRecSplit = RecSplit<LEAF, sux::util::AllocType::MALLOC, SpookyHasher, false, BucketDirectory>;
+	vector<hash128_t> keys;
+	for (size_t i = 0; i < NKEYS_TEST; ++i) keys.push_back(hash128_t(next(), next()));
+
+	for (size_t bucket_size : {1, 5, 100, 2000}) {
+		DirRecSplit rs(keys, bucket_size);
+		RecSplit2 rs_ef(keys, bucket_size);
+		for (const auto &k : keys) ASSERT_EQ(rs_ef(k), rs(k)) << "bucket size " << bucket_size;
+
+		vector<size_t> out(keys.size());
+		rs.lookup(keys.data(), out.data(), keys.size());
+		for (size_t i = 0; i < keys.size(); ++i) ASSERT_EQ(rs(keys[i]), out[i]);
+
+		stringstream ss;
+		ss << rs;
+		const string serialized = ss.str();
+		DirRecSplit rs_load, rs_view;
+		ss >> rs_load;
+		ASSERT_TRUE(ss);
+		ASSERT_EQ(serialized.data() + serialized.size(), rs_view.view(serialized.data(), serialized.data() + serialized.size(), true));
+		for (size_t i = 0; i < keys.size(); i += 7) {
+			ASSERT_EQ(rs(keys[i]), rs_load(keys[i]));
+			ASSERT_EQ(rs(keys[i]), rs_view(keys[i]));
+		}
+
+		// The directory is part of the format
+		RecSplit2 rs_wrong;
+		stringstream wrong(serialized);
+		wrong >> rs_wrong;
+		EXPECT_FALSE(wrong);
+		EXPECT_EQ(nullptr, rs_wrong.view(serialized.data(), serialized.data() + serialized.size()));
+	}
+}
+
+TEST(recsplit_test, external) {
+	const char *filename = "test/test_keys";
+	vector<string> keys;
+	ofstream ofs(filename);
+	for (size_t i = 0; i < NKEYS_TEST; ++i) {
+		keys.push_back(to_string(next()));
+		ofs << keys.back() << endl;
+	}
+	ofs.close();
+
+	ifstream ifs(filename);
+	RecSplit2 rs_internal(ifs, BUCKET_SIZE_TEST);
+	ifs.close();
+	stringstream internal;
+	internal << rs_internal;
+
+	// The second budget is too small for a single level of temporary files
+	for (size_t memory_budget : {1 << 24, 1 << 16}) {
+		ifs.open(filename);
+		RecSplit2 rs_external(ifs, BUCKET_SIZE_TEST, 2, memory_budget, "test");
+		ifs.close();
+		stringstream external;
+		external << rs_external;
+		ASSERT_EQ(internal.str(), external.str()) << "with budget " << memory_budget << endl;
+	}
+
+	recsplit_unit_test(rs_internal, keys);
+	remove(filename);
+}
+
+TEST(recsplit_test, profile) {
+	vector<string> keys;
+	for (size_t i = 0; i < NKEYS_TEST; ++i) keys.push_back(to_string(next()));
+
+	RecSplit2 rs(keys, BUCKET_SIZE_TEST, 2);
+	const RecSplitProfile &p = rs.buildProfile();
+	ASSERT_EQ(NKEYS_TEST, p.keys);
+	ASSERT_EQ((NKEYS_TEST + BUCKET_SIZE_TEST - 1) / BUCKET_SIZE_TEST, p.buckets);
+	ASSERT_EQ(2, p.threads);
+	ASSERT_GT(p.time_hash, 0);
+	ASSERT_GT(p.time_sort, 0);
+	ASSERT_GT(p.time_buckets, 0);
+	ASSERT_EQ(p.time_hash + p.time_spill + p.time_sort + p.time_buckets + p.time_concat + p.time_descriptors + p.time_ef, p.time());
+	ASSERT_EQ(0, p.spill_bytes);
+	ASSERT_GE(p.scratch_allocations, 2 * 3);
+	ASSERT_GE(p.sort_bytes, NKEYS_TEST * sizeof(hash128_t));
+	ASSERT_GT(p.descriptor_bits, 0);
+	ASSERT_GT(p.ef_bits, 0);
+
+	const string json = p.json();
+	ASSERT_EQ('{', json.front());
+	ASSERT_EQ('}', json.back());
+	ASSERT_NE(string::npos, json.find("\"keys\": " + to_string(NKEYS_TEST)));
+	ASSERT_NE(string::npos, json.find("\"time\": " + to_string(p.time())));
+
+	// The external construction spills all hashes at least once
+	const char *filename = "test/test_keys";
+	ofstream ofs(filename);
+	for (const auto &k : keys) ofs << k << endl;
+	ofs.close();
+	ifstream ifs(filename);
+	RecSplit2 rs_external(ifs, BUCKET_SIZE_TEST, 1, 1 << 16, "test");
+	ifs.close();
+	ASSERT_GE(rs_external.buildProfile().spill_bytes, NKEYS_TEST * sizeof(hash128_t));
+	ASSERT_GT(rs_external.buildProfile().time_spill, 0);
+	remove(filename);
+
+	// A loaded instance has no profile
+	stringstream ss;
+	ss << rs;
+	RecSplit2 rs_load;
+	ss >> rs_load;
+	ASSERT_EQ(0, rs_load.buildProfile().time());
+}
+
+TEST(recsplit_test, dump_and_view) {
+	vector<hash128_t> keys;
+	const char *filename = "test/test_dump";
+	for (size_t i = 0; i < NKEYS_TEST; ++i) {
+		keys.push_back(hash128_t(next(), next()));
+	}
+
+	RecSplit2 rs_dump(keys, BUCKET_SIZE_TEST);
+
+	fstream fs;
+	fs.exceptions(fstream::failbit | fstream::badbit);
+	fs.open(filename, fstream::out | fstream::binary | fstream::trunc);
+	fs << rs_dump;
+	fs.close();
+
+	util::MappedFile file(filename);
+	RecSplit2 rs_view;
+	ASSERT_EQ(file.end(), rs_view.view(file.data(), file.end(), true));
+
+	for (size_t i = 0; i < rs_dump.size(); i++) ASSERT_EQ(rs_dump(keys[i]), rs_view(keys[i]));
+	recsplit_unit_test(rs_view, keys);
+	remove(filename);
+}
+
+TEST(recsplit_test, dump_and_prefault) {
+	vector<hash128_t> keys;
+	const char *filename = "test/test_dump_load";
+	for (size_t i = 0; i < NKEYS_TEST; ++i) {
+		keys.push_back(hash128_t(next(), next()));
+	}
+
+	RecSplit2 rs_dump(keys, BUCKET_SIZE_TEST);
+
+	fstream fs;
+	fs.exceptions(fstream::failbit | fstream::badbit);
+	fs.open(filename, fstream::out | fstream::binary | fstream::trunc);
+	fs << rs_dump;
+	fs.close();
+
+	util::MappedFile populated(filename, true);
+	util::LoadedFile<util::TRANSHUGEPAGE> loaded(filename);
+	util::LoadedFile<util::MALLOC> loaded_malloc(filename);
+	ASSERT_EQ(populated.size(), loaded.size());
+	ASSERT_EQ(0, memcmp(populated.data(), loaded.data(), loaded.size()));
+
+	RecSplit2 rs_populated, rs_loaded, rs_loaded_malloc;
+	ASSERT_EQ(populated.end(), rs_populated.view(populated.data(), populated.end(), true));
+	ASSERT_EQ(loaded.end(), rs_loaded.view(loaded.data(), loaded.end(), true));
+	ASSERT_EQ(loaded_malloc.end(), rs_loaded_malloc.view(loaded_malloc.data(), loaded_malloc.end(), true));
+
+	for (size_t i = 0; i < rs_dump.size(); i++) {
+		ASSERT_EQ(rs_dump(keys[i]), rs_populated(keys[i]));
+		ASSERT_EQ(rs_dump(keys[i]), rs_loaded(keys[i]));
+		ASSERT_EQ(rs_dump(keys[i]), rs_loaded_malloc(keys[i]));
+	}
+	remove(filename);
+}
+
+TEST(recsplit_test, invalid_load) {
+	vector<hash128_t> keys;
+	for (size_t i = 0; i < 10000; ++i) {
+		keys.push_back(hash128_t(next(), next()));
+	}
+
+	RecSplit2 rs(keys, BUCKET_SIZE_TEST);
+	stringstream ss;
+	ss << rs;
+	const string serialized = ss.str();
+
+	// Different leaf size
+	RecSplit<LEAF + 1> rs_leaf;
+	stringstream leaf(serialized);
+	leaf >> rs_leaf;
+	EXPECT_FALSE(leaf);
+	EXPECT_EQ(nullptr, rs_leaf.view(serialized.data(), serialized.data() + serialized.size()));
+
+	// Different hasher
+	RecSplit<LEAF, sux::util::AllocType::MALLOC, WyHasher> rs_hasher;
+	stringstream hasher(serialized);
+	hasher >> rs_hasher;
+	EXPECT_FALSE(hasher);
+	EXPECT_EQ(nullptr, rs_hasher.view(serialized.data(), serialized.data() + serialized.size()));
+
+	// Truncated data
+	RecSplit2 rs_load;
+	stringstream truncated(serialized.substr(0, serialized.size() - 64));
+	truncated >> rs_load;
+	EXPECT_FALSE(truncated);
+	EXPECT_EQ(nullptr, rs_load.view(serialized.data(), serialized.data() + serialized.size() - 64));
+
+	// Corrupted data
+	string corrupted = serialized;
+	corrupted[corrupted.size() / 2] ^= 1;
+	stringstream corrupted_ss(corrupted);
+	corrupted_ss >> rs_load;
+	EXPECT_FALSE(corrupted_ss);
+	EXPECT_EQ(nullptr, rs_load.view(corrupted.data(), corrupted.data() + corrupted.size(), true));
+}
+
+TEST(recsplit_test, instrumentation) {
+	using namespace sux::instrumentation;
+	vector<hash128_t> keys;
+	for (size_t i = 0; i < NKEYS_TEST / 10; ++i) keys.push_back(hash128_t(next(), next()));
+
+	RecSplit2 rs(keys, BUCKET_SIZE_TEST);
+	RecSplit<LEAF, util::AllocType::MALLOC, SpookyHasher, false, DoubleEF, Sampled<0>> instrumented(keys, BUCKET_SIZE_TEST);
+	for (const auto &key : keys) ASSERT_EQ(rs(key), instrumented(key));
+	vector<size_t> out(keys.size());
+	instrumented.lookup(&keys[0], &out[0], keys.size());
+
+	const auto &instr = instrumented.instrumentation();
+	const Summary bucket_size = instr.summary(instrumented.BUCKET_SIZE), depth = instr.summary(instrumented.DEPTH);
+	EXPECT_EQ(2 * keys.size(), bucket_size.samples);
+	EXPECT_EQ(2 * keys.size(), depth.samples);
+	EXPECT_EQ(2 * keys.size(), instr.summary(instrumented.SKIPPED_SUBTREES).samples);
+	// Keys in larger buckets are sampled more often, so the mean is at least the average bucket size
+	EXPECT_GE(bucket_size.mean(), BUCKET_SIZE_TEST * 0.9);
+	EXPECT_GT(depth.mean(), 1);
+	EXPECT_GE(instr.summary(instrumented.SKIPPED_NODES).sum, instr.summary(instrumented.SKIPPED_SUBTREES).sum);
+	EXPECT_STREQ("depth", instrumented.COUNTER_NAMES[instrumented.DEPTH]);
+}
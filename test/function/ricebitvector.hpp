@@ -1,6 +1,7 @@
 #pragma once
 
 #include <random>
+#include <sstream>
 #include <sux/function/RiceBitVector.hpp>
 #include <vector>
 
@@ -138,3 +139,96 @@ TEST(RiceBitVector_test, trees_golomb_6) {
 
 	test_rice_trees(r, keys, golomb_param, tree_offset);
 }
+
+TEST(RiceBitVector_test, append) {
+	vector<uint64_t> keys = gen_keys();
+
+	for (int golomb_param = 0; golomb_param < 7; golomb_param++) {
+		for (size_t split = 0; split < 130; split++) {
+			RiceBitVector<>::Builder whole, first, second;
+			size_t i = 0;
+			for (uint64_t k : keys) {
+				whole.appendFixed(k, golomb_param);
+				(i++ < split ? first : second).appendFixed(k, golomb_param);
+			}
+			first.append(second);
+			ASSERT_EQ(whole.getBits(), first.getBits());
+
+			auto a = whole.build(), b = first.build();
+			stringstream sa, sb;
+			sa << a;
+			sb << b;
+			ASSERT_EQ(sa.str(), sb.str()) << "golomb " << golomb_param << ", split " << split << endl;
+		}
+	}
+}
+
+TEST(RiceBitVector_test, skip_and_read) {
+	mt19937_64 rng(0);
+	const int golomb_param = 3;
+	vector<uint64_t> keys;
+	// Small codes (many unary parts per word) and a few large ones (spanning words)
+	for (size_t i = 0; i < 1000; ++i) keys.push_back(i % 97 == 0 ? rng() % 2000 : rng() % 32);
+
+	RiceBitVector<>::Builder b;
+	vector<uint32_t> unary;
+	for (uint64_t k : keys) {
+		b.appendFixed(k, golomb_param);
+		unary.push_back(k >> golomb_param);
+	}
+	b.appendUnaryAll(unary);
+	auto r = b.build();
+
+	for (size_t first = 0; first < 200; ++first) {
+		for (size_t nodes = 0; nodes < 300; nodes += 1 + nodes / 8) {
+			auto reader = r.reader(), expected = r.reader();
+			reader.readReset(0, golomb_param * keys.size());
+			expected.readReset(0, golomb_param * keys.size());
+			for (size_t i = 0; i < first; ++i) {
+				reader.readNext(golomb_param);
+				expected.readNext(golomb_param);
+			}
+			if (nodes != 0) expected.skipSubtree(nodes, golomb_param * nodes);
+			ASSERT_EQ(keys[first + nodes], reader.skipAndReadNext(nodes, golomb_param * nodes, golomb_param)) << first << ", " << nodes;
+			ASSERT_EQ(keys[first + nodes], expected.readNext(golomb_param));
+			// The readers are in the same state
+			ASSERT_EQ(expected.readNext(golomb_param), reader.readNext(golomb_param));
+		}
+	}
+}
+
+TEST(RiceBitVector_test, append_range_and_align) {
+	mt19937_64 rng(0);
+	RiceBitVector<>::Builder source;
+	vector<pair<uint64_t, int>> codes;
+	for (size_t i = 0; i < 10000; ++i) {
+		const int len = 1 + rng() % 40;
+		codes.emplace_back(rng() & ((uint64_t(1) << len) - 1), len);
+		source.appendFixed(codes.back().first, len);
+	}
+
+	// Copies random ranges of the source, possibly aligned, and appends the same codes one by one
+	RiceBitVector<>::Builder copy, expected;
+	for (size_t i = 0, from = 0; i < codes.size();) {
+		const size_t n = min(codes.size() - i, size_t(1 + rng() % 100));
+		size_t length = 0;
+		for (size_t j = i; j < i + n; ++j) length += codes[j].second;
+		if (rng() % 2) {
+			copy.alignToCacheLine(length);
+			expected.alignToCacheLine(length);
+			// The range spans as few cache lines as possible
+			ASSERT_EQ((copy.getBits() % 512 + length + 511) / 512, (length + 511) / 512);
+		}
+		copy.append(source, from, length);
+		for (size_t j = i; j < i + n; ++j) expected.appendFixed(codes[j].first, codes[j].second);
+		ASSERT_EQ(expected.getBits(), copy.getBits());
+		from += length;
+		i += n;
+	}
+
+	auto a = copy.build(), b = expected.build();
+	stringstream sa, sb;
+	sa << a;
+	sb << b;
+	ASSERT_EQ(sb.str(), sa.str());
+}
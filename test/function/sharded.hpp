@@ -0,0 +1,95 @@
+#pragma once
+
+#include <sstream>
+#include <sux/function/ShardedRecSplit.hpp>
+
+using ShardedRecSplit2 = ShardedRecSplit<LEAF>;
+
+TEST(sharded_recsplit_test, strings) {
+	vector<string> keys;
+	for (size_t i = 0; i < NKEYS_TEST / 4; ++i) keys.push_back(to_string(next()));
+
+	for (size_t num_shards : {1, 5, 16}) {
+		ShardedRecSplit2 rs(keys, BUCKET_SIZE_TEST, num_shards, 3);
+		ASSERT_EQ(keys.size(), rs.size());
+		ASSERT_EQ(num_shards, rs.numShards());
+		recsplit_unit_test(rs, keys);
+	}
+}
+
+TEST(sharded_recsplit_test, empty_shards) {
+	vector<hash128_t> keys;
+	for (size_t i = 0; i < 20; ++i) keys.push_back(hash128_t(next(), next()));
+
+	ShardedRecSplit2 rs(keys, BUCKET_SIZE_TEST, 64, 4);
+	ASSERT_EQ(keys.size(), rs.size());
+	size_t nonempty = 0;
+	for (size_t s = 0; s < rs.numShards(); s++) nonempty += rs.getShard(s).size() != 0;
+	ASSERT_LT(nonempty, 64);
+	recsplit_unit_test(rs, keys);
+
+	stringstream ss;
+	ss << rs;
+	ShardedRecSplit2 rs_load;
+	ss >> rs_load;
+	ASSERT_TRUE(ss);
+	for (const auto &k : keys) ASSERT_EQ(rs(k), rs_load(k));
+}
+
+TEST(sharded_recsplit_test, rebuild) {
+	vector<hash128_t> keys;
+	for (size_t i = 0; i < NKEYS_TEST / 4; ++i) keys.push_back(hash128_t(next(), next()));
+	ShardedRecSplit2 rs(keys, BUCKET_SIZE_TEST, 8, 2);
+
+	// Replaces half of the keys of shard 3 and adds some new keys to it
+	const size_t s = 3;
+	vector<hash128_t> new_keys;
+	bool drop = false;
+	for (const auto &k : keys)
+		if (rs.shard(k) != s || (drop = !drop)) new_keys.push_back(k);
+	for (size_t added = 0; added < 1000;) {
+		const hash128_t k(next(), next());
+		if (rs.shard(k) == s) {
+			new_keys.push_back(k);
+			added++;
+		}
+	}
+
+	const size_t before = rs.getShard(s + 1).size();
+	rs.rebuild(s, new_keys, BUCKET_SIZE_TEST);
+	ASSERT_EQ(new_keys.size(), rs.size());
+	ASSERT_EQ(before, rs.getShard(s + 1).size());
+	recsplit_unit_test(rs, new_keys);
+
+	// A rebuilt shard can be deployed independently
+	ShardedRecSplit2 old(keys, BUCKET_SIZE_TEST, 8);
+	stringstream shard;
+	shard << rs.getShard(s);
+	RecSplit2 rs_shard;
+	shard >> rs_shard;
+	old.setShard(s, std::move(rs_shard));
+	for (const auto &k : new_keys) ASSERT_EQ(rs(k), old(k));
+}
+
+TEST(sharded_recsplit_test, dump_and_view) {
+	vector<string> keys;
+	for (size_t i = 0; i < NKEYS_TEST / 10; ++i) keys.push_back(to_string(next()));
+	ShardedRecSplit2 rs(keys, BUCKET_SIZE_TEST, 4, 2);
+
+	const char *filename = "test/test_dump_sharded";
+	fstream fs;
+	fs.exceptions(fstream::failbit | fstream::badbit);
+	fs.open(filename, fstream::out | fstream::binary | fstream::trunc);
+	fs << rs;
+	fs.close();
+
+	util::MappedFile file(filename);
+	ShardedRecSplit2 rs_view;
+	ASSERT_EQ(file.end(), rs_view.view(file.data(), file.end(), true));
+	for (const auto &k : keys) ASSERT_EQ(rs(k), rs_view(k));
+
+	// Truncated data is invalid
+	ShardedRecSplit2 rs_invalid;
+	ASSERT_EQ(nullptr, rs_invalid.view(file.data(), file.end() - 64));
+	remove(filename);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <sstream>
+#include <sux/function/StaticMap.hpp>
+
+TEST(static_map_test, values) {
+	vector<string> keys;
+	vector<uint64_t> values;
+	for (size_t i = 0; i < NKEYS_TEST / 4; ++i) {
+		keys.push_back(to_string(next()));
+		values.push_back(next() & ((1 << 13) - 1));
+	}
+
+	StaticMap<LEAF, 13> map(keys, values, 100, 2);
+	ASSERT_EQ(keys.size(), map.size());
+	for (size_t i = 0; i < keys.size(); i++) ASSERT_EQ(values[i], map(keys[i])) << i;
+
+	vector<hash128_t> h;
+	vector<uint64_t> full;
+	for (size_t i = 0; i < NKEYS_TEST / 4; ++i) {
+		h.push_back(hash128_t(next(), next()));
+		full.push_back(next());
+	}
+	StaticMap<LEAF, 64> map64(h, full, BUCKET_SIZE_TEST);
+	for (size_t i = 0; i < h.size(); i++) ASSERT_EQ(full[i], map64(h[i])) << i;
+
+	// Batched lookups
+	vector<uint64_t> out(h.size());
+	map64.lookup(h.data(), out.data(), h.size());
+	ASSERT_EQ(full, out);
+}
+
+TEST(static_map_test, fingerprints) {
+	vector<hash128_t> keys;
+	vector<uint64_t> values;
+	for (size_t i = 0; i < NKEYS_TEST / 4; ++i) {
+		keys.push_back(hash128_t(next(), next()));
+		values.push_back(i % 7);
+	}
+
+	StaticMap<LEAF, 3, 12> map(keys, values, 100);
+	uint64_t v;
+	for (size_t i = 0; i < keys.size(); i++) {
+		ASSERT_TRUE(map.get(keys[i], v)) << i;
+		ASSERT_EQ(values[i], v) << i;
+	}
+
+	// Keys outside the set are accepted with probability 2^-12
+	size_t accepted = 0;
+	for (size_t i = 0; i < keys.size(); i++) accepted += map.get(hash128_t(next(), next()), v);
+	ASSERT_LT(accepted, 3 * keys.size() / 4096);
+
+	// Without fingerprints all keys are accepted
+	StaticMap<LEAF, 3> plain(keys, values, 100);
+	ASSERT_TRUE(plain.get(hash128_t(next(), next()), v));
+}
+
+TEST(static_map_test, dump_and_view) {
+	vector<string> keys;
+	vector<uint64_t> values;
+	for (size_t i = 0; i < NKEYS_TEST / 10; ++i) {
+		keys.push_back(to_string(next()));
+		values.push_back(next() & 0xFFFF);
+	}
+	StaticMap<LEAF, 16, 8> map(keys, values, 100);
+
+	const char *filename = "test/test_dump_map";
+	fstream fs;
+	fs.exceptions(fstream::failbit | fstream::badbit);
+	fs.open(filename, fstream::out | fstream::binary | fstream::trunc);
+	fs << map;
+	fs.close();
+
+	fs.open(filename, fstream::in | fstream::binary);
+	StaticMap<LEAF, 16, 8> map_load;
+	fs >> map_load;
+	fs.close();
+
+	util::MappedFile file(filename);
+	StaticMap<LEAF, 16, 8> map_view;
+	ASSERT_EQ(file.end(), map_view.view(file.data(), file.end(), true));
+	uint64_t v;
+	for (size_t i = 0; i < keys.size(); i++) {
+		ASSERT_EQ(values[i], map_load(keys[i]));
+		ASSERT_TRUE(map_view.get(keys[i], v));
+		ASSERT_EQ(values[i], v);
+	}
+
+	// A different number of value bits is rejected
+	StaticMap<LEAF, 15, 8> other;
+	ASSERT_EQ(nullptr, other.view(file.data(), file.end()));
+	remove(filename);
+}
@@ -6,6 +6,8 @@
 #define LEAF 4
 #define NKEYS_TEST 1000000
 #include "recsplit.hpp"
+#include "sharded.hpp"
+#include "staticmap.hpp"
 
 int main(int argc, char **argv) {
 	::testing::InitGoogleTest(&argc, argv);
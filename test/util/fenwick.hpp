@@ -1,12 +1,20 @@
 #pragma once
 
 #include <cmath>
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <sux/util/FenwickAtomicF.hpp>
 #include <sux/util/FenwickBitF.hpp>
 #include <sux/util/FenwickBitL.hpp>
 #include <sux/util/FenwickByteF.hpp>
 #include <sux/util/FenwickByteL.hpp>
 #include <sux/util/FenwickFixedF.hpp>
 #include <sux/util/FenwickFixedL.hpp>
+#include <sux/util/FenwickPersistentL.hpp>
+#include <sux/util/InstrumentedPrefixSums.hpp>
+#include <sux/util/KaryPrefixSums.hpp>
 
 template <std::size_t S> void run_fenwick(std::size_t size) {
 	using namespace sux::util;
@@ -25,6 +33,9 @@ template <std::size_t S> void run_fenwick(std::size_t size) {
 	FenwickByteL<S> bytel(increments, size);
 	FenwickBitF<S> bitf(increments, size);
 	FenwickBitL<S> bitl(increments, size);
+	FenwickAtomicF<S> atomicf(increments, size);
+	FenwickPersistentL<S> persistentl(increments, size);
+	KaryPrefixSums<S> kary(increments, size);
 
 	// prefix
 	for (size_t i = 0; i <= size; ++i) {
@@ -35,6 +46,9 @@ template <std::size_t S> void run_fenwick(std::size_t size) {
 		EXPECT_EQ(res, bytel.prefix(i)) << "at index " << i << ", size " << size << ", bound " << S;
 		EXPECT_EQ(res, bitf.prefix(i)) << "at index " << i << ", size " << size << ", bound " << S;
 		EXPECT_EQ(res, bitl.prefix(i)) << "at index " << i << ", size " << size << ", bound " << S;
+		EXPECT_EQ(res, atomicf.prefix(i)) << "at index " << i << ", size " << size << ", bound " << S;
+		EXPECT_EQ(res, persistentl.prefix(i)) << "at index " << i << ", size " << size << ", bound " << S;
+		EXPECT_EQ(res, kary.prefix(i)) << "at index " << i << ", size " << size << ", bound " << S;
 	}
 
 	// find
@@ -47,6 +61,9 @@ template <std::size_t S> void run_fenwick(std::size_t size) {
 		EXPECT_EQ(res, bytel.find(item)) << "at index " << i << ", size " << size << ", bound: " << S;
 		EXPECT_EQ(res, bitf.find(item)) << "at index " << i << ", size " << size << ", bound: " << S;
 		EXPECT_EQ(res, bitl.find(item)) << "at index " << i << ", size " << size << ", bound: " << S;
+		EXPECT_EQ(res, atomicf.find(item)) << "at index " << i << ", size " << size << ", bound: " << S;
+		EXPECT_EQ(res, persistentl.find(item)) << "at index " << i << ", size " << size << ", bound: " << S;
+		EXPECT_EQ(res, kary.find(item)) << "at index " << i << ", size " << size << ", bound: " << S;
 	}
 
 	// add
@@ -57,6 +74,9 @@ template <std::size_t S> void run_fenwick(std::size_t size) {
 		bytel.add(i + 1, add_updates[i]);
 		bitf.add(i + 1, add_updates[i]);
 		bitl.add(i + 1, add_updates[i]);
+		atomicf.add(i + 1, add_updates[i]);
+		persistentl.add(i + 1, add_updates[i]);
+		kary.add(i + 1, add_updates[i]);
 	}
 
 	// post add prefix (check add correctness)
@@ -68,6 +88,9 @@ template <std::size_t S> void run_fenwick(std::size_t size) {
 		EXPECT_EQ(res, bytel.prefix(i)) << "at index " << i << ", size " << size << ", bound " << S;
 		EXPECT_EQ(res, bitf.prefix(i)) << "at index " << i << ", size " << size << ", bound " << S;
 		EXPECT_EQ(res, bitl.prefix(i)) << "at index " << i << ", size " << size << ", bound " << S;
+		EXPECT_EQ(res, atomicf.prefix(i)) << "at index " << i << ", size " << size << ", bound " << S;
+		EXPECT_EQ(res, persistentl.prefix(i)) << "at index " << i << ", size " << size << ", bound " << S;
+		EXPECT_EQ(res, kary.prefix(i)) << "at index " << i << ", size " << size << ", bound " << S;
 	}
 
 	// find complement
@@ -80,6 +103,9 @@ template <std::size_t S> void run_fenwick(std::size_t size) {
 		EXPECT_EQ(res, bytel.compFind(item)) << "at index " << i << ", size " << size << ", bound " << S;
 		EXPECT_EQ(res, bitf.compFind(item)) << "at index " << i << ", size " << size << ", bound " << S;
 		EXPECT_EQ(res, bitl.compFind(item)) << "at index " << i << ", size " << size << ", bound " << S;
+		EXPECT_EQ(res, atomicf.compFind(item)) << "at index " << i << ", size " << size << ", bound " << S;
+		EXPECT_EQ(res, persistentl.compFind(item)) << "at index " << i << ", size " << size << ", bound " << S;
+		EXPECT_EQ(res, kary.compFind(item)) << "at index " << i << ", size " << size << ", bound " << S;
 	}
 
 	delete[] increments;
@@ -119,3 +145,339 @@ TEST(fenwick, bound) {
 
 	// Note: BOUND >= 2^55 is not supported in FenwickBitF
 }
+
+template <class T> static void check_batch(T ft, T reference, size_t size, size_t n) {
+	std::vector<size_t> idx(n), length(n);
+	std::vector<std::int64_t> inc(n);
+	std::vector<std::uint64_t> out(n);
+
+	// Sorted indices, with repetitions
+	for (size_t i = 0; i < n; i++) idx[i] = 1 + next() % size;
+	std::sort(idx.begin(), idx.end());
+	for (size_t i = 0; i < n; i++) inc[i] = next() % 2;
+
+	ft.addBatch(idx.data(), inc.data(), n);
+	for (size_t i = 0; i < n; i++) reference.add(idx[i], inc[i]);
+	for (size_t i = 0; i <= size; ++i) ASSERT_EQ(reference.prefix(i), ft.prefix(i)) << "at index " << i << ", size " << size;
+
+	// Bulk prefix sums, in sorted and in arbitrary order
+	for (size_t i = 0; i < n; i++) length[i] = next() % (size + 1);
+	for (int sorted = 0; sorted < 2; sorted++) {
+		if (sorted) std::sort(length.begin(), length.end());
+		ft.prefix(length.data(), out.data(), n);
+		for (size_t i = 0; i < n; i++) ASSERT_EQ(reference.prefix(length[i]), out[i]) << "at index " << i << ", size " << size;
+	}
+
+	// Decrements
+	for (size_t i = 0; i < n; i++) inc[i] = -inc[i];
+	ft.addBatch(idx.data(), inc.data(), n);
+	for (size_t i = 0; i < n; i++) reference.add(idx[i], inc[i]);
+	for (size_t i = 0; i <= size; ++i) ASSERT_EQ(reference.prefix(i), ft.prefix(i)) << "at index " << i << ", size " << size;
+}
+
+TEST(fenwick, batch) {
+	using namespace sux::util;
+	for (size_t size : {1, 2, 3, 7, 64, 1000, 100000}) {
+		std::uint64_t *increments = new std::uint64_t[size];
+		for (std::size_t i = 0; i < size; i++) increments[i] = next() % 63;
+
+		for (size_t n : {size_t(0), size_t(1), size_t(10), size / 2 + 1, size * 3}) {
+			check_batch(FenwickFixedF<64>(increments, size), FenwickFixedF<64>(increments, size), size, n);
+			check_batch(FenwickFixedL<64>(increments, size), FenwickFixedL<64>(increments, size), size, n);
+			check_batch(FenwickByteF<64>(increments, size), FenwickByteF<64>(increments, size), size, n);
+			check_batch(FenwickByteL<64>(increments, size), FenwickByteL<64>(increments, size), size, n);
+			check_batch(FenwickBitF<64>(increments, size), FenwickBitF<64>(increments, size), size, n);
+			check_batch(FenwickBitL<64>(increments, size), FenwickBitL<64>(increments, size), size, n);
+			check_batch(FenwickAtomicF<64>(increments, size), FenwickAtomicF<64>(increments, size), size, n);
+			check_batch(FenwickPersistentL<64>(increments, size), FenwickPersistentL<64>(increments, size), size, n);
+			check_batch(KaryPrefixSums<64>(increments, size), KaryPrefixSums<64>(increments, size), size, n);
+		}
+
+		delete[] increments;
+	}
+}
+
+template <class T> static void check_serialization(T ft, size_t size) {
+	std::stringstream ss;
+	ss << ft;
+	const std::string serialized = ss.str();
+	ASSERT_EQ(0, serialized.size() % 64);
+
+	T loaded;
+	ss >> loaded;
+	ASSERT_TRUE(ss);
+	for (size_t i = 0; i <= size; ++i) ASSERT_EQ(ft.prefix(i), loaded.prefix(i)) << "at index " << i;
+
+	// Truncated data
+	std::stringstream truncated(serialized.substr(0, serialized.size() - 1));
+	truncated >> loaded;
+	EXPECT_FALSE(truncated);
+
+	// Corrupted data
+	std::string corrupted = serialized;
+	corrupted[corrupted.size() / 2] ^= 1;
+	std::stringstream corrupted_ss(corrupted);
+	corrupted_ss >> loaded;
+	EXPECT_FALSE(corrupted_ss);
+}
+
+TEST(fenwick, serialization) {
+	using namespace sux::util;
+	const size_t size = 1000;
+	std::uint64_t *increments = new std::uint64_t[size];
+	for (std::size_t i = 0; i < size; i++) increments[i] = next() % 64;
+
+	check_serialization(FenwickFixedF<64>(increments, size), size);
+	check_serialization(FenwickFixedL<64>(increments, size), size);
+	check_serialization(FenwickByteF<64>(increments, size), size);
+	check_serialization(FenwickByteL<64>(increments, size), size);
+	check_serialization(FenwickBitF<64>(increments, size), size);
+	check_serialization(FenwickBitL<64>(increments, size), size);
+	check_serialization(FenwickAtomicF<64>(increments, size), size);
+	check_serialization(FenwickPersistentL<64>(increments, size), size);
+	check_serialization(KaryPrefixSums<64>(increments, size), size);
+
+	// Different bound
+	std::stringstream ss;
+	ss << FenwickFixedF<64>(increments, size);
+	FenwickFixedF<63> other;
+	ss >> other;
+	EXPECT_FALSE(ss);
+
+	delete[] increments;
+}
+
+TEST(fenwick, concurrent) {
+	using namespace sux::util;
+	const size_t size = 100000, num_threads = 8, updates = 100000;
+	std::uint64_t *increments = new std::uint64_t[size];
+	for (std::size_t i = 0; i < size; i++) increments[i] = next() % 32;
+
+	FenwickAtomicF<64> atomicf(increments, size);
+	FenwickFixedF<64> fixedf(increments, size);
+
+	// Each thread adds and then removes the same increments, plus a final increment of its own
+	std::vector<std::vector<size_t>> idx(num_threads);
+	for (size_t t = 0; t < num_threads; t++)
+		for (size_t i = 0; i < updates; i++) idx[t].push_back(1 + next() % size);
+
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < num_threads; t++)
+		threads.emplace_back([&, t] {
+			for (size_t i = 0; i < updates; i++) atomicf.add(idx[t][i], 1);
+			for (size_t i = 0; i < updates; i++) {
+				// Prefix sums can only grow while increments are being removed elsewhere
+				EXPECT_GE(atomicf.prefix(size), fixedf.prefix(size));
+				atomicf.add(idx[t][i], -1);
+			}
+			atomicf.add(t + 1, 1);
+		});
+	for (auto &thread : threads) thread.join();
+
+	for (size_t t = 0; t < num_threads; t++) fixedf.add(t + 1, 1);
+	for (size_t i = 0; i <= size; ++i) ASSERT_EQ(fixedf.prefix(i), atomicf.prefix(i)) << "at index " << i;
+
+	delete[] increments;
+}
+
+TEST(fenwick, snapshot) {
+	using namespace sux::util;
+	const size_t size = 100000;
+	std::uint64_t *increments = new std::uint64_t[size];
+	for (std::size_t i = 0; i < size; i++) increments[i] = next() % 32;
+
+	FenwickPersistentL<64> persistentl(increments, size);
+	FenwickFixedF<64> fixedf(increments, size);
+
+	// A snapshot of an unmodified tree shares all its pages
+	FenwickPersistentL<64> snapshot = persistentl.snapshot();
+	const FenwickPersistentL<64> copy = snapshot;
+	for (size_t i = 0; i < 1000; i++) persistentl.add(1 + next() % size, 1);
+	for (size_t i = 0; i < 100; i++) persistentl.push(next() % 65);
+	for (size_t i = 0; i < 1000; i++) persistentl.pop();
+	EXPECT_EQ(size, copy.size());
+	for (size_t i = 0; i <= size; ++i) ASSERT_EQ(fixedf.prefix(i), snapshot.prefix(i)) << "at index " << i;
+	for (size_t i = 0; i < 1000; i++) {
+		uint64_t val = next() % (32 * size), val_snapshot = val;
+		ASSERT_EQ(fixedf.find(&val), snapshot.find(&val_snapshot));
+		ASSERT_EQ(val, val_snapshot);
+	}
+
+	// Modifying the snapshot does not affect the original
+	FenwickPersistentL<64> reference = persistentl.snapshot();
+	for (size_t i = 0; i < 1000; i++) snapshot.add(1 + next() % size, 1);
+	for (size_t i = 0; i <= persistentl.size(); ++i) ASSERT_EQ(reference.prefix(i), persistentl.prefix(i)) << "at index " << i;
+
+	// A thread queries a snapshot while the original is modified
+	snapshot = persistentl.snapshot();
+	std::vector<uint64_t> expected(size + 1);
+	for (size_t i = 0; i <= persistentl.size(); ++i) expected[i] = persistentl.prefix(i);
+	std::thread reader([&] {
+		for (size_t r = 0; r < 4; r++)
+			for (size_t i = 0; i < expected.size() && i <= snapshot.size(); ++i) ASSERT_EQ(expected[i], snapshot.prefix(i)) << "at index " << i;
+	});
+	for (size_t i = 0; i < 100000; i++) persistentl.add(1 + next() % persistentl.size(), 1);
+	reader.join();
+
+	delete[] increments;
+}
+
+template <class T> static void check_push_pop() {
+	using namespace sux::util;
+	T tree;
+	FenwickFixedF<64> fixedf;
+
+	// Crosses several times the sizes at which the trees gain a level
+	for (size_t round = 0; round < 3; round++) {
+		for (size_t i = 0; i < 5000; i++) {
+			const uint64_t val = next() % 65;
+			tree.push(val);
+			fixedf.push(val);
+		}
+		for (size_t i = 0; i < 4000 - round * 1000; i++) {
+			tree.pop();
+			fixedf.pop();
+		}
+
+		ASSERT_EQ(fixedf.size(), tree.size());
+		const size_t size = fixedf.size();
+		for (size_t i = 0; i <= size; ++i) ASSERT_EQ(fixedf.prefix(i), tree.prefix(i)) << "at index " << i << ", round " << round;
+		for (size_t i = 0; i <= size; ++i) {
+			uint64_t val = next() % (65 * size + 1), comp_val = val, val_tree = val, comp_val_tree = val;
+			ASSERT_EQ(fixedf.find(&val), tree.find(&val_tree)) << "at index " << i << ", round " << round;
+			ASSERT_EQ(val, val_tree) << "at index " << i << ", round " << round;
+			ASSERT_EQ(fixedf.compFind(&comp_val), tree.compFind(&comp_val_tree)) << "at index " << i << ", round " << round;
+			ASSERT_EQ(comp_val, comp_val_tree) << "at index " << i << ", round " << round;
+		}
+	}
+}
+
+TEST(fenwick, push_pop) {
+	using namespace sux::util;
+	check_push_pop<FenwickFixedL<64>>();
+	check_push_pop<FenwickByteF<64>>();
+	check_push_pop<FenwickByteL<64>>();
+	check_push_pop<FenwickBitF<64>>();
+	check_push_pop<FenwickBitL<64>>();
+	check_push_pop<FenwickAtomicF<64>>();
+	check_push_pop<FenwickPersistentL<64>>();
+	check_push_pop<KaryPrefixSums<64>>();
+}
+
+template <template <size_t, sux::util::AllocType> class T, size_t S> static void check_parallel(const std::uint64_t *increments, const size_t size) {
+	using namespace sux::util;
+	T<S, MALLOC> sequential((std::uint64_t *)increments, size), parallel((std::uint64_t *)increments, size, 4);
+	std::uint64_t sum = 0;
+	for (size_t i = 0; i <= size; ++i) {
+		ASSERT_EQ(sum, sequential.prefix(i)) << "at index " << i << ", size " << size << ", bound " << S;
+		ASSERT_EQ(sum, parallel.prefix(i)) << "at index " << i << ", size " << size << ", bound " << S;
+		if (i < size) sum += increments[i];
+	}
+}
+
+template <size_t S> static void run_parallel(const size_t size) {
+	std::uint64_t *increments = new std::uint64_t[size];
+	for (std::size_t i = 0; i < size; i++) increments[i] = next() % (S + 1);
+
+	check_parallel<sux::util::FenwickFixedF, S>(increments, size);
+	check_parallel<sux::util::FenwickFixedL, S>(increments, size);
+	check_parallel<sux::util::FenwickByteF, S>(increments, size);
+	check_parallel<sux::util::FenwickByteL, S>(increments, size);
+	check_parallel<sux::util::FenwickBitF, S>(increments, size);
+	check_parallel<sux::util::FenwickBitL, S>(increments, size);
+	check_parallel<sux::util::FenwickAtomicF, S>(increments, size);
+	check_parallel<sux::util::FenwickPersistentL, S>(increments, size);
+
+	delete[] increments;
+}
+
+TEST(fenwick, parallel) {
+	for (size_t size : {0, 1, 1000, 1 << 17, 1000000}) {
+		run_parallel<1>(size);
+		run_parallel<64>(size);
+		run_parallel<100000>(size);
+	}
+}
+
+template <class T> static void check_range_add(T ft, T reference, const size_t size) {
+	for (size_t r = 0; r < 100; r++) {
+		size_t from = next() % (size + 1), to = next() % (size + 1);
+		if (from > to) std::swap(from, to);
+		if (r % 10 == 0) to = size;
+		ft.rangeAdd(from, to, 2);
+		for (size_t i = from + 1; i <= to; i++) reference.add(i, 2);
+		if (r % 2 == 0) {
+			ft.rangeAdd(from, to, -1);
+			for (size_t i = from + 1; i <= to; i++) reference.add(i, -1);
+		}
+	}
+	for (size_t i = 0; i <= size; ++i) ASSERT_EQ(reference.prefix(i), ft.prefix(i)) << "at index " << i << ", size " << size;
+}
+
+TEST(fenwick, range_add) {
+	using namespace sux::util;
+	for (size_t size : {1, 2, 17, 1000, 5000}) {
+		std::uint64_t *increments = new std::uint64_t[size]();
+
+		check_range_add(FenwickFixedF<1000>(increments, size), FenwickFixedF<1000>(increments, size), size);
+		check_range_add(FenwickFixedL<1000>(increments, size), FenwickFixedL<1000>(increments, size), size);
+		check_range_add(FenwickByteF<1000>(increments, size), FenwickByteF<1000>(increments, size), size);
+		check_range_add(FenwickByteL<1000>(increments, size), FenwickByteL<1000>(increments, size), size);
+		check_range_add(FenwickBitF<1000>(increments, size), FenwickBitF<1000>(increments, size), size);
+		check_range_add(FenwickBitL<1000>(increments, size), FenwickBitL<1000>(increments, size), size);
+		check_range_add(FenwickAtomicF<1000>(increments, size), FenwickAtomicF<1000>(increments, size), size);
+		check_range_add(FenwickPersistentL<1000>(increments, size), FenwickPersistentL<1000>(increments, size), size);
+		check_range_add(KaryPrefixSums<1000>(increments, size), KaryPrefixSums<1000>(increments, size), size);
+
+		delete[] increments;
+	}
+}
+
+TEST(fenwick, instrumentation) {
+	using namespace sux::util;
+	using namespace sux::instrumentation;
+	for (size_t size : {1, 1000, 1 << 17}) {
+		std::uint64_t *increments = new std::uint64_t[size];
+		for (size_t i = 0; i < size; i++) increments[i] = next() % 64;
+
+		FenwickFixedF<64> reference(increments, size);
+		InstrumentedPrefixSums<FenwickFixedF<64>, Sampled<0, 1>> all(increments, size);
+		InstrumentedPrefixSums<FenwickByteL<64>, Sampled<2, 1>> some(increments, size);
+		InstrumentedPrefixSums<FenwickByteL<64>> none(increments, size);
+		const uint64_t total = reference.prefix(size);
+		for (size_t q = 0; q < 1000; q++) {
+			const uint64_t val = next() % (total + 1);
+			const size_t result = reference.find(val);
+			ASSERT_EQ(result, all.find(val));
+			ASSERT_EQ(result, some.find(val));
+			ASSERT_EQ(result, none.find(val));
+		}
+
+		const Summary s = all.instrumentation().summary(all.PATH_LENGTH);
+		EXPECT_EQ(1000, s.samples);
+		EXPECT_LE(s.max, uint64_t(sux::lambda(size) + 1));
+		EXPECT_GE(s.sum, s.samples);
+		uint64_t histogram = 0;
+		for (const auto h : s.histogram) histogram += h;
+		EXPECT_EQ(s.samples, histogram);
+		EXPECT_EQ(250, some.instrumentation().summary(some.PATH_LENGTH).samples);
+
+		all.instrumentation().reset();
+		EXPECT_EQ(0, all.instrumentation().summary(all.PATH_LENGTH).samples);
+		delete[] increments;
+	}
+
+	// Instances queried alternately are sampled independently
+	uint64_t increments[] = {1, 2, 3, 4};
+	InstrumentedPrefixSums<FenwickFixedF<64>, Sampled<6, 1>> first(increments, 4), second(increments, 4);
+	for (size_t q = 0; q < 64 * 100; q++) {
+		first.find(uint64_t(5));
+		second.find(uint64_t(5));
+	}
+	for (const auto *ps : {&first, &second}) {
+		// Exactly 100, unless the instances share an entry of the table of counts
+		const uint64_t samples = ps->instrumentation().summary(ps->PATH_LENGTH).samples;
+		EXPECT_GE(samples, 50);
+		EXPECT_LE(samples, 150);
+	}
+}
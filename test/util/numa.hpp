@@ -0,0 +1,32 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <sux/util/Numa.hpp>
+#include <sux/util/Vector.hpp>
+
+TEST(numa, placement) {
+	using namespace sux::util;
+	const int nodes = numa::nodes();
+	ASSERT_LE(1, nodes);
+	ASSERT_LT(numa::node(), nodes);
+
+	{
+		// Placement may be forbidden (e.g., in containers), but it must never alter the content
+		NumaScope interleave;
+		Vector<uint64_t, SMALLPAGE> v(1 << 20);
+		for (size_t i = 0; i < v.size(); i++) v[i] = i;
+		v.place(numa::node());
+		v.place(-1);
+		for (size_t i = 0; i < v.size(); i++) ASSERT_EQ(i, v[i]);
+	}
+
+	NumaReplicas<Vector<uint64_t>> replicas([] {
+		auto v = std::make_unique<Vector<uint64_t>>(1000);
+		for (size_t i = 0; i < v->size(); i++) (*v)[i] = i * i;
+		return v;
+	});
+	ASSERT_EQ(size_t(nodes), replicas.size());
+	for (size_t n = 0; n < replicas.size(); n++)
+		for (size_t i = 0; i < 1000; i++) ASSERT_EQ(i * i, replicas[n][i]);
+	EXPECT_EQ(999 * 999, replicas.local()[999]);
+}
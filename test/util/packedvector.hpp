@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <sux/util/MonotoneVector.hpp>
+#include <sux/util/PackedVector.hpp>
+
+template <int WIDTH, sux::util::AllocType AT> void test_packed(const size_t n, const int width) {
+	using namespace sux::util;
+	const uint64_t mask = width == 64 ? UINT64_MAX : (UINT64_C(1) << width) - 1;
+	std::vector<uint64_t> values(n);
+	for (auto &v : values) v = next() & mask;
+
+	PackedVector<WIDTH, AT> pv(values, width);
+	ASSERT_EQ(n, pv.size());
+	ASSERT_EQ(width, pv.bitWidth());
+	for (size_t i = 0; i < n; i++) ASSERT_EQ(values[i], pv.get(i)) << "at index " << i;
+
+	std::vector<uint64_t> out(n + 1);
+	for (size_t from = 0; from <= n; from += 1 + n / 10)
+		for (size_t to : {from, std::min(n, from + 1), std::min(n, from + 7), n}) {
+			out[to - from] = 42;
+			pv.decode(from, to, out.data());
+			for (size_t i = from; i < to; i++) ASSERT_EQ(values[i], out[i - from]) << "from " << from << " to " << to << " at index " << i;
+			ASSERT_EQ(42, out[to - from]);
+		}
+
+	// Overwriting does not affect neighbours
+	PackedVector<WIDTH, AT> zeros(n, width);
+	for (size_t i = 0; i < n; i++) ASSERT_EQ(0, zeros.get(i));
+	for (size_t i = 0; i < n; i += 2) pv.set(i, ~values[i] & mask);
+	for (size_t i = 0; i < n; i++) ASSERT_EQ(i % 2 ? values[i] : ~values[i] & mask, pv.get(i)) << "at index " << i;
+
+	std::stringstream ss;
+	ss << pv;
+	const std::string serialized = ss.str();
+	PackedVector<WIDTH, AT> loaded, viewed;
+	ss >> loaded;
+	ASSERT_TRUE(ss);
+	std::vector<uint64_t> aligned(serialized.size() / sizeof(uint64_t));
+	memcpy(aligned.data(), serialized.data(), serialized.size());
+	ASSERT_NE(nullptr, viewed.view((const char *)aligned.data(), (const char *)aligned.data() + serialized.size(), true));
+	ASSERT_EQ(n, loaded.size());
+	ASSERT_EQ(n, viewed.size());
+	for (size_t i = 0; i < n; i++) {
+		ASSERT_EQ(pv.get(i), loaded.get(i)) << "at index " << i;
+		ASSERT_EQ(pv.get(i), viewed.get(i)) << "at index " << i;
+	}
+}
+
+TEST(packedvector, runtime_width) {
+	for (size_t n : {0, 1, 3, 64, 1000, 10000})
+		for (int width = 1; width <= 64; width++) test_packed<0, sux::util::AllocType::MALLOC>(n, width);
+	test_packed<0, sux::util::AllocType::SMALLPAGE>(10000, 13);
+
+	// The width is deduced from the values
+	EXPECT_EQ(1, sux::util::PackedVector<>(std::vector<uint64_t>{0, 0}).bitWidth());
+	EXPECT_EQ(10, sux::util::PackedVector<>(std::vector<uint64_t>{1, 1000, 3}).bitWidth());
+	EXPECT_EQ(64, sux::util::PackedVector<>(std::vector<uint64_t>{UINT64_MAX}).bitWidth());
+}
+
+TEST(packedvector, compile_time_width) {
+	for (size_t n : {0, 1, 1000}) {
+		test_packed<1, sux::util::AllocType::MALLOC>(n, 1);
+		test_packed<7, sux::util::AllocType::MALLOC>(n, 7);
+		test_packed<32, sux::util::AllocType::MALLOC>(n, 32);
+		test_packed<57, sux::util::AllocType::MALLOC>(n, 57);
+		test_packed<58, sux::util::AllocType::MALLOC>(n, 58);
+		test_packed<64, sux::util::AllocType::MALLOC>(n, 64);
+	}
+
+	// Serialized vectors with different compile-time widths are not compatible
+	std::stringstream ss;
+	ss << sux::util::PackedVector<0>(10, 7);
+	sux::util::PackedVector<7> pv;
+	ss >> pv;
+	EXPECT_FALSE(ss);
+}
+
+TEST(packedvector, monotone) {
+	using namespace sux::util;
+
+	for (size_t n : {0, 1, 2, 1000, 100000})
+		for (uint64_t gap : {UINT64_C(1), UINT64_C(3), UINT64_C(1000), UINT64_C(1) << 40}) {
+			std::vector<uint64_t> values(n);
+			for (size_t i = 0, v = next() % gap; i < n; i++, v += next() % gap) values[i] = v;
+
+			MonotoneVector<> mv(values);
+			ASSERT_EQ(n, mv.size());
+			for (size_t i = 0; i < n; i++) ASSERT_EQ(values[i], mv.get(i)) << "at index " << i;
+
+			std::vector<uint64_t> out(n + 1);
+			for (size_t from = 0; from <= n; from += 1 + n / 10)
+				for (size_t to : {from, std::min(n, from + 1), std::min(n, from + 100), n}) {
+					mv.decode(from, to, out.data());
+					for (size_t i = from; i < to; i++) ASSERT_EQ(values[i], out[i - from]) << "from " << from << " to " << to << " at index " << i;
+				}
+
+			std::vector<uint64_t> index(std::min(n, size_t(1000)));
+			for (auto &i : index) i = next() % n;
+			mv.get(index.data(), out.data(), index.size());
+			for (size_t i = 0; i < index.size(); i++) ASSERT_EQ(values[index[i]], out[i]);
+
+			std::stringstream ss;
+			ss << mv;
+			const std::string serialized = ss.str();
+			MonotoneVector<> loaded, viewed;
+			ss >> loaded;
+			ASSERT_TRUE(ss);
+			std::vector<uint64_t> aligned(serialized.size() / sizeof(uint64_t));
+			memcpy(aligned.data(), serialized.data(), serialized.size());
+			ASSERT_NE(nullptr, viewed.view((const char *)aligned.data(), (const char *)aligned.data() + serialized.size(), true));
+			ASSERT_EQ(n, loaded.size());
+			ASSERT_EQ(n, viewed.size());
+			for (size_t i = 0; i < n; i++) {
+				ASSERT_EQ(values[i], loaded.get(i)) << "at index " << i;
+				ASSERT_EQ(values[i], viewed.get(i)) << "at index " << i;
+			}
+
+			std::stringstream truncated(serialized.substr(0, serialized.size() - 8));
+			truncated >> loaded;
+			EXPECT_FALSE(truncated);
+		}
+}
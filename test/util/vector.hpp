@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <sux/util/Vector.hpp>
+
+TEST(vector, file_backed) {
+	using namespace sux::util;
+	const char *filename = "test/test_vector";
+	remove(filename);
+
+	{
+		Vector<uint64_t, MMAPFILE> v(filename);
+		EXPECT_TRUE(v.isFileBacked());
+		EXPECT_EQ(0, v.size());
+		for (uint64_t i = 0; i < 100000; i++) v.pushBack(i * i);
+		EXPECT_TRUE(v.sync());
+	}
+
+	{
+		Vector<uint64_t, MMAPFILE> v(filename);
+		ASSERT_EQ(100000, v.size());
+		for (uint64_t i = 0; i < v.size(); i++) ASSERT_EQ(i * i, v[i]) << "at index " << i;
+		for (uint64_t i = 0; i < 60000; i++) v.popBack();
+		v.trimToFit();
+		v.pushBack(42);
+	}
+
+	{
+		Vector<uint64_t, MMAPFILE> v(filename);
+		ASSERT_EQ(40001, v.size());
+		for (uint64_t i = 0; i < 40000; i++) ASSERT_EQ(i * i, v[i]) << "at index " << i;
+		EXPECT_EQ(42, v[40000]);
+
+		// Deserialization goes into the file
+		Vector<uint64_t> source(1000);
+		for (uint64_t i = 0; i < source.size(); i++) source[i] = i + 1;
+		std::stringstream ss;
+		ss << source;
+		ss >> v;
+		ASSERT_TRUE(ss);
+		EXPECT_TRUE(v.isFileBacked());
+	}
+
+	{
+		Vector<uint64_t, MMAPFILE> v(filename);
+		ASSERT_EQ(1000, v.size());
+		for (uint64_t i = 0; i < v.size(); i++) ASSERT_EQ(i + 1, v[i]) << "at index " << i;
+
+		// Moving transfers the file
+		Vector<uint64_t, MMAPFILE> moved(std::move(v));
+		EXPECT_FALSE(v.isFileBacked());
+		EXPECT_TRUE(moved.isFileBacked());
+	}
+
+	// Vectors built without a file are anonymous
+	Vector<uint64_t, MMAPFILE> anonymous(1000);
+	EXPECT_FALSE(anonymous.isFileBacked());
+	anonymous.resize(100000);
+	EXPECT_EQ(0, anonymous[99999]);
+
+	remove(filename);
+}
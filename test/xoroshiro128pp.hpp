@@ -12,7 +12,8 @@ See <http://creativecommons.org/publicdomain/zero/1.0/>. */
 
 static inline uint64_t rotl(const uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
 
-static uint64_t s[2] = {0x333e2c3815b27604, 0x47ed6e7691d8f09f};
+// Thread local, so that concurrent threads (e.g., in benchmarks) do not share the generator state
+static thread_local uint64_t s[2] = {0x333e2c3815b27604, 0x47ed6e7691d8f09f};
 
 static uint64_t next(void) {
 	const uint64_t s0 = s[0];